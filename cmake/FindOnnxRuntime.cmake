@@ -0,0 +1,17 @@
+# Copyright (C) 2023 The Qt Company Ltd.
+# SPDX-License-Identifier: BSD-3-Clause
+
+# We can't create the same interface imported target multiple times, CMake will complain if we do
+# that. This can happen if the find_package call is done in multiple different subdirectories.
+if(TARGET OnnxRuntime::OnnxRuntime)
+    set(OnnxRuntime_FOUND 1)
+    return()
+endif()
+
+find_package(PkgConfig QUIET)
+
+pkg_check_modules(OnnxRuntime "libonnxruntime" IMPORTED_TARGET GLOBAL)
+
+if (TARGET PkgConfig::OnnxRuntime)
+    add_library(OnnxRuntime::OnnxRuntime ALIAS PkgConfig::OnnxRuntime)
+endif()
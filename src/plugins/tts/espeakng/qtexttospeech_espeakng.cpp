@@ -0,0 +1,236 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include "qtexttospeech_espeakng.h"
+
+#include <QtCore/QCoreApplication>
+
+QT_BEGIN_NAMESPACE
+
+using namespace Qt::StringLiterals;
+
+QTextToSpeechEngineEspeakNG::QTextToSpeechEngineEspeakNG(const QVariantMap &parameters, QObject *parent)
+    : QTextToSpeechEngine(parent)
+{
+    QAudioDevice audioDevice;
+    if (const auto it = parameters.find("audioDevice"_L1); it != parameters.end())
+        audioDevice = (*it).value<QAudioDevice>();
+    else
+        audioDevice = QMediaDevices::defaultAudioOutput();
+
+    if (audioDevice.isNull()) {
+        m_errorReason = QTextToSpeech::ErrorReason::Playback;
+        m_errorString = QCoreApplication::translate("QTextToSpeech", "No audio device available");
+    }
+    m_processor.reset(new QTextToSpeechProcessorEspeakNG(audioDevice));
+
+    // Connect processor to engine for state changes and error
+    connect(m_processor.get(), &QTextToSpeechProcessorEspeakNG::stateChanged,
+            this, &QTextToSpeechEngineEspeakNG::changeState);
+    connect(m_processor.get(), &QTextToSpeechProcessorEspeakNG::errorOccurred, this,
+            &QTextToSpeechEngineEspeakNG::setError);
+    connect(m_processor.get(), &QTextToSpeechProcessorEspeakNG::sayingWord, this,
+            &QTextToSpeechEngine::sayingWord);
+    connect(m_processor.get(), &QTextToSpeechProcessorEspeakNG::synthesized, this,
+            &QTextToSpeechEngine::synthesized);
+
+    // Read voices from processor before moving it to a separate thread
+    const QList<QTextToSpeechProcessorEspeakNG::VoiceInfo> voices = m_processor->voices();
+
+    int voiceIndex = 0;
+    for (const QTextToSpeechProcessorEspeakNG::VoiceInfo &voiceInfo : voices) {
+        const QLocale locale(voiceInfo.locale);
+        const QVoice voice = QTextToSpeechEngine::createVoice(voiceInfo.name, locale,
+                                                              voiceInfo.gender, voiceInfo.age,
+                                                              QVariant(voiceInfo.name));
+        m_voices.insert(locale, voice);
+        // Use the first available locale/voice as a fallback
+        if (voiceIndex == 0)
+            m_voice = voice;
+        ++voiceIndex;
+    }
+
+    if (!m_processor->isInitialized()) {
+        m_errorReason = QTextToSpeech::ErrorReason::Initialization;
+        m_errorString = QCoreApplication::translate("QTextToSpeech", "Could not initialize espeak-ng");
+    } else if (voiceIndex) {
+        m_state = QTextToSpeech::Ready;
+        m_processor->moveToThread(&m_thread);
+        m_thread.start();
+    } else {
+        m_errorReason = QTextToSpeech::ErrorReason::Configuration;
+        m_errorString = QCoreApplication::translate("QTextToSpeech", "No voices available");
+    }
+}
+
+QTextToSpeechEngineEspeakNG::~QTextToSpeechEngineEspeakNG()
+{
+    // release a processor thread that is waiting for the consumer
+    m_processor->setThrottled(false);
+    m_processor->cancel();
+    m_thread.exit();
+    m_thread.wait();
+}
+
+QList<QLocale> QTextToSpeechEngineEspeakNG::availableLocales() const
+{
+    return m_voices.uniqueKeys();
+}
+
+QList<QVoice> QTextToSpeechEngineEspeakNG::availableVoices() const
+{
+    return m_voices.values(m_voice.locale());
+}
+
+void QTextToSpeechEngineEspeakNG::say(const QString &text)
+{
+    QMetaObject::invokeMethod(m_processor.get(), "say", Qt::QueuedConnection, Q_ARG(QString, text),
+                              Q_ARG(QString, voiceData(voice()).toString()), Q_ARG(double, pitch()),
+                              Q_ARG(double, rate()), Q_ARG(double, volume()));
+}
+
+void QTextToSpeechEngineEspeakNG::synthesize(const QString &text)
+{
+    QMetaObject::invokeMethod(m_processor.get(), "synthesize", Qt::QueuedConnection, Q_ARG(QString, text),
+                              Q_ARG(QString, voiceData(voice()).toString()), Q_ARG(double, pitch()),
+                              Q_ARG(double, rate()), Q_ARG(double, volume()));
+}
+
+void QTextToSpeechEngineEspeakNG::stop(QTextToSpeech::BoundaryHint boundaryHint)
+{
+    Q_UNUSED(boundaryHint);
+    // abort a running synthesis, the processor thread is blocked in espeak
+    m_processor->setThrottled(false);
+    m_processor->cancel();
+    QMetaObject::invokeMethod(m_processor.get(), &QTextToSpeechProcessorEspeakNG::stop, Qt::QueuedConnection);
+}
+
+void QTextToSpeechEngineEspeakNG::pause(QTextToSpeech::BoundaryHint boundaryHint)
+{
+    Q_UNUSED(boundaryHint);
+    QMetaObject::invokeMethod(m_processor.get(), &QTextToSpeechProcessorEspeakNG::pause, Qt::QueuedConnection);
+}
+
+void QTextToSpeechEngineEspeakNG::resume()
+{
+    QMetaObject::invokeMethod(m_processor.get(), &QTextToSpeechProcessorEspeakNG::resume, Qt::QueuedConnection);
+}
+
+void QTextToSpeechEngineEspeakNG::setSynthesisThrottled(bool throttled)
+{
+    // called directly, as the processor thread might be blocked
+    m_processor->setThrottled(throttled);
+}
+
+void QTextToSpeechEngineEspeakNG::setAudioFilterChain(QTextToSpeechAudioFilterChain *chain)
+{
+    // set before the processor receives the first utterance
+    m_processor->setAudioFilterChain(chain);
+}
+
+double QTextToSpeechEngineEspeakNG::rate() const
+{
+    return m_rate;
+}
+
+bool QTextToSpeechEngineEspeakNG::setRate(double rate)
+{
+    if (m_rate == rate)
+        return false;
+
+    m_rate = rate;
+    return true;
+}
+
+double QTextToSpeechEngineEspeakNG::pitch() const
+{
+    return m_pitch;
+}
+
+bool QTextToSpeechEngineEspeakNG::setPitch(double pitch)
+{
+    if (m_pitch == pitch)
+        return false;
+
+    m_pitch = pitch;
+    return true;
+}
+
+QLocale QTextToSpeechEngineEspeakNG::locale() const
+{
+    return m_voice.locale();
+}
+
+bool QTextToSpeechEngineEspeakNG::setLocale(const QLocale &locale)
+{
+    const auto &voices = m_voices.values(locale);
+    if (voices.isEmpty())
+        return false;
+    // The list returned by QMultiHash::values is reversed
+    setVoice(voices.last());
+    return true;
+}
+
+double QTextToSpeechEngineEspeakNG::volume() const
+{
+    return m_volume;
+}
+
+bool QTextToSpeechEngineEspeakNG::setVolume(double volume)
+{
+    if (m_volume == volume)
+        return false;
+
+    m_volume = volume;
+    return true;
+}
+
+QVoice QTextToSpeechEngineEspeakNG::voice() const
+{
+    return m_voice;
+}
+
+bool QTextToSpeechEngineEspeakNG::setVoice(const QVoice &voice)
+{
+    QLocale locale = m_voices.key(voice); // returns default locale if not found, so
+    if (!m_voices.contains(locale, voice)) {
+        qWarning() << "Voice" << voice << "is not supported by this engine";
+        return false;
+    }
+
+    m_voice = voice;
+    return true;
+}
+
+void QTextToSpeechEngineEspeakNG::changeState(QTextToSpeech::State newState)
+{
+    if (newState != m_state) {
+        m_state = newState;
+        emit stateChanged(newState);
+    }
+}
+
+QTextToSpeech::State QTextToSpeechEngineEspeakNG::state() const
+{
+    return m_state;
+}
+
+QTextToSpeech::ErrorReason QTextToSpeechEngineEspeakNG::errorReason() const
+{
+    return m_errorReason;
+}
+
+QString QTextToSpeechEngineEspeakNG::errorString() const
+{
+    return m_errorString;
+}
+
+void QTextToSpeechEngineEspeakNG::setError(QTextToSpeech::ErrorReason error, const QString &errorString)
+{
+    m_errorReason = error;
+    m_errorString = errorString;
+    changeState(QTextToSpeech::Error);
+    emit errorOccurred(error, errorString);
+}
+
+QT_END_NAMESPACE
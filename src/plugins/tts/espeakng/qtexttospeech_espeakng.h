@@ -0,0 +1,84 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHENGINE_ESPEAKNG_H
+#define QTEXTTOSPEECHENGINE_ESPEAKNG_H
+
+#include "qtexttospeech_espeakng_processor.h"
+#include "qtexttospeechengine.h"
+#include "qvoice.h"
+
+#include <QtTextToSpeech/private/qtexttospeechaudiofilterchain_p.h>
+
+#include <QtCore/QString>
+#include <QtCore/QList>
+#include <QtCore/QLocale>
+#include <QtCore/QMultiHash>
+
+QT_BEGIN_NAMESPACE
+
+class QTextToSpeechEngineEspeakNG : public QTextToSpeechEngine,
+                                    public QTextToSpeechAudioFilterChainClient
+{
+    Q_OBJECT
+    Q_INTERFACES(QTextToSpeechAudioFilterChainClient)
+
+public:
+    QTextToSpeechEngineEspeakNG(const QVariantMap &parameters, QObject *parent);
+    ~QTextToSpeechEngineEspeakNG() override;
+
+    // Plug-in API:
+    QList<QLocale> availableLocales() const override;
+    QList<QVoice> availableVoices() const override;
+    void say(const QString &text) override;
+    void synthesize(const QString &text) override;
+    void stop(QTextToSpeech::BoundaryHint boundaryHint) override;
+    void pause(QTextToSpeech::BoundaryHint boundaryHint) override;
+    void resume() override;
+    void setSynthesisThrottled(bool throttled) override;
+    double rate() const override;
+    bool setRate(double rate) override;
+    double pitch() const override;
+    bool setPitch(double pitch) override;
+    QLocale locale() const override;
+    bool setLocale(const QLocale &locale) override;
+    double volume() const override;
+    bool setVolume(double volume) override;
+    QVoice voice() const override;
+    bool setVoice(const QVoice &voice) override;
+    QTextToSpeech::State state() const override;
+    QTextToSpeech::ErrorReason errorReason() const override;
+    QString errorString() const override;
+
+    // QTextToSpeechAudioFilterChainClient
+    void setAudioFilterChain(QTextToSpeechAudioFilterChain *chain) override;
+
+Q_SIGNALS:
+    void speaking();
+    void engineErrorOccurred(QTextToSpeech::ErrorReason, const QString &errorString);
+
+private slots:
+    void changeState(QTextToSpeech::State newState);
+    void setError(QTextToSpeech::ErrorReason error, const QString &errorString);
+
+private:
+    QTextToSpeech::State m_state = QTextToSpeech::Error;
+    QTextToSpeech::ErrorReason m_errorReason = QTextToSpeech::ErrorReason::Initialization;
+    QString m_errorString;
+
+    QVoice m_voice;
+    double m_rate = 0;
+    double m_pitch = 0;
+    double m_volume = 1;
+
+    // Voices mapped by their locale name.
+    QMultiHash<QLocale, QVoice> m_voices;
+
+    // Thread for blocking operations
+    QThread m_thread;
+    std::unique_ptr<QTextToSpeechProcessorEspeakNG> m_processor;
+};
+
+QT_END_NAMESPACE
+
+#endif
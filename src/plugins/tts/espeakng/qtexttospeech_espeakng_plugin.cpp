@@ -0,0 +1,18 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include "qtexttospeech_espeakng_plugin.h"
+#include "qtexttospeech_espeakng.h"
+
+QT_BEGIN_NAMESPACE
+
+Q_LOGGING_CATEGORY(lcSpeechTtsEspeakNG, "qt.speech.tts.espeakng")
+
+QTextToSpeechEngine *QTextToSpeechEspeakNGPlugin::createTextToSpeechEngine(
+        const QVariantMap &parameters, QObject *parent, QString *errorString) const
+{
+    Q_UNUSED(errorString);
+    return new QTextToSpeechEngineEspeakNG(parameters, parent);
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,494 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include "qtexttospeech_espeakng_processor.h"
+#include "qtexttospeech_espeakng_plugin.h"
+
+#include <QtTextToSpeech/private/qtexttospeechsharedlibrary_p.h>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QLocale>
+#include <QtCore/QThread>
+
+QT_BEGIN_NAMESPACE
+
+namespace {
+// libespeak-ng keeps the voice, the parameters and the synth callback in
+// global variables, so processors have to take turns, also with the piper
+// engine, which converts text to phonemes with it.
+QTextToSpeechSharedLibrary *espeakLibrary()
+{
+    return QTextToSpeechSharedLibrary::instance("espeak-ng");
+}
+
+// espeak-ng speaks between 80 and 450 words per minute, with a default of 175
+int toWordsPerMinute(double rate)
+{
+    constexpr double normalRate = espeakRATE_NORMAL;
+    if (rate < 0)
+        return qRound(normalRate + rate * (normalRate - espeakRATE_MINIMUM));
+    return qRound(normalRate + rate * (espeakRATE_MAXIMUM - normalRate));
+}
+
+QVoice::Age toAge(unsigned char age)
+{
+    if (age == 0)
+        return QVoice::Other;
+    if (age < 13)
+        return QVoice::Child;
+    if (age < 20)
+        return QVoice::Teenager;
+    if (age < 60)
+        return QVoice::Adult;
+    return QVoice::Senior;
+}
+} // namespace
+
+QTextToSpeechProcessorEspeakNG::QTextToSpeechProcessorEspeakNG(const QAudioDevice &audioDevice)
+    : m_audioDevice(audioDevice)
+{
+    const int sampleRate = espeakLibrary()->ref([]{
+        return espeak_Initialize(AUDIO_OUTPUT_SYNCHRONOUS, 0, nullptr, espeakINITIALIZE_DONT_EXIT);
+    });
+    if (sampleRate <= 0) {
+        qCWarning(lcSpeechTtsEspeakNG) << "Could not initialize espeak-ng";
+        return;
+    }
+
+    m_format.setSampleFormat(QAudioFormat::Int16);
+    m_format.setSampleRate(sampleRate);
+    m_format.setChannelConfig(QAudioFormat::ChannelConfigMono);
+
+    QMutexLocker locker(espeakLibrary()->mutex());
+
+    for (const espeak_VOICE **it = espeak_ListVoices(nullptr); it && *it; ++it) {
+        const espeak_VOICE *voice = *it;
+        // MBROLA voices need additional voice data and an external program
+        if (!voice->name || !voice->languages
+            || qstrncmp(voice->identifier, "mb/", 3) == 0) {
+            continue;
+        }
+        // The languages are a list of a priority byte followed by a 0-terminated
+        // language name, like "en-us"; the first one is the main language.
+        QString language = QString::fromLatin1(voice->languages + 1);
+        if (const qsizetype separator = language.indexOf(u'-'); separator > 0)
+            language = language.first(separator) + u'_' + language.sliced(separator + 1).toUpper();
+        const QLocale locale(language);
+        if (locale.language() == QLocale::C)
+            continue;
+
+        QVoice::Gender gender = QVoice::Unknown;
+        if (voice->gender == 1)
+            gender = QVoice::Male;
+        else if (voice->gender == 2)
+            gender = QVoice::Female;
+
+        m_voices.append(VoiceInfo{
+            QString::fromUtf8(voice->name),
+            locale.name(),
+            gender,
+            toAge(voice->age)
+        });
+    }
+    qCDebug(lcSpeechTtsEspeakNG) << "Initialized with" << m_voices.size() << "voices at"
+                                 << sampleRate << "Hz";
+}
+
+QTextToSpeechProcessorEspeakNG::~QTextToSpeechProcessorEspeakNG()
+{
+    if (isInitialized())
+        espeakLibrary()->deref([]{ espeak_Terminate(); });
+}
+
+const QList<QTextToSpeechProcessorEspeakNG::VoiceInfo> &QTextToSpeechProcessorEspeakNG::voices() const
+{
+    return m_voices;
+}
+
+void QTextToSpeechProcessorEspeakNG::startTokenTimer()
+{
+    const TokenData &token = m_tokens.at(m_currentToken);
+    const qint64 playedTime = m_audioSink->processedUSecs() / 1000;
+    m_tokenTimer.start(qMax(token.startTime - playedTime, 0), Qt::PreciseTimer, this);
+}
+
+void QTextToSpeechProcessorEspeakNG::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() != m_tokenTimer.timerId()) {
+        QObject::timerEvent(event);
+        return;
+    }
+
+    const TokenData &token = m_tokens.at(m_currentToken);
+    emit sayingWord(m_text.sliced(token.begin, token.length), token.begin, token.length);
+    ++m_currentToken;
+    if (m_currentToken == m_tokens.size())
+        m_tokenTimer.stop();
+    else
+        startTokenTimer();
+}
+
+int QTextToSpeechProcessorEspeakNG::synthCallback(short *wav, int sampleCount,
+                                                  espeak_EVENT *events)
+{
+    auto *processor = static_cast<QTextToSpeechProcessorEspeakNG *>(events->user_data);
+    if (processor && processor->processAudio(wav, sampleCount, events))
+        return 0;
+    // abort the synthesis
+    return 1;
+}
+
+bool QTextToSpeechProcessorEspeakNG::processAudio(const short *wav, int sampleCount,
+                                                  const espeak_EVENT *events)
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+    if (m_cancelled.loadRelaxed())
+        return false;
+
+    if (m_output == Output::Speaker) {
+        const qsizetype tokenCount = m_tokens.size();
+        for (const espeak_EVENT *event = events; event->type != espeakEVENT_LIST_TERMINATED; ++event) {
+            if (event->type != espeakEVENT_WORD)
+                continue;
+            const qsizetype begin = toUtf16Position(event->text_position - 1);
+            const qsizetype end = toUtf16Position(event->text_position - 1 + event->length);
+            if (end > begin)
+                m_tokens.append(TokenData{event->audio_position, begin, end - begin});
+        }
+        if (m_tokens.size() > tokenCount && !m_tokenTimer.isActive())
+            startTokenTimer();
+    }
+
+    if (m_output == Output::Data)
+        return processData(wav, sampleCount, events);
+
+    // the last call only reports the end of the synthesis
+    if (!wav || sampleCount <= 0)
+        return true;
+
+    const char *data = reinterpret_cast<const char *>(wav);
+    qsizetype size = sampleCount * sizeof(short);
+
+    // the samples belong to espeak, so filter a copy in a reused buffer
+    if (m_audioFilters && !m_audioFilters->isEmpty()) {
+        m_filterBuffer.assign(QByteArrayView(data, size));
+        m_audioFilters->process(m_format, m_filterBuffer);
+        size = m_filterBuffer.size();
+        data = m_filterBuffer.constData();
+    }
+
+    if (size && !m_audioBuffer->write(data, size)) {
+        setError(QTextToSpeech::ErrorReason::Playback,
+                 QCoreApplication::translate("QTextToSpeech", "Audio streaming error."));
+        deinitAudio();
+        return false;
+    }
+    return true;
+}
+
+// The audio of each word is emitted once the next word starts. While the
+// consumer is throttled, the synthesis is interrupted, and the audio of the
+// current word is dropped; processText() continues with that word once the
+// consumer has caught up, so that the data doesn't pile up meanwhile.
+bool QTextToSpeechProcessorEspeakNG::processData(const short *wav, int sampleCount,
+                                                 const espeak_EVENT *events)
+{
+    const char *chunk = reinterpret_cast<const char *>(wav);
+    const qsizetype chunkSize = wav && sampleCount > 0 ? sampleCount * qsizetype(sizeof(short)) : 0;
+    const qint64 chunkStart = m_synthesizedSamples;
+    qsizetype consumed = 0;
+    for (const espeak_EVENT *event = events; event->type != espeakEVENT_LIST_TERMINATED; ++event) {
+        if (event->type != espeakEVENT_WORD)
+            continue;
+        // the audio position is in ms since the start of espeak_Synth()
+        const qint64 wordSample = qint64(event->audio_position) * m_format.sampleRate() / 1000;
+        const qsizetype offset = qBound(consumed,
+                                        qsizetype(wordSample - chunkStart) * qsizetype(sizeof(short)),
+                                        chunkSize);
+        m_wordAudio.append(chunk + consumed, offset - consumed);
+        consumed = offset;
+        if (!m_wordAudio.isEmpty())
+            emit synthesized(m_format, std::exchange(m_wordAudio, {}));
+        m_wordCharacter = event->text_position - 1;
+    }
+    m_wordAudio.append(chunk + consumed, chunkSize - consumed);
+    m_synthesizedSamples += sampleCount > 0 ? sampleCount : 0;
+
+    // the last call only reports the end of the synthesis
+    if (!chunkSize) {
+        if (!m_wordAudio.isEmpty())
+            emit synthesized(m_format, std::exchange(m_wordAudio, {}));
+        return true;
+    }
+    if (isThrottled()) {
+        m_interrupted = true;
+        m_wordAudio.clear();
+        return false;
+    }
+    return !m_cancelled.loadRelaxed();
+}
+
+// espeak reports text positions in characters; the words arrive in order, so
+// the conversion continues from the previous position.
+qsizetype QTextToSpeechProcessorEspeakNG::toUtf16Position(int characterPosition)
+{
+    if (characterPosition < m_characterPosition) {
+        m_characterPosition = 0;
+        m_utf16Position = 0;
+    }
+    while (m_characterPosition < characterPosition && m_utf16Position < m_text.size()) {
+        if (m_text.at(m_utf16Position).isHighSurrogate() && m_utf16Position + 1 < m_text.size()
+            && m_text.at(m_utf16Position + 1).isLowSurrogate()) {
+            ++m_utf16Position;
+        }
+        ++m_utf16Position;
+        ++m_characterPosition;
+    }
+    return m_utf16Position;
+}
+
+bool QTextToSpeechProcessorEspeakNG::isThrottled()
+{
+    QMutexLocker locker(&m_throttleMutex);
+    return m_throttled;
+}
+
+// Blocks the processor's thread until the consumer has caught up.
+void QTextToSpeechProcessorEspeakNG::waitWhileThrottled()
+{
+    QMutexLocker locker(&m_throttleMutex);
+    if (m_throttled)
+        qCDebug(lcSpeechTtsEspeakNG) << "Synthesis throttled by consumer";
+    while (m_throttled)
+        m_throttleCondition.wait(&m_throttleMutex);
+}
+
+void QTextToSpeechProcessorEspeakNG::setThrottled(bool throttled)
+{
+    QMutexLocker locker(&m_throttleMutex);
+    m_throttled = throttled;
+    if (!throttled)
+        m_throttleCondition.wakeAll();
+}
+
+bool QTextToSpeechProcessorEspeakNG::processText(const QString &text, const QString &voiceName,
+                                                 double pitch, double rate, double volume,
+                                                 Output output)
+{
+    qCDebug(lcSpeechTtsEspeakNG) << "processText() begin";
+    // held for the synthesis, as the callback and the voice are shared by
+    // all processors
+    QMutexLocker locker(espeakLibrary()->mutex());
+    const auto setup = [&]{
+        espeak_SetSynthCallback(synthCallback);
+        if (espeak_SetVoiceByName(voiceName.toUtf8().constData()) != EE_OK)
+            return false;
+        espeak_SetParameter(espeakRATE, toWordsPerMinute(rate), 0);
+        espeak_SetParameter(espeakPITCH, qRound(50 + pitch * 50), 0);
+        espeak_SetParameter(espeakVOLUME, qRound(volume * 100), 0);
+        return true;
+    };
+    if (!setup()) {
+        setError(QTextToSpeech::ErrorReason::Configuration,
+                 QCoreApplication::translate("QTextToSpeech", "Invalid voice %1.").arg(voiceName));
+        return false;
+    }
+
+    m_output = output;
+    m_text = text;
+    m_characterPosition = 0;
+    m_utf16Position = 0;
+
+    espeak_ERROR result = EE_OK;
+    forever {
+        m_interrupted = false;
+        m_synthesizedSamples = 0;
+        m_wordCharacter = 0;
+        m_wordAudio.clear();
+        const QByteArray utf8 = m_text.toUtf8();
+        result = espeak_Synth(utf8.constData(), utf8.size() + 1, 0, POS_CHARACTER, 0,
+                              espeakCHARS_UTF8, nullptr, this);
+        if (!m_interrupted || m_cancelled.loadRelaxed())
+            break;
+
+        // let the other processors use the library while the consumer
+        // catches up, and then continue with the interrupted word
+        m_text = m_text.sliced(toUtf16Position(m_wordCharacter));
+        m_characterPosition = 0;
+        m_utf16Position = 0;
+        locker.unlock();
+        waitWhileThrottled();
+        locker.relock();
+        if (m_cancelled.loadRelaxed())
+            break;
+        if (!setup()) {
+            setError(QTextToSpeech::ErrorReason::Configuration,
+                     QCoreApplication::translate("QTextToSpeech", "Invalid voice %1.")
+                        .arg(voiceName));
+            return false;
+        }
+    }
+    locker.unlock();
+
+    // cancelled, or the audio sink failed
+    if (m_cancelled.loadRelaxed() || (output == Output::Speaker && !m_audioBuffer))
+        return false;
+    if (result != EE_OK) {
+        setError(QTextToSpeech::ErrorReason::Input,
+                 QCoreApplication::translate("QTextToSpeech", "Speech synthesizing failure."));
+        return false;
+    }
+
+    qCDebug(lcSpeechTtsEspeakNG) << "processText() end";
+    return true;
+}
+
+bool QTextToSpeechProcessorEspeakNG::initAudio()
+{
+    if (m_audioDevice.isNull()) {
+        setError(QTextToSpeech::ErrorReason::Playback,
+                 QCoreApplication::translate("QTextToSpeech", "No audio device specified."));
+        return false;
+    }
+    if (!m_audioDevice.isFormatSupported(m_format)) {
+        QString formatString;
+        QDebug(&formatString) << m_format;
+        setError(QTextToSpeech::ErrorReason::Playback,
+                 QCoreApplication::translate("QTextToSpeech", "Audio device does not support format: %1")
+                    .arg(formatString));
+        return false;
+    }
+
+    if (!m_audioSink) {
+        m_audioSink = new QAudioSink(m_audioDevice, m_format, this);
+        connect(m_audioSink, &QAudioSink::stateChanged,
+                this, &QTextToSpeechProcessorEspeakNG::changeState);
+        connect(QThread::currentThread(), &QThread::finished, m_audioSink, &QObject::deleteLater);
+    }
+    m_audioBuffer = m_audioSink->start();
+    if (!m_audioBuffer) {
+        deinitAudio();
+        setError(QTextToSpeech::ErrorReason::Playback,
+                 QCoreApplication::translate("QTextToSpeech", "Audio Open error: No I/O device available."));
+        return false;
+    }
+    return true;
+}
+
+void QTextToSpeechProcessorEspeakNG::deinitAudio()
+{
+    m_tokenTimer.stop();
+    m_tokens.clear();
+    m_currentToken = -1;
+    if (m_audioSink) {
+        m_audioSink->disconnect(this);
+        delete m_audioSink;
+        m_audioSink = nullptr;
+        m_audioBuffer = nullptr;
+    }
+}
+
+void QTextToSpeechProcessorEspeakNG::changeState(QAudio::State newState)
+{
+    if (m_state == newState)
+        return;
+
+    qCDebug(lcSpeechTtsEspeakNG) << "Audio sink state transition" << m_state << newState;
+
+    switch (newState) {
+    case QAudio::ActiveState:
+        if (!m_tokenTimer.isActive() && m_currentToken >= 0 && m_currentToken < m_tokens.size())
+            startTokenTimer();
+        break;
+    case QAudio::IdleState:
+    case QAudio::SuspendedState:
+    case QAudio::StoppedState:
+        m_tokenTimer.stop();
+        break;
+    }
+
+    m_state = newState;
+    switch (newState) {
+    case QAudio::ActiveState:
+        emit stateChanged(QTextToSpeech::Speaking);
+        break;
+    case QAudio::SuspendedState:
+        emit stateChanged(QTextToSpeech::Paused);
+        break;
+    case QAudio::IdleState:
+    case QAudio::StoppedState:
+        emit stateChanged(QTextToSpeech::Ready);
+        break;
+    }
+}
+
+void QTextToSpeechProcessorEspeakNG::setError(QTextToSpeech::ErrorReason err, const QString &errorString)
+{
+    qCDebug(lcSpeechTtsEspeakNG) << "Error" << err << errorString;
+    emit stateChanged(QTextToSpeech::Error);
+    emit errorOccurred(err, errorString);
+}
+
+void QTextToSpeechProcessorEspeakNG::say(const QString &text, const QString &voiceName,
+                                         double pitch, double rate, double volume)
+{
+    if (text.isEmpty())
+        return;
+
+    m_tokenTimer.stop();
+    m_tokens.clear();
+    m_currentToken = 0;
+    if (!initAudio())
+        return;
+    if (m_audioFilters)
+        m_audioFilters->reset();
+
+    if (!processText(text, voiceName, pitch, rate, volume, Output::Speaker)) {
+        const bool cancelled = m_cancelled.loadRelaxed();
+        deinitAudio();
+        if (cancelled)
+            changeState(QAudio::StoppedState);
+        return;
+    }
+    // the sink becomes idle once the written data has been played
+    m_audioBuffer->close();
+}
+
+void QTextToSpeechProcessorEspeakNG::synthesize(const QString &text, const QString &voiceName,
+                                                double pitch, double rate, double volume)
+{
+    if (text.isEmpty())
+        return;
+
+    emit stateChanged(QTextToSpeech::Synthesizing);
+    if (processText(text, voiceName, pitch, rate, volume, Output::Data) || m_cancelled.loadRelaxed())
+        emit stateChanged(QTextToSpeech::Ready);
+}
+
+// Stop current and cancel subsequent utterances
+void QTextToSpeechProcessorEspeakNG::stop()
+{
+    // a text that was queued before the call to cancel() is skipped
+    m_cancelled.storeRelaxed(false);
+    if (m_state == QAudio::ActiveState || m_state == QAudio::SuspendedState) {
+        deinitAudio();
+        changeState(QAudio::StoppedState);
+    }
+}
+
+void QTextToSpeechProcessorEspeakNG::pause()
+{
+    if (m_audioSink && m_state == QAudio::ActiveState)
+        m_audioSink->suspend();
+}
+
+void QTextToSpeechProcessorEspeakNG::resume()
+{
+    if (m_audioSink && m_state == QAudio::SuspendedState) {
+        m_audioSink->resume();
+        // QAudioSink in push mode transitions to Idle when resumed
+        changeState(QAudio::ActiveState);
+    }
+}
+
+QT_END_NAMESPACE
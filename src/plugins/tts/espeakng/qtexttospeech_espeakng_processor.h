@@ -0,0 +1,137 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHPROCESSOR_ESPEAKNG_H
+#define QTEXTTOSPEECHPROCESSOR_ESPEAKNG_H
+
+#include "qtexttospeechengine.h"
+#include "qvoice.h"
+
+#include <QtTextToSpeech/private/qtexttospeechaudiofilterchain_p.h>
+
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QBasicTimer>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QTimerEvent>
+#include <QtCore/QWaitCondition>
+#include <QtMultimedia/QAudioSink>
+#include <QtMultimedia/QMediaDevices>
+
+#include <espeak-ng/speak_lib.h>
+
+QT_BEGIN_NAMESPACE
+
+// Runs libespeak-ng in synchronous mode in the thread the processor lives in.
+// The library has global state, so all processors share one instance of it,
+// and synthesize one text at a time.
+class QTextToSpeechProcessorEspeakNG : public QObject
+{
+    Q_OBJECT
+
+public:
+    QTextToSpeechProcessorEspeakNG(const QAudioDevice &audioDevice);
+    ~QTextToSpeechProcessorEspeakNG();
+
+    struct VoiceInfo
+    {
+        QString name;
+        QString locale;
+        QVoice::Gender gender;
+        QVoice::Age age;
+    };
+
+    Q_INVOKABLE void say(const QString &text, const QString &voiceName, double pitch,
+                         double rate, double volume);
+    Q_INVOKABLE void synthesize(const QString &text, const QString &voiceName, double pitch,
+                                double rate, double volume);
+    Q_INVOKABLE void pause();
+    Q_INVOKABLE void resume();
+    Q_INVOKABLE void stop();
+
+    // thread-safe
+    void setThrottled(bool throttled);
+    void cancel() { m_cancelled.storeRelaxed(true); }
+    // to be called before the first utterance
+    void setAudioFilterChain(QTextToSpeechAudioFilterChain *chain) { m_audioFilters = chain; }
+
+    bool isInitialized() const { return m_format.isValid(); }
+    const QList<VoiceInfo> &voices() const;
+
+Q_SIGNALS:
+    void errorOccurred(QTextToSpeech::ErrorReason error, const QString &errorString);
+    void stateChanged(QTextToSpeech::State);
+    void sayingWord(const QString &word, qsizetype begin, qsizetype length);
+    void synthesized(const QAudioFormat &format, const QByteArray &array);
+
+protected:
+    void timerEvent(QTimerEvent *event) override;
+
+private slots:
+    void changeState(QAudio::State newState);
+
+private:
+    enum class Output {
+        Speaker,
+        Data
+    };
+
+    static int synthCallback(short *wav, int sampleCount, espeak_EVENT *events);
+    bool processAudio(const short *wav, int sampleCount, const espeak_EVENT *events);
+    bool processData(const short *wav, int sampleCount, const espeak_EVENT *events);
+    bool processText(const QString &text, const QString &voiceName, double pitch, double rate,
+                     double volume, Output output);
+    qsizetype toUtf16Position(int characterPosition);
+    bool isThrottled();
+    void waitWhileThrottled();
+
+    bool initAudio();
+    void deinitAudio();
+    void startTokenTimer();
+    void setError(QTextToSpeech::ErrorReason err, const QString &errorString);
+
+    QAudioDevice m_audioDevice;
+    QAudioFormat m_format;
+    QAudioSink *m_audioSink = nullptr;
+    QIODevice *m_audioBuffer = nullptr;
+    QAudio::State m_state = QAudio::IdleState;
+    Output m_output = Output::Speaker;
+    QAtomicInteger<bool> m_cancelled = false;
+
+    QTextToSpeechAudioFilterChain *m_audioFilters = nullptr;
+    QByteArray m_filterBuffer;
+
+    // Synthesis to data: the audio of the current word, and where that word
+    // starts in the text, to continue with it after an interruption
+    QByteArray m_wordAudio;
+    int m_wordCharacter = 0;
+    qint64 m_synthesizedSamples = 0;
+    bool m_interrupted = false;
+
+    // Word boundaries of the current text, start time in ms of audio
+    struct TokenData
+    {
+        qint64 startTime;
+        qsizetype begin;
+        qsizetype length;
+    };
+    QString m_text;
+    QList<TokenData> m_tokens;
+    qsizetype m_currentToken = -1;
+    QBasicTimer m_tokenTimer;
+    // espeak reports positions in characters, these map them to UTF-16 positions
+    int m_characterPosition = 0;
+    qsizetype m_utf16Position = 0;
+
+    QList<VoiceInfo> m_voices;
+
+    // Back-pressure from the consumer of synthesized data
+    QMutex m_throttleMutex;
+    QWaitCondition m_throttleCondition;
+    bool m_throttled = false;
+};
+
+QT_END_NAMESPACE
+
+#endif
@@ -12,8 +12,6 @@ using namespace Qt::StringLiterals;
 QTextToSpeechEngineFlite::QTextToSpeechEngineFlite(const QVariantMap &parameters, QObject *parent)
     : QTextToSpeechEngine(parent)
 {
-    Q_UNUSED(parameters);
-
     QAudioDevice audioDevice;
     if (const auto it = parameters.find("audioDevice"_L1); it != parameters.end())
         audioDevice = (*it).value<QAudioDevice>();
@@ -25,6 +23,12 @@ QTextToSpeechEngineFlite::QTextToSpeechEngineFlite(const QVariantMap &parameters
         m_errorString = QCoreApplication::translate("QTextToSpeech", "No audio device available");
     }
     m_processor.reset(new QTextToSpeechProcessorFlite(audioDevice));
+    m_processor->setSilenceTrimming(parameters.value("trimSilence"_L1, false).toBool(),
+                                    parameters.value("maximumPause"_L1, 200).toInt());
+    m_processor->setGapless(parameters.value("gapless"_L1, false).toBool(),
+                            parameters.value("gapDuration"_L1, 0).toInt());
+    m_processor->setTimeStretching(parameters.value("timeStretch"_L1, false).toBool());
+    m_processor->setPlaybackRate(m_rate);
 
     // Connect processor to engine for state changes and error
     connect(m_processor.get(), &QTextToSpeechProcessorFlite::stateChanged,
@@ -33,6 +37,14 @@ QTextToSpeechEngineFlite::QTextToSpeechEngineFlite(const QVariantMap &parameters
             &QTextToSpeechEngineFlite::setError);
     connect(m_processor.get(), &QTextToSpeechProcessorFlite::sayingWord, this,
             &QTextToSpeechEngine::sayingWord);
+    connect(m_processor.get(), &QTextToSpeechProcessorFlite::wordTimeline, this,
+            &QTextToSpeechEngine::wordTimeline);
+    connect(m_processor.get(), &QTextToSpeechProcessorFlite::phonemeEvents, this,
+            &QTextToSpeechEngine::phonemeEvents);
+    connect(m_processor.get(), &QTextToSpeechProcessorFlite::readyForNextUtterance, this,
+            &QTextToSpeechEngine::readyForNextUtterance);
+    connect(m_processor.get(), &QTextToSpeechProcessorFlite::utteranceStarted, this,
+            &QTextToSpeechEngine::utteranceStarted);
     connect(m_processor.get(), &QTextToSpeechProcessorFlite::synthesized, this,
             &QTextToSpeechEngine::synthesized);
 
@@ -64,6 +76,8 @@ QTextToSpeechEngineFlite::QTextToSpeechEngineFlite(const QVariantMap &parameters
 
 QTextToSpeechEngineFlite::~QTextToSpeechEngineFlite()
 {
+    // release a processor thread that is waiting for the consumer
+    m_processor->setThrottled(false);
     m_thread.exit();
     m_thread.wait();
 }
@@ -85,6 +99,13 @@ void QTextToSpeechEngineFlite::say(const QString &text)
                               Q_ARG(double, rate()), Q_ARG(double, volume()));
 }
 
+void QTextToSpeechEngineFlite::appendUtterance(const QString &text)
+{
+    QMetaObject::invokeMethod(m_processor.get(), "sayNext", Qt::QueuedConnection, Q_ARG(QString, text),
+                              Q_ARG(int, voiceData(voice()).toInt()), Q_ARG(double, pitch()),
+                              Q_ARG(double, rate()), Q_ARG(double, volume()));
+}
+
 void QTextToSpeechEngineFlite::synthesize(const QString &text)
 {
     QMetaObject::invokeMethod(m_processor.get(), "synthesize", Qt::QueuedConnection, Q_ARG(QString, text),
@@ -95,6 +116,7 @@ void QTextToSpeechEngineFlite::synthesize(const QString &text)
 void QTextToSpeechEngineFlite::stop(QTextToSpeech::BoundaryHint boundaryHint)
 {
     Q_UNUSED(boundaryHint);
+    m_processor->setThrottled(false);
     QMetaObject::invokeMethod(m_processor.get(), &QTextToSpeechProcessorFlite::stop, Qt::QueuedConnection);
 }
 
@@ -109,6 +131,41 @@ void QTextToSpeechEngineFlite::resume()
     QMetaObject::invokeMethod(m_processor.get(), &QTextToSpeechProcessorFlite::resume, Qt::QueuedConnection);
 }
 
+void QTextToSpeechEngineFlite::setSynthesisThrottled(bool throttled)
+{
+    // called directly, as the processor thread might be blocked
+    m_processor->setThrottled(throttled);
+}
+
+void QTextToSpeechEngineFlite::setAudioFilterChain(QTextToSpeechAudioFilterChain *chain)
+{
+    // set before the processor receives the first utterance
+    m_processor->setAudioFilterChain(chain);
+}
+
+void QTextToSpeechEngineFlite::setAudioMixerSource(QTextToSpeechAudioMixerSource *source)
+{
+    QTextToSpeechProcessorFlite *processor = m_processor.get();
+    QMetaObject::invokeMethod(processor, [processor, source]{
+        processor->setAudioMixerSource(source);
+    }, Qt::QueuedConnection);
+}
+
+void QTextToSpeechEngineFlite::setSayingWordEnabled(bool enabled)
+{
+    m_processor->setSayingWordEnabled(enabled);
+}
+
+void QTextToSpeechEngineFlite::setWordTimelineEnabled(bool enabled)
+{
+    m_processor->setWordTimelineEnabled(enabled);
+}
+
+void QTextToSpeechEngineFlite::setPhonemeEventsEnabled(bool enabled)
+{
+    m_processor->setPhonemeEventsEnabled(enabled);
+}
+
 double QTextToSpeechEngineFlite::rate() const
 {
     return m_rate;
@@ -120,6 +177,8 @@ bool QTextToSpeechEngineFlite::setRate(double rate)
         return false;
 
     m_rate = rate;
+    // only has an effect while speaking with time-stretching
+    m_processor->setPlaybackRate(rate);
     return true;
 }
 
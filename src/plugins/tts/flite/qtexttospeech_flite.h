@@ -8,6 +8,9 @@
 #include "qtexttospeechengine.h"
 #include "qvoice.h"
 
+#include <QtTextToSpeech/private/qtexttospeechaudiofilterchain_p.h>
+#include <QtTextToSpeech/private/qtexttospeechaudiomixer_p.h>
+
 #include <QtCore/QString>
 #include <QtCore/QList>
 #include <QtCore/QLocale>
@@ -15,9 +18,12 @@
 
 QT_BEGIN_NAMESPACE
 
-class QTextToSpeechEngineFlite : public QTextToSpeechEngine
+class QTextToSpeechEngineFlite : public QTextToSpeechEngine,
+                                 public QTextToSpeechAudioFilterChainClient,
+                                 public QTextToSpeechAudioMixerClient
 {
     Q_OBJECT
+    Q_INTERFACES(QTextToSpeechAudioFilterChainClient QTextToSpeechAudioMixerClient)
 
 public:
     QTextToSpeechEngineFlite(const QVariantMap &parameters, QObject *parent);
@@ -27,10 +33,15 @@ public:
     QList<QLocale> availableLocales() const override;
     QList<QVoice> availableVoices() const override;
     void say(const QString &text) override;
+    void appendUtterance(const QString &text) override;
     void synthesize(const QString &text) override;
     void stop(QTextToSpeech::BoundaryHint boundaryHint) override;
     void pause(QTextToSpeech::BoundaryHint boundaryHint) override;
     void resume() override;
+    void setSynthesisThrottled(bool throttled) override;
+    void setSayingWordEnabled(bool enabled) override;
+    void setWordTimelineEnabled(bool enabled) override;
+    void setPhonemeEventsEnabled(bool enabled) override;
     double rate() const override;
     bool setRate(double rate) override;
     double pitch() const override;
@@ -45,6 +56,12 @@ public:
     QTextToSpeech::ErrorReason errorReason() const override;
     QString errorString() const override;
 
+    // QTextToSpeechAudioFilterChainClient
+    void setAudioFilterChain(QTextToSpeechAudioFilterChain *chain) override;
+
+    // QTextToSpeechAudioMixerClient
+    void setAudioMixerSource(QTextToSpeechAudioMixerSource *source) override;
+
 Q_SIGNALS:
     void speaking();
     void engineErrorOccurred(QTextToSpeech::ErrorReason, const QString &errorString);
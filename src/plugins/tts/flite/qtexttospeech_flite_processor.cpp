@@ -3,6 +3,10 @@
 
 #include "qtexttospeech_flite_processor.h"
 #include "qtexttospeech_flite_plugin.h"
+#include "qtexttospeech_flite_tracepoints_p.h"
+
+#include <QtTextToSpeech/private/qtexttospeechaudiokernels_p.h>
+#include <QtTextToSpeech/private/qtexttospeechtimeline_p.h>
 
 #include <QtCore/QCoreApplication>
 #include <QtCore/QString>
@@ -14,6 +18,7 @@
 QT_BEGIN_NAMESPACE
 
 using namespace Qt::StringLiterals;
+using Phase = QTextToSpeechTimeline::Phase;
 
 QTextToSpeechProcessorFlite::QTextToSpeechProcessorFlite(const QAudioDevice &audioDevice)
     : m_audioDevice(audioDevice)
@@ -34,11 +39,33 @@ const QList<QTextToSpeechProcessorFlite::VoiceInfo> &QTextToSpeechProcessorFlite
 
 void QTextToSpeechProcessorFlite::startTokenTimer()
 {
+    // Without receivers for each word, only the beginnings of appended
+    // texts need to be timed.
+    if (!m_sayingWordEnabled.loadRelaxed()) {
+        while (m_currentToken < m_tokens.size() && !m_tokens.at(m_currentToken).text.isEmpty())
+            ++m_currentToken;
+        if (m_currentToken == m_tokens.size()) {
+            m_tokenTimer.stop();
+            return;
+        }
+    }
     qCDebug(lcSpeechTtsFlite) << "Starting token timer with" << m_tokens.count() - m_currentToken << "left";
 
     const TokenData &token = m_tokens.at(m_currentToken);
-    const qint64 playedTime = m_audioSink->processedUSecs() / 1000;
-    m_tokenTimer.start(qMax(token.startTime - playedTime, 0), Qt::PreciseTimer, this);
+    const qint64 playedTime = processedUSecs() / 1000;
+    m_tokenTimer.start(qMax(playbackTime(token) - playedTime, 0), Qt::PreciseTimer, this);
+}
+
+/*
+    Returns when the \a token is played, in milliseconds since the sink was
+    started. Stretched audio that hasn't been written to the sink yet is
+    assumed to keep the current tempo.
+*/
+qint64 QTextToSpeechProcessorFlite::playbackTime(const TokenData &token) const
+{
+    if (!pacedOutput())
+        return token.startTime;
+    return samplesToMs(m_timeStretch.outputPosition(token.sample));
 }
 
 int QTextToSpeechProcessorFlite::audioOutputCb(const cst_wave *w, int start, int size,
@@ -46,37 +73,152 @@ int QTextToSpeechProcessorFlite::audioOutputCb(const cst_wave *w, int start, int
 {
     QTextToSpeechProcessorFlite *processor = static_cast<QTextToSpeechProcessorFlite *>(asi->userdata);
     if (processor) {
-        if (asi->item == NULL)
-            asi->item = relation_head(utt_relation(asi->utt,"Token"));
-
-        const float startTime = flite_ffeature_float(asi->item, "R:Token.daughter1.R:SylStructure.daughter1.daughter1.R:Segment.p.end");
-        const int startSample = int(startTime * float(w->sample_rate));
-        if ((startSample >= start) && (startSample < start + size)) {
-            const char *ws = flite_ffeature_string(asi->item, "whitespace");
-            const char *prepunc = flite_ffeature_string(asi->item, "prepunctuation");
-            if (cst_streq("0",prepunc))
-                prepunc = "";
-            const char *token = flite_ffeature_string(asi->item, "name");
-            const char *postpunc = flite_ffeature_string(asi->item, "punc");
-            if (cst_streq("0",postpunc))
-                postpunc = "";
-            if (token) {
-                qCDebug(lcSpeechTtsFlite).nospace() << "Processing token start_time: " << startTime
-                                                    << " content: \"" << ws << prepunc << "'" << token << "'" << postpunc << "\"";
-                processor->m_tokens.append(TokenData{
-                    qRound(startTime * 1000),
-                    QString::fromUtf8(token)
-                });
-                if (!processor->m_tokenTimer.isActive())
-                    processor->startTokenTimer();
-            }
-            asi->item = item_next(asi->item);
+        const qsizetype tokenCount = processor->m_tokens.size();
+        processor->addToken(w, start, size, asi);
+        if (processor->m_collectingPhonemes)
+            processor->addPhonemes(w, start, size, asi);
+        const int result = processor->audioOutput(w, start, size, last, asi);
+        // start the timer only after silence trimming has moved the new token
+        if (result == CST_AUDIO_STREAM_CONT && processor->m_tokens.size() > tokenCount
+            && !processor->m_tokenTimer.isActive()) {
+            processor->startTokenTimer();
         }
-        return processor->audioOutput(w, start, size, last, asi);
+        return result;
     }
     return CST_AUDIO_STREAM_STOP;
 }
 
+/*
+    Adds the token that starts in the chunk of \a size samples at \a start,
+    if any, to m_tokens.
+*/
+void QTextToSpeechProcessorFlite::addToken(const cst_wave *w, int start, int size,
+                                           cst_audio_streaming_info *asi)
+{
+    if (asi->item == NULL)
+        asi->item = relation_head(utt_relation(asi->utt,"Token"));
+
+    const float startTime = flite_ffeature_float(asi->item, "R:Token.daughter1.R:SylStructure.daughter1.daughter1.R:Segment.p.end");
+    const int startSample = int(startTime * float(w->sample_rate));
+    if ((startSample < start) || (startSample >= start + size))
+        return;
+
+    const char *ws = flite_ffeature_string(asi->item, "whitespace");
+    const char *prepunc = flite_ffeature_string(asi->item, "prepunctuation");
+    if (cst_streq("0",prepunc))
+        prepunc = "";
+    const char *token = flite_ffeature_string(asi->item, "name");
+    const char *postpunc = flite_ffeature_string(asi->item, "punc");
+    if (cst_streq("0",postpunc))
+        postpunc = "";
+    if (token) {
+        qCDebug(lcSpeechTtsFlite).nospace() << "Processing token start_time: " << startTime
+                                            << " content: \"" << ws << prepunc << "'" << token << "'" << postpunc << "\"";
+        const QString text = QString::fromUtf8(token);
+        m_index = m_text.indexOf(text, m_index);
+        // with silence trimming, the token is moved into the stream later
+        qint64 tokenTime = qRound(startTime * 1000);
+        qint64 tokenSample = qint64(startSample) * w->num_channels;
+        if (!m_trimSilence) {
+            tokenTime += samplesToMs(m_utteranceStart);
+            tokenSample += m_utteranceStart;
+        }
+        m_tokens.append(TokenData{
+            tokenTime,
+            text,
+            m_index,
+            tokenSample
+        });
+        m_index += text.length();
+    }
+    asi->item = item_next(asi->item);
+}
+
+QList<QTextToSpeech::WordBoundary>
+QTextToSpeechProcessorFlite::wordBoundaries(qsizetype firstToken, int channelCount) const
+{
+    const qint64 textStart = samplesToMs(m_utteranceStart);
+    QList<QTextToSpeech::WordBoundary> words;
+    words.reserve(m_tokens.size() - firstToken);
+    for (qsizetype i = firstToken; i < m_tokens.size(); ++i) {
+        const TokenData &token = m_tokens.at(i);
+        if (!token.text.isEmpty()) {
+            words.append({token.begin, token.text.size(), token.startTime - textStart,
+                          (token.sample - m_utteranceStart) / qMax(1, channelCount)});
+        }
+    }
+    return words;
+}
+
+/*
+    Adds the phonemes of the Segment relation that start in the chunk of
+    \a size samples at \a start to m_phonemes.
+*/
+void QTextToSpeechProcessorFlite::addPhonemes(const cst_wave *w, int start, int size,
+                                              cst_audio_streaming_info *asi)
+{
+    if (start == 0) {
+        m_segment = relation_head(utt_relation(asi->utt, "Segment"));
+        const cst_phoneset *phoneset = m_segment ? item_phoneset(m_segment) : nullptr;
+        // the names are converted once per phone set, and then shared
+        if (phoneset != m_phoneset) {
+            m_phoneset = phoneset;
+            m_phoneNames.clear();
+            for (int i = 0; phoneset && i < phoneset->num_phones; ++i)
+                m_phoneNames << QString::fromLatin1(phoneset->phonenames[i]);
+        }
+    }
+    if (!m_phoneset)
+        return;
+
+    // with silence trimming, the phonemes are moved into the stream later
+    const qint64 offset = m_trimSilence ? 0 : m_utteranceStart;
+    for (; m_segment; m_segment = item_next(m_segment)) {
+        const qint64 startSample = qint64(flite_ffeature_float(m_segment, "p.end") * float(w->sample_rate));
+        if (startSample >= start + size)
+            break;
+        const qint64 endSample = qint64(flite_ffeature_float(m_segment, "end") * float(w->sample_rate));
+        const char *name = item_name(m_segment);
+        const int id = phone_id(m_phoneset, name);
+        m_phonemes.append(PhonemeData{
+            id >= 0 && id < m_phoneNames.size() ? m_phoneNames.at(id) : QString::fromLatin1(name),
+            startSample * w->num_channels + offset,
+            qMax(startSample, endSample) * w->num_channels + offset
+        });
+    }
+}
+
+/*
+    Reports the phonemes that end in the audio that has been \a written, or
+    all of them after the last chunk, with their positions in the audio of
+    the text.
+*/
+void QTextToSpeechProcessorFlite::emitPhonemes(qint64 written, bool last, int channelCount)
+{
+    qsizetype count = last ? m_phonemes.size() : m_mappedPhonemeEnds;
+    if (!m_trimSilence && !last) {
+        while (count < m_phonemes.size() && m_phonemes.at(count).end <= written)
+            ++count;
+    }
+    if (!count)
+        return;
+
+    const int channels = qMax(1, channelCount);
+    QList<QTextToSpeech::Phoneme> phonemes;
+    phonemes.reserve(count);
+    for (qsizetype i = 0; i < count; ++i) {
+        const PhonemeData &phoneme = m_phonemes.at(i);
+        const qint64 start = qMin(phoneme.start, written);
+        const qint64 end = qMin(phoneme.end, written);
+        phonemes.append({phoneme.name, (start - m_utteranceStart) / channels,
+                         (end - start) / channels});
+    }
+    m_phonemes.remove(0, count);
+    m_mappedPhonemeStarts = qMax(m_mappedPhonemeStarts - count, qsizetype(0));
+    m_mappedPhonemeEnds = qMax(m_mappedPhonemeEnds - count, qsizetype(0));
+    emit phonemeEvents(phonemes);
+}
+
 int QTextToSpeechProcessorFlite::audioOutput(const cst_wave *w, int start, int size,
                                              int last, cst_audio_streaming_info *asi)
 {
@@ -84,35 +226,152 @@ int QTextToSpeechProcessorFlite::audioOutput(const cst_wave *w, int start, int s
     Q_ASSERT(QThread::currentThread() == thread());
     if (size == 0)
         return CST_AUDIO_STREAM_CONT;
-    if (start == 0 && !initAudio(w->sample_rate, w->num_channels))
-        return CST_AUDIO_STREAM_STOP;
+    if (start == 0) {
+        if (m_appending) {
+            // continue the playing stream after the configured gap
+            setOutputVolume(m_volume);
+            const qint64 gap = m_utteranceStart - m_streamSamples;
+            if (gap > 0 && !writeToSink(QByteArray(gap * sizeof(short), 0).constData(),
+                                        gap * sizeof(short))) {
+                setError(QTextToSpeech::ErrorReason::Playback,
+                         QCoreApplication::translate("QTextToSpeech", "Audio streaming error."));
+                stop();
+                return CST_AUDIO_STREAM_STOP;
+            }
+            m_streamSamples += gap;
+        } else if (!initAudio(w->sample_rate, w->num_channels)) {
+            return CST_AUDIO_STREAM_STOP;
+        }
+        if (m_trimSilence)
+            resetSilenceTrimming(m_format, m_utteranceStart);
+    }
 
-    const qsizetype bytesToWrite = size * sizeof(short);
+    qsizetype bytesToWrite = size * sizeof(short);
+    const char *data = reinterpret_cast<const char *>(&w->samples[start]);
+    // the wave belongs to flite, so trim and filter a copy in a reused buffer
+    if (m_trimSilence) {
+        trimSilence(m_format, start, &w->samples[start], size, last == 1, m_filterBuffer);
+        bytesToWrite = m_filterBuffer.size();
+        data = m_filterBuffer.constData();
+    }
+    if (m_audioFilters && !m_audioFilters->isEmpty()) {
+        if (start == 0)
+            m_audioFilters->reset();
+        if (!m_trimSilence)
+            m_filterBuffer.assign(QByteArrayView(data, bytesToWrite));
+        m_audioFilters->process(m_format, m_filterBuffer);
+        bytesToWrite = m_filterBuffer.size();
+        data = m_filterBuffer.constData();
+    }
 
-    if (!m_audioBuffer->write(reinterpret_cast<const char *>(&w->samples[start]), bytesToWrite)) {
+    if (bytesToWrite && !writeToSink(data, bytesToWrite)) {
         setError(QTextToSpeech::ErrorReason::Playback,
                  QCoreApplication::translate("QTextToSpeech", "Audio streaming error."));
         stop();
         return CST_AUDIO_STREAM_STOP;
     }
+    if (start == 0) {
+        Q_TRACE(QTextToSpeechProcessorFlite_audioOutput_first, w->sample_rate, int(bytesToWrite));
+        QTextToSpeechTimeline::record(Phase::Instant, "first audio", -1, bytesToWrite);
+    }
 
     // Stats for debugging
     ++numberChunks;
     totalBytes += bytesToWrite;
+    m_streamSamples += bytesToWrite / sizeof(short);
+
+    if (m_collectingPhonemes) {
+        emitPhonemes(m_trimSilence ? m_outputSamples : m_utteranceStart + start + size,
+                     last == 1, w->num_channels);
+    }
 
     if (last == 1) {
         qCDebug(lcSpeechTtsFlite) << "last data chunk written";
-        m_audioBuffer->close();
+        Q_TRACE(QTextToSpeechProcessorFlite_audioOutput_last, numberChunks, totalBytes);
+        QTextToSpeechTimeline::record(Phase::Instant, "last audio", -1, totalBytes);
+        // In gapless mode, the stream stays open for the next text. Without
+        // one, the sink becomes idle once the written data has been played.
+        if (pacedOutput()) {
+            m_timeStretch.flush();
+            m_closeWhenWritten = !m_gapless;
+            if (!writeStretchedAudio()) {
+                setError(QTextToSpeech::ErrorReason::Playback,
+                         QCoreApplication::translate("QTextToSpeech", "Audio streaming error."));
+                stop();
+                return CST_AUDIO_STREAM_STOP;
+            }
+        }
+        if (m_gapless)
+            emit readyForNextUtterance();
+        else if (!pacedOutput())
+            m_audioBuffer->close();
     }
     return CST_AUDIO_STREAM_CONT;
 }
 
+/*
+    Writes audio to the sink, or, with time-stretching or a mixer, to the
+    stretcher from which the sink is fed.
+*/
+bool QTextToSpeechProcessorFlite::writeToSink(const char *data, qsizetype size)
+{
+    if (!pacedOutput())
+        return m_audioBuffer->write(data, size) > 0;
+
+    m_timeStretch.write(reinterpret_cast<const short *>(data), size / qsizetype(sizeof(short)));
+    return writeStretchedAudio();
+}
+
+/*
+    Writes as much of the held audio as the sink can take, stretched to the
+    current playback rate. Called for new audio, and by m_writeTimer, as
+    QAudioSink doesn't tell when it has free space in push mode. The audio
+    buffer is closed once everything has been written after the last text.
+*/
+bool QTextToSpeechProcessorFlite::writeStretchedAudio()
+{
+    if (!m_audioBuffer)
+        return false;
+
+    // texts are synthesized at the normal rate
+    const double tempo = m_timeStretch.tempo();
+    const double rate = m_timeStretching ? m_playbackRate.load(std::memory_order_relaxed) : 0;
+    m_timeStretch.setTempo(1.0 / durationStretch(rate));
+
+    const qsizetype bytesFree = m_mixing ? m_mixerSource->bytesFree() : m_audioSink->bytesFree();
+    m_stretchBuffer.resize(bytesFree / qsizetype(sizeof(short)));
+    const qsizetype count = m_timeStretch.read(m_stretchBuffer.data(), m_stretchBuffer.size());
+    if (count && m_audioBuffer->write(reinterpret_cast<const char *>(m_stretchBuffer.constData()),
+                                      count * qsizetype(sizeof(short))) <= 0) {
+        return false;
+    }
+
+    // the words that are still to come move with the new tempo
+    if (m_timeStretch.tempo() != tempo && m_tokenTimer.isActive())
+        startTokenTimer();
+    // only the positions from the next word on are timed
+    m_timeStretch.discardBefore(m_currentToken >= 0 && m_currentToken < m_tokens.size()
+                                ? m_tokens.at(m_currentToken).sample : m_streamSamples);
+
+    if (m_closeWhenWritten && m_timeStretch.isEmpty()) {
+        m_closeWhenWritten = false;
+        m_writeTimer.stop();
+        m_audioBuffer->close();
+    }
+    return true;
+}
+
 int QTextToSpeechProcessorFlite::dataOutputCb(const cst_wave *w, int start, int size,
                                               int last, cst_audio_streaming_info *asi)
 {
     QTextToSpeechProcessorFlite *processor = static_cast<QTextToSpeechProcessorFlite *>(asi->userdata);
-    if (processor)
+    if (processor) {
+        if (processor->m_synthesizingWords)
+            processor->addToken(w, start, size, asi);
+        if (processor->m_collectingPhonemes)
+            processor->addPhonemes(w, start, size, asi);
         return processor->dataOutput(w, start, size, last, asi);
+    }
     return CST_AUDIO_STREAM_STOP;
 }
 
@@ -133,17 +392,197 @@ int QTextToSpeechProcessorFlite::dataOutput(const cst_wave *w, int start, int si
     if (!format.isValid())
         return CST_AUDIO_STREAM_STOP;
 
-    const qsizetype bytesToWrite = size * format.bytesPerSample();
-    emit synthesized(format, QByteArray(reinterpret_cast<const char *>(&w->samples[start]), bytesToWrite));
+    // words are reported before the data in which they start
+    const auto emitNewWords = [this]{
+        if (!m_sayingWordEnabled.loadRelaxed()) {
+            m_currentToken = m_tokens.size();
+            return;
+        }
+        for (; m_currentToken < m_tokens.size(); ++m_currentToken) {
+            const TokenData &token = m_tokens.at(m_currentToken);
+            emit sayingWord(token.text, token.begin, token.text.length());
+        }
+    };
+
+    if (m_trimSilence) {
+        if (start == 0)
+            resetSilenceTrimming(format, 0);
+        QByteArray trimmed;
+        trimSilence(format, start, &w->samples[start], size, last == 1, trimmed);
+        if (start == 0) {
+            Q_TRACE(QTextToSpeechProcessorFlite_dataOutput_first, w->sample_rate, int(trimmed.size()));
+            QTextToSpeechTimeline::record(Phase::Instant, "first chunk", -1, trimmed.size());
+        }
+        emitNewWords();
+        if (!trimmed.isEmpty())
+            emit synthesized(format, trimmed);
+    } else {
+        const qsizetype bytesToWrite = size * format.bytesPerSample();
+        if (start == 0) {
+            Q_TRACE(QTextToSpeechProcessorFlite_dataOutput_first, w->sample_rate, int(bytesToWrite));
+            QTextToSpeechTimeline::record(Phase::Instant, "first chunk", -1, bytesToWrite);
+        }
+        emitNewWords();
+        emit synthesized(format, QByteArray(reinterpret_cast<const char *>(&w->samples[start]), bytesToWrite));
+    }
+    if (m_collectingPhonemes)
+        emitPhonemes(m_trimSilence ? m_outputSamples : start + size, last == 1, w->num_channels);
 
-    if (last == 1)
+    if (last == 1) {
+        Q_TRACE(QTextToSpeechProcessorFlite_dataOutput_last);
+        QTextToSpeechTimeline::record(Phase::Instant, "last chunk");
+        // the words are reported before the text is done, with their
+        // positions in the data that has been emitted
+        if (m_synthesizingWords && m_wordTimelineEnabled.loadRelaxed())
+            emit wordTimeline(wordBoundaries(0, w->num_channels));
         emit stateChanged(QTextToSpeech::Ready);
+    } else {
+        waitWhileThrottled();
+    }
 
     return CST_AUDIO_STREAM_CONT;
 }
 
+// Blocks flite in the streaming callback until the consumer has caught up.
+// Returning anything but CST_AUDIO_STREAM_CONT would abort the synthesis.
+void QTextToSpeechProcessorFlite::waitWhileThrottled()
+{
+    QMutexLocker locker(&m_throttleMutex);
+    if (m_throttled)
+        qCDebug(lcSpeechTtsFlite) << "Synthesis throttled by consumer";
+    while (m_throttled)
+        m_throttleCondition.wait(&m_throttleMutex);
+}
+
+void QTextToSpeechProcessorFlite::setThrottled(bool throttled)
+{
+    QMutexLocker locker(&m_throttleMutex);
+    m_throttled = throttled;
+    if (!throttled)
+        m_throttleCondition.wakeAll();
+}
+
+void QTextToSpeechProcessorFlite::setSilenceTrimming(bool enabled, int maximumPause)
+{
+    m_trimSilence = enabled;
+    m_maximumPause = qMax(0, maximumPause);
+}
+
+void QTextToSpeechProcessorFlite::setGapless(bool enabled, int gapDuration)
+{
+    m_gapless = enabled;
+    m_gapDuration = qMax(0, gapDuration);
+}
+
+qint64 QTextToSpeechProcessorFlite::samplesToMs(qint64 samples) const
+{
+    const qint64 samplesPerSecond = qint64(m_format.sampleRate()) * m_format.channelCount();
+    return samplesPerSecond > 0 ? samples * 1000 / samplesPerSecond : 0;
+}
+
+void QTextToSpeechProcessorFlite::resetSilenceTrimming(const QAudioFormat &format,
+                                                       qint64 outputPosition)
+{
+    m_silenceTrimmer.reset(format.sampleRate(), format.channelCount());
+    m_silenceTrimmer.setMaximumPause(m_maximumPause);
+    m_outputSamples = outputPosition;
+}
+
+/*
+    Removes the silence at the beginning and end of an utterance, and shortens
+    pauses to m_maximumPause, with the same trimmer as
+    QTextToSpeechSilenceTrimFilter. The retained part of a pause is held back
+    until the speech continues, so that trailing silence can be dropped without
+    having to know in advance where the utterance ends.
+
+    The output is written to \a output, and the start times of new tokens, as
+    well as the boundaries of new phonemes, are moved to their position in the
+    trimmed audio.
+*/
+void QTextToSpeechProcessorFlite::trimSilence(const QAudioFormat &format, qint64 start,
+                                              const short *samples, qsizetype count, bool last,
+                                              QByteArray &output)
+{
+    const int channelCount = qMax(1, format.channelCount());
+    const int sampleRate = format.sampleRate();
+    const qsizetype window = m_silenceTrimmer.windowFrames() * channelCount;
+
+    output.resize((count + m_silenceTrimmer.heldFrames() * channelCount) * sizeof(short));
+    short *out = reinterpret_cast<short *>(output.data());
+    qsizetype written = 0;
+    m_trimWindow.resize(window);
+
+    const auto toMs = [=](qint64 position) {
+        return position * 1000 / (qint64(sampleRate) * channelCount);
+    };
+
+    for (qsizetype offset = 0; offset < count; offset += window) {
+        const qsizetype length = qMin(window, count - offset);
+        const short *in = samples + offset;
+        QTextToSpeechAudioKernels::int16ToFloat(in, m_trimWindow.data(), length);
+        const qsizetype silence = m_silenceTrimmer.next(m_trimWindow.constData(),
+                                                        length / channelCount);
+        const bool silent = silence < 0;
+
+        qint64 windowOutput;
+        if (silent) {
+            // words starting in silence start where the audio continues
+            windowOutput = m_outputSamples + written + m_silenceTrimmer.heldFrames() * channelCount;
+        } else {
+            std::fill_n(out + written, silence * channelCount, short(0));
+            written += silence * channelCount;
+            windowOutput = m_outputSamples + written;
+            std::copy_n(in, length, out + written);
+            written += length;
+        }
+
+        const qint64 windowStart = start + offset;
+        const qint64 windowEnd = windowStart + length;
+        const auto map = [&](qint64 &position) {
+            const qint64 delta = silent ? 0 : qBound(qint64(0), position - windowStart, qint64(length));
+            position = windowOutput + delta;
+        };
+        while (m_mappedTokens < m_tokens.size()) {
+            TokenData &token = m_tokens[m_mappedTokens];
+            if (token.sample >= windowEnd)
+                break;
+            map(token.sample);
+            token.startTime = toMs(token.sample);
+            ++m_mappedTokens;
+        }
+        for (; m_mappedPhonemeStarts < m_phonemes.size()
+               && m_phonemes.at(m_mappedPhonemeStarts).start < windowEnd; ++m_mappedPhonemeStarts) {
+            map(m_phonemes[m_mappedPhonemeStarts].start);
+        }
+        for (; m_mappedPhonemeEnds < m_phonemes.size()
+               && m_phonemes.at(m_mappedPhonemeEnds).end < windowEnd; ++m_mappedPhonemeEnds) {
+            map(m_phonemes[m_mappedPhonemeEnds].end);
+        }
+    }
+
+    // trailing silence is dropped, and the phonemes in it end with the audio
+    if (last) {
+        m_silenceTrimmer.reset(sampleRate, channelCount);
+        for (; m_mappedPhonemeStarts < m_phonemes.size(); ++m_mappedPhonemeStarts)
+            m_phonemes[m_mappedPhonemeStarts].start = m_outputSamples + written;
+        for (; m_mappedPhonemeEnds < m_phonemes.size(); ++m_mappedPhonemeEnds)
+            m_phonemes[m_mappedPhonemeEnds].end = m_outputSamples + written;
+    }
+
+    m_outputSamples += written;
+    output.resize(written * sizeof(short));
+}
+
 void QTextToSpeechProcessorFlite::timerEvent(QTimerEvent *event)
 {
+    if (event->timerId() == m_writeTimer.timerId()) {
+        if (!writeStretchedAudio()) {
+            setError(QTextToSpeech::ErrorReason::Playback,
+                     QCoreApplication::translate("QTextToSpeech", "Audio streaming error."));
+            stop();
+        }
+        return;
+    }
     if (event->timerId() != m_tokenTimer.timerId()) {
         QObject::timerEvent(event);
         return;
@@ -151,9 +590,10 @@ void QTextToSpeechProcessorFlite::timerEvent(QTimerEvent *event)
 
     qCDebug(lcSpeechTtsFlite) << "Moving current token" << m_currentToken << m_tokens.size();
     auto currentToken = m_tokens.at(m_currentToken);
-    m_index = m_text.indexOf(currentToken.text, m_index);
-    emit sayingWord(currentToken.text, m_index, currentToken.text.length());
-    m_index += currentToken.text.length();
+    if (currentToken.text.isEmpty())
+        emit utteranceStarted();
+    else
+        emit sayingWord(currentToken.text, currentToken.begin, currentToken.text.length());
     ++m_currentToken;
     if (m_currentToken == m_tokens.size())
         m_tokenTimer.stop();
@@ -161,16 +601,50 @@ void QTextToSpeechProcessorFlite::timerEvent(QTimerEvent *event)
         startTokenTimer();
 }
 
-void QTextToSpeechProcessorFlite::processText(const QString &text, int voiceId, double pitch, double rate, OutputHandler outputHandler)
+void QTextToSpeechProcessorFlite::processText(const QString &text, int voiceId, double pitch, double rate, OutputHandler outputHandler,
+                                              bool append)
 {
     qCDebug(lcSpeechTtsFlite) << "processText() begin";
+    Q_TRACE(QTextToSpeechProcessorFlite_processText_entry, int(text.size()), append);
     if (!checkVoice(voiceId))
         return;
 
+    QTextToSpeechTimeline::nameThread("flite processor");
+    QTextToSpeechTimeline::record(Phase::Begin, "flite synthesis", -1, text.size());
+
     m_text = text;
-    m_tokens.clear();
-    m_currentToken = 0;
     m_index = 0;
+    // The audio of the same voice can be appended to a stream that is still
+    // playing; otherwise the sink is restarted.
+    m_appending = append && m_state == QAudio::ActiveState && m_audioBuffer
+               && m_audioBuffer->isOpen() && voiceId == m_streamVoiceId;
+    if (m_appending) {
+        m_utteranceStart = m_streamSamples
+                         + qint64(m_gapDuration) * m_format.sampleRate() / 1000 * m_format.channelCount();
+        m_tokens.append(TokenData{samplesToMs(m_utteranceStart), QString(), -1, m_utteranceStart});
+        if (!m_tokenTimer.isActive())
+            startTokenTimer();
+    } else {
+        m_tokens.clear();
+        m_currentToken = 0;
+        m_utteranceStart = 0;
+        // an appended text that restarts the sink is reported all the same
+        if (append)
+            m_tokens.append(TokenData{0, QString(), -1, 0});
+        if (outputHandler == audioOutputCb)
+            m_streamVoiceId = voiceId;
+    }
+    m_mappedTokens = m_tokens.size();
+    m_collectingPhonemes = m_phonemeEventsEnabled.loadRelaxed();
+    m_phonemes.clear();
+    m_mappedPhonemeStarts = 0;
+    m_mappedPhonemeEnds = 0;
+    m_segment = nullptr;
+    m_phoneset = nullptr;
+    // without receivers, synthesize() doesn't need to look at the tokens
+    m_synthesizingWords = outputHandler == dataOutputCb
+                       && (m_sayingWordEnabled.loadRelaxed() || m_wordTimelineEnabled.loadRelaxed());
+    const qsizetype firstToken = m_tokens.size();
     float secsToSpeak = -1;
     const VoiceInfo &voiceInfo = m_voices.at(voiceId);
     cst_voice *voice = voiceInfo.vox;
@@ -178,9 +652,11 @@ void QTextToSpeechProcessorFlite::processText(const QString &text, int voiceId,
     asi->asc = outputHandler;
     asi->userdata = (void *)this;
     feat_set(voice->features, "streaming_info", audio_streaming_info_val(asi));
-    setRateForVoice(voice, rate);
+    // played audio gets its rate from time-stretching
+    setRateForVoice(voice, m_timeStretching && outputHandler == audioOutputCb ? 0 : rate);
     setPitchForVoice(voice, pitch);
     secsToSpeak = flite_text_to_speech(text.toUtf8().constData(), voice, "none");
+    QTextToSpeechTimeline::record(Phase::End, "flite synthesis");
 
     if (secsToSpeak <= 0) {
         setError(QTextToSpeech::ErrorReason::Input,
@@ -188,10 +664,14 @@ void QTextToSpeechProcessorFlite::processText(const QString &text, int voiceId,
         return;
     }
 
+    // all tokens of the text are known, and moved to their final position
+    if (outputHandler == audioOutputCb && m_wordTimelineEnabled.loadRelaxed())
+        emit wordTimeline(wordBoundaries(firstToken, m_format.channelCount()));
+
     qCDebug(lcSpeechTtsFlite) << "processText() end" << secsToSpeak << "Seconds";
 }
 
-void QTextToSpeechProcessorFlite::setRateForVoice(cst_voice *voice, float rate)
+float QTextToSpeechProcessorFlite::durationStretch(double rate)
 {
     float stretch = 1.0;
     Q_ASSERT(rate >= -1.0 && rate <= 1.0);
@@ -200,7 +680,12 @@ void QTextToSpeechProcessorFlite::setRateForVoice(cst_voice *voice, float rate)
         stretch -= rate * 2;
     if (rate > 0)
         stretch -= rate * (100.0 / 175.0);
-    feat_set_float(voice->features, "duration_stretch", stretch);
+    return stretch;
+}
+
+void QTextToSpeechProcessorFlite::setRateForVoice(cst_voice *voice, float rate)
+{
+    feat_set_float(voice->features, "duration_stretch", durationStretch(rate));
 }
 
 void QTextToSpeechProcessorFlite::setPitchForVoice(cst_voice *voice, float pitch)
@@ -331,14 +816,21 @@ bool QTextToSpeechProcessorFlite::initAudio(double rate, int channelCount)
        return false;
 
     createSink();
+    if (!m_audioBuffer)
+        return false;
 
-    m_audioSink->setVolume(m_volume);
+    setOutputVolume(m_volume);
 
     return true;
 }
 
 void QTextToSpeechProcessorFlite::deleteSink()
 {
+    if (m_mixing) {
+        m_mixerSource->stop();
+        m_mixing = false;
+        m_audioBuffer = nullptr;
+    }
     if (m_audioSink) {
         m_audioSink->disconnect();
         delete m_audioSink;
@@ -349,18 +841,28 @@ void QTextToSpeechProcessorFlite::deleteSink()
 
 void QTextToSpeechProcessorFlite::createSink()
 {
-    // Create new sink if none exists or the format has changed
-    if (!m_audioSink || (m_audioSink->format() != m_format)) {
-        // No signals while we create new sink with QIODevice
-        const bool sigs = signalsBlocked();
-        auto resetSignals = qScopeGuard([this, sigs](){ blockSignals(sigs); });
-        blockSignals(true);
+    if (m_mixerSource) {
+        // the mixer plays the audio of all its sources through one sink
         deleteSink();
-        m_audioSink = new QAudioSink(m_audioDevice, m_format, this);
-        connect(m_audioSink, &QAudioSink::stateChanged, this, &QTextToSpeechProcessorFlite::changeState);
-        connect(QThread::currentThread(), &QThread::finished, m_audioSink, &QObject::deleteLater);
+        m_audioBuffer = m_mixerSource->start(m_format);
+        m_mixing = m_audioBuffer != nullptr;
+    } else {
+        // Create new sink if none exists or the format has changed
+        if (!m_audioSink || (m_audioSink->format() != m_format)) {
+            // No signals while we create new sink with QIODevice
+            const bool sigs = signalsBlocked();
+            auto resetSignals = qScopeGuard([this, sigs](){ blockSignals(sigs); });
+            blockSignals(true);
+            deleteSink();
+            m_audioSink = new QAudioSink(m_audioDevice, m_format, this);
+            connect(m_audioSink, &QAudioSink::stateChanged, this, &QTextToSpeechProcessorFlite::changeState);
+            connect(QThread::currentThread(), &QThread::finished, m_audioSink, &QObject::deleteLater);
+        }
+        // a small buffer lets rate changes be heard quickly
+        if (m_timeStretching)
+            m_audioSink->setBufferSize(m_format.bytesForDuration(100000));
+        m_audioBuffer = m_audioSink->start();
     }
-    m_audioBuffer = m_audioSink->start();
     if (!m_audioBuffer) {
         deleteSink();
         setError(QTextToSpeech::ErrorReason::Playback,
@@ -369,6 +871,15 @@ void QTextToSpeechProcessorFlite::createSink()
 
     numberChunks = 0;
     totalBytes = 0;
+    m_streamSamples = 0;
+
+    if (pacedOutput() && m_audioBuffer) {
+        m_timeStretch.reset(m_format.sampleRate(), m_format.channelCount());
+        m_closeWhenWritten = false;
+        const qsizetype bufferSize = m_mixing ? m_mixerSource->bufferSize() : m_audioSink->bufferSize();
+        const qint64 interval = m_format.durationForBytes(bufferSize) / 4000;
+        m_writeTimer.start(qMax(interval, qint64(1)), Qt::PreciseTimer, this);
+    }
 }
 
 // Wrapper for QAudioSink::stateChanged, bypassing early idle bug
@@ -378,6 +889,8 @@ void QTextToSpeechProcessorFlite::changeState(QAudio::State newState)
         return;
 
     qCDebug(lcSpeechTtsFlite) << "Audio sink state transition" << m_state << newState;
+    Q_TRACE(QTextToSpeechProcessorFlite_changeState, int(m_state), int(newState));
+    QTextToSpeechTimeline::record(Phase::Instant, "audio sink state", -1, newState);
 
     switch (newState) {
     case QAudio::ActiveState:
@@ -385,10 +898,31 @@ void QTextToSpeechProcessorFlite::changeState(QAudio::State newState)
         if (!m_tokenTimer.isActive() && m_currentToken < m_tokens.count())
             startTokenTimer();
         break;
-    case QAudio::SuspendedState:
     case QAudio::IdleState:
+        // The sink ran dry before the timer wrote more of the stretched audio.
+        if (pacedOutput() && m_audioBuffer && !m_timeStretch.isEmpty()
+            && writeStretchedAudio()) {
+            return;
+        }
+        // All written data has been played; report appended texts whose
+        // beginning the token timer didn't reach.
+        for (qsizetype i = m_currentToken; i >= 0 && i < m_tokens.size();) {
+            if (m_tokens.at(i).text.isEmpty()) {
+                m_tokens.removeAt(i);
+                emit utteranceStarted();
+            } else {
+                ++i;
+            }
+        }
+        m_tokenTimer.stop();
+        m_writeTimer.stop();
+        break;
+    case QAudio::SuspendedState:
+        m_tokenTimer.stop();
+        break;
     case QAudio::StoppedState:
         m_tokenTimer.stop();
+        m_writeTimer.stop();
         break;
     }
 
@@ -427,6 +961,10 @@ constexpr QTextToSpeech::State QTextToSpeechProcessorFlite::audioStateToTts(QAud
 void QTextToSpeechProcessorFlite::deinitAudio()
 {
     m_tokenTimer.stop();
+    m_writeTimer.stop();
+    m_closeWhenWritten = false;
+    if (pacedOutput())
+        m_timeStretch.reset(m_format.sampleRate(), m_format.channelCount());
     m_index = -1;
     m_currentToken = -1;
     deleteSink();
@@ -479,7 +1017,46 @@ bool QTextToSpeechProcessorFlite::checkVoice(int voiceId)
 // Wrap QAudioSink::state and compensate early idle bug
 QAudio::State QTextToSpeechProcessorFlite::audioSinkState() const
 {
-    return (m_audioSink) ? m_state : QAudio::StoppedState;
+    return (m_audioSink || m_mixing) ? m_state : QAudio::StoppedState;
+}
+
+qint64 QTextToSpeechProcessorFlite::processedUSecs() const
+{
+    return m_mixing ? m_mixerSource->processedUSecs() : m_audioSink->processedUSecs();
+}
+
+void QTextToSpeechProcessorFlite::setOutputVolume(double volume)
+{
+    if (m_mixing)
+        m_mixerSource->setVolume(volume);
+    else
+        m_audioSink->setVolume(volume);
+}
+
+void QTextToSpeechProcessorFlite::setAudioMixerSource(QTextToSpeechAudioMixerSource *source)
+{
+    if (source == m_mixerSource)
+        return;
+
+    stop();
+    deleteSink();
+    if (m_mixerSource)
+        m_mixerSource->disconnect(this);
+    m_mixerSource = source;
+    // The source changes state in the audio callback as well, which is
+    // queued. The changes of writing and closing the stream are handled
+    // directly, so that those of a source without a mixer arrive in order.
+    if (m_mixerSource) {
+        connect(m_mixerSource, &QTextToSpeechAudioMixerSource::stateChanged,
+                this, &QTextToSpeechProcessorFlite::changeMixerState);
+    }
+}
+
+void QTextToSpeechProcessorFlite::changeMixerState(QAudio::State newState)
+{
+    // ignore changes that were queued before the stream was replaced
+    if (m_mixing && newState == m_mixerSource->state())
+        changeState(newState);
 }
 
 // Stop current and cancel subsequent utterances
@@ -494,14 +1071,21 @@ void QTextToSpeechProcessorFlite::stop()
 
 void QTextToSpeechProcessorFlite::pause()
 {
-    if (audioSinkState() == QAudio::ActiveState)
+    if (audioSinkState() != QAudio::ActiveState)
+        return;
+    if (m_mixing)
+        m_mixerSource->suspend();
+    else
         m_audioSink->suspend();
 }
 
 void QTextToSpeechProcessorFlite::resume()
 {
     if (audioSinkState() == QAudio::SuspendedState) {
-        m_audioSink->resume();
+        if (m_mixing)
+            m_mixerSource->resume();
+        else
+            m_audioSink->resume();
         // QAudioSink in push mode transitions to Idle when resumed, even if
         // there is still data to play. Workaround this weird behavior if we
         // know we are not done yet.
@@ -521,6 +1105,18 @@ void QTextToSpeechProcessorFlite::say(const QString &text, int voiceId, double p
     processText(text, voiceId, pitch, rate, QTextToSpeechProcessorFlite::audioOutputCb);
 }
 
+void QTextToSpeechProcessorFlite::sayNext(const QString &text, int voiceId, double pitch, double rate, double volume)
+{
+    if (text.isEmpty())
+        return;
+
+    if (!checkVoice(voiceId))
+        return;
+
+    m_volume = volume;
+    processText(text, voiceId, pitch, rate, QTextToSpeechProcessorFlite::audioOutputCb, true);
+}
+
 void QTextToSpeechProcessorFlite::synthesize(const QString &text, int voiceId, double pitch, double rate, double volume)
 {
     if (text.isEmpty())
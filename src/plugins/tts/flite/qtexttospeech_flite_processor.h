@@ -7,11 +7,18 @@
 #include "qtexttospeechengine.h"
 #include "qvoice.h"
 
+#include <QtTextToSpeech/private/qtexttospeechaudiofilter_p.h>
+#include <QtTextToSpeech/private/qtexttospeechaudiofilterchain_p.h>
+#include <QtTextToSpeech/private/qtexttospeechaudiomixer_p.h>
+#include <QtTextToSpeech/private/qtexttospeechtimestretch_p.h>
+
 #include <QtCore/QList>
 #include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
 #include <QtCore/QThread>
 #include <QtCore/QLibrary>
 #include <QtCore/QString>
+#include <QtCore/QStringList>
 #include <QtCore/QBasicTimer>
 #include <QtCore/QTimerEvent>
 #include <QtCore/QAbstractEventDispatcher>
@@ -22,6 +29,8 @@
 
 #include <flite/flite.h>
 
+#include <atomic>
+
 QT_BEGIN_NAMESPACE
 
 class QTextToSpeechProcessorFlite : public QObject
@@ -44,11 +53,28 @@ public:
     };
 
     Q_INVOKABLE void say(const QString &text, int voiceId, double pitch, double rate, double volume);
+    Q_INVOKABLE void sayNext(const QString &text, int voiceId, double pitch, double rate, double volume);
     Q_INVOKABLE void synthesize(const QString &text, int voiceId, double pitch, double rate, double volume);
     Q_INVOKABLE void pause();
     Q_INVOKABLE void resume();
     Q_INVOKABLE void stop();
 
+    // thread-safe
+    void setThrottled(bool throttled);
+    // to be called before the first utterance
+    void setAudioFilterChain(QTextToSpeechAudioFilterChain *chain) { m_audioFilters = chain; }
+    void setSilenceTrimming(bool enabled, int maximumPause);
+    void setGapless(bool enabled, int gapDuration);
+    void setTimeStretching(bool enabled) { m_timeStretching = enabled; }
+    // thread-safe; applies to the audio that is still to be played
+    void setPlaybackRate(double rate) { m_playbackRate.store(rate, std::memory_order_relaxed); }
+    // stops the current text, the next one plays through the source
+    void setAudioMixerSource(QTextToSpeechAudioMixerSource *source);
+    // thread-safe
+    void setSayingWordEnabled(bool enabled) { m_sayingWordEnabled.storeRelaxed(enabled); }
+    void setWordTimelineEnabled(bool enabled) { m_wordTimelineEnabled.storeRelaxed(enabled); }
+    void setPhonemeEventsEnabled(bool enabled) { m_phonemeEventsEnabled.storeRelaxed(enabled); }
+
     const QList<QTextToSpeechProcessorFlite::VoiceInfo> &voices() const;
     static constexpr QTextToSpeech::State audioStateToTts(QAudio::State audioState);
 
@@ -61,10 +87,25 @@ private:
 
     using OutputHandler = decltype(QTextToSpeechProcessorFlite::audioOutputCb);
     // Process a single text
-    void processText(const QString &text, int voiceId, double pitch, double rate, OutputHandler outputHandler);
+    void processText(const QString &text, int voiceId, double pitch, double rate, OutputHandler outputHandler,
+                     bool append = false);
     int audioOutput(const cst_wave *w, int start, int size, int last, cst_audio_streaming_info *asi);
     int dataOutput(const cst_wave *w, int start, int size, int last, cst_audio_streaming_info *asi);
+    void addToken(const cst_wave *w, int start, int size, cst_audio_streaming_info *asi);
+    QList<QTextToSpeech::WordBoundary> wordBoundaries(qsizetype firstToken, int channelCount) const;
+    void addPhonemes(const cst_wave *w, int start, int size, cst_audio_streaming_info *asi);
+    void emitPhonemes(qint64 written, bool last, int channelCount);
+
+    void waitWhileThrottled();
+
+    bool writeToSink(const char *data, qsizetype size);
+    bool writeStretchedAudio();
+
+    void resetSilenceTrimming(const QAudioFormat &format, qint64 outputPosition);
+    void trimSilence(const QAudioFormat &format, qint64 start, const short *samples,
+                     qsizetype count, bool last, QByteArray &output);
 
+    static float durationStretch(double rate);
     void setRateForVoice(cst_voice *voice, float rate);
     void setPitchForVoice(cst_voice *voice, float pitch);
 
@@ -76,6 +117,9 @@ private:
     void deleteSink();
     void createSink();
     QAudio::State audioSinkState() const;
+    qint64 processedUSecs() const;
+    void setOutputVolume(double volume);
+    bool pacedOutput() const { return m_timeStretching || m_mixing; }
     void setError(QTextToSpeech::ErrorReason err, const QString &errorString = QString());
 
     // Read available flite voices
@@ -83,38 +127,108 @@ private:
 
 private slots:
     void changeState(QAudio::State newState);
+    void changeMixerState(QAudio::State newState);
 
 Q_SIGNALS:
     void errorOccurred(QTextToSpeech::ErrorReason error, const QString &errorString);
     void stateChanged(QTextToSpeech::State);
     void sayingWord(const QString &word, qsizetype begin, qsizetype length);
+    void wordTimeline(const QList<QTextToSpeech::WordBoundary> &words);
+    void phonemeEvents(const QList<QTextToSpeech::Phoneme> &phonemes);
+    void readyForNextUtterance();
+    void utteranceStarted();
     void synthesized(const QAudioFormat &format, const QByteArray &array);
 
 protected:
     void timerEvent(QTimerEvent *event) override;
 
 private:
+    // a token without text marks the beginning of an appended text
     struct TokenData {
         qint64 startTime;
         QString text;
+        qsizetype begin;
+        qint64 sample; // same position as startTime, in samples
     };
     QString m_text;
     qsizetype m_index = -1;
     QList<TokenData> m_tokens;
     qsizetype m_currentToken = -1;
     QBasicTimer m_tokenTimer;
+    QAtomicInteger<bool> m_sayingWordEnabled = true;
+    QAtomicInteger<bool> m_wordTimelineEnabled = true;
+    bool m_synthesizingWords = false; // whether synthesize() collects tokens
     void startTokenTimer();
+    qint64 playbackTime(const TokenData &token) const;
+
+    // Phonemes from the Segment relation, in samples like the tokens. The
+    // names are copied from the voice's phone set into m_phoneNames whenever
+    // the phone set changes, so the events own their data; m_phoneset is only
+    // compared against to detect that change.
+    struct PhonemeData {
+        QString name;
+        qint64 start;
+        qint64 end;
+    };
+    QAtomicInteger<bool> m_phonemeEventsEnabled = false;
+    bool m_collectingPhonemes = false;
+    const cst_phoneset *m_phoneset = nullptr;
+    QStringList m_phoneNames; // of m_phoneset
+    cst_item *m_segment = nullptr;
+    QList<PhonemeData> m_phonemes; // not reported yet
+    qsizetype m_mappedPhonemeStarts = 0;
+    qsizetype m_mappedPhonemeEnds = 0;
 
     QAudioSink *m_audioSink = nullptr;
     QAudio::State m_state = QAudio::IdleState;
     QIODevice *m_audioBuffer = nullptr;
+    // replaces the sink while the engine plays through a mixer
+    QTextToSpeechAudioMixerSource *m_mixerSource = nullptr;
+    bool m_mixing = false;
 
     QAudioDevice m_audioDevice;
     QAudioFormat m_format;
     double m_volume = 1;
 
+    QTextToSpeechAudioFilterChain *m_audioFilters = nullptr;
+    QByteArray m_filterBuffer;
+
+    // Silence trimming, all counts in samples
+    bool m_trimSilence = false;
+    int m_maximumPause = 200; // ms
+    QTextToSpeechSilenceTrimmer m_silenceTrimmer;
+    QList<float> m_trimWindow;
+    qint64 m_outputSamples = 0;
+    qsizetype m_mappedTokens = 0;
+
+    // Gapless playback of consecutive texts
+    bool m_gapless = false;
+    int m_gapDuration = 0; // ms
+    bool m_appending = false;
+    int m_streamVoiceId = -1;
+    qint64 m_streamSamples = 0; // written since the sink was started
+    qint64 m_utteranceStart = 0; // position of the current text in the stream
+    qint64 samplesToMs(qint64 samples) const;
+
+    // Time-stretching of the played audio, so that rate changes apply while
+    // speaking. Texts are synthesized at the normal rate, and held here until
+    // the sink can take them; the positions in the stream are those before
+    // stretching. A mixer source only buffers a little audio, so the audio for
+    // it is held here as well, at a tempo of 1.
+    bool m_timeStretching = false;
+    std::atomic<double> m_playbackRate = 0;
+    QTextToSpeechTimeStretch m_timeStretch;
+    QBasicTimer m_writeTimer;
+    QList<short> m_stretchBuffer;
+    bool m_closeWhenWritten = false;
+
     QList<VoiceInfo> m_voices;
 
+    // Back-pressure from the consumer of synthesized data
+    QMutex m_throttleMutex;
+    QWaitCondition m_throttleCondition;
+    bool m_throttled = false;
+
     // Statistics for debugging
     qint64 numberChunks = 0;
     qint64 totalBytes = 0;
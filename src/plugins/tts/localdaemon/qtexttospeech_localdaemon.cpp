@@ -0,0 +1,564 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include "qtexttospeech_localdaemon.h"
+#include "qtexttospeech_localdaemon_plugin.h"
+
+#include <QtTextToSpeech/private/qtexttospeechaudiofilterchain_p.h>
+#include <QtTextToSpeech/private/qtexttospeechdaemonprotocol_p.h>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QTimerEvent>
+#include <QtMultimedia/QMediaDevices>
+
+QT_BEGIN_NAMESPACE
+
+using namespace Qt::StringLiterals;
+using namespace QTextToSpeechDaemonProtocol;
+
+// The daemon might have to load the engine and its voices first
+static constexpr int WelcomeTimeout = 10000;
+// Messages aren't read from the socket while more audio than that is waiting
+// for the sink, so that the daemon's output is buffered by the socket.
+static constexpr qsizetype MaximumPendingAudio = 256 * 1024;
+
+QTextToSpeechEngineLocalDaemon::QTextToSpeechEngineLocalDaemon(const QVariantMap &parameters,
+                                                               QObject *parent)
+    : QTextToSpeechEngine(parent)
+{
+    if (const auto it = parameters.find("audioDevice"_L1); it != parameters.end())
+        m_audioDevice = (*it).value<QAudioDevice>();
+    else
+        m_audioDevice = QMediaDevices::defaultAudioOutput();
+
+    const QString serverName = parameters.value("serverName"_L1, defaultServerName()).toString();
+    const QString engine = parameters.value("engine"_L1).toString();
+    const QVariantMap engineParameters = parameters.value("engineParameters"_L1).toMap();
+
+    m_stream.setDevice(&m_socket);
+    m_stream.setVersion(StreamVersion);
+
+    // The daemon might have to load the engine and its voices first, which
+    // must not block the application. Texts are sent once we are welcomed.
+    connect(&m_socket, &QLocalSocket::connected, this, [this, engine, engineParameters]{
+        m_socket.write(message(MessageType::Hello, Version, engine, engineParameters));
+    });
+    connect(&m_socket, &QLocalSocket::readyRead, this, &QTextToSpeechEngineLocalDaemon::readMessages);
+    connect(&m_socket, &QLocalSocket::errorOccurred, this, [this, serverName]{
+        if (m_welcomed)
+            return;
+        connectionFailed(QCoreApplication::translate("QTextToSpeech",
+                                                     "Could not connect to the speech daemon %1: %2")
+                            .arg(serverName, m_socket.errorString()));
+    });
+    connect(&m_socket, &QLocalSocket::disconnected, this, [this]{
+        connectionFailed(QCoreApplication::translate("QTextToSpeech",
+                                                     "The speech daemon closed the connection."));
+    });
+    m_welcomeTimer.start(WelcomeTimeout, this);
+    m_socket.connectToServer(serverName);
+}
+
+QTextToSpeechEngineLocalDaemon::~QTextToSpeechEngineLocalDaemon()
+{
+    m_socket.disconnect(this);
+    deleteSink();
+}
+
+void QTextToSpeechEngineLocalDaemon::readMessages()
+{
+    QByteArray payload;
+    while (!m_throttled && m_pendingAudio.size() < MaximumPendingAudio
+           && readMessage(m_stream, payload)) {
+        handleMessage(payload);
+    }
+}
+
+void QTextToSpeechEngineLocalDaemon::handleMessage(const QByteArray &payload)
+{
+    QDataStream in(payload);
+    in.setVersion(StreamVersion);
+    quint8 type = 0;
+    in >> type;
+
+    if (MessageType(type) == MessageType::Welcome) {
+        int errorReason = 0;
+        QString errorString;
+        int capabilities = 0;
+        in >> errorReason >> errorString >> capabilities >> m_voice >> m_voices;
+        if (QTextToSpeech::ErrorReason(errorReason) != QTextToSpeech::ErrorReason::NoError) {
+            m_welcomeTimer.stop();
+            m_socket.disconnect(this);
+            m_socket.abort();
+            m_id = 0;
+            setError(QTextToSpeech::ErrorReason(errorReason), errorString);
+            return;
+        }
+        m_welcomed = true;
+        m_welcomeTimer.stop();
+        qCDebug(lcSpeechTtsLocalDaemon) << "Connected to" << m_socket.fullServerName() << "with"
+                                        << m_voices.size() << "voices";
+
+        // apply what was set while we were connecting
+        const auto voice = std::exchange(m_pendingVoice, std::nullopt);
+        const auto locale = std::exchange(m_pendingLocale, std::nullopt);
+        if (voice && m_voices.contains(*voice))
+            m_voice = *voice;
+        else if (locale)
+            setLocale(*locale);
+        if (m_id)
+            sendRequest();
+        return;
+    }
+
+    quint32 id = 0;
+    in >> id;
+    if (!id || id != m_id)
+        return;
+
+    switch (MessageType(type)) {
+    case MessageType::Format:
+        m_format = readFormat(in);
+        if (m_mode == Mode::Speaker && (!m_audioSink || m_audioSink->format() != m_format)) {
+            deleteSink();
+            if (m_audioDevice.isNull() || !m_audioDevice.isFormatSupported(m_format)) {
+                QString formatString;
+                QDebug(&formatString) << m_format;
+                setError(QTextToSpeech::ErrorReason::Playback,
+                         QCoreApplication::translate("QTextToSpeech",
+                                                     "Audio device does not support format: %1")
+                            .arg(formatString));
+                cancelRequest();
+                return;
+            }
+            m_audioSink = new QAudioSink(m_audioDevice, m_format, this);
+            m_audioSink->setVolume(m_volume);
+            connect(m_audioSink, &QAudioSink::stateChanged,
+                    this, &QTextToSpeechEngineLocalDaemon::sinkStateChanged);
+        }
+        break;
+    case MessageType::Audio: {
+        QByteArray pcm;
+        in >> pcm;
+        if (m_mode == Mode::Data) {
+            emit synthesized(m_format, pcm);
+            break;
+        }
+        if (!m_audioSink)
+            break;
+        if (!m_audioBuffer) {
+            m_audioBuffer = m_audioSink->start();
+            if (!m_audioBuffer) {
+                setError(QTextToSpeech::ErrorReason::Playback,
+                         QCoreApplication::translate("QTextToSpeech",
+                                                     "Audio Open error: No I/O device available."));
+                cancelRequest();
+                return;
+            }
+        }
+        if (m_audioFilters && !m_audioFilters->isEmpty()) {
+            if (std::exchange(m_firstChunk, false))
+                m_audioFilters->reset();
+            m_audioFilters->process(m_format, pcm);
+        }
+        m_pendingAudio += pcm;
+        writeAudio();
+        break;
+    }
+    case MessageType::Word: {
+        qint64 audioOffset = 0;
+        qint64 start = 0;
+        qint64 length = 0;
+        in >> audioOffset >> start >> length;
+        if (m_mode == Mode::Data) {
+            emit sayingWord(m_text.mid(start, length), start, length);
+            break;
+        }
+        m_words.append(Word{m_format.durationForBytes(audioOffset) / 1000, start, length});
+        if (!m_wordTimer.isActive() && m_state == QTextToSpeech::Speaking)
+            startWordTimer();
+        break;
+    }
+    case MessageType::Finished:
+        m_finished = true;
+        if (m_mode == Mode::Data || !m_audioBuffer) {
+            m_id = 0;
+            changeState(QTextToSpeech::Ready);
+        } else {
+            writeAudio();
+        }
+        break;
+    case MessageType::Error: {
+        int errorReason = 0;
+        QString errorString;
+        in >> errorReason >> errorString;
+        deleteSink();
+        m_id = 0;
+        setError(QTextToSpeech::ErrorReason(errorReason), errorString);
+        break;
+    }
+    default:
+        qCWarning(lcSpeechTtsLocalDaemon) << "Unexpected message" << type;
+        break;
+    }
+}
+
+// Writes as much of the pending audio as the sink takes, and closes the
+// stream once the daemon has sent everything.
+void QTextToSpeechEngineLocalDaemon::writeAudio()
+{
+    if (!m_audioBuffer)
+        return;
+
+    if (!m_pendingAudio.isEmpty()) {
+        const qsizetype bytesFree = m_audioSink->bytesFree();
+        const qint64 written = bytesFree ? m_audioBuffer->write(m_pendingAudio.constData(),
+                                                                qMin(bytesFree, m_pendingAudio.size()))
+                                         : 0;
+        if (written < 0) {
+            setError(QTextToSpeech::ErrorReason::Playback,
+                     QCoreApplication::translate("QTextToSpeech", "Audio streaming error."));
+            cancelRequest();
+            return;
+        }
+        m_pendingAudio.remove(0, written);
+    }
+
+    if (!m_pendingAudio.isEmpty()) {
+        // the sink doesn't notify about free space in push mode
+        if (!m_writeTimer.isActive())
+            m_writeTimer.start(int(qMax(qint64(1),
+                                        m_format.durationForBytes(m_audioSink->bufferSize()) / 4000)),
+                               this);
+        return;
+    }
+
+    m_writeTimer.stop();
+    // the sink becomes idle once the written data has been played
+    if (m_finished)
+        m_audioBuffer->close();
+}
+
+void QTextToSpeechEngineLocalDaemon::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == m_welcomeTimer.timerId()) {
+        connectionFailed(QCoreApplication::translate("QTextToSpeech",
+                                                     "The speech daemon %1 did not respond.")
+                            .arg(m_socket.serverName()));
+        return;
+    }
+    if (event->timerId() == m_writeTimer.timerId()) {
+        m_writeTimer.stop();
+        writeAudio();
+        // continue with the messages that weren't read while the sink was busy
+        readMessages();
+        return;
+    }
+    if (event->timerId() != m_wordTimer.timerId()) {
+        QTextToSpeechEngine::timerEvent(event);
+        return;
+    }
+
+    const Word word = m_words.at(m_currentWord++);
+    emit sayingWord(m_text.mid(word.start, word.length), word.start, word.length);
+    if (m_currentWord < m_words.size())
+        startWordTimer();
+    else
+        m_wordTimer.stop();
+}
+
+void QTextToSpeechEngineLocalDaemon::startWordTimer()
+{
+    if (m_currentWord >= m_words.size() || !m_audioSink)
+        return;
+    const qint64 playedTime = m_audioSink->processedUSecs() / 1000;
+    m_wordTimer.start(int(qMax(m_words.at(m_currentWord).time - playedTime, qint64(0))),
+                      Qt::PreciseTimer, this);
+}
+
+void QTextToSpeechEngineLocalDaemon::sinkStateChanged(QAudio::State state)
+{
+    qCDebug(lcSpeechTtsLocalDaemon) << "Audio sink state" << state;
+    switch (state) {
+    case QAudio::ActiveState:
+        startWordTimer();
+        changeState(QTextToSpeech::Speaking);
+        break;
+    case QAudio::SuspendedState:
+        m_wordTimer.stop();
+        changeState(QTextToSpeech::Paused);
+        break;
+    case QAudio::IdleState:
+        // an underrun while the daemon is still synthesizing
+        if (!m_finished || !m_pendingAudio.isEmpty())
+            break;
+        Q_FALLTHROUGH();
+    case QAudio::StoppedState:
+        if (m_audioSink->error() != QAudio::NoError && m_audioSink->error() != QAudio::UnderrunError) {
+            setError(QTextToSpeech::ErrorReason::Playback,
+                     QCoreApplication::translate("QTextToSpeech", "Audio streaming error."));
+            cancelRequest();
+            break;
+        }
+        m_wordTimer.stop();
+        m_id = 0;
+        changeState(QTextToSpeech::Ready);
+        break;
+    }
+}
+
+// Drops the connection, and the running request with it.
+void QTextToSpeechEngineLocalDaemon::connectionFailed(const QString &errorString)
+{
+    m_welcomeTimer.stop();
+    m_socket.disconnect(this);
+    m_socket.abort();
+    m_id = 0;
+    deleteSink();
+    setError(QTextToSpeech::ErrorReason::Initialization, errorString);
+}
+
+void QTextToSpeechEngineLocalDaemon::request(Mode mode, const QString &text)
+{
+    if (m_socket.state() == QLocalSocket::UnconnectedState)
+        return;
+    cancelRequest();
+
+    m_mode = mode;
+    m_id = ++m_nextId;
+    if (!m_id) // wrapped around, 0 means no request
+        m_id = ++m_nextId;
+    m_text = text;
+    m_finished = false;
+    m_firstChunk = true;
+    m_words.clear();
+    m_currentWord = 0;
+    m_requestSent = false;
+
+    if (m_welcomed)
+        sendRequest();
+    if (mode == Mode::Data)
+        changeState(QTextToSpeech::Synthesizing);
+}
+
+void QTextToSpeechEngineLocalDaemon::sendRequest()
+{
+    // the volume of spoken text is applied by the local sink
+    m_socket.write(message(MessageType::Synthesize, m_id, m_text, m_voice.locale(), m_voice,
+                           m_rate, m_pitch, m_mode == Mode::Data ? m_volume : 1.0));
+    m_requestSent = true;
+}
+
+// Drops the running request; the daemon stops synthesizing it, and its
+// remaining messages are ignored.
+void QTextToSpeechEngineLocalDaemon::cancelRequest()
+{
+    if (m_id && m_requestSent && !m_finished)
+        m_socket.write(message(MessageType::Cancel, m_id));
+    m_id = 0;
+    deleteSink();
+}
+
+void QTextToSpeechEngineLocalDaemon::deleteSink()
+{
+    m_wordTimer.stop();
+    m_writeTimer.stop();
+    m_pendingAudio.clear();
+    m_audioBuffer = nullptr;
+    if (m_audioSink) {
+        m_audioSink->disconnect(this);
+        m_audioSink->stop();
+        delete m_audioSink;
+        m_audioSink = nullptr;
+    }
+}
+
+QList<QLocale> QTextToSpeechEngineLocalDaemon::availableLocales() const
+{
+    QList<QLocale> locales;
+    for (const QVoice &voice : m_voices) {
+        if (!locales.contains(voice.locale()))
+            locales.append(voice.locale());
+    }
+    return locales;
+}
+
+QList<QVoice> QTextToSpeechEngineLocalDaemon::availableVoices() const
+{
+    QList<QVoice> voices;
+    for (const QVoice &voice : m_voices) {
+        if (voice.locale() == m_voice.locale())
+            voices.append(voice);
+    }
+    return voices;
+}
+
+void QTextToSpeechEngineLocalDaemon::say(const QString &text)
+{
+    request(Mode::Speaker, text);
+}
+
+void QTextToSpeechEngineLocalDaemon::synthesize(const QString &text)
+{
+    request(Mode::Data, text);
+}
+
+void QTextToSpeechEngineLocalDaemon::stop(QTextToSpeech::BoundaryHint boundaryHint)
+{
+    Q_UNUSED(boundaryHint);
+    if (!m_id)
+        return;
+    cancelRequest();
+    changeState(QTextToSpeech::Ready);
+}
+
+void QTextToSpeechEngineLocalDaemon::pause(QTextToSpeech::BoundaryHint boundaryHint)
+{
+    Q_UNUSED(boundaryHint);
+    if (m_audioSink && m_state == QTextToSpeech::Speaking)
+        m_audioSink->suspend();
+}
+
+void QTextToSpeechEngineLocalDaemon::resume()
+{
+    if (m_audioSink && m_state == QTextToSpeech::Paused) {
+        m_audioSink->resume();
+        // QAudioSink in push mode reports Idle when resumed, even if there
+        // is still data to play
+        sinkStateChanged(QAudio::ActiveState);
+    }
+}
+
+void QTextToSpeechEngineLocalDaemon::setSynthesisThrottled(bool throttled)
+{
+    m_throttled = throttled;
+    // continue with the messages that the socket has buffered meanwhile
+    if (!throttled)
+        QMetaObject::invokeMethod(this, &QTextToSpeechEngineLocalDaemon::readMessages,
+                                  Qt::QueuedConnection);
+}
+
+void QTextToSpeechEngineLocalDaemon::setAudioFilterChain(QTextToSpeechAudioFilterChain *chain)
+{
+    m_audioFilters = chain;
+}
+
+double QTextToSpeechEngineLocalDaemon::rate() const
+{
+    return m_rate;
+}
+
+bool QTextToSpeechEngineLocalDaemon::setRate(double rate)
+{
+    if (m_rate == rate)
+        return false;
+
+    m_rate = rate;
+    return true;
+}
+
+double QTextToSpeechEngineLocalDaemon::pitch() const
+{
+    return m_pitch;
+}
+
+bool QTextToSpeechEngineLocalDaemon::setPitch(double pitch)
+{
+    if (m_pitch == pitch)
+        return false;
+
+    m_pitch = pitch;
+    return true;
+}
+
+QLocale QTextToSpeechEngineLocalDaemon::locale() const
+{
+    if (m_pendingVoice)
+        return m_pendingVoice->locale();
+    return m_pendingLocale.value_or(m_voice.locale());
+}
+
+bool QTextToSpeechEngineLocalDaemon::setLocale(const QLocale &locale)
+{
+    // the voices are known once we are welcomed
+    if (isConnecting()) {
+        m_pendingLocale = locale;
+        m_pendingVoice.reset();
+        return true;
+    }
+    for (const QVoice &voice : std::as_const(m_voices)) {
+        if (voice.locale() == locale)
+            return setVoice(voice);
+    }
+    return false;
+}
+
+double QTextToSpeechEngineLocalDaemon::volume() const
+{
+    return m_volume;
+}
+
+bool QTextToSpeechEngineLocalDaemon::setVolume(double volume)
+{
+    if (m_volume == volume)
+        return false;
+
+    m_volume = volume;
+    if (m_audioSink)
+        m_audioSink->setVolume(volume);
+    return true;
+}
+
+QVoice QTextToSpeechEngineLocalDaemon::voice() const
+{
+    return m_pendingVoice.value_or(m_voice);
+}
+
+bool QTextToSpeechEngineLocalDaemon::setVoice(const QVoice &voice)
+{
+    if (isConnecting()) {
+        m_pendingVoice = voice;
+        return true;
+    }
+    if (!m_voices.contains(voice)) {
+        qWarning() << "Voice" << voice << "is not supported by this engine";
+        return false;
+    }
+
+    m_voice = voice;
+    return true;
+}
+
+QTextToSpeech::State QTextToSpeechEngineLocalDaemon::state() const
+{
+    return m_state;
+}
+
+QTextToSpeech::ErrorReason QTextToSpeechEngineLocalDaemon::errorReason() const
+{
+    return m_errorReason;
+}
+
+QString QTextToSpeechEngineLocalDaemon::errorString() const
+{
+    return m_errorString;
+}
+
+void QTextToSpeechEngineLocalDaemon::changeState(QTextToSpeech::State newState)
+{
+    if (newState != m_state) {
+        m_state = newState;
+        emit stateChanged(newState);
+    }
+}
+
+void QTextToSpeechEngineLocalDaemon::setError(QTextToSpeech::ErrorReason error,
+                                              const QString &errorString)
+{
+    m_errorReason = error;
+    m_errorString = errorString;
+    changeState(QTextToSpeech::Error);
+    emit errorOccurred(error, errorString);
+}
+
+QT_END_NAMESPACE
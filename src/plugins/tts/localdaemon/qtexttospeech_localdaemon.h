@@ -0,0 +1,135 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHENGINE_LOCALDAEMON_H
+#define QTEXTTOSPEECHENGINE_LOCALDAEMON_H
+
+#include "qtexttospeechengine.h"
+#include "qvoice.h"
+
+#include <QtTextToSpeech/private/qtexttospeechaudiofilterchain_p.h>
+
+#include <QtCore/QBasicTimer>
+#include <QtCore/QByteArray>
+#include <QtCore/QDataStream>
+#include <QtCore/QList>
+#include <QtCore/QLocale>
+#include <QtCore/QString>
+#include <QtMultimedia/QAudioDevice>
+#include <QtMultimedia/QAudioFormat>
+#include <QtMultimedia/QAudioSink>
+#include <QtNetwork/QLocalSocket>
+
+#include <optional>
+
+QT_BEGIN_NAMESPACE
+
+class QTextToSpeechEngineLocalDaemon : public QTextToSpeechEngine,
+                                       public QTextToSpeechAudioFilterChainClient
+{
+    Q_OBJECT
+    Q_INTERFACES(QTextToSpeechAudioFilterChainClient)
+
+public:
+    QTextToSpeechEngineLocalDaemon(const QVariantMap &parameters, QObject *parent);
+    ~QTextToSpeechEngineLocalDaemon() override;
+
+    // Plug-in API:
+    QList<QLocale> availableLocales() const override;
+    QList<QVoice> availableVoices() const override;
+    void say(const QString &text) override;
+    void synthesize(const QString &text) override;
+    void stop(QTextToSpeech::BoundaryHint boundaryHint) override;
+    void pause(QTextToSpeech::BoundaryHint boundaryHint) override;
+    void resume() override;
+    void setSynthesisThrottled(bool throttled) override;
+    double rate() const override;
+    bool setRate(double rate) override;
+    double pitch() const override;
+    bool setPitch(double pitch) override;
+    QLocale locale() const override;
+    bool setLocale(const QLocale &locale) override;
+    double volume() const override;
+    bool setVolume(double volume) override;
+    QVoice voice() const override;
+    bool setVoice(const QVoice &voice) override;
+    QTextToSpeech::State state() const override;
+    QTextToSpeech::ErrorReason errorReason() const override;
+    QString errorString() const override;
+
+    // QTextToSpeechAudioFilterChainClient
+    void setAudioFilterChain(QTextToSpeechAudioFilterChain *chain) override;
+
+protected:
+    void timerEvent(QTimerEvent *event) override;
+
+private:
+    enum class Mode { Speaker, Data };
+
+    struct Word
+    {
+        qint64 time; // in ms from the start of the audio
+        qsizetype start;
+        qsizetype length;
+    };
+
+    bool isConnecting() const
+    { return !m_welcomed && m_socket.state() != QLocalSocket::UnconnectedState; }
+    void connectionFailed(const QString &errorString);
+    void request(Mode mode, const QString &text);
+    void sendRequest();
+    void cancelRequest();
+    void readMessages();
+    void handleMessage(const QByteArray &payload);
+    void writeAudio();
+    void startWordTimer();
+    void sinkStateChanged(QAudio::State state);
+    void deleteSink();
+    void changeState(QTextToSpeech::State newState);
+    void setError(QTextToSpeech::ErrorReason error, const QString &errorString);
+
+    QTextToSpeech::State m_state = QTextToSpeech::Ready;
+    QTextToSpeech::ErrorReason m_errorReason = QTextToSpeech::ErrorReason::NoError;
+    QString m_errorString;
+
+    QLocalSocket m_socket;
+    QDataStream m_stream;
+    bool m_welcomed = false;
+    QBasicTimer m_welcomeTimer;
+    bool m_throttled = false;
+
+    QList<QVoice> m_voices;
+    QVoice m_voice;
+    // set while we were connecting
+    std::optional<QLocale> m_pendingLocale;
+    std::optional<QVoice> m_pendingVoice;
+    double m_rate = 0;
+    double m_pitch = 0;
+    double m_volume = 1;
+
+    // the running request; messages for earlier requests are ignored
+    quint32 m_id = 0;
+    quint32 m_nextId = 0;
+    Mode m_mode = Mode::Speaker;
+    QString m_text;
+    QAudioFormat m_format;
+    bool m_requestSent = false;
+    bool m_finished = false;
+
+    QAudioDevice m_audioDevice;
+    QAudioSink *m_audioSink = nullptr;
+    QIODevice *m_audioBuffer = nullptr;
+    QTextToSpeechAudioFilterChain *m_audioFilters = nullptr;
+    // audio that didn't fit into the sink's buffer yet
+    QByteArray m_pendingAudio;
+    QBasicTimer m_writeTimer;
+    bool m_firstChunk = true;
+
+    QList<Word> m_words;
+    qsizetype m_currentWord = 0;
+    QBasicTimer m_wordTimer;
+};
+
+QT_END_NAMESPACE
+
+#endif
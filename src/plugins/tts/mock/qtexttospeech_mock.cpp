@@ -16,6 +16,19 @@ QTextToSpeechEngineMock::QTextToSpeechEngineMock(const QVariantMap &parameters,
 {
     m_locale = availableLocales().first();
     m_voice = availableVoices().first();
+    m_format.setSampleRate(22050);
+    m_format.setChannelConfig(QAudioFormat::ChannelConfigMono);
+    m_format.setSampleFormat(QAudioFormat::Int16);
+
+    if (m_parameters[u"synthetic"_s].toBool()) {
+        m_synthetic = true;
+        m_realTimeFactor = qMax(0.0, m_parameters.value(u"realTimeFactor"_s, 0.0).toDouble());
+        m_chunkFrames = qMax(1, m_parameters.value(u"chunkSize"_s, 1024).toInt());
+        m_latency = qMax(0, m_parameters[u"latency"_s].toInt());
+        m_jitter = qMax(0, m_parameters[u"jitter"_s].toInt());
+        m_random.seed(m_parameters.value(u"seed"_s, 1).toUInt());
+        m_silence = QByteArray(m_format.bytesForFrames(m_chunkFrames), 0);
+    }
     if (m_parameters[u"delayedInitialization"_s].toBool()) {
         QTimer::singleShot(50, this, [this]{
             m_state = QTextToSpeech::Ready;
@@ -111,22 +124,40 @@ void QTextToSpeechEngineMock::say(const QString &text)
 {
     m_text = text;
     m_currentIndex = 0;
-    m_timer.start(wordTime(), Qt::PreciseTimer, this);
+    m_wordFrame = 0;
+    emit wordTimeline(wordBoundaries(text));
+    if (m_synthetic) {
+        prepareSyntheticText(false);
+        scheduleSyntheticChunk();
+    } else {
+        m_timer.start(wordTime(), Qt::PreciseTimer, this);
+    }
     m_state = QTextToSpeech::Speaking;
     emit stateChanged(m_state);
 }
 
+void QTextToSpeechEngineMock::appendUtterance(const QString &text)
+{
+    Q_ASSERT(m_state == QTextToSpeech::Speaking);
+    m_nextText = text;
+    emit wordTimeline(wordBoundaries(text));
+}
+
 void QTextToSpeechEngineMock::synthesize(const QString &text)
 {
     m_text = text;
     m_currentIndex = 0;
-    m_timer.start(wordTime(), Qt::PreciseTimer, this);
+    m_wordFrame = 0;
+    if (m_synthetic) {
+        prepareSyntheticText(false);
+        if (!m_throttled)
+            scheduleSyntheticChunk();
+    } else if (!m_throttled) {
+        m_timer.start(wordTime(), Qt::PreciseTimer, this);
+    }
     m_state = QTextToSpeech::Synthesizing;
     emit stateChanged(m_state);
-
-    m_format.setSampleRate(22050);
-    m_format.setChannelConfig(QAudioFormat::ChannelConfigMono);
-    m_format.setSampleFormat(QAudioFormat::Int16);
+    emit wordTimeline(wordBoundaries(text));
 }
 
 void QTextToSpeechEngineMock::stop(QTextToSpeech::BoundaryHint boundaryHint)
@@ -135,10 +166,13 @@ void QTextToSpeechEngineMock::stop(QTextToSpeech::BoundaryHint boundaryHint)
     if (m_state == QTextToSpeech::Ready || m_state == QTextToSpeech::Error)
         return;
 
-    Q_ASSERT(m_state == QTextToSpeech::Paused || m_timer.isActive());
+    Q_ASSERT(m_state == QTextToSpeech::Paused || m_throttled || m_timer.isActive());
     // finish immediately
     m_text.clear();
+    m_nextText.clear();
+    m_nextTextStarting = false;
     m_currentIndex = -1;
+    m_words.clear();
     m_timer.stop();
 
     m_state = QTextToSpeech::Ready;
@@ -160,11 +194,40 @@ void QTextToSpeechEngineMock::resume()
     if (m_state != QTextToSpeech::Paused)
         return;
 
-    m_timer.start(wordTime(), Qt::PreciseTimer, this);
+    if (m_synthetic) {
+        // chunks that would have been due during the pause aren't caught up
+        m_due = qMax(m_due, double(m_clock.elapsed()));
+        scheduleSyntheticChunk();
+    } else {
+        m_timer.start(wordTime(), Qt::PreciseTimer, this);
+    }
     m_state = QTextToSpeech::Speaking;
     emit stateChanged(m_state);
 }
 
+void QTextToSpeechEngineMock::setSynthesisThrottled(bool throttled)
+{
+    m_throttled = throttled;
+    if (m_state != QTextToSpeech::Synthesizing)
+        return;
+
+    if (m_throttled) {
+        m_timer.stop();
+    } else if (!m_timer.isActive()) {
+        if (m_synthetic) {
+            m_due = qMax(m_due, double(m_clock.elapsed()));
+            scheduleSyntheticChunk();
+        } else {
+            m_timer.start(wordTime(), Qt::PreciseTimer, this);
+        }
+    }
+}
+
+void QTextToSpeechEngineMock::setPhonemeEventsEnabled(bool enabled)
+{
+    m_phonemeEventsEnabled = enabled;
+}
+
 void QTextToSpeechEngineMock::timerEvent(QTimerEvent *e)
 {
     if (e->timerId() != m_timer.timerId()) {
@@ -172,20 +235,57 @@ void QTextToSpeechEngineMock::timerEvent(QTimerEvent *e)
         return;
     }
 
+    if (m_synthetic) {
+        produceSyntheticChunks();
+        return;
+    }
+
     Q_ASSERT(m_state == QTextToSpeech::Speaking || m_state == QTextToSpeech::Synthesizing);
     Q_ASSERT(m_text.length());
 
+    if (m_nextTextStarting) {
+        m_nextTextStarting = false;
+        emit utteranceStarted();
+    }
+
     // Find start of next word, skipping punctuations. This is good enough for testing.
+    static const QRegularExpression nonWord(u"\\W+"_s);
     QRegularExpressionMatch match;
-    qsizetype nextSpace = m_text.indexOf(QRegularExpression(u"\\W+"_s), m_currentIndex, &match);
+    qsizetype nextSpace = m_text.indexOf(nonWord, m_currentIndex, &match);
     if (nextSpace == -1)
         nextSpace = m_text.length();
     const QString word = m_text.sliced(m_currentIndex, nextSpace - m_currentIndex);
     sayingWord(word, m_currentIndex, nextSpace - m_currentIndex);
     m_currentIndex = nextSpace + match.captured().length();
 
+    if (m_phonemeEventsEnabled) {
+        QList<QTextToSpeech::Phoneme> phonemes;
+        appendPhonemes(phonemes, word, m_wordFrame, m_format.framesForDuration(wordTime() * 1000));
+        emit phonemeEvents(phonemes);
+    }
+    m_wordFrame += m_format.framesForDuration(wordTime() * 1000);
+
     emit synthesized(m_format, QByteArray(m_format.bytesForDuration(wordTime() * 1000), 0));
 
+    // in gapless mode, ask for the next text and continue with it
+    if (m_currentIndex >= m_text.length() && m_state == QTextToSpeech::Speaking
+        && m_parameters[u"gapless"_s].toBool()) {
+        emit readyForNextUtterance();
+        if (!m_nextText.isEmpty()) {
+            m_text = std::exchange(m_nextText, {});
+            m_currentIndex = 0;
+            m_wordFrame = 0;
+            m_nextTextStarting = true;
+            // like an engine that can't append, and restarts its output
+            if (m_parameters[u"gaplessRestart"_s].toBool()) {
+                m_state = QTextToSpeech::Ready;
+                emit stateChanged(m_state);
+                m_state = QTextToSpeech::Speaking;
+                emit stateChanged(m_state);
+            }
+        }
+    }
+
     if (m_currentIndex >= m_text.length()) {
         // done speaking all words
         m_timer.stop();
@@ -200,6 +300,153 @@ void QTextToSpeechEngineMock::timerEvent(QTimerEvent *e)
     m_pauseRequested = false;
 }
 
+QList<QTextToSpeech::WordBoundary> QTextToSpeechEngineMock::wordBoundaries(const QString &text) const
+{
+    static const QRegularExpression word(u"\\w+"_s);
+    const qint64 framesPerWord = m_format.framesForDuration(wordTime() * 1000);
+    QList<QTextToSpeech::WordBoundary> words;
+    for (auto it = word.globalMatch(text); it.hasNext();) {
+        const QRegularExpressionMatch match = it.next();
+        words.append({match.capturedStart(), match.capturedLength(),
+                      words.size() * wordTime(), words.size() * framesPerWord});
+    }
+    return words;
+}
+
+/*
+    Appends a phoneme for each letter of the \a word, which all get the same
+    share of its \a frames. The names are created once, and then shared.
+*/
+void QTextToSpeechEngineMock::appendPhonemes(QList<QTextToSpeech::Phoneme> &phonemes,
+                                             QStringView word, qint64 frame, qint64 frames) const
+{
+    static const QStringList names = []{
+        QStringList result;
+        for (char16_t letter = u'a'; letter <= u'z'; ++letter)
+            result << QString(QChar(letter));
+        result << u"?"_s;
+        return result;
+    }();
+    if (word.isEmpty())
+        return;
+    const qint64 duration = frames / word.size();
+    for (qsizetype i = 0; i < word.size(); ++i) {
+        const char16_t letter = word.at(i).toLower().unicode();
+        const QString &name = letter >= u'a' && letter <= u'z' ? names.at(letter - u'a')
+                                                               : names.last();
+        phonemes.append({name, frame + i * duration, duration});
+    }
+}
+
+/*
+    Finds the words of the text once; each word gets the same number of
+    audio frames.
+*/
+void QTextToSpeechEngineMock::prepareSyntheticText(bool continuing)
+{
+    m_words = wordBoundaries(m_text);
+    m_framesPerWord = m_format.framesForDuration(wordTime() * 1000);
+    m_totalFrames = m_words.size() * m_framesPerWord;
+    m_nextWord = 0;
+    m_frame = 0;
+
+    // a text that continues the playing stream doesn't have the latency
+    if (!continuing) {
+        m_clock.start();
+        m_due = m_latency;
+    }
+    drawJitter();
+}
+
+/*
+    The jitter delays only the next chunk. It is not added to m_due, so that
+    the schedule doesn't drift from the real-time factor over a long text.
+*/
+void QTextToSpeechEngineMock::drawJitter()
+{
+    m_jitterDelay = m_jitter ? m_random.bounded(m_jitter + 1) : 0;
+}
+
+void QTextToSpeechEngineMock::scheduleSyntheticChunk()
+{
+    const qint64 delay = qMax(qint64(0), qint64(m_due + m_jitterDelay) - m_clock.elapsed());
+    m_timer.start(int(delay), Qt::PreciseTimer, this);
+}
+
+/*
+    Emits all chunks that are due. With a real-time factor of 0, that is the
+    entire text, unless the engine gets throttled, paused or stopped by a
+    connected slot.
+*/
+void QTextToSpeechEngineMock::produceSyntheticChunks()
+{
+    const QTextToSpeech::State state = m_state;
+    Q_ASSERT(state == QTextToSpeech::Speaking || state == QTextToSpeech::Synthesizing);
+
+    while (m_state == state && !m_throttled && m_due + m_jitterDelay <= m_clock.elapsed()) {
+        if (m_nextTextStarting) {
+            m_nextTextStarting = false;
+            emit utteranceStarted();
+        }
+
+        const qint64 end = qMin(m_frame + m_chunkFrames, m_totalFrames);
+        QList<QTextToSpeech::Phoneme> phonemes;
+        while (m_state == state && m_nextWord < m_words.size()
+               && m_nextWord * m_framesPerWord < end) {
+            const QTextToSpeech::WordBoundary &word = m_words.at(m_nextWord++);
+            const QString text = m_text.sliced(word.start, word.length);
+            emit sayingWord(text, word.start, word.length);
+            if (m_phonemeEventsEnabled)
+                appendPhonemes(phonemes, text, word.frame, m_framesPerWord);
+        }
+        if (m_state != state)
+            return;
+        if (!phonemes.isEmpty())
+            emit phonemeEvents(phonemes);
+        if (m_state != state)
+            return;
+
+        if (end > m_frame) {
+            const qint64 frames = end - m_frame;
+            emit synthesized(m_format, frames == m_chunkFrames
+                                       ? m_silence
+                                       : m_silence.first(m_format.bytesForFrames(frames)));
+            m_due += m_format.durationForFrames(frames) * m_realTimeFactor / 1000.0;
+            drawJitter();
+        }
+        m_frame = end;
+        if (m_state != state)
+            return;
+
+        if (m_frame >= m_totalFrames) {
+            // in gapless mode, ask for the next text and continue with it
+            if (m_state == QTextToSpeech::Speaking && m_parameters[u"gapless"_s].toBool()) {
+                emit readyForNextUtterance();
+                if (!m_nextText.isEmpty()) {
+                    m_text = std::exchange(m_nextText, {});
+                    m_nextTextStarting = true;
+                    prepareSyntheticText(true);
+                    continue;
+                }
+            }
+            m_timer.stop();
+            m_state = QTextToSpeech::Ready;
+            m_currentIndex = -1;
+            emit stateChanged(m_state);
+            return;
+        }
+        if (std::exchange(m_pauseRequested, false)) {
+            m_timer.stop();
+            m_state = QTextToSpeech::Paused;
+            emit stateChanged(m_state);
+            return;
+        }
+    }
+
+    if (m_state == state && !m_throttled)
+        scheduleSyntheticChunk();
+}
+
 double QTextToSpeechEngineMock::rate() const
 {
     return m_rate;
@@ -208,7 +455,8 @@ double QTextToSpeechEngineMock::rate() const
 bool QTextToSpeechEngineMock::setRate(double rate)
 {
     m_rate = rate;
-    if (m_timer.isActive()) {
+    // synthetic mode applies the rate to the next text
+    if (m_timer.isActive() && !m_synthetic) {
         m_timer.stop();
         m_timer.start(wordTime(), Qt::PreciseTimer, this);
     }
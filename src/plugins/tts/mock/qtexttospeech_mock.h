@@ -6,6 +6,8 @@
 
 #include "qtexttospeechengine.h"
 #include <QtCore/QBasicTimer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QRandomGenerator>
 
 QT_BEGIN_NAMESPACE
 
@@ -21,10 +23,13 @@ public:
     QList<QVoice> availableVoices() const override;
 
     void say(const QString &text) override;
+    void appendUtterance(const QString &text) override;
     void synthesize(const QString &text) override;
     void stop(QTextToSpeech::BoundaryHint boundaryHint) override;
     void pause(QTextToSpeech::BoundaryHint boundaryHint) override;
     void resume() override;
+    void setSynthesisThrottled(bool throttled) override;
+    void setPhonemeEventsEnabled(bool enabled) override;
 
     double rate() const override;
     bool setRate(double rate) override;
@@ -47,6 +52,14 @@ private:
     // mock engine uses 100ms per word, +/- 50ms depending on rate
     int wordTime() const { return 100 - int(50.0 * m_rate); }
 
+    QList<QTextToSpeech::WordBoundary> wordBoundaries(const QString &text) const;
+    void appendPhonemes(QList<QTextToSpeech::Phoneme> &phonemes, QStringView word,
+                        qint64 frame, qint64 frames) const;
+    void prepareSyntheticText(bool continuing);
+    void drawJitter();
+    void scheduleSyntheticChunk();
+    void produceSyntheticChunks();
+
     const QVariantMap m_parameters;
     QString m_text;
     QLocale m_locale;
@@ -59,8 +72,32 @@ private:
     QTextToSpeech::ErrorReason m_errorReason = QTextToSpeech::ErrorReason::Initialization;
     QString m_errorString;
     bool m_pauseRequested = false;
+    bool m_throttled = false;
     qsizetype m_currentIndex = -1;
+    QString m_nextText;
+    bool m_nextTextStarting = false;
     QAudioFormat m_format;
+    // one phoneme per letter
+    bool m_phonemeEventsEnabled = false;
+    qint64 m_wordFrame = 0;
+
+    // In synthetic mode, audio is produced in chunks that are due according
+    // to the real-time factor, instead of one timer tick per word.
+    bool m_synthetic = false;
+    double m_realTimeFactor = 0;
+    qint64 m_chunkFrames = 1024;
+    int m_latency = 0;
+    int m_jitter = 0;
+    QRandomGenerator m_random;
+    QElapsedTimer m_clock;
+    double m_due = 0; // ms on m_clock when the next chunk is due, without jitter
+    int m_jitterDelay = 0; // ms that the next chunk is late
+    QList<QTextToSpeech::WordBoundary> m_words;
+    qint64 m_framesPerWord = 0;
+    qsizetype m_nextWord = 0;
+    qint64 m_frame = 0;
+    qint64 m_totalFrames = 0;
+    QByteArray m_silence;
 };
 
 QT_END_NAMESPACE
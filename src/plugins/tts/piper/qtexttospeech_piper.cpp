@@ -0,0 +1,275 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include "qtexttospeech_piper.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QStandardPaths>
+
+QT_BEGIN_NAMESPACE
+
+using namespace Qt::StringLiterals;
+
+QTextToSpeechEnginePiper::QTextToSpeechEnginePiper(const QVariantMap &parameters, QObject *parent)
+    : QTextToSpeechEngine(parent)
+{
+    QAudioDevice audioDevice;
+    if (const auto it = parameters.find("audioDevice"_L1); it != parameters.end())
+        audioDevice = (*it).value<QAudioDevice>();
+    else
+        audioDevice = QMediaDevices::defaultAudioOutput();
+
+    if (audioDevice.isNull()) {
+        m_errorReason = QTextToSpeech::ErrorReason::Playback;
+        m_errorString = QCoreApplication::translate("QTextToSpeech", "No audio device available");
+    }
+    QStringList voicePaths;
+    if (const auto it = parameters.find("voicePath"_L1); it != parameters.end()) {
+        voicePaths = (*it).toStringList();
+    } else {
+        voicePaths = QStandardPaths::locateAll(QStandardPaths::GenericDataLocation,
+                                               u"piper-voices"_s, QStandardPaths::LocateDirectory);
+    }
+    m_batchSize = qMax(1, parameters.value("batchSize"_L1, m_batchSize).toInt());
+
+    m_processor.reset(new QTextToSpeechProcessorPiper(audioDevice, voicePaths));
+    m_processor->setInferenceOptions(parameters.value("intraOpThreads"_L1, 1).toInt(), m_batchSize);
+
+    // Connect processor to engine for state changes and error
+    connect(m_processor.get(), &QTextToSpeechProcessorPiper::stateChanged,
+            this, &QTextToSpeechEnginePiper::changeState);
+    connect(m_processor.get(), &QTextToSpeechProcessorPiper::errorOccurred, this,
+            &QTextToSpeechEnginePiper::setError);
+    connect(m_processor.get(), &QTextToSpeechProcessorPiper::readyForNextUtterance, this,
+            &QTextToSpeechEnginePiper::requestNextUtterances);
+    connect(m_processor.get(), &QTextToSpeechProcessorPiper::utteranceStarted, this,
+            &QTextToSpeechEngine::utteranceStarted);
+    connect(m_processor.get(), &QTextToSpeechProcessorPiper::synthesized, this,
+            &QTextToSpeechEngine::synthesized);
+
+    // Read voices from processor before moving it to a separate thread
+    const QList<QTextToSpeechProcessorPiper::VoiceInfo> voices = m_processor->voices();
+
+    int voiceIndex = 0;
+    for (const QTextToSpeechProcessorPiper::VoiceInfo &voiceInfo : voices) {
+        const QLocale locale(voiceInfo.locale);
+        const QVoice voice = QTextToSpeechEngine::createVoice(voiceInfo.name, locale,
+                                                              voiceInfo.gender, voiceInfo.age,
+                                                              QVariant(voiceInfo.id));
+        m_voices.insert(locale, voice);
+        // Use the first available locale/voice as a fallback
+        if (voiceIndex == 0)
+            m_voice = voice;
+        ++voiceIndex;
+    }
+
+    if (!m_processor->isInitialized()) {
+        m_errorReason = QTextToSpeech::ErrorReason::Initialization;
+        m_errorString = QCoreApplication::translate("QTextToSpeech", "Could not initialize espeak-ng or ONNX Runtime");
+    } else if (voiceIndex) {
+        m_state = QTextToSpeech::Ready;
+        m_processor->moveToThread(&m_thread);
+        m_thread.start();
+    } else {
+        m_errorReason = QTextToSpeech::ErrorReason::Configuration;
+        m_errorString = QCoreApplication::translate("QTextToSpeech", "No voices available");
+    }
+}
+
+QTextToSpeechEnginePiper::~QTextToSpeechEnginePiper()
+{
+    // release a processor thread that is waiting for the consumer
+    m_processor->setThrottled(false);
+    m_processor->cancel();
+    m_thread.exit();
+    m_thread.wait();
+}
+
+QList<QLocale> QTextToSpeechEnginePiper::availableLocales() const
+{
+    return m_voices.uniqueKeys();
+}
+
+QList<QVoice> QTextToSpeechEnginePiper::availableVoices() const
+{
+    return m_voices.values(m_voice.locale());
+}
+
+void QTextToSpeechEnginePiper::say(const QString &text)
+{
+    m_nextUtterances.clear();
+    QMetaObject::invokeMethod(m_processor.get(), "say", Qt::QueuedConnection, Q_ARG(QString, text),
+                              Q_ARG(int, voiceData(voice()).toInt()), Q_ARG(double, rate()),
+                              Q_ARG(double, volume()));
+}
+
+void QTextToSpeechEnginePiper::appendUtterance(const QString &text)
+{
+    m_nextUtterances.append(text);
+}
+
+/*
+    Called when the processor has decoded all sentences it has. Collects up
+    to m_batchSize queued texts, so that their sentences are decoded together.
+*/
+void QTextToSpeechEnginePiper::requestNextUtterances()
+{
+    for (int i = 0; i < m_batchSize; ++i) {
+        const qsizetype count = m_nextUtterances.size();
+        emit readyForNextUtterance();
+        if (m_nextUtterances.size() == count)
+            break;
+    }
+    if (m_nextUtterances.isEmpty())
+        return;
+
+    QMetaObject::invokeMethod(m_processor.get(), "sayNext", Qt::QueuedConnection,
+                              Q_ARG(QStringList, std::exchange(m_nextUtterances, {})),
+                              Q_ARG(int, voiceData(voice()).toInt()), Q_ARG(double, rate()),
+                              Q_ARG(double, volume()));
+}
+
+void QTextToSpeechEnginePiper::synthesize(const QString &text)
+{
+    QMetaObject::invokeMethod(m_processor.get(), "synthesize", Qt::QueuedConnection, Q_ARG(QString, text),
+                              Q_ARG(int, voiceData(voice()).toInt()), Q_ARG(double, rate()),
+                              Q_ARG(double, volume()));
+}
+
+void QTextToSpeechEnginePiper::stop(QTextToSpeech::BoundaryHint boundaryHint)
+{
+    Q_UNUSED(boundaryHint);
+    // skip the remaining batches
+    m_nextUtterances.clear();
+    m_processor->setThrottled(false);
+    m_processor->cancel();
+    QMetaObject::invokeMethod(m_processor.get(), &QTextToSpeechProcessorPiper::stop, Qt::QueuedConnection);
+}
+
+void QTextToSpeechEnginePiper::pause(QTextToSpeech::BoundaryHint boundaryHint)
+{
+    Q_UNUSED(boundaryHint);
+    QMetaObject::invokeMethod(m_processor.get(), &QTextToSpeechProcessorPiper::pause, Qt::QueuedConnection);
+}
+
+void QTextToSpeechEnginePiper::resume()
+{
+    QMetaObject::invokeMethod(m_processor.get(), &QTextToSpeechProcessorPiper::resume, Qt::QueuedConnection);
+}
+
+void QTextToSpeechEnginePiper::setSynthesisThrottled(bool throttled)
+{
+    // called directly, as the processor thread might be blocked
+    m_processor->setThrottled(throttled);
+}
+
+void QTextToSpeechEnginePiper::setAudioFilterChain(QTextToSpeechAudioFilterChain *chain)
+{
+    // set before the processor receives the first utterance
+    m_processor->setAudioFilterChain(chain);
+}
+
+double QTextToSpeechEnginePiper::rate() const
+{
+    return m_rate;
+}
+
+bool QTextToSpeechEnginePiper::setRate(double rate)
+{
+    if (m_rate == rate)
+        return false;
+
+    m_rate = rate;
+    return true;
+}
+
+double QTextToSpeechEnginePiper::pitch() const
+{
+    return m_pitch;
+}
+
+bool QTextToSpeechEnginePiper::setPitch(double pitch)
+{
+    // the models don't have a pitch parameter
+    Q_UNUSED(pitch);
+    return false;
+}
+
+QLocale QTextToSpeechEnginePiper::locale() const
+{
+    return m_voice.locale();
+}
+
+bool QTextToSpeechEnginePiper::setLocale(const QLocale &locale)
+{
+    const auto &voices = m_voices.values(locale);
+    if (voices.isEmpty())
+        return false;
+    // The list returned by QMultiHash::values is reversed
+    setVoice(voices.last());
+    return true;
+}
+
+double QTextToSpeechEnginePiper::volume() const
+{
+    return m_volume;
+}
+
+bool QTextToSpeechEnginePiper::setVolume(double volume)
+{
+    if (m_volume == volume)
+        return false;
+
+    m_volume = volume;
+    return true;
+}
+
+QVoice QTextToSpeechEnginePiper::voice() const
+{
+    return m_voice;
+}
+
+bool QTextToSpeechEnginePiper::setVoice(const QVoice &voice)
+{
+    QLocale locale = m_voices.key(voice); // returns default locale if not found, so
+    if (!m_voices.contains(locale, voice)) {
+        qWarning() << "Voice" << voice << "is not supported by this engine";
+        return false;
+    }
+
+    m_voice = voice;
+    return true;
+}
+
+void QTextToSpeechEnginePiper::changeState(QTextToSpeech::State newState)
+{
+    if (newState != m_state) {
+        m_state = newState;
+        emit stateChanged(newState);
+    }
+}
+
+QTextToSpeech::State QTextToSpeechEnginePiper::state() const
+{
+    return m_state;
+}
+
+QTextToSpeech::ErrorReason QTextToSpeechEnginePiper::errorReason() const
+{
+    return m_errorReason;
+}
+
+QString QTextToSpeechEnginePiper::errorString() const
+{
+    return m_errorString;
+}
+
+void QTextToSpeechEnginePiper::setError(QTextToSpeech::ErrorReason error, const QString &errorString)
+{
+    m_errorReason = error;
+    m_errorString = errorString;
+    changeState(QTextToSpeech::Error);
+    emit errorOccurred(error, errorString);
+}
+
+QT_END_NAMESPACE
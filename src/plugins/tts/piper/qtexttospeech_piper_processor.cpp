@@ -0,0 +1,704 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include "qtexttospeech_piper_processor.h"
+#include "qtexttospeech_piper_plugin.h"
+
+#include <QtTextToSpeech/private/qtexttospeechsharedlibrary_p.h>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDirIterator>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QLocale>
+#include <QtCore/QThread>
+
+#include <espeak-ng/speak_lib.h>
+#include <onnxruntime_cxx_api.h>
+
+#include <array>
+#include <cmath>
+#include <vector>
+
+QT_BEGIN_NAMESPACE
+
+using namespace Qt::StringLiterals;
+
+namespace {
+// espeak-ng converts the text to phonemes. The library has global state, so
+// all processors take turns, also with the espeakng engine.
+QTextToSpeechSharedLibrary *espeakLibrary()
+{
+    return QTextToSpeechSharedLibrary::instance("espeak-ng");
+}
+} // namespace
+
+QTextToSpeechProcessorPiper::QTextToSpeechProcessorPiper(const QAudioDevice &audioDevice,
+                                                         const QStringList &voicePaths)
+    : m_audioDevice(audioDevice)
+{
+    m_format.setSampleFormat(QAudioFormat::Int16);
+    m_format.setChannelConfig(QAudioFormat::ChannelConfigMono);
+
+    m_espeakInitialized = espeakLibrary()->ref([]{
+        return espeak_Initialize(AUDIO_OUTPUT_SYNCHRONOUS, 0, nullptr, espeakINITIALIZE_DONT_EXIT);
+    }) > 0;
+    if (!m_espeakInitialized) {
+        qCWarning(lcSpeechTtsPiper) << "Could not initialize espeak-ng";
+        return;
+    }
+    try {
+        m_env = std::make_unique<Ort::Env>(ORT_LOGGING_LEVEL_WARNING, "qtexttospeech_piper");
+    } catch (const Ort::Exception &e) {
+        qCWarning(lcSpeechTtsPiper) << "Could not initialize ONNX Runtime:" << e.what();
+        return;
+    }
+    m_initialized = true;
+    findVoices(voicePaths);
+}
+
+QTextToSpeechProcessorPiper::~QTextToSpeechProcessorPiper()
+{
+    if (m_espeakInitialized)
+        espeakLibrary()->deref([]{ espeak_Terminate(); });
+    if (m_audioSamples) {
+        qCDebug(lcSpeechTtsPiper) << "Overall real-time factor"
+                                  << m_inferenceNSecs / 1e9 / (double(m_audioSamples) / m_format.sampleRate());
+    }
+}
+
+const QList<QTextToSpeechProcessorPiper::VoiceInfo> &QTextToSpeechProcessorPiper::voices() const
+{
+    return m_voices;
+}
+
+void QTextToSpeechProcessorPiper::setInferenceOptions(int intraOpThreads, int batchSize)
+{
+    m_intraOpThreads = qMax(0, intraOpThreads);
+    m_batchSize = qMax(1, batchSize);
+}
+
+/*
+    A Piper voice is a model file like "en_US-lessac-medium.onnx", with its
+    configuration in "en_US-lessac-medium.onnx.json". Models with several
+    speakers provide one voice per speaker.
+*/
+void QTextToSpeechProcessorPiper::findVoices(const QStringList &voicePaths)
+{
+    for (const QString &voicePath : voicePaths) {
+        QDirIterator it(voicePath, {u"*.onnx"_s}, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            const QString modelPath = it.next();
+            QFile configFile(modelPath + ".json"_L1);
+            if (!configFile.open(QIODevice::ReadOnly))
+                continue;
+            const QJsonObject config = QJsonDocument::fromJson(configFile.readAll()).object();
+            QString language = config["language"_L1]["code"_L1].toString();
+            if (language.isEmpty())
+                language = config["espeak"_L1]["voice"_L1].toString();
+            const QLocale locale(language);
+            if (locale.language() == QLocale::C) {
+                qCDebug(lcSpeechTtsPiper) << "Skipping voice without language" << modelPath;
+                continue;
+            }
+
+            QString name = config["dataset"_L1].toString();
+            if (name.isEmpty())
+                name = QFileInfo(modelPath).completeBaseName();
+            const QJsonObject speakers = config["speaker_id_map"_L1].toObject();
+            if (config["num_speakers"_L1].toInt(1) > 1 && !speakers.isEmpty()) {
+                for (auto speaker = speakers.begin(); speaker != speakers.end(); ++speaker) {
+                    m_voices.append(VoiceInfo{int(m_voices.size()), name + u' ' + speaker.key(),
+                                              locale.name(), modelPath,
+                                              speaker.value().toInteger()});
+                }
+            } else {
+                m_voices.append(VoiceInfo{int(m_voices.size()), name, locale.name(), modelPath, 0});
+            }
+        }
+    }
+    qCDebug(lcSpeechTtsPiper) << "Found" << m_voices.size() << "voices in" << voicePaths;
+}
+
+// Only the model of the current voice is kept in memory
+bool QTextToSpeechProcessorPiper::loadModel(const VoiceInfo &voice)
+{
+    if (m_model.session && m_model.path == voice.modelPath)
+        return true;
+
+    const auto configurationError = [this, &voice]{
+        setError(QTextToSpeech::ErrorReason::Configuration,
+                 QCoreApplication::translate("QTextToSpeech", "Invalid voice configuration %1.")
+                    .arg(voice.modelPath + ".json"_L1));
+        return false;
+    };
+
+    QFile configFile(voice.modelPath + ".json"_L1);
+    if (!configFile.open(QIODevice::ReadOnly))
+        return configurationError();
+    const QJsonObject config = QJsonDocument::fromJson(configFile.readAll()).object();
+
+    Model model;
+    model.path = voice.modelPath;
+    model.espeakVoice = config["espeak"_L1]["voice"_L1].toString();
+    model.sampleRate = config["audio"_L1]["sample_rate"_L1].toInt(model.sampleRate);
+    model.speakerCount = config["num_speakers"_L1].toInt(model.speakerCount);
+    const QJsonValue inference = config["inference"_L1];
+    model.noiseScale = inference["noise_scale"_L1].toDouble(model.noiseScale);
+    model.lengthScale = inference["length_scale"_L1].toDouble(model.lengthScale);
+    model.noiseW = inference["noise_w"_L1].toDouble(model.noiseW);
+
+    const QJsonObject idMap = config["phoneme_id_map"_L1].toObject();
+    for (auto it = idMap.begin(); it != idMap.end(); ++it) {
+        const QList<uint> phoneme = it.key().toUcs4();
+        if (phoneme.size() != 1)
+            continue;
+        QList<qint64> ids;
+        const QJsonArray values = it.value().toArray();
+        for (const QJsonValue &value : values)
+            ids.append(value.toInteger());
+        model.phonemeIds.insert(phoneme.first(), ids);
+    }
+    if (model.espeakVoice.isEmpty() || model.phonemeIds.isEmpty() || model.sampleRate <= 0)
+        return configurationError();
+
+    QElapsedTimer timer;
+    timer.start();
+    try {
+        Ort::SessionOptions options;
+        options.SetIntraOpNumThreads(m_intraOpThreads);
+        options.SetInterOpNumThreads(1);
+        options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+#ifdef Q_OS_WIN
+        const auto path = reinterpret_cast<const wchar_t *>(voice.modelPath.utf16());
+#else
+        const QByteArray encodedPath = QFile::encodeName(voice.modelPath);
+        const char *path = encodedPath.constData();
+#endif
+        // release the previous model first, models are large
+        m_model = Model();
+        model.session = std::make_unique<Ort::Session>(*m_env, path, options);
+    } catch (const Ort::Exception &e) {
+        setError(QTextToSpeech::ErrorReason::Configuration,
+                 QCoreApplication::translate("QTextToSpeech", "Could not load voice model: %1")
+                    .arg(QString::fromUtf8(e.what())));
+        return false;
+    }
+    qCDebug(lcSpeechTtsPiper) << "Loaded" << voice.modelPath << "in" << timer.elapsed() << "ms";
+
+    m_model = std::move(model);
+    return true;
+}
+
+bool QTextToSpeechProcessorPiper::enqueueText(const QString &text, int voiceId, double rate,
+                                              double volume, bool startsUtterance)
+{
+    if (voiceId < 0 || voiceId >= m_voices.size()) {
+        setError(QTextToSpeech::ErrorReason::Configuration,
+                 QCoreApplication::translate("QTextToSpeech", "Invalid voiceId %1.").arg(voiceId));
+        return false;
+    }
+    if (!loadModel(m_voices.at(voiceId)))
+        return false;
+
+    // rate 1 speaks twice as fast, rate -1 half as fast
+    const double lengthScale = m_model.lengthScale * std::pow(2.0, -rate);
+    const auto makeSentence = [&](QList<qint64> &&ids) {
+        return Sentence{voiceId, std::exchange(startsUtterance, false), lengthScale,
+                        float(volume), std::move(ids)};
+    };
+
+    QMutexLocker locker(espeakLibrary()->mutex());
+    if (espeak_SetVoiceByName(m_model.espeakVoice.toUtf8().constData()) != EE_OK) {
+        setError(QTextToSpeech::ErrorReason::Configuration,
+                 QCoreApplication::translate("QTextToSpeech", "No espeak-ng voice for %1.")
+                    .arg(m_model.espeakVoice));
+        return false;
+    }
+
+    // espeak-ng converts one clause at a time; clauses are joined to sentences,
+    // which are the unit in which the model is run.
+    const QByteArray utf8 = text.toUtf8();
+    const void *position = utf8.constData();
+    QString phonemes;
+    while (position) {
+        const char *clauseStart = static_cast<const char *>(position);
+        phonemes += QString::fromUtf8(espeak_TextToPhonemes(&position, espeakCHARS_UTF8,
+                                                            espeakPHONEMES_IPA));
+        const char *clauseEnd = position ? static_cast<const char *>(position) : utf8.constEnd();
+        const QByteArrayView clause = QByteArrayView(clauseStart, clauseEnd).trimmed();
+        if (position && !clause.isEmpty() && !QByteArrayView(".!?").contains(clause.back())) {
+            phonemes += u' ';
+            continue;
+        }
+        if (!phonemes.trimmed().isEmpty())
+            m_sentences.enqueue(makeSentence(toPhonemeIds(phonemes)));
+        phonemes.clear();
+    }
+    // a text without anything to say still starts an utterance
+    if (startsUtterance)
+        m_sentences.enqueue(makeSentence({}));
+    return true;
+}
+
+// The model expects a phoneme id after each phoneme, between begin and end markers
+QList<qint64> QTextToSpeechProcessorPiper::toPhonemeIds(QStringView phonemes) const
+{
+    QList<qint64> ids;
+    const auto append = [this, &ids](char32_t phoneme) {
+        const auto it = m_model.phonemeIds.constFind(phoneme);
+        if (it == m_model.phonemeIds.constEnd())
+            return false;
+        ids.append(*it);
+        return true;
+    };
+
+    append(U'^');
+    append(U'_');
+    for (const uint phoneme : phonemes.toUcs4()) {
+        if (append(phoneme))
+            append(U'_');
+    }
+    append(U'$');
+    return ids;
+}
+
+void QTextToSpeechProcessorPiper::scheduleNextBatch()
+{
+    if (m_batchTimer.isActive())
+        return;
+    // One batch per event loop iteration, so that stop and pause are handled
+    // in between. Decoding doesn't get further ahead of the playback than
+    // necessary, so that there's no work to throw away when stopping.
+    qint64 delay = 0;
+    if (m_output == Output::Speaker && m_audioBuffer) {
+        const qint64 buffered = m_streamSamples * 1000 / m_format.sampleRate()
+                              - m_audioSink->processedUSecs() / 1000;
+        delay = qMax(buffered - MaximumLead, qint64(0));
+    }
+    m_batchTimer.start(int(delay), this);
+}
+
+void QTextToSpeechProcessorPiper::processNextBatch()
+{
+    // resume() continues
+    if (m_cancelled.loadRelaxed() || m_state == QAudio::SuspendedState)
+        return;
+
+    // texts without sentences
+    while (!m_sentences.isEmpty() && m_sentences.head().phonemeIds.isEmpty()) {
+        m_sentences.dequeue();
+        if (m_output == Output::Speaker && m_audioBuffer) {
+            m_utteranceStarts.enqueue(m_streamSamples * 1000 / m_format.sampleRate());
+            if (!m_utteranceTimer.isActive())
+                startUtteranceTimer();
+        }
+    }
+
+    if (m_sentences.isEmpty()) {
+        if (m_output == Output::Speaker) {
+            // the sink becomes idle once the written data has been played,
+            // unless more text is appended in the meantime
+            emit readyForNextUtterance();
+        } else {
+            emit stateChanged(QTextToSpeech::Ready);
+        }
+        return;
+    }
+
+    // sentences decoded together have to use the same voice and rate
+    const Sentence &head = m_sentences.head();
+    const qsizetype limit = std::exchange(m_firstBatch, false) ? 1 : m_batchSize;
+    qsizetype count = 1;
+    while (count < limit && count < m_sentences.size()) {
+        const Sentence &sentence = m_sentences.at(count);
+        if (sentence.voiceId != head.voiceId || sentence.lengthScale != head.lengthScale
+            || sentence.phonemeIds.isEmpty()) {
+            break;
+        }
+        ++count;
+    }
+
+    if (!loadModel(m_voices.at(head.voiceId))) {
+        clear();
+        return;
+    }
+    if (m_output == Output::Speaker) {
+        // a different sample rate restarts the audio output
+        if (!m_audioBuffer || m_format.sampleRate() != m_model.sampleRate) {
+            m_format.setSampleRate(m_model.sampleRate);
+            if (!initAudio()) {
+                clear();
+                return;
+            }
+        }
+    } else {
+        m_format.setSampleRate(m_model.sampleRate);
+    }
+
+    if (!infer(count)) {
+        clear();
+        if (m_output == Output::Speaker)
+            deinitAudio();
+        return;
+    }
+    scheduleNextBatch();
+}
+
+bool QTextToSpeechProcessorPiper::infer(qsizetype count)
+{
+    const VoiceInfo &voice = m_voices.at(m_sentences.head().voiceId);
+    const float lengthScale = m_sentences.head().lengthScale;
+    qsizetype maxLength = 0;
+    for (qsizetype i = 0; i < count; ++i)
+        maxLength = qMax(maxLength, m_sentences.at(i).phonemeIds.size());
+
+    const int64_t padId = m_model.phonemeIds.value(U'_').value(0, 0);
+    std::vector<int64_t> input(count * maxLength, padId);
+    std::vector<int64_t> lengths(count);
+    std::vector<int64_t> speakerIds(count, voice.speakerId);
+    for (qsizetype i = 0; i < count; ++i) {
+        const QList<qint64> &ids = m_sentences.at(i).phonemeIds;
+        std::copy(ids.cbegin(), ids.cend(), input.begin() + i * maxLength);
+        lengths[i] = ids.size();
+    }
+    std::array<float, 3> scales{m_model.noiseScale, lengthScale, m_model.noiseW};
+    const std::array<int64_t, 2> inputShape{int64_t(count), int64_t(maxLength)};
+    const std::array<int64_t, 1> batchShape{int64_t(count)};
+    const std::array<int64_t, 1> scalesShape{int64_t(scales.size())};
+
+    try {
+        const auto memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+        std::vector<Ort::Value> inputs;
+        std::vector<const char *> inputNames{"input", "input_lengths", "scales"};
+        inputs.push_back(Ort::Value::CreateTensor<int64_t>(memoryInfo, input.data(), input.size(),
+                                                           inputShape.data(), inputShape.size()));
+        inputs.push_back(Ort::Value::CreateTensor<int64_t>(memoryInfo, lengths.data(), lengths.size(),
+                                                           batchShape.data(), batchShape.size()));
+        inputs.push_back(Ort::Value::CreateTensor<float>(memoryInfo, scales.data(), scales.size(),
+                                                         scalesShape.data(), scalesShape.size()));
+        if (m_model.speakerCount > 1) {
+            inputNames.push_back("sid");
+            inputs.push_back(Ort::Value::CreateTensor<int64_t>(memoryInfo, speakerIds.data(),
+                                                               speakerIds.size(), batchShape.data(),
+                                                               batchShape.size()));
+        }
+        const char *outputNames[] = {"output"};
+
+        QElapsedTimer timer;
+        timer.start();
+        const std::vector<Ort::Value> outputs = m_model.session->Run(
+                Ort::RunOptions{nullptr}, inputNames.data(), inputs.data(), inputs.size(),
+                outputNames, 1);
+        const qint64 elapsed = timer.nsecsElapsed();
+
+        // the output has the shape [count, 1, samples], or [count, 1, 1, samples]
+        const std::vector<int64_t> shape = outputs.front().GetTensorTypeAndShapeInfo().GetShape();
+        const qsizetype samplesPerSentence = shape.empty() ? 0 : shape.back();
+        const float *audio = outputs.front().GetTensorData<float>();
+        qint64 batchSamples = 0;
+        for (qsizetype i = 0; i < count; ++i) {
+            const Sentence sentence = m_sentences.dequeue();
+            const qsizetype previousSamples = m_audioSamples;
+            writeAudio(sentence, audio + i * samplesPerSentence, samplesPerSentence);
+            batchSamples += m_audioSamples - previousSamples;
+            if (m_cancelled.loadRelaxed() || (m_output == Output::Speaker && !m_audioBuffer))
+                break;
+        }
+
+        m_inferenceNSecs += elapsed;
+        if (batchSamples) {
+            const double audioSecs = double(batchSamples) / m_model.sampleRate;
+            qCDebug(lcSpeechTtsPiper).nospace()
+                    << "Decoded " << count << " sentences, " << audioSecs << "s of audio in "
+                    << elapsed / 1e9 << "s, real-time factor " << elapsed / 1e9 / audioSecs
+                    << " (overall " << m_inferenceNSecs / 1e9 / (double(m_audioSamples) / m_model.sampleRate)
+                    << ")";
+        }
+    } catch (const Ort::Exception &e) {
+        setError(QTextToSpeech::ErrorReason::Input,
+                 QCoreApplication::translate("QTextToSpeech", "Speech synthesizing failure: %1")
+                    .arg(QString::fromUtf8(e.what())));
+        return false;
+    }
+    // cancelled, or the audio output failed
+    return !m_cancelled.loadRelaxed() && (m_output == Output::Data || m_audioBuffer);
+}
+
+void QTextToSpeechProcessorPiper::writeAudio(const Sentence &sentence, const float *samples,
+                                             qsizetype count)
+{
+    float peak = 0.01f;
+    for (qsizetype i = 0; i < count; ++i)
+        peak = std::max(peak, std::abs(samples[i]));
+    // Shorter sentences of a batch are padded with silence, which is removed
+    // like the trailing silence of the longest one, relative to the peak that
+    // becomes full scale.
+    m_silenceTrimmer.reset(m_format.sampleRate(), 1);
+    m_silenceTrimmer.setThreshold(QTextToSpeechSilenceTrimmer::DefaultThreshold
+                                  + 20 * std::log10(peak));
+    count = m_silenceTrimmer.speechEnd(samples, count);
+
+    // normalize to full scale, like Piper does
+    const float scale = 32767.0f / peak * sentence.volume;
+    m_samples.resize(count);
+    for (qsizetype i = 0; i < count; ++i)
+        m_samples[i] = qint16(std::clamp(samples[i] * scale, -32767.0f, 32767.0f));
+    m_audioSamples += count;
+
+    const char *data = reinterpret_cast<const char *>(m_samples.constData());
+    qsizetype size = count * sizeof(qint16);
+
+    if (m_output == Output::Data) {
+        emit synthesized(m_format, QByteArray(data, size));
+        waitWhileThrottled();
+        return;
+    }
+
+    if (sentence.startsUtterance) {
+        m_utteranceStarts.enqueue(m_streamSamples * 1000 / m_format.sampleRate());
+        if (!m_utteranceTimer.isActive())
+            startUtteranceTimer();
+    }
+    if (m_audioFilters && !m_audioFilters->isEmpty()) {
+        m_filterBuffer.assign(QByteArrayView(data, size));
+        m_audioFilters->process(m_format, m_filterBuffer);
+        data = m_filterBuffer.constData();
+        size = m_filterBuffer.size();
+    }
+    if (size && !m_audioBuffer->write(data, size)) {
+        setError(QTextToSpeech::ErrorReason::Playback,
+                 QCoreApplication::translate("QTextToSpeech", "Audio streaming error."));
+        deinitAudio();
+        return;
+    }
+    m_streamSamples += size / sizeof(qint16);
+}
+
+// Blocks the processor thread until the consumer has caught up.
+void QTextToSpeechProcessorPiper::waitWhileThrottled()
+{
+    QMutexLocker locker(&m_throttleMutex);
+    if (m_throttled)
+        qCDebug(lcSpeechTtsPiper) << "Synthesis throttled by consumer";
+    while (m_throttled)
+        m_throttleCondition.wait(&m_throttleMutex);
+}
+
+void QTextToSpeechProcessorPiper::setThrottled(bool throttled)
+{
+    QMutexLocker locker(&m_throttleMutex);
+    m_throttled = throttled;
+    if (!throttled)
+        m_throttleCondition.wakeAll();
+}
+
+void QTextToSpeechProcessorPiper::startUtteranceTimer()
+{
+    const qint64 playedTime = m_audioSink->processedUSecs() / 1000;
+    m_utteranceTimer.start(int(qMax(m_utteranceStarts.head() - playedTime, qint64(0))),
+                           Qt::PreciseTimer, this);
+}
+
+void QTextToSpeechProcessorPiper::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == m_batchTimer.timerId()) {
+        m_batchTimer.stop();
+        processNextBatch();
+        return;
+    }
+    if (event->timerId() != m_utteranceTimer.timerId()) {
+        QObject::timerEvent(event);
+        return;
+    }
+
+    m_utteranceStarts.dequeue();
+    emit utteranceStarted();
+    if (m_utteranceStarts.isEmpty())
+        m_utteranceTimer.stop();
+    else
+        startUtteranceTimer();
+}
+
+bool QTextToSpeechProcessorPiper::initAudio()
+{
+    if (m_audioDevice.isNull()) {
+        setError(QTextToSpeech::ErrorReason::Playback,
+                 QCoreApplication::translate("QTextToSpeech", "No audio device specified."));
+        return false;
+    }
+    if (!m_audioDevice.isFormatSupported(m_format)) {
+        QString formatString;
+        QDebug(&formatString) << m_format;
+        setError(QTextToSpeech::ErrorReason::Playback,
+                 QCoreApplication::translate("QTextToSpeech", "Audio device does not support format: %1")
+                    .arg(formatString));
+        return false;
+    }
+
+    if (!m_audioSink || m_audioSink->format() != m_format) {
+        deinitAudio();
+        m_audioSink = new QAudioSink(m_audioDevice, m_format, this);
+        connect(m_audioSink, &QAudioSink::stateChanged,
+                this, &QTextToSpeechProcessorPiper::changeState);
+        connect(QThread::currentThread(), &QThread::finished, m_audioSink, &QObject::deleteLater);
+    }
+    m_audioBuffer = m_audioSink->start();
+    m_streamSamples = 0;
+    if (!m_audioBuffer) {
+        deinitAudio();
+        setError(QTextToSpeech::ErrorReason::Playback,
+                 QCoreApplication::translate("QTextToSpeech", "Audio Open error: No I/O device available."));
+        return false;
+    }
+    return true;
+}
+
+void QTextToSpeechProcessorPiper::deinitAudio()
+{
+    m_utteranceTimer.stop();
+    m_utteranceStarts.clear();
+    if (m_audioSink) {
+        m_audioSink->disconnect(this);
+        delete m_audioSink;
+        m_audioSink = nullptr;
+        m_audioBuffer = nullptr;
+    }
+}
+
+void QTextToSpeechProcessorPiper::clear()
+{
+    m_sentences.clear();
+    m_firstBatch = true;
+    m_batchTimer.stop();
+}
+
+void QTextToSpeechProcessorPiper::changeState(QAudio::State newState)
+{
+    if (m_state == newState)
+        return;
+
+    // The sink runs dry if the model is slower than real time; that's not
+    // the end of the text as long as sentences are left.
+    if (newState == QAudio::IdleState && (m_batchTimer.isActive() || !m_sentences.isEmpty())) {
+        qCDebug(lcSpeechTtsPiper) << "Audio underrun";
+        return;
+    }
+
+    qCDebug(lcSpeechTtsPiper) << "Audio sink state transition" << m_state << newState;
+
+    switch (newState) {
+    case QAudio::ActiveState:
+        if (!m_utteranceTimer.isActive() && !m_utteranceStarts.isEmpty())
+            startUtteranceTimer();
+        emit stateChanged(QTextToSpeech::Speaking);
+        break;
+    case QAudio::IdleState:
+        // all written data has been played
+        m_utteranceTimer.stop();
+        while (!m_utteranceStarts.isEmpty()) {
+            m_utteranceStarts.dequeue();
+            emit utteranceStarted();
+        }
+        emit stateChanged(QTextToSpeech::Ready);
+        break;
+    case QAudio::SuspendedState:
+        m_utteranceTimer.stop();
+        emit stateChanged(QTextToSpeech::Paused);
+        break;
+    case QAudio::StoppedState:
+        m_utteranceTimer.stop();
+        emit stateChanged(QTextToSpeech::Ready);
+        break;
+    }
+    m_state = newState;
+}
+
+void QTextToSpeechProcessorPiper::setError(QTextToSpeech::ErrorReason err, const QString &errorString)
+{
+    qCDebug(lcSpeechTtsPiper) << "Error" << err << errorString;
+    emit stateChanged(QTextToSpeech::Error);
+    emit errorOccurred(err, errorString);
+}
+
+void QTextToSpeechProcessorPiper::say(const QString &text, int voiceId, double rate, double volume)
+{
+    if (text.isEmpty())
+        return;
+
+    clear();
+    m_utteranceTimer.stop();
+    m_utteranceStarts.clear();
+    m_output = Output::Speaker;
+    // restart the audio output with the first batch
+    m_audioBuffer = nullptr;
+    if (m_audioFilters)
+        m_audioFilters->reset();
+    if (enqueueText(text, voiceId, rate, volume, false))
+        scheduleNextBatch();
+}
+
+void QTextToSpeechProcessorPiper::sayNext(const QStringList &texts, int voiceId, double rate,
+                                          double volume)
+{
+    if (m_output != Output::Speaker)
+        return;
+
+    // Sentences of the texts are decoded together with the remaining ones
+    for (const QString &text : texts) {
+        if (!enqueueText(text, voiceId, rate, volume, true))
+            return;
+    }
+    scheduleNextBatch();
+}
+
+void QTextToSpeechProcessorPiper::synthesize(const QString &text, int voiceId, double rate,
+                                             double volume)
+{
+    if (text.isEmpty())
+        return;
+
+    clear();
+    m_output = Output::Data;
+    emit stateChanged(QTextToSpeech::Synthesizing);
+    if (enqueueText(text, voiceId, rate, volume, false))
+        scheduleNextBatch();
+}
+
+// Stop current and cancel subsequent utterances
+void QTextToSpeechProcessorPiper::stop()
+{
+    m_cancelled.storeRelaxed(false);
+    const bool synthesizing = m_output == Output::Data
+                           && (m_batchTimer.isActive() || !m_sentences.isEmpty());
+    clear();
+    if (synthesizing) {
+        emit stateChanged(QTextToSpeech::Ready);
+    } else if (m_state == QAudio::ActiveState || m_state == QAudio::SuspendedState) {
+        deinitAudio();
+        changeState(QAudio::StoppedState);
+    }
+}
+
+void QTextToSpeechProcessorPiper::pause()
+{
+    if (m_audioSink && m_state == QAudio::ActiveState)
+        m_audioSink->suspend();
+}
+
+void QTextToSpeechProcessorPiper::resume()
+{
+    if (m_audioSink && m_state == QAudio::SuspendedState) {
+        m_audioSink->resume();
+        // QAudioSink in push mode transitions to Idle when resumed
+        changeState(QAudio::ActiveState);
+        if (!m_sentences.isEmpty())
+            scheduleNextBatch();
+    }
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,178 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHPROCESSOR_PIPER_H
+#define QTEXTTOSPEECHPROCESSOR_PIPER_H
+
+#include "qtexttospeechengine.h"
+#include "qvoice.h"
+
+#include <QtTextToSpeech/private/qtexttospeechaudiofilter_p.h>
+#include <QtTextToSpeech/private/qtexttospeechaudiofilterchain_p.h>
+
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QBasicTimer>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QQueue>
+#include <QtCore/QString>
+#include <QtCore/QTimerEvent>
+#include <QtCore/QWaitCondition>
+#include <QtMultimedia/QAudioSink>
+#include <QtMultimedia/QMediaDevices>
+
+#include <memory>
+
+namespace Ort {
+struct Env;
+struct Session;
+}
+
+QT_BEGIN_NAMESPACE
+
+// Synthesizes speech with Piper voices, VITS models exported to ONNX, using
+// ONNX Runtime on the CPU. Texts are split into sentences that are converted
+// to phonemes with espeak-ng, and several sentences are decoded in one call
+// to the model.
+class QTextToSpeechProcessorPiper : public QObject
+{
+    Q_OBJECT
+
+public:
+    QTextToSpeechProcessorPiper(const QAudioDevice &audioDevice, const QStringList &voicePaths);
+    ~QTextToSpeechProcessorPiper();
+
+    struct VoiceInfo
+    {
+        int id;
+        QString name;
+        QString locale;
+        QString modelPath;
+        qint64 speakerId;
+    };
+
+    Q_INVOKABLE void say(const QString &text, int voiceId, double rate, double volume);
+    Q_INVOKABLE void sayNext(const QStringList &texts, int voiceId, double rate, double volume);
+    Q_INVOKABLE void synthesize(const QString &text, int voiceId, double rate, double volume);
+    Q_INVOKABLE void pause();
+    Q_INVOKABLE void resume();
+    Q_INVOKABLE void stop();
+
+    // to be called before the first utterance
+    void setInferenceOptions(int intraOpThreads, int batchSize);
+    // thread-safe
+    void setThrottled(bool throttled);
+    void cancel() { m_cancelled.storeRelaxed(true); }
+    // to be called before the first utterance
+    void setAudioFilterChain(QTextToSpeechAudioFilterChain *chain) { m_audioFilters = chain; }
+
+    bool isInitialized() const { return m_initialized; }
+    const QList<VoiceInfo> &voices() const;
+
+Q_SIGNALS:
+    void errorOccurred(QTextToSpeech::ErrorReason error, const QString &errorString);
+    void stateChanged(QTextToSpeech::State);
+    void readyForNextUtterance();
+    void utteranceStarted();
+    void synthesized(const QAudioFormat &format, const QByteArray &array);
+
+protected:
+    void timerEvent(QTimerEvent *event) override;
+
+private slots:
+    void changeState(QAudio::State newState);
+
+private:
+    enum class Output {
+        Speaker,
+        Data
+    };
+
+    // Phoneme ids of a sentence, ready to be passed to the model
+    struct Sentence
+    {
+        int voiceId;
+        // the first sentence of a text passed to sayNext()
+        bool startsUtterance;
+        double lengthScale;
+        float volume;
+        QList<qint64> phonemeIds;
+    };
+
+    struct Model
+    {
+        QString path;
+        std::unique_ptr<Ort::Session> session;
+        QHash<char32_t, QList<qint64>> phonemeIds;
+        QString espeakVoice;
+        int sampleRate = 22050;
+        int speakerCount = 1;
+        float noiseScale = 0.667f;
+        float lengthScale = 1.0f;
+        float noiseW = 0.8f;
+    };
+
+    void findVoices(const QStringList &voicePaths);
+    bool loadModel(const VoiceInfo &voice);
+    bool enqueueText(const QString &text, int voiceId, double rate, double volume,
+                     bool startsUtterance);
+    QList<qint64> toPhonemeIds(QStringView phonemes) const;
+    bool infer(qsizetype count);
+    void writeAudio(const Sentence &sentence, const float *samples, qsizetype count);
+    void scheduleNextBatch();
+    void processNextBatch();
+    void waitWhileThrottled();
+
+    bool initAudio();
+    void deinitAudio();
+    void clear();
+    void startUtteranceTimer();
+    void setError(QTextToSpeech::ErrorReason err, const QString &errorString);
+
+    bool m_initialized = false;
+    bool m_espeakInitialized = false;
+    std::unique_ptr<Ort::Env> m_env;
+    Model m_model;
+    QList<VoiceInfo> m_voices;
+    int m_intraOpThreads = 1;
+    int m_batchSize = 4;
+
+    // how far the decoding gets ahead of the playback, in ms
+    static constexpr qint64 MaximumLead = 2000;
+    QQueue<Sentence> m_sentences;
+    QBasicTimer m_batchTimer;
+    // the first batch of a text only has one sentence, so that it starts quickly
+    bool m_firstBatch = true;
+    QList<qint16> m_samples;
+    QByteArray m_filterBuffer;
+    QTextToSpeechSilenceTrimmer m_silenceTrimmer;
+
+    // Real-time factor statistics
+    qint64 m_inferenceNSecs = 0;
+    qint64 m_audioSamples = 0;
+
+    QAudioDevice m_audioDevice;
+    QAudioFormat m_format;
+    QAudioSink *m_audioSink = nullptr;
+    QIODevice *m_audioBuffer = nullptr;
+    QAudio::State m_state = QAudio::IdleState;
+    Output m_output = Output::Speaker;
+    QAtomicInteger<bool> m_cancelled = false;
+
+    QTextToSpeechAudioFilterChain *m_audioFilters = nullptr;
+
+    // Start times in ms of texts passed to sayNext(), in the audio stream
+    QQueue<qint64> m_utteranceStarts;
+    qint64 m_streamSamples = 0;
+    QBasicTimer m_utteranceTimer;
+
+    // Back-pressure from the consumer of synthesized data
+    QMutex m_throttleMutex;
+    QWaitCondition m_throttleCondition;
+    bool m_throttled = false;
+};
+
+QT_END_NAMESPACE
+
+#endif
@@ -3,24 +3,198 @@
 
 
 #include "qtexttospeech_speechd.h"
+#include "qtexttospeech_speechd_plugin.h"
 
 #include <QtCore/QDebug>
 #include <QtCore/QCoreApplication>
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutex>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+#include <QtCore/QThread>
 
 #include <libspeechd.h>
 
+#include <algorithm>
+#include <charconv>
+#include <memory>
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#ifndef POLLRDHUP
+  #define POLLRDHUP 0 // POLLHUP is reported anyway
+#endif
+
 #if LIBSPEECHD_MAJOR_VERSION > 0 || LIBSPEECHD_MINOR_VERSION >= 9
   #define HAVE_SPD_090
 #endif
 
 QT_BEGIN_NAMESPACE
 
-typedef QList<QTextToSpeechEngineSpeechd*> QTextToSpeechSpeechDispatcherBackendList;
-Q_GLOBAL_STATIC(QTextToSpeechSpeechDispatcherBackendList, backends)
+namespace {
+
+// Routes the notifications from speech-dispatcher to the engine that sent the
+// message. A notification can arrive on the callback thread before spd_say has
+// returned the message id to the engine; those are kept until the engine
+// claims them.
+class QSpeechdMessageRouter
+{
+public:
+    void route(size_t msgId, SPDNotificationType type, int mark)
+    {
+        QMutexLocker locker(&m_mutex);
+        const auto it = m_owners.constFind(msgId);
+        if (it != m_owners.cend()) {
+            it.value()->postNotification(msgId, type, mark);
+            if (isFinal(type))
+                m_owners.erase(it);
+            return;
+        }
+        // messages of destroyed engines must not accumulate here
+        if (m_unclaimed.size() == MaxUnclaimed)
+            m_unclaimed.removeFirst();
+        m_unclaimed.append({msgId, type, mark});
+    }
+
+    void claim(size_t msgId, QTextToSpeechEngineSpeechd *engine)
+    {
+        QMutexLocker locker(&m_mutex);
+        bool finished = false;
+        m_unclaimed.removeIf([&](const Unclaimed &notification){
+            if (notification.msgId != msgId)
+                return false;
+            engine->postNotification(msgId, notification.type, notification.mark);
+            finished |= isFinal(notification.type);
+            return true;
+        });
+        if (!finished)
+            m_owners.insert(msgId, engine);
+    }
+
+    void remove(QTextToSpeechEngineSpeechd *engine)
+    {
+        QMutexLocker locker(&m_mutex);
+        for (auto it = m_owners.begin(); it != m_owners.end();)
+            it = it.value() == engine ? m_owners.erase(it) : std::next(it);
+    }
+
+private:
+    struct Unclaimed
+    {
+        size_t msgId;
+        SPDNotificationType type;
+        int mark;
+    };
+    static constexpr qsizetype MaxUnclaimed = 16;
+    static bool isFinal(SPDNotificationType type)
+    {
+        return type == SPD_EVENT_END || type == SPD_EVENT_CANCEL;
+    }
+
+    QMutex m_mutex;
+    QHash<size_t, QTextToSpeechEngineSpeechd *> m_owners;
+    QList<Unclaimed> m_unclaimed;
+};
+
+// Appends the UTF-8 encoding of text to out, escaping the characters that
+// have a meaning in SSML.
+void appendEscapedUtf8(QByteArray &out, QStringView text)
+{
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        char32_t ucs = text.at(i).unicode();
+        switch (ucs) {
+        case u'&':
+            out.append("&amp;");
+            continue;
+        case u'<':
+            out.append("&lt;");
+            continue;
+        case u'>':
+            out.append("&gt;");
+            continue;
+        default:
+            break;
+        }
+        if (ucs < 0x80) {
+            out.append(char(ucs));
+            continue;
+        }
+        if (QChar::isHighSurrogate(ucs) && i + 1 < text.size()
+            && text.at(i + 1).isLowSurrogate()) {
+            ucs = QChar::surrogateToUcs4(char16_t(ucs), text.at(++i).unicode());
+        } else if (QChar::isSurrogate(ucs)) {
+            ucs = QChar::ReplacementCharacter;
+        }
+        if (ucs < 0x800) {
+            out.append(char(0xc0 | (ucs >> 6)));
+        } else {
+            if (ucs < 0x10000) {
+                out.append(char(0xe0 | (ucs >> 12)));
+            } else {
+                out.append(char(0xf0 | (ucs >> 18)));
+                out.append(char(0x80 | ((ucs >> 12) & 0x3f)));
+            }
+            out.append(char(0x80 | ((ucs >> 6) & 0x3f)));
+        }
+        out.append(char(0x80 | (ucs & 0x3f)));
+    }
+}
+
+bool isWordCharacter(QChar ch)
+{
+    return ch.isLetterOrNumber() || ch.isMark() || ch == u'_';
+}
+
+// Converts text to an SSML document with a <mark> in front of each word, named
+// after the index of the word, and records the position of each word in text.
+// Runs in one pass over text, and only allocates when the buffers need to grow.
+void textToSsml(QStringView text, QByteArray &ssml,
+                QList<std::pair<qsizetype, qsizetype>> &words)
+{
+    ssml.clear();
+    ssml.reserve(text.size() + text.size() / 2 + 32);
+    words.clear();
+    ssml.append("<speak>");
+
+    qsizetype segmentStart = 0;
+    qsizetype wordStart = -1;
+    const auto flush = [&](qsizetype end){
+        appendEscapedUtf8(ssml, text.sliced(segmentStart, end - segmentStart));
+        segmentStart = end;
+    };
+    for (qsizetype i = 0; i <= text.size(); ++i) {
+        const bool isWord = i < text.size() && isWordCharacter(text.at(i));
+        if (isWord && wordStart < 0) {
+            flush(i);
+            wordStart = i;
+            char number[16];
+            const auto result = std::to_chars(number, number + sizeof(number), words.size());
+            ssml.append("<mark name=\"");
+            ssml.append(number, result.ptr - number);
+            ssml.append("\"/>");
+        } else if (!isWord && wordStart >= 0) {
+            words.append({wordStart, i - wordStart});
+            wordStart = -1;
+        }
+    }
+    flush(text.size());
+    ssml.append("</speak>");
+}
+
+}
+
+Q_GLOBAL_STATIC(QSpeechdMessageRouter, messageRouter)
 
 void speech_finished_callback(size_t msg_id, size_t client_id, SPDNotificationType state);
+void index_mark_callback(size_t msg_id, size_t client_id, SPDNotificationType state,
+                         char *index_mark);
 
-QLocale QTextToSpeechEngineSpeechd::localeForVoice(SPDVoice *voice) const
+QLocale QTextToSpeechEngineSpeechd::localeForVoice(SPDVoice *voice)
 {
     QString lang_var = QString::fromLatin1(voice->language);
     if (qstrcmp(voice->variant, "none") != 0) {
@@ -30,82 +204,371 @@ QLocale QTextToSpeechEngineSpeechd::localeForVoice(SPDVoice *voice) const
     return QLocale(lang_var);
 }
 
-QTextToSpeechEngineSpeechd::QTextToSpeechEngineSpeechd(const QVariantMap &, QObject *)
+QTextToSpeechEngineSpeechd::QTextToSpeechEngineSpeechd(const QVariantMap &parameters, QObject *)
     : speechDispatcher(nullptr)
+    , m_pipelineDepth(qMax(0, parameters.value(QStringLiteral("pipelineDepth")).toInt()))
+    , m_wordProgress(parameters.value(QStringLiteral("wordProgress")).toBool())
 {
-    backends->append(this);
+    // The catalog of the voices from a previous run is used until we know
+    // whether speech-dispatcher still has the same modules. The default locale
+    // is selected once we are connected.
+    QList<QVoice> voices;
+    if (readVoiceCache(m_modules, voices)) {
+        for (const QVoice &voice : std::as_const(voices))
+            m_voices.insert(voice.locale(), voice);
+        m_allVoicesLoaded = true;
+    }
+    m_pendingLocale = QLocale();
+
+    m_reconnectTimer.setSingleShot(true);
+    connect(&m_reconnectTimer, &QTimer::timeout, this, [this]{ connectToSpeechDispatcher(); });
     connectToSpeechDispatcher();
 }
 
 QTextToSpeechEngineSpeechd::~QTextToSpeechEngineSpeechd()
 {
+    if (m_voiceThread) {
+        m_voiceThreadCancelled.storeRelaxed(true);
+        m_voiceThread->wait();
+    }
+    if (m_connectThread) {
+        m_connectThread->wait();
+        if (m_connection.connection)
+            spd_close(m_connection.connection);
+    }
     if (speechDispatcher) {
+        stopWatching();
         if ((m_state != QTextToSpeech::Error) && (m_state != QTextToSpeech::Ready))
             spd_cancel_all(speechDispatcher);
+        // joins the callback thread of the connection
         spd_close(speechDispatcher);
     }
-    backends->removeAll(this);
+    messageRouter->remove(this);
+
+    Notification *notification = m_notifications.fetchAndStoreAcquire(nullptr);
+    while (notification)
+        delete std::exchange(notification, notification->next);
 }
 
+// Returns whether we are connected. Otherwise starts connecting in the
+// background, unless we are connecting already, or waiting for the next attempt.
 bool QTextToSpeechEngineSpeechd::connectToSpeechDispatcher()
 {
     if (speechDispatcher)
         return true;
-
-    speechDispatcher = spd_open("QTextToSpeech", "main", nullptr, SPD_MODE_THREADED);
-    if (!speechDispatcher) {
-        setError(QTextToSpeech::ErrorReason::Initialization,
-                QCoreApplication::translate("QTextToSpeech", "Connection to speech-dispatcher failed"));
+    if (m_connectThread || m_reconnectTimer.isActive())
         return false;
+
+    m_connection = {};
+    m_connectThread.reset(QThread::create(&QTextToSpeechEngineSpeechd::openConnection,
+                                          std::ref(m_connection), m_wordProgress));
+    connect(m_connectThread.get(), &QThread::finished,
+            this, &QTextToSpeechEngineSpeechd::connectionFinished);
+    m_connectThread->start();
+    return false;
+}
+
+// Runs in a background thread, as opening the connection and listing the
+// modules can take seconds. The voices are only listed when they are needed.
+void QTextToSpeechEngineSpeechd::openConnection(Connection &result, bool wordProgress)
+{
+    SPDConnection *connection = spd_open("QTextToSpeech", "main", nullptr, SPD_MODE_THREADED);
+    if (!connection) {
+        result.errorReason = QTextToSpeech::ErrorReason::Initialization;
+        result.errorString = QCoreApplication::translate("QTextToSpeech",
+                                                         "Connection to speech-dispatcher failed");
+        return;
     }
 
-    speechDispatcher->callback_begin = speech_finished_callback;
-    spd_set_notification_on(speechDispatcher, SPD_BEGIN);
-    speechDispatcher->callback_end = speech_finished_callback;
-    spd_set_notification_on(speechDispatcher, SPD_END);
-    speechDispatcher->callback_cancel = speech_finished_callback;
-    spd_set_notification_on(speechDispatcher, SPD_CANCEL);
-    speechDispatcher->callback_resume = speech_finished_callback;
-    spd_set_notification_on(speechDispatcher, SPD_RESUME);
-    speechDispatcher->callback_pause = speech_finished_callback;
-    spd_set_notification_on(speechDispatcher, SPD_PAUSE);
+    connection->callback_begin = speech_finished_callback;
+    spd_set_notification_on(connection, SPD_BEGIN);
+    connection->callback_end = speech_finished_callback;
+    spd_set_notification_on(connection, SPD_END);
+    connection->callback_cancel = speech_finished_callback;
+    spd_set_notification_on(connection, SPD_CANCEL);
+    connection->callback_resume = speech_finished_callback;
+    spd_set_notification_on(connection, SPD_RESUME);
+    connection->callback_pause = speech_finished_callback;
+    spd_set_notification_on(connection, SPD_PAUSE);
+    if (wordProgress) {
+        // we send SSML with a mark in front of each word
+        spd_set_data_mode(connection, SPD_DATA_SSML);
+        connection->callback_im = index_mark_callback;
+        spd_set_notification_on(connection, SPD_INDEX_MARKS);
+    }
 
-    QStringList availableModules;
-    char **modules = spd_list_modules(speechDispatcher);
+    char **modules = spd_list_modules(connection);
     int i = 0;
     while (modules && modules[i]) {
-        availableModules.append(QString::fromUtf8(modules[i]));
+        result.modules.append(QString::fromUtf8(modules[i]));
         ++i;
     }
+#ifdef HAVE_SPD_090
+    free_spd_modules(modules);
+#endif
 
-    if (availableModules.length() == 0) {
-        setError(QTextToSpeech::ErrorReason::Configuration,
-                    QCoreApplication::translate("QTextToSpeech",
-                                                "Found no modules in speech-dispatcher."));
-        return false;
+    if (result.modules.length() == 0) {
+        spd_close(connection);
+        result.errorReason = QTextToSpeech::ErrorReason::Configuration;
+        result.errorString = QCoreApplication::translate("QTextToSpeech",
+                                                         "Found no modules in speech-dispatcher.");
+        return;
+    }
+
+#ifdef HAVE_SPD_090
+    result.rate = spd_get_voice_rate(connection) / 100.0;
+    result.pitch = spd_get_voice_pitch(connection) / 100.0;
+    // -100..100 to 0.0..1.0
+    result.volume = (spd_get_volume(connection) + 100) / 200.0;
+#endif
+    result.connection = connection;
+}
+
+void QTextToSpeechEngineSpeechd::connectionFinished()
+{
+    m_connectThread->wait();
+    m_connectThread.reset();
+    Connection connection = std::exchange(m_connection, {});
+    if (!connection.connection) {
+        // Report the failure, unless we did already, and keep trying with
+        // increasing delays. The texts can't be spoken.
+        if (m_state != QTextToSpeech::Error) {
+            m_pendingTexts.clear();
+            setError(connection.errorReason, connection.errorString);
+        }
+        m_reconnectTimer.start(m_reconnectDelay);
+        m_reconnectDelay = qMin(m_reconnectDelay * 2, MaxReconnectDelay);
+        return;
     }
+    m_reconnectDelay = InitialReconnectDelay;
 
-    updateVoices();
-    if (m_currentVoice == QVoice()) {
+    speechDispatcher = connection.connection;
+    // the catalog of the voices is only valid for the same modules
+    if (connection.modules != m_modules) {
+        m_voices.clear();
+        m_allVoicesLoaded = false;
+        m_modules = connection.modules;
+    }
+    startWatching();
+    loadVoices();
+
+    // Restore the settings that were made while we were not connected. After a
+    // reconnect, speech-dispatcher might have restarted with default settings.
+    if (m_restoreSettings & RateSetting)
+        spd_set_voice_rate(speechDispatcher, qRound(m_rate * 100));
+    else
+        m_rate = connection.rate;
+    if (m_restoreSettings & PitchSetting)
+        spd_set_voice_pitch(speechDispatcher, qRound(m_pitch * 100));
+    else
+        m_pitch = connection.pitch;
+    if (m_restoreSettings & VolumeSetting)
+        spd_set_volume(speechDispatcher, qRound((m_volume - 0.5) * 200));
+    else
+        m_volume = connection.volume;
+    m_restoreSettings = RateSetting | PitchSetting | VolumeSetting;
+
+    const QTextToSpeech::State reportedState = m_state;
+    bool hasVoice = false;
+    {
+        // failed attempts are only an error if all of them fail
+        const QSignalBlocker blocker(this);
+        if (const auto locale = std::exchange(m_pendingLocale, std::nullopt))
+            hasVoice = setLocale(*locale);
+        else if (m_currentVoice != QVoice())
+            hasVoice = setVoice(m_currentVoice);
         // Set the default locale (which is usually the system locale), and fall back
         // to a locale that has the same language if that fails. That might then still fail,
         // in which case there won't be a valid voice.
-        if (!setLocale(QLocale()) && !setLocale(QLocale().language())) {
-            setError(QTextToSpeech::ErrorReason::Configuration,
-                    QCoreApplication::translate("QTextToSpeech",
-                                                "Failed to initialize default locale and voice."));
-            return false;
-        }
+        if (!hasVoice)
+            hasVoice = setLocale(QLocale()) || setLocale(QLocale().language());
+    }
+    m_state = reportedState;
+    if (!hasVoice) {
+        m_pendingTexts.clear();
+        setError(QTextToSpeech::ErrorReason::Configuration,
+                 QCoreApplication::translate("QTextToSpeech",
+                                             "Failed to initialize default locale and voice."));
+        return;
     }
 
-    m_state = QTextToSpeech::Ready;
     m_errorReason = QTextToSpeech::ErrorReason::NoError;
     m_errorString.clear();
+    const QStringList texts = std::exchange(m_pendingTexts, {});
+    const QTextToSpeech::State state = texts.isEmpty() ? QTextToSpeech::Ready
+                                                       : QTextToSpeech::Speaking;
+    if (m_state != state) {
+        m_state = state;
+        emit stateChanged(m_state);
+    }
+
+    // the first text replaces what speech-dispatcher might still be speaking
+    m_messages.clear();
+    for (qsizetype i = 0; i < texts.size(); ++i) {
+        if (!sendText(texts.at(i), i ? SPD_TEXT : SPD_MESSAGE)) {
+            // lost again; the rest waits for the next connection
+            if (!speechDispatcher)
+                m_pendingTexts += texts.sliced(i + 1);
+            break;
+        }
+    }
+}
+
+// Called when the socket of the connection hung up, or when a request failed
+// and speech-dispatcher doesn't respond anymore, for instance because the
+// service was restarted. The texts that speech-dispatcher didn't finish are
+// spoken again once we have reconnected in the background.
+void QTextToSpeechEngineSpeechd::connectionLost(const QString &failedText)
+{
+    stopWatching();
+    spd_close(speechDispatcher);
+    speechDispatcher = nullptr;
+    messageRouter->remove(this);
+    for (const Message &message : std::as_const(m_messages))
+        m_pendingTexts.append(message.text);
+    m_messages.clear();
+    if (!failedText.isEmpty())
+        m_pendingTexts.append(failedText);
+    if (!m_pendingTexts.isEmpty() && m_state != QTextToSpeech::Speaking) {
+        m_state = QTextToSpeech::Speaking;
+        emit stateChanged(m_state);
+    }
+    connectToSpeechDispatcher();
+}
+
+// libspeechd doesn't report a closed connection, so a thread waits for the
+// socket to hang up, or to be woken up when we close the connection.
+void QTextToSpeechEngineSpeechd::watchConnection(int socket, int wakeUpFd)
+{
+    pollfd fds[] = {{socket, POLLRDHUP, 0}, {wakeUpFd, POLLIN, 0}};
+    while (::poll(fds, 2, -1) < 0 && errno == EINTR)
+        ;
+}
+
+void QTextToSpeechEngineSpeechd::startWatching()
+{
+    // without the thread, a lost connection is noticed when a request fails
+    if (::pipe(m_wakeUpPipe) != 0)
+        return;
+    m_watchThread.reset(QThread::create(&QTextToSpeechEngineSpeechd::watchConnection,
+                                        speechDispatcher->socket, m_wakeUpPipe[0]));
+    connect(m_watchThread.get(), &QThread::finished, this, [this]{ connectionLost(); });
+    m_watchThread->start();
+}
+
+void QTextToSpeechEngineSpeechd::stopWatching()
+{
+    if (!m_watchThread)
+        return;
+    m_watchThread->disconnect(this);
+    const char wakeUp = 0;
+    while (::write(m_wakeUpPipe[1], &wakeUp, 1) < 0 && errno == EINTR)
+        ;
+    m_watchThread->wait();
+    m_watchThread.reset();
+    ::close(m_wakeUpPipe[0]);
+    ::close(m_wakeUpPipe[1]);
+    m_wakeUpPipe[0] = m_wakeUpPipe[1] = -1;
+}
 
+bool QTextToSpeechEngineSpeechd::isConnectionAlive() const
+{
+#ifdef HAVE_SPD_090
+    char *module = spd_get_output_module(speechDispatcher);
+    free(module);
+    return module != nullptr;
+#else
     return true;
+#endif
+}
+
+void QTextToSpeechEngineSpeechd::postNotification(size_t msgId, SPDNotificationType type,
+                                                  int mark)
+{
+    Notification *notification = new Notification{m_notifications.loadRelaxed(), msgId, type,
+                                                   mark};
+    while (!m_notifications.testAndSetRelease(notification->next, notification, notification->next))
+        ;
+    // only the first notification of a batch needs to wake up the engine's thread
+    if (!notification->next)
+        QMetaObject::invokeMethod(this, &QTextToSpeechEngineSpeechd::processNotifications,
+                                  Qt::QueuedConnection);
+}
+
+void QTextToSpeechEngineSpeechd::processNotifications()
+{
+    // the stack has the newest notification on top, reverse it
+    Notification *notification = m_notifications.fetchAndStoreAcquire(nullptr);
+    Notification *ordered = nullptr;
+    while (notification) {
+        Notification *next = notification->next;
+        notification->next = ordered;
+        ordered = notification;
+        notification = next;
+    }
+
+    while (ordered) {
+        const std::unique_ptr<Notification> current(std::exchange(ordered, ordered->next));
+        handleNotification(current->msgId, current->type, current->mark);
+    }
+}
+
+void QTextToSpeechEngineSpeechd::handleNotification(size_t msgId, SPDNotificationType type,
+                                                    int mark)
+{
+    // a cancelled message can still report its end after we sent the next one
+    const auto it = std::find_if(m_messages.cbegin(), m_messages.cend(),
+                                 [msgId](const Message &message){ return message.id == msgId; });
+    if (it == m_messages.cend())
+        return;
+    const qsizetype index = std::distance(m_messages.cbegin(), it);
+
+    switch (type) {
+    case SPD_EVENT_INDEX_MARK:
+        if (index == 0 && mark >= 0 && mark < it->words.size()) {
+            const auto [start, length] = it->words.at(mark);
+            emit sayingWord(it->text.sliced(start, length), start, length);
+        }
+        break;
+    case SPD_EVENT_BEGIN:
+        // messages sent ahead of time begin while we are speaking already
+        if (index == 0) {
+            spdStateChanged(type);
+            requestNextUtterances();
+        }
+        break;
+    case SPD_EVENT_END:
+        m_messages.remove(index);
+        if (!m_messages.isEmpty()) {
+            emit utteranceStarted();
+            requestNextUtterances();
+        } else {
+            spdStateChanged(type);
+        }
+        break;
+    case SPD_EVENT_CANCEL:
+        // stop() cancels all messages, the other notifications will be ignored
+        m_messages.clear();
+        spdStateChanged(type);
+        break;
+    default:
+        spdStateChanged(type);
+        break;
+    }
+}
+
+// Sends queued texts to speech-dispatcher until the pipeline is full, or
+// QTextToSpeech has no more text for us.
+void QTextToSpeechEngineSpeechd::requestNextUtterances()
+{
+    while (m_state == QTextToSpeech::Speaking && m_messages.size() <= m_pipelineDepth) {
+        const qsizetype messageCount = m_messages.size();
+        emit readyForNextUtterance();
+        if (m_messages.size() == messageCount)
+            break;
+    }
 }
 
-// hack to get state notifications
 void QTextToSpeechEngineSpeechd::spdStateChanged(SPDNotificationType state)
 {
     QTextToSpeech::State s = QTextToSpeech::Error;
@@ -140,15 +603,62 @@ void QTextToSpeechEngineSpeechd::setError(QTextToSpeech::ErrorReason reason, con
 
 void QTextToSpeechEngineSpeechd::say(const QString &text)
 {
-    if (text.isEmpty() || !connectToSpeechDispatcher())
+    if (text.isEmpty())
+        return;
+    // spoken once we are connected
+    if (!connectToSpeechDispatcher()) {
+        m_pendingTexts = {text};
+        if (m_state != QTextToSpeech::Speaking) {
+            m_state = QTextToSpeech::Speaking;
+            emit stateChanged(m_state);
+        }
         return;
+    }
 
     if (m_state != QTextToSpeech::Ready)
         stop(QTextToSpeech::BoundaryHint::Default);
 
-    if (spd_say(speechDispatcher, SPD_MESSAGE, text.toUtf8().constData()) < 0)
+    m_messages.clear();
+    sendText(text, SPD_MESSAGE);
+}
+
+void QTextToSpeechEngineSpeechd::appendUtterance(const QString &text)
+{
+    if (text.isEmpty())
+        return;
+    if (!connectToSpeechDispatcher()) {
+        m_pendingTexts.append(text);
+        return;
+    }
+
+    // Text priority messages wait until the message priority message we are
+    // speaking has finished, and are spoken in the order they were sent.
+    sendText(text, SPD_TEXT);
+}
+
+bool QTextToSpeechEngineSpeechd::sendText(const QString &text, SPDPriority priority)
+{
+    Message message{0, text, {}};
+    int msgId = -1;
+    if (m_wordProgress) {
+        textToSsml(text, m_ssml, message.words);
+        msgId = spd_say(speechDispatcher, priority, m_ssml.constData());
+    } else {
+        msgId = spd_say(speechDispatcher, priority, text.toUtf8().constData());
+    }
+    if (msgId < 0) {
+        if (!isConnectionAlive()) {
+            connectionLost(text);
+            return false;
+        }
         setError(QTextToSpeech::ErrorReason::Input,
                  QCoreApplication::translate("QTextToSpeech", "Text synthesizing failure."));
+        return false;
+    }
+    message.id = size_t(msgId);
+    m_messages.append(std::move(message));
+    messageRouter->claim(size_t(msgId), this);
+    return true;
 }
 
 void QTextToSpeechEngineSpeechd::synthesize(const QString &)
@@ -159,8 +669,14 @@ void QTextToSpeechEngineSpeechd::synthesize(const QString &)
 void QTextToSpeechEngineSpeechd::stop(QTextToSpeech::BoundaryHint boundaryHint)
 {
     Q_UNUSED(boundaryHint);
-    if (!connectToSpeechDispatcher())
+    if (!connectToSpeechDispatcher()) {
+        m_pendingTexts.clear();
+        if (m_state == QTextToSpeech::Speaking) {
+            m_state = QTextToSpeech::Ready;
+            emit stateChanged(m_state);
+        }
         return;
+    }
 
     if (m_state == QTextToSpeech::Paused)
         spd_resume_all(speechDispatcher);
@@ -190,80 +706,87 @@ void QTextToSpeechEngineSpeechd::resume()
 
 bool QTextToSpeechEngineSpeechd::setPitch(double pitch)
 {
-    if (!connectToSpeechDispatcher())
-        return false;
+    const int value = static_cast<int>(pitch * 100);
+    // applied once we are connected
+    if (!connectToSpeechDispatcher()) {
+        m_pitch = value / 100.0;
+        m_restoreSettings |= PitchSetting;
+        return true;
+    }
 
-    int result = spd_set_voice_pitch(speechDispatcher, static_cast<int>(pitch * 100));
-    if (result == 0)
+    int result = spd_set_voice_pitch(speechDispatcher, value);
+    if (result == 0) {
+        m_pitch = value / 100.0;
         return true;
+    }
     return false;
 }
 
 double QTextToSpeechEngineSpeechd::pitch() const
 {
-    double pitch = 0.0;
-#ifdef HAVE_SPD_090
-    if (speechDispatcher != 0) {
-        int result = spd_get_voice_pitch(speechDispatcher);
-        pitch = result / 100.0;
-    }
-#endif
-    return pitch;
+    return m_pitch;
 }
 
 bool QTextToSpeechEngineSpeechd::setRate(double rate)
 {
-    if (!connectToSpeechDispatcher())
-        return false;
+    const int value = static_cast<int>(rate * 100);
+    if (!connectToSpeechDispatcher()) {
+        m_rate = value / 100.0;
+        m_restoreSettings |= RateSetting;
+        return true;
+    }
 
-    int result = spd_set_voice_rate(speechDispatcher, static_cast<int>(rate * 100));
+    int result = spd_set_voice_rate(speechDispatcher, value);
+    if (result == 0)
+        m_rate = value / 100.0;
     return result == 0;
 }
 
 double QTextToSpeechEngineSpeechd::rate() const
 {
-    double rate = 0.0;
-#ifdef HAVE_SPD_090
-    if (speechDispatcher != 0) {
-        int result = spd_get_voice_rate(speechDispatcher);
-        rate = result / 100.0;
-    }
-#endif
-    return rate;
+    return m_rate;
 }
 
 bool QTextToSpeechEngineSpeechd::setVolume(double volume)
 {
-    if (!connectToSpeechDispatcher())
-        return false;
-
     // convert from 0.0..1.0 to -100..100
-    int result = spd_set_volume(speechDispatcher, (volume - 0.5) * 200);
+    const int value = (volume - 0.5) * 200;
+    if (!connectToSpeechDispatcher()) {
+        m_volume = (value + 100) / 200.0;
+        m_restoreSettings |= VolumeSetting;
+        return true;
+    }
+
+    int result = spd_set_volume(speechDispatcher, value);
+    if (result == 0)
+        m_volume = (value + 100) / 200.0;
     return result == 0;
 }
 
 double QTextToSpeechEngineSpeechd::volume() const
 {
-    double volume = 0.0;
-#ifdef HAVE_SPD_090
-    if (speechDispatcher != 0) {
-        int result = spd_get_volume(speechDispatcher);
-        // -100..100 to 0.0..1.0
-        volume = (result + 100) / 200.0;
-    }
-#endif
-    return volume;
+    return m_volume;
 }
 
 bool QTextToSpeechEngineSpeechd::setLocale(const QLocale &locale)
 {
-    if (!connectToSpeechDispatcher())
-        return false;
+    // the voice is selected once we are connected
+    if (!connectToSpeechDispatcher()) {
+        m_pendingLocale = locale;
+        return true;
+    }
 
     const int result = spd_set_language(speechDispatcher, locale.uiLanguages().at(0).toUtf8().data());
     if (result == 0) {
         const QVoice previousVoice = m_currentVoice;
 
+        // speech-dispatcher picks a voice for the language until we know
+        // the voices, and can select the voice for the locale
+        if (!m_voices.contains(locale) && !m_allVoicesLoaded) {
+            m_pendingLocale = locale;
+            loadVoices();
+            return true;
+        }
         const QList<QVoice> voices = m_voices.values(locale);
         // QMultiHash returns the values in the reverse order
         if (voices.size() > 0 && setVoice(voices.last()))
@@ -280,13 +803,19 @@ bool QTextToSpeechEngineSpeechd::setLocale(const QLocale &locale)
 
 QLocale QTextToSpeechEngineSpeechd::locale() const
 {
+    if (m_pendingLocale)
+        return *m_pendingLocale;
     return m_currentVoice.locale();
 }
 
 bool QTextToSpeechEngineSpeechd::setVoice(const QVoice &voice)
 {
-    if (!connectToSpeechDispatcher())
-        return false;
+    // selected once we are connected
+    if (!connectToSpeechDispatcher()) {
+        m_currentVoice = voice;
+        m_pendingLocale.reset();
+        return true;
+    }
 
     const QByteArray moduleName = voiceData(voice).value<QByteArray>();
     const int result = spd_set_output_module(speechDispatcher, moduleName);
@@ -300,6 +829,7 @@ bool QTextToSpeechEngineSpeechd::setVoice(const QVoice &voice)
     const int result2 = spd_set_synthesis_voice(speechDispatcher, voice.name().toUtf8().data());
     if (result2 == 0) {
         m_currentVoice = voice;
+        m_pendingLocale.reset();
         return true;
     }
     setError(QTextToSpeech::ErrorReason::Configuration,
@@ -327,48 +857,184 @@ QString QTextToSpeechEngineSpeechd::errorString() const
     return m_errorString;
 }
 
-void QTextToSpeechEngineSpeechd::updateVoices()
+// Lists the voices of the given modules. This starts each module in
+// speech-dispatcher, which can take several seconds, so it runs in a background
+// thread, with a connection of its own. The voices of each module are passed
+// to the engine as soon as they are known.
+void QTextToSpeechEngineSpeechd::listVoices(QTextToSpeechEngineSpeechd *engine,
+                                            const QStringList &modules)
 {
-    char **modules = spd_list_modules(speechDispatcher);
-#ifdef HAVE_SPD_090
-    char *original_module = spd_get_output_module(speechDispatcher);
-#else
-    char *original_module = modules[0];
-#endif
-    char **module = modules;
-    while (module != nullptr && module[0] != nullptr) {
-        spd_set_output_module(speechDispatcher, module[0]);
+    SPDConnection *connection = spd_open("QTextToSpeech", "voices", nullptr, SPD_MODE_SINGLE);
+    if (!connection)
+        return;
+
+    QList<QVoice> voiceList;
+    for (const QString &module : modules) {
+        if (engine->m_voiceThreadCancelled.loadRelaxed())
+            break;
+        const QByteArray moduleName = module.toUtf8();
+        spd_set_output_module(connection, moduleName.constData());
 
-        SPDVoice **voices = spd_list_synthesis_voices(speechDispatcher);
+        QList<QVoice> moduleVoices;
+        SPDVoice **voices = spd_list_synthesis_voices(connection);
         int i = 0;
         while (voices != nullptr && voices[i] != nullptr) {
             const QLocale locale = localeForVoice(voices[i]);
-            const QVariant data = QVariant::fromValue<QByteArray>(module[0]);
+            const QVariant data = QVariant::fromValue<QByteArray>(moduleName);
             // speechd declares enums and APIs for gender and age, but the SPDVoice struct
             // carries no relevant information.
-            const QVoice voice = createVoice(QString::fromUtf8(voices[i]->name), locale,
-                                             QVoice::Unknown, QVoice::Other, data);
-            m_voices.insert(locale, voice);
+            moduleVoices.append(createVoice(QString::fromUtf8(voices[i]->name), locale,
+                                            QVoice::Unknown, QVoice::Other, data));
             ++i;
         }
         // free voices.
 #ifdef HAVE_SPD_090
         free_spd_voices(voices);
 #endif
-        ++module;
+        if (moduleVoices.isEmpty())
+            continue;
+        voiceList += moduleVoices;
+        QMetaObject::invokeMethod(engine, [engine, moduleVoices]{
+            engine->addVoices(moduleVoices);
+        }, Qt::QueuedConnection);
     }
+    spd_close(connection);
 
-#ifdef HAVE_SPD_090
-    // Also free modules.
-    free_spd_modules(modules);
-#endif
-    // Set the output module back to what it was.
-    spd_set_output_module(speechDispatcher, original_module);
-#ifdef HAVE_SPD_090
-    free(original_module);
-#endif
+    if (!voiceList.isEmpty() && !engine->m_voiceThreadCancelled.loadRelaxed())
+        writeVoiceCache(modules, voiceList);
+}
+
+// Starts listing the voices of all modules, unless they are known already.
+void QTextToSpeechEngineSpeechd::loadVoices()
+{
+    if (m_allVoicesLoaded || m_voiceThread || !speechDispatcher)
+        return;
+
+    // the voices of a previous attempt are listed again
+    if (!m_voices.isEmpty()) {
+        m_voices.clear();
+        emit voicesChanged();
+    }
+    m_voiceThread.reset(QThread::create(&QTextToSpeechEngineSpeechd::listVoices, this,
+                                        m_modules));
+    connect(m_voiceThread.get(), &QThread::finished,
+            this, &QTextToSpeechEngineSpeechd::voicesLoaded);
+    m_voiceThread->start();
+}
+
+// Adds the voices of a module, and selects the voice for the locale that was
+// set in the meantime as soon as a module has one.
+void QTextToSpeechEngineSpeechd::addVoices(const QList<QVoice> &voices)
+{
+    for (const QVoice &voice : voices)
+        m_voices.insert(voice.locale(), voice);
+    emit voicesChanged();
+
+    if (speechDispatcher && m_pendingLocale)
+        selectVoice(m_voices.values(*m_pendingLocale));
+}
+
+void QTextToSpeechEngineSpeechd::voicesLoaded()
+{
+    m_voiceThread->wait();
+    m_voiceThread.reset();
+    // tried again with the next connection, or when a locale is set
+    if (m_voices.isEmpty())
+        return;
+    m_allVoicesLoaded = true;
+
+    // No module has a voice for the locale that was set in the meantime. The
+    // language is set already, so without a voice for that language either
+    // we leave the choice to speech-dispatcher.
+    if (speechDispatcher && m_pendingLocale)
+        selectVoice(m_voices.values(QLocale(m_pendingLocale->language())));
+}
+
+// Selects the voice of the first module in voices, and reports the changes,
+// as they don't result from a call to setLocale() or setVoice().
+void QTextToSpeechEngineSpeechd::selectVoice(const QList<QVoice> &voices)
+{
+    if (voices.isEmpty())
+        return;
+    const QLocale previousLocale = locale();
+    const QVoice previousVoice = m_currentVoice;
+    // QMultiHash returns the values in the reverse order
+    if (!setVoice(voices.last()))
+        return;
+    if (locale() != previousLocale)
+        emit localeChanged(locale());
+    if (m_currentVoice != previousVoice)
+        emit voiceChanged(m_currentVoice);
+}
+
+static QString voiceCacheFileName()
+{
+    const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+    if (cacheDir.isEmpty())
+        return {};
+    return cacheDir + QLatin1String("/qtspeech/speechd-voices.cache");
+}
+
+static constexpr quint32 VoiceCacheMagic = 0x51545344; // QTSD
+static constexpr quint32 VoiceCacheVersion = 1;
+
+// The cache is valid as long as speech-dispatcher reports the same modules.
+bool QTextToSpeechEngineSpeechd::readVoiceCache(QStringList &modules, QList<QVoice> &voices)
+{
+    QFile file(voiceCacheFileName());
+    if (file.fileName().isEmpty() || !file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    stream >> magic >> version;
+    if (magic != VoiceCacheMagic || version != VoiceCacheVersion)
+        return false;
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    QStringList cachedModules;
+    QList<QVoice> cachedVoices;
+    stream >> cachedModules >> cachedVoices;
+    if (stream.status() != QDataStream::Ok || cachedModules.isEmpty())
+        return false;
+
+    qCDebug(lcSpeechTtsSpeechd) << "Read" << cachedVoices.size() << "voices from"
+                                << file.fileName();
+    modules = cachedModules;
+    voices = cachedVoices;
+    return true;
+}
+
+void QTextToSpeechEngineSpeechd::writeVoiceCache(const QStringList &modules,
+                                                 const QList<QVoice> &voices)
+{
+    const QString fileName = voiceCacheFileName();
+    if (fileName.isEmpty() || !QDir().mkpath(QFileInfo(fileName).path()))
+        return;
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+    QDataStream stream(&file);
+    stream << VoiceCacheMagic << VoiceCacheVersion;
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << modules << voices;
+    if (stream.status() != QDataStream::Ok || !file.commit())
+        qCDebug(lcSpeechTtsSpeechd) << "Failed to write the voice cache" << fileName;
 }
 
+QTextToSpeech::Capabilities QTextToSpeechEngineSpeechd::capabilities() const
+{
+    // without word progress, the capabilities are read from the plugin meta data
+    if (!m_wordProgress)
+        return QTextToSpeech::Capability::None;
+    return QTextToSpeech::Capability::Speak | QTextToSpeech::Capability::PauseResume
+         | QTextToSpeech::Capability::WordByWordProgress;
+}
+
+// The voices that are known; the others are loaded in the background, and
+// reported with voicesChanged().
 QList<QLocale> QTextToSpeechEngineSpeechd::availableLocales() const
 {
     return m_voices.uniqueKeys();
@@ -376,18 +1042,33 @@ QList<QLocale> QTextToSpeechEngineSpeechd::availableLocales() const
 
 QList<QVoice> QTextToSpeechEngineSpeechd::availableVoices() const
 {
-    QList<QVoice> resultList = m_voices.values(m_currentVoice.locale());
+    QList<QVoice> resultList = m_voices.values(locale());
     std::reverse(resultList.begin(), resultList.end());
     return resultList;
 }
 
 // We have no way of knowing our own client_id since speech-dispatcher seems to be incomplete
-// (history functions are just stubs)
+// (history functions are just stubs), so notifications are routed by the message id.
 void speech_finished_callback(size_t msg_id, size_t client_id, SPDNotificationType state)
 {
-    qDebug() << "Message from speech dispatcher" << msg_id << client_id;
-    for (QTextToSpeechEngineSpeechd *backend : std::as_const(*backends))
-        backend->spdStateChanged(state);
+    qCDebug(lcSpeechTtsSpeechd) << "Message from speech dispatcher" << msg_id << client_id
+                                << state;
+    messageRouter->route(msg_id, state, -1);
+}
+
+void index_mark_callback(size_t msg_id, size_t client_id, SPDNotificationType state,
+                         char *index_mark)
+{
+    qCDebug(lcSpeechTtsSpeechd) << "Index mark from speech dispatcher" << msg_id << client_id
+                                << index_mark;
+    // the string is owned by libspeechd, parse it now
+    int mark = -1;
+    if (index_mark) {
+        const char *end = index_mark + qstrlen(index_mark);
+        if (std::from_chars(index_mark, end, mark).ptr != end)
+            mark = -1;
+    }
+    messageRouter->route(msg_id, state, mark);
 }
 
 QT_END_NAMESPACE
@@ -7,15 +7,23 @@
 #include "qtexttospeechengine.h"
 #include "qvoice.h"
 
+#include <QtCore/qatomic.h>
 #include <QtCore/qhash.h>
 #include <QtCore/qlist.h>
 #include <QtCore/qlocale.h>
 #include <QtCore/qobject.h>
 #include <QtCore/qstring.h>
+#include <QtCore/qstringlist.h>
+#include <QtCore/qtimer.h>
 #include <libspeechd.h>
 
+#include <memory>
+#include <optional>
+
 QT_BEGIN_NAMESPACE
 
+class QThread;
+
 class QTextToSpeechEngineSpeechd : public QTextToSpeechEngine
 {
     Q_OBJECT
@@ -25,9 +33,11 @@ public:
     ~QTextToSpeechEngineSpeechd();
 
     // Plug-in API:
+    QTextToSpeech::Capabilities capabilities() const override;
     QList<QLocale> availableLocales() const override;
     QList<QVoice> availableVoices() const override;
     void say(const QString &text) override;
+    void appendUtterance(const QString &text) override;
     void synthesize(const QString &text) override;
     void stop(QTextToSpeech::BoundaryHint boundaryHint) override;
     void pause(QTextToSpeech::BoundaryHint boundaryHint) override;
@@ -46,21 +56,107 @@ public:
     QTextToSpeech::ErrorReason errorReason() const override;
     QString errorString() const override;
 
-    void spdStateChanged(SPDNotificationType state);
+    // called on libspeechd's callback thread; mark is the index of the word
+    // for SPD_EVENT_INDEX_MARK
+    void postNotification(size_t msgId, SPDNotificationType type, int mark);
 
 private:
-    QLocale localeForVoice(SPDVoice *voice) const;
+    struct Notification
+    {
+        Notification *next;
+        size_t msgId;
+        SPDNotificationType type;
+        int mark;
+    };
+    struct Message
+    {
+        size_t id;
+        QString text;
+        // start and length of each word in text, indexed by the mark
+        QList<std::pair<qsizetype, qsizetype>> words;
+    };
+
+    // the result of connecting in the background
+    struct Connection
+    {
+        SPDConnection *connection = nullptr;
+        QStringList modules;
+        double rate = 0.0;
+        double pitch = 0.0;
+        double volume = 0.0;
+        QTextToSpeech::ErrorReason errorReason = QTextToSpeech::ErrorReason::NoError;
+        QString errorString;
+    };
+    enum Setting {
+        RateSetting = 0x1,
+        PitchSetting = 0x2,
+        VolumeSetting = 0x4
+    };
+    static constexpr int InitialReconnectDelay = 250;
+    static constexpr int MaxReconnectDelay = 30000;
+
+    static void openConnection(Connection &result, bool wordProgress);
+    void connectionFinished();
+    void connectionLost(const QString &failedText = {});
+    bool isConnectionAlive() const;
+    static void watchConnection(int socket, int wakeUpFd);
+    void startWatching();
+    void stopWatching();
+    bool sendText(const QString &text, SPDPriority priority);
+    void processNotifications();
+    void handleNotification(size_t msgId, SPDNotificationType type, int mark);
+    void spdStateChanged(SPDNotificationType state);
+    void requestNextUtterances();
+    static QLocale localeForVoice(SPDVoice *voice);
     bool connectToSpeechDispatcher();
-    void updateVoices();
+    static void listVoices(QTextToSpeechEngineSpeechd *engine, const QStringList &modules);
+    void loadVoices();
+    void addVoices(const QList<QVoice> &voices);
+    void voicesLoaded();
+    void selectVoice(const QList<QVoice> &voices);
+    static bool readVoiceCache(QStringList &modules, QList<QVoice> &voices);
+    static void writeVoiceCache(const QStringList &modules, const QList<QVoice> &voices);
     void setError(QTextToSpeech::ErrorReason reason, const QString &errorString);
 
-    QTextToSpeech::State m_state = QTextToSpeech::Error;
-    QTextToSpeech::ErrorReason m_errorReason = QTextToSpeech::ErrorReason::Initialization;
+    QTextToSpeech::State m_state = QTextToSpeech::Ready;
+    QTextToSpeech::ErrorReason m_errorReason = QTextToSpeech::ErrorReason::NoError;
     QString m_errorString;
     SPDConnection *speechDispatcher;
+    // the ids of the message being spoken and of the ones sent ahead of time;
+    // notifications for other messages are ignored
+    QList<Message> m_messages;
+    int m_pipelineDepth = 0;
+    bool m_wordProgress = false;
+    QByteArray m_ssml;
+    // local copies of the server's settings
+    double m_rate = 0.0;
+    double m_pitch = 0.0;
+    double m_volume = 0.0;
+    // settings to apply to a new connection
+    int m_restoreSettings = 0;
+
+    // work requested while not connected, spoken in this order; the locale
+    // is also pending while the voices are loaded
+    QStringList m_pendingTexts;
+    std::optional<QLocale> m_pendingLocale;
+
+    std::unique_ptr<QThread> m_connectThread;
+    Connection m_connection; // written by m_connectThread
+    QTimer m_reconnectTimer;
+    int m_reconnectDelay = InitialReconnectDelay;
+    // waits for the socket of the connection to hang up
+    std::unique_ptr<QThread> m_watchThread;
+    int m_wakeUpPipe[2] = {-1, -1};
+    // lock-free stack of notifications posted from the callback thread
+    QAtomicPointer<Notification> m_notifications = nullptr;
     QVoice m_currentVoice;
-    // Voices mapped by their locale name.
+    QStringList m_modules;
+    // Voices mapped by their locale name, and in the order of the modules,
+    // loaded in the background once connected, one module at a time.
     QMultiHash<QLocale, QVoice> m_voices;
+    bool m_allVoicesLoaded = false;
+    std::unique_ptr<QThread> m_voiceThread;
+    QAtomicInteger<bool> m_voiceThreadCancelled = false;
 };
 
 QT_END_NAMESPACE
@@ -4,8 +4,14 @@
 #include "qtexttospeech_speechd_plugin.h"
 #include "qtexttospeech_speechd.h"
 
+QT_BEGIN_NAMESPACE
+
+Q_LOGGING_CATEGORY(lcSpeechTtsSpeechd, "qt.speech.tts.speechd")
+
 QTextToSpeechEngine *QTextToSpeechSpeechdPlugin::createTextToSpeechEngine(const QVariantMap &parameters, QObject *parent, QString *errorString) const
 {
     Q_UNUSED(errorString);
     return new QTextToSpeechEngineSpeechd(parameters, parent);
 }
+
+QT_END_NAMESPACE
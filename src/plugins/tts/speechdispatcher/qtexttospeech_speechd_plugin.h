@@ -12,7 +12,7 @@
 
 QT_BEGIN_NAMESPACE
 
-//Q_DECLARE_LOGGING_CATEGORY(lcSpeechTtsSpeechd)
+Q_DECLARE_LOGGING_CATEGORY(lcSpeechTtsSpeechd)
 
 class QTextToSpeechSpeechdPlugin : public QObject, public QTextToSpeechPlugin
 {
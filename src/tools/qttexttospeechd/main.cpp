@@ -0,0 +1,70 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include "qtexttospeechdaemon.h"
+
+#include <QtTextToSpeech/private/qtexttospeechdaemonprotocol_p.h>
+
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QThread>
+
+#include <cstdio>
+
+using namespace Qt::StringLiterals;
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(u"qttexttospeechd"_s);
+    QCoreApplication::setApplicationVersion(QT_VERSION_STR ""_L1);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        u"Synthesizes speech for applications that use the localdaemon "
+         "text-to-speech engine."_s);
+    parser.addHelpOption();
+    parser.addVersionOption();
+    const QCommandLineOption nameOption(u"name"_s,
+        u"Listen on the local socket <name>."_s, u"name"_s,
+        QTextToSpeechDaemonProtocol::defaultServerName());
+    parser.addOption(nameOption);
+    const QCommandLineOption workersOption(u"workers"_s,
+        u"Synthesize up to <count> texts concurrently."_s, u"count"_s,
+        QString::number(qBound(1, QThread::idealThreadCount() / 2, 4)));
+    parser.addOption(workersOption);
+    const QCommandLineOption accessOption(u"access"_s,
+        u"Accept connections from the <policy> user, group, or world."_s, u"policy"_s,
+        u"user"_s);
+    parser.addOption(accessOption);
+    parser.process(app);
+
+    bool ok = false;
+    const int workers = parser.value(workersOption).toInt(&ok);
+    if (!ok || workers < 1) {
+        fprintf(stderr, "Invalid worker count: %s\n", qPrintable(parser.value(workersOption)));
+        return 1;
+    }
+
+    QLocalServer::SocketOptions access;
+    const QString policy = parser.value(accessOption);
+    if (policy == "user"_L1) {
+        access = QLocalServer::UserAccessOption;
+    } else if (policy == "group"_L1) {
+        access = QLocalServer::UserAccessOption | QLocalServer::GroupAccessOption;
+    } else if (policy == "world"_L1) {
+        access = QLocalServer::WorldAccessOption;
+    } else {
+        fprintf(stderr, "Invalid access policy: %s\n", qPrintable(policy));
+        return 1;
+    }
+
+    QTextToSpeechDaemon daemon(workers);
+    if (!daemon.listen(parser.value(nameOption), access)) {
+        fprintf(stderr, "Could not listen on %s: %s\n", qPrintable(parser.value(nameOption)),
+                qPrintable(daemon.errorString()));
+        return 1;
+    }
+
+    return app.exec();
+}
@@ -0,0 +1,328 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include "qtexttospeechdaemon.h"
+
+#include <QtTextToSpeech/private/qtexttospeechdaemonprotocol_p.h>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QLoggingCategory>
+#include <QtNetwork/QLocalSocket>
+
+QT_BEGIN_NAMESPACE
+
+Q_LOGGING_CATEGORY(lcSpeechDaemon, "qt.speech.daemon")
+
+using namespace QTextToSpeechDaemonProtocol;
+
+// The engines synthesizing for a client are throttled while more audio than
+// that waits to be written to its socket, and resume once it drained to the
+// low-water mark. The client stops reading while its sink is behind.
+static constexpr qint64 HighWaterMark = 256 * 1024;
+static constexpr qint64 LowWaterMark = HighWaterMark / 4;
+
+QTextToSpeechDaemon::QTextToSpeechDaemon(int workerCount, QObject *parent)
+    : QObject(parent)
+{
+    for (int i = 0; i < qMax(1, workerCount); ++i) {
+        auto worker = std::make_unique<Worker>();
+        worker->worker = new QTextToSpeechDaemonWorker;
+        worker->worker->moveToThread(&worker->thread);
+        connect(&worker->thread, &QThread::finished, worker->worker, &QObject::deleteLater);
+
+        connect(worker->worker, &QTextToSpeechDaemonWorker::described,
+                this, &QTextToSpeechDaemon::described);
+        connect(worker->worker, &QTextToSpeechDaemonWorker::audio,
+                this, &QTextToSpeechDaemon::audio);
+        connect(worker->worker, &QTextToSpeechDaemonWorker::word,
+                this, &QTextToSpeechDaemon::word);
+        connect(worker->worker, &QTextToSpeechDaemonWorker::failed,
+                this, &QTextToSpeechDaemon::failed);
+        connect(worker->worker, &QTextToSpeechDaemonWorker::finished,
+                this, [this, w = worker.get()](quint64 ticket) { finished(w, ticket); });
+
+        worker->thread.setObjectName(QStringLiteral("QTextToSpeechDaemonWorker %1").arg(i));
+        worker->thread.start();
+        m_workers.push_back(std::move(worker));
+    }
+
+    connect(&m_server, &QLocalServer::newConnection, this, &QTextToSpeechDaemon::newConnection);
+}
+
+QTextToSpeechDaemon::~QTextToSpeechDaemon()
+{
+    for (const auto &worker : m_workers) {
+        worker->thread.quit();
+        worker->thread.wait();
+    }
+    qDeleteAll(m_clients);
+}
+
+bool QTextToSpeechDaemon::listen(const QString &serverName, QLocalServer::SocketOptions access)
+{
+    // A socket file that nobody accepts connections on is left behind by a
+    // daemon that crashed, and can be removed. Another daemon that is still
+    // running keeps serving its clients.
+    QLocalSocket probe;
+    probe.connectToServer(serverName);
+    if (probe.waitForConnected(1000)) {
+        probe.abort();
+        m_errorString = QCoreApplication::translate("QTextToSpeech",
+                                                    "Another speech daemon is running.");
+        return false;
+    }
+    QLocalServer::removeServer(serverName);
+
+    m_server.setSocketOptions(access);
+    if (!m_server.listen(serverName)) {
+        m_errorString = m_server.errorString();
+        return false;
+    }
+    qCDebug(lcSpeechDaemon) << "Listening on" << m_server.fullServerName() << "with"
+                            << m_workers.size() << "workers";
+    return true;
+}
+
+void QTextToSpeechDaemon::newConnection()
+{
+    while (QLocalSocket *socket = m_server.nextPendingConnection()) {
+        Client *client = new Client{socket, {}, {}};
+        m_clients.append(client);
+        connect(socket, &QLocalSocket::readyRead, this, [this, client]{ readMessages(client); });
+        connect(socket, &QLocalSocket::disconnected, this, [this, client]{ disconnected(client); });
+        connect(socket, &QLocalSocket::bytesWritten, this, [this, client]{
+            if (client->throttled && client->socket->bytesToWrite() <= LowWaterMark)
+                setThrottled(client, false);
+        });
+        qCDebug(lcSpeechDaemon) << "Client connected," << m_clients.size() << "clients";
+    }
+}
+
+void QTextToSpeechDaemon::readMessages(Client *client)
+{
+    QDataStream in(client->socket);
+    in.setVersion(StreamVersion);
+    QByteArray payload;
+    while (readMessage(in, payload))
+        handleMessage(client, payload);
+}
+
+void QTextToSpeechDaemon::handleMessage(Client *client, const QByteArray &payload)
+{
+    QDataStream in(payload);
+    in.setVersion(StreamVersion);
+    quint8 type = 0;
+    in >> type;
+
+    switch (MessageType(type)) {
+    case MessageType::Hello: {
+        quint32 version = 0;
+        in >> version >> client->engine >> client->parameters;
+        if (version != Version) {
+            client->socket->write(message(MessageType::Welcome,
+                int(QTextToSpeech::ErrorReason::Initialization),
+                QCoreApplication::translate("QTextToSpeech",
+                                            "Incompatible speech daemon protocol version %1.")
+                    .arg(version), 0, QVoice(), QList<QVoice>()));
+            return;
+        }
+        const quint64 ticket = ++m_nextTicket;
+        m_tickets.insert(ticket, Ticket{client, 0, nullptr, {}});
+        // any worker can describe the engine, and will then already have it loaded
+        QTextToSpeechDaemonWorker::Request request;
+        request.engine = client->engine;
+        request.parameters = client->parameters;
+        Worker *worker = idleWorker(request);
+        if (!worker)
+            worker = m_workers.front().get();
+        const std::pair engine(client->engine, client->parameters);
+        if (!worker->engines.contains(engine))
+            worker->engines.append(engine);
+        QMetaObject::invokeMethod(worker->worker, [worker, ticket, engine = client->engine,
+                                                   parameters = client->parameters]{
+            worker->worker->describe(ticket, engine, parameters);
+        }, Qt::QueuedConnection);
+        break;
+    }
+    case MessageType::Synthesize: {
+        quint32 id = 0;
+        QTextToSpeechDaemonWorker::Request request;
+        in >> id >> request.text >> request.locale >> request.voice
+           >> request.rate >> request.pitch >> request.volume;
+        request.ticket = ++m_nextTicket;
+        request.engine = client->engine;
+        request.parameters = client->parameters;
+        m_tickets.insert(request.ticket, Ticket{client, id, nullptr, {}});
+        m_pending.enqueue(request);
+        dispatch();
+        break;
+    }
+    case MessageType::Cancel: {
+        quint32 id = 0;
+        in >> id;
+        for (auto it = m_tickets.cbegin(); it != m_tickets.cend(); ++it) {
+            if (it->client == client && it->id == id) {
+                cancel(it.key());
+                break;
+            }
+        }
+        break;
+    }
+    default:
+        qCWarning(lcSpeechDaemon) << "Unexpected message" << type;
+        break;
+    }
+}
+
+void QTextToSpeechDaemon::disconnected(Client *client)
+{
+    QList<quint64> tickets;
+    for (auto it = m_tickets.cbegin(); it != m_tickets.cend(); ++it) {
+        if (it->client == client)
+            tickets.append(it.key());
+    }
+    for (quint64 ticket : std::as_const(tickets))
+        cancel(ticket);
+
+    m_clients.removeOne(client);
+    client->socket->disconnect(this);
+    client->socket->deleteLater();
+    delete client;
+    qCDebug(lcSpeechDaemon) << "Client disconnected," << m_clients.size() << "clients";
+}
+
+// Output of a canceled request is dropped, but the worker stays busy until
+// the engine has stopped.
+void QTextToSpeechDaemon::cancel(quint64 ticket)
+{
+    const auto it = m_tickets.find(ticket);
+    if (it == m_tickets.end())
+        return;
+
+    if (Worker *worker = it->worker) {
+        it->client = nullptr;
+        QMetaObject::invokeMethod(worker->worker, [worker, ticket]{
+            worker->worker->cancel(ticket);
+        }, Qt::QueuedConnection);
+    } else {
+        m_pending.removeIf([ticket](const QTextToSpeechDaemonWorker::Request &request) {
+            return request.ticket == ticket;
+        });
+        m_tickets.erase(it);
+    }
+}
+
+void QTextToSpeechDaemon::setThrottled(Client *client, bool throttled)
+{
+    client->throttled = throttled;
+    qCDebug(lcSpeechDaemon) << (throttled ? "Throttling" : "Unthrottling") << "client with"
+                            << client->socket->bytesToWrite() << "bytes to write";
+    for (auto it = m_tickets.cbegin(); it != m_tickets.cend(); ++it) {
+        if (it->client == client && it->worker)
+            throttle(it.key(), throttled);
+    }
+}
+
+void QTextToSpeechDaemon::throttle(quint64 ticket, bool throttled)
+{
+    Worker *worker = m_tickets.value(ticket).worker;
+    Q_ASSERT(worker);
+    QMetaObject::invokeMethod(worker->worker, [worker, ticket, throttled]{
+        worker->worker->setThrottled(ticket, throttled);
+    }, Qt::QueuedConnection);
+}
+
+// Prefers an idle worker that has already created the engine
+QTextToSpeechDaemon::Worker *QTextToSpeechDaemon::idleWorker(
+        const QTextToSpeechDaemonWorker::Request &request) const
+{
+    Worker *candidate = nullptr;
+    for (const auto &worker : m_workers) {
+        if (worker->ticket)
+            continue;
+        if (worker->engines.contains(std::pair(request.engine, request.parameters)))
+            return worker.get();
+        if (!candidate)
+            candidate = worker.get();
+    }
+    return candidate;
+}
+
+void QTextToSpeechDaemon::dispatch()
+{
+    while (!m_pending.isEmpty()) {
+        Worker *worker = idleWorker(m_pending.head());
+        if (!worker)
+            return;
+        const QTextToSpeechDaemonWorker::Request request = m_pending.dequeue();
+        const std::pair engine(request.engine, request.parameters);
+        if (!worker->engines.contains(engine))
+            worker->engines.append(engine);
+        worker->ticket = request.ticket;
+        m_tickets[request.ticket].worker = worker;
+        QMetaObject::invokeMethod(worker->worker, [worker, request]{
+            worker->worker->synthesize(request);
+        }, Qt::QueuedConnection);
+        // the request starts throttled if the client is still behind
+        const Client *client = m_tickets.value(request.ticket).client;
+        if (client && client->throttled)
+            throttle(request.ticket, true);
+    }
+}
+
+void QTextToSpeechDaemon::described(quint64 ticket, int errorReason, const QString &errorString,
+                                    int capabilities, const QVoice &voice,
+                                    const QList<QVoice> &voices)
+{
+    const auto it = m_tickets.constFind(ticket);
+    if (it == m_tickets.cend())
+        return;
+    if (it->client) {
+        it->client->socket->write(message(MessageType::Welcome, errorReason, errorString,
+                                          capabilities, voice, voices));
+    }
+    m_tickets.erase(it);
+}
+
+void QTextToSpeechDaemon::audio(quint64 ticket, const QAudioFormat &format, const QByteArray &pcm)
+{
+    const auto it = m_tickets.find(ticket);
+    if (it == m_tickets.end() || !it->client)
+        return;
+    if (it->format != format) {
+        it->format = format;
+        it->client->socket->write(formatMessage(it->id, format));
+    }
+    it->client->socket->write(message(MessageType::Audio, it->id, pcm));
+    if (!it->client->throttled && it->client->socket->bytesToWrite() > HighWaterMark)
+        setThrottled(it->client, true);
+}
+
+void QTextToSpeechDaemon::word(quint64 ticket, qint64 audioOffset, qint64 start, qint64 length)
+{
+    const auto it = m_tickets.constFind(ticket);
+    if (it != m_tickets.cend() && it->client)
+        it->client->socket->write(message(MessageType::Word, it->id, audioOffset, start, length));
+}
+
+void QTextToSpeechDaemon::failed(quint64 ticket, int errorReason, const QString &errorString)
+{
+    const auto it = m_tickets.constFind(ticket);
+    if (it != m_tickets.cend() && it->client)
+        it->client->socket->write(message(MessageType::Error, it->id, errorReason, errorString));
+}
+
+void QTextToSpeechDaemon::finished(Worker *worker, quint64 ticket)
+{
+    const auto it = m_tickets.constFind(ticket);
+    if (it != m_tickets.cend()) {
+        if (it->client)
+            it->client->socket->write(message(MessageType::Finished, it->id));
+        m_tickets.erase(it);
+    }
+    if (worker->ticket == ticket)
+        worker->ticket = 0;
+    dispatch();
+}
+
+QT_END_NAMESPACE
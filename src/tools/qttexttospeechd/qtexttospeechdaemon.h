@@ -0,0 +1,96 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHDAEMON_H
+#define QTEXTTOSPEECHDAEMON_H
+
+#include "qtexttospeechdaemonworker.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QQueue>
+#include <QtCore/QThread>
+#include <QtNetwork/QLocalServer>
+
+#include <memory>
+
+QT_BEGIN_NAMESPACE
+
+class QLocalSocket;
+
+// Accepts connections from the localdaemon engine plugin, and schedules the
+// requests of all clients on a pool of workers.
+class QTextToSpeechDaemon : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit QTextToSpeechDaemon(int workerCount, QObject *parent = nullptr);
+    ~QTextToSpeechDaemon() override;
+
+    // Only the user that runs the daemon can connect by default, as clients
+    // can have any text synthesized with the engines of the daemon.
+    bool listen(const QString &serverName,
+                QLocalServer::SocketOptions access = QLocalServer::UserAccessOption);
+    QString errorString() const { return m_errorString; }
+
+private:
+    struct Client
+    {
+        QLocalSocket *socket = nullptr;
+        QString engine;
+        QVariantMap parameters;
+        // the workers of the client's requests are throttled while the
+        // socket has too much audio to write
+        bool throttled = false;
+    };
+
+    struct Worker
+    {
+        QThread thread;
+        QTextToSpeechDaemonWorker *worker = nullptr;
+        quint64 ticket = 0;
+        // engines the worker has created, for scheduling requests to workers
+        // that don't have to load the engine first
+        QList<std::pair<QString, QVariantMap>> engines;
+    };
+
+    // identifies a request across all clients
+    struct Ticket
+    {
+        Client *client = nullptr;
+        quint32 id = 0;
+        Worker *worker = nullptr;
+        QAudioFormat format;
+    };
+
+    void newConnection();
+    void readMessages(Client *client);
+    void handleMessage(Client *client, const QByteArray &payload);
+    void disconnected(Client *client);
+    void cancel(quint64 ticket);
+    void setThrottled(Client *client, bool throttled);
+    void throttle(quint64 ticket, bool throttled);
+    void dispatch();
+    Worker *idleWorker(const QTextToSpeechDaemonWorker::Request &request) const;
+
+    void described(quint64 ticket, int errorReason, const QString &errorString, int capabilities,
+                   const QVoice &voice, const QList<QVoice> &voices);
+    void audio(quint64 ticket, const QAudioFormat &format, const QByteArray &pcm);
+    void word(quint64 ticket, qint64 audioOffset, qint64 start, qint64 length);
+    void failed(quint64 ticket, int errorReason, const QString &errorString);
+    void finished(Worker *worker, quint64 ticket);
+
+    QLocalServer m_server;
+    QString m_errorString;
+    QList<Client *> m_clients;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    QHash<quint64, Ticket> m_tickets;
+    QQueue<QTextToSpeechDaemonWorker::Request> m_pending;
+    quint64 m_nextTicket = 0;
+};
+
+QT_END_NAMESPACE
+
+#endif
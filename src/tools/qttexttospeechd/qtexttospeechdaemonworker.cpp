@@ -0,0 +1,160 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include "qtexttospeechdaemonworker.h"
+
+#include <QtTextToSpeech/private/qtexttospeech_p.h>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QLoggingCategory>
+
+QT_BEGIN_NAMESPACE
+
+Q_DECLARE_LOGGING_CATEGORY(lcSpeechDaemon)
+
+using namespace Qt::StringLiterals;
+
+QTextToSpeechDaemonWorker::Engine *QTextToSpeechDaemonWorker::engine(const QString &name,
+                                                                     const QVariantMap &parameters)
+{
+    for (Engine &engine : m_engines) {
+        if (engine.name == name && engine.parameters == parameters)
+            return &engine;
+    }
+
+    // the daemon can't serve itself
+    if (name == "localdaemon"_L1)
+        return nullptr;
+
+    Engine entry{name, parameters, new QTextToSpeech(name, parameters, this), {}, {}};
+    QTextToSpeech *tts = entry.tts;
+    if (name.isEmpty() && tts->engine() == "localdaemon"_L1) {
+        delete tts;
+        return nullptr;
+    }
+    qCDebug(lcSpeechDaemon) << "Created engine" << tts->engine() << "in" << thread();
+
+    // the catalog is collected once, as changing the locale of an engine
+    // that is synthesizing would affect the running request
+    if (tts->state() != QTextToSpeech::Error) {
+        entry.defaultVoice = tts->voice();
+        const QLocale defaultLocale = tts->locale();
+        const QList<QLocale> locales = tts->availableLocales();
+        for (const QLocale &locale : locales) {
+            tts->setLocale(locale);
+            entry.voices += tts->availableVoices();
+        }
+        tts->setLocale(defaultLocale);
+        tts->setVoice(entry.defaultVoice);
+    }
+
+    connect(tts, &QTextToSpeech::stateChanged, this, [this, tts](QTextToSpeech::State state) {
+        if (tts != m_tts)
+            return;
+        if (state == QTextToSpeech::Error) {
+            emit failed(m_ticket, int(tts->errorReason()), tts->errorString());
+            finish();
+        } else if (state == QTextToSpeech::Ready) {
+            finish();
+        }
+    });
+    // engines that report words while synthesizing
+    connect(tts, &QTextToSpeech::sayingWord, this,
+            [this, tts](const QString &, qsizetype, qsizetype start, qsizetype length) {
+        if (tts == m_tts)
+            emit word(m_ticket, m_audioOffset, start, length);
+    });
+
+    m_engines.append(entry);
+    return &m_engines.last();
+}
+
+void QTextToSpeechDaemonWorker::describe(quint64 ticket, const QString &name,
+                                         const QVariantMap &parameters)
+{
+    const Engine *engine = this->engine(name, parameters);
+    if (!engine) {
+        emit described(ticket, int(QTextToSpeech::ErrorReason::Configuration),
+                       QCoreApplication::translate("QTextToSpeech", "Engine %1 is not available.")
+                            .arg(name), 0, {}, {});
+        return;
+    }
+
+    const QTextToSpeech *tts = engine->tts;
+    if (tts->state() == QTextToSpeech::Error) {
+        emit described(ticket, int(tts->errorReason()), tts->errorString(), 0, {}, {});
+    } else if (!(tts->engineCapabilities() & QTextToSpeech::Capability::Synthesize)) {
+        emit described(ticket, int(QTextToSpeech::ErrorReason::Configuration),
+                       QCoreApplication::translate("QTextToSpeech",
+                                                   "Engine %1 can't synthesize audio data.")
+                            .arg(tts->engine()), 0, {}, {});
+    } else {
+        emit described(ticket, int(QTextToSpeech::ErrorReason::NoError), {},
+                       tts->engineCapabilities().toInt(), engine->defaultVoice, engine->voices);
+    }
+}
+
+void QTextToSpeechDaemonWorker::synthesize(const Request &request)
+{
+    Q_ASSERT(!m_ticket);
+    // engines don't change their state for texts without words, so the
+    // request would never finish
+    if (request.text.trimmed().isEmpty()) {
+        emit failed(request.ticket, int(QTextToSpeech::ErrorReason::Input),
+                    QCoreApplication::translate("QTextToSpeech", "The text is empty."));
+        emit finished(request.ticket);
+        return;
+    }
+
+    const Engine *engine = this->engine(request.engine, request.parameters);
+    QTextToSpeech *tts = engine ? engine->tts : nullptr;
+    if (!tts || tts->state() == QTextToSpeech::Error) {
+        emit failed(request.ticket, int(QTextToSpeech::ErrorReason::Configuration),
+                    tts ? tts->errorString()
+                        : QCoreApplication::translate("QTextToSpeech", "Engine %1 is not available.")
+                            .arg(request.engine));
+        emit finished(request.ticket);
+        return;
+    }
+
+    if (request.locale != tts->locale())
+        tts->setLocale(request.locale);
+    if (!request.voice.name().isEmpty() && request.voice != tts->voice())
+        tts->setVoice(request.voice);
+    tts->setRate(request.rate);
+    tts->setPitch(request.pitch);
+    tts->setVolume(request.volume);
+
+    m_ticket = request.ticket;
+    m_tts = tts;
+    m_audioOffset = 0;
+    tts->synthesize(request.text, this, [this](const QAudioFormat &format, const QByteArray &pcm) {
+        emit audio(m_ticket, format, pcm);
+        m_audioOffset += pcm.size();
+    });
+}
+
+void QTextToSpeechDaemonWorker::cancel(quint64 ticket)
+{
+    // the request finishes once the engine is ready
+    if (ticket == m_ticket && m_tts)
+        m_tts->stop(QTextToSpeech::BoundaryHint::Immediate);
+}
+
+// The daemon throttles the request while the client doesn't read its audio
+// fast enough. The throttle is released when the synthesis is done.
+void QTextToSpeechDaemonWorker::setThrottled(quint64 ticket, bool throttled)
+{
+    if (ticket == m_ticket && m_tts)
+        QTextToSpeechPrivate::setSynthesisThrottled(m_tts, throttled);
+}
+
+void QTextToSpeechDaemonWorker::finish()
+{
+    const quint64 ticket = std::exchange(m_ticket, 0);
+    m_tts = nullptr;
+    if (ticket)
+        emit finished(ticket);
+}
+
+QT_END_NAMESPACE
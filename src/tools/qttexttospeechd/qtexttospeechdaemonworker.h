@@ -0,0 +1,79 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHDAEMONWORKER_H
+#define QTEXTTOSPEECHDAEMONWORKER_H
+
+#include <QtTextToSpeech/qtexttospeech.h>
+#include <QtTextToSpeech/qvoice.h>
+
+#include <QtCore/QList>
+#include <QtCore/QLocale>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QVariantMap>
+#include <QtMultimedia/QAudioFormat>
+
+QT_BEGIN_NAMESPACE
+
+// Lives in a thread of the worker pool, and synthesizes one text at a time.
+// The engines are created on first use, and then shared by all clients that
+// use the same engine with the same parameters.
+class QTextToSpeechDaemonWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Request
+    {
+        quint64 ticket = 0;
+        QString engine;
+        QVariantMap parameters;
+        QString text;
+        QLocale locale;
+        QVoice voice;
+        double rate = 0;
+        double pitch = 0;
+        double volume = 1;
+    };
+
+    using QObject::QObject;
+
+    void describe(quint64 ticket, const QString &engine, const QVariantMap &parameters);
+    void synthesize(const Request &request);
+    void cancel(quint64 ticket);
+    void setThrottled(quint64 ticket, bool throttled);
+
+Q_SIGNALS:
+    void described(quint64 ticket, int errorReason, const QString &errorString, int capabilities,
+                   const QVoice &voice, const QList<QVoice> &voices);
+    void audio(quint64 ticket, const QAudioFormat &format, const QByteArray &pcm);
+    void word(quint64 ticket, qint64 audioOffset, qint64 start, qint64 length);
+    void failed(quint64 ticket, int errorReason, const QString &errorString);
+    void finished(quint64 ticket);
+
+private:
+    struct Engine
+    {
+        QString name;
+        QVariantMap parameters;
+        QTextToSpeech *tts = nullptr;
+        // all voices, in all locales
+        QList<QVoice> voices;
+        QVoice defaultVoice;
+    };
+
+    Engine *engine(const QString &name, const QVariantMap &parameters);
+    void finish();
+
+    QList<Engine> m_engines;
+
+    // the running request
+    quint64 m_ticket = 0;
+    QTextToSpeech *m_tts = nullptr;
+    qint64 m_audioOffset = 0;
+};
+
+QT_END_NAMESPACE
+
+#endif
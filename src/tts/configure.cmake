@@ -12,6 +12,8 @@
 qt_find_package(Flite PROVIDED_TARGETS Flite::Flite MODULE_NAME texttospeech QMAKE_LIB flite)
 qt_find_package(ALSA PROVIDED_TARGETS ALSA::ALSA MODULE_NAME texttospeech QMAKE_LIB flite_alsa)
 qt_find_package(SpeechDispatcher PROVIDED_TARGETS SpeechDispatcher::SpeechDispatcher MODULE_NAME texttospeech QMAKE_LIB speechd)
+qt_find_package(EspeakNG PROVIDED_TARGETS EspeakNG::EspeakNG MODULE_NAME texttospeech QMAKE_LIB espeakng)
+qt_find_package(OnnxRuntime PROVIDED_TARGETS OnnxRuntime::OnnxRuntime MODULE_NAME texttospeech QMAKE_LIB onnxruntime)
 
 
 #### Tests
@@ -33,8 +35,18 @@ qt_feature("speechd" PUBLIC
     AUTODETECT UNIX
     CONDITION SpeechDispatcher_FOUND
 )
+qt_feature("espeakng" PRIVATE
+    LABEL "eSpeak NG"
+    CONDITION EspeakNG_FOUND
+)
+qt_feature("piper" PRIVATE
+    LABEL "Piper (ONNX Runtime)"
+    CONDITION EspeakNG_FOUND AND OnnxRuntime_FOUND
+)
 qt_configure_add_summary_section(NAME "Qt TextToSpeech")
 qt_configure_add_summary_entry(ARGS "flite")
 qt_configure_add_summary_entry(ARGS "flite_alsa")
 qt_configure_add_summary_entry(ARGS "speechd")
+qt_configure_add_summary_entry(ARGS "espeakng")
+qt_configure_add_summary_entry(ARGS "piper")
 qt_configure_end_summary_section() # end of "Qt TextToSpeech" section
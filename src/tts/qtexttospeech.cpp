@@ -4,16 +4,30 @@
 
 #include "qtexttospeech.h"
 #include "qtexttospeech_p.h"
+#include "qtexttospeechaudiofilter.h"
+#include "qtexttospeechaudiomixer_p.h"
+#include "qtexttospeechfilewriter_p.h"
+#include "qtexttospeechtimeline_p.h"
+#include "qttexttospeech_tracepoints_p.h"
+#if QT_CONFIG(sharedmemory)
+#include "qtexttospeechsharedmemory.h"
+#endif
 
 #include <QtCore/qcborarray.h>
 #include <QtCore/qdebug.h>
+#include <QtCore/qiodevice.h>
+#include <QtCore/qmetaobject.h>
+#include <QtCore/qthread.h>
 #include <QtCore/private/qfactoryloader_p.h>
 
 #include <QtMultimedia/qaudiobuffer.h>
 
+#include <memory>
+
 QT_BEGIN_NAMESPACE
 
 using namespace Qt::StringLiterals;
+using Phase = QTextToSpeechTimeline::Phase;
 
 Q_GLOBAL_STATIC_WITH_ARGS(QFactoryLoader, loader,
         ("org.qt-project.qt.speech.tts.plugin/6.0",
@@ -26,6 +40,7 @@ QTextToSpeechPrivate::QTextToSpeechPrivate(QTextToSpeech *speech)
 {
     qRegisterMetaType<QTextToSpeech::State>();
     qRegisterMetaType<QTextToSpeech::ErrorReason>();
+    QTextToSpeechTimeline::startFromEnvironment();
 }
 
 QTextToSpeechPrivate::~QTextToSpeechPrivate()
@@ -75,15 +90,51 @@ void QTextToSpeechPrivate::setEngineProvider(const QString &engine, const QVaria
         // We have to maintain the public state separately from the engine's actual
         // state, as we use it to manage queued texts
         updateState(m_engine->state());
+        // engines that don't play audio themselves don't implement the interface
+        if (auto *client = qobject_cast<QTextToSpeechAudioFilterChainClient *>(m_engine.get()))
+            client->setAudioFilterChain(&m_audioFilters);
+        if (m_audioMixer)
+            QTextToSpeechAudioMixerPrivate::setEngineSource(m_engine.get(), m_mixerSource.get());
         QObjectPrivate::connect(m_engine.get(), &QTextToSpeechEngine::stateChanged,
                                 this, &QTextToSpeechPrivate::updateState);
         // The other engine signals are directly forwarded to public API signals
         QObject::connect(m_engine.get(), &QTextToSpeechEngine::errorOccurred,
                          q, &QTextToSpeech::errorOccurred);
+        QObject::connect(m_engine.get(), &QTextToSpeechEngine::localeChanged,
+                         q, &QTextToSpeech::localeChanged);
+        QObject::connect(m_engine.get(), &QTextToSpeechEngine::voiceChanged,
+                         q, &QTextToSpeech::voiceChanged);
+        QObject::connect(m_engine.get(), &QTextToSpeechEngine::voicesChanged,
+                         q, &QTextToSpeech::availableVoicesChanged);
         QObject::connect(m_engine.get(), &QTextToSpeechEngine::sayingWord,
                          q, [this, q](const QString &word, qsizetype start, qsizetype length){
+            Q_TRACE(QTextToSpeechEngine_sayingWord, qint64(m_currentUtterance),
+                    qint64(start), qint64(length));
+            QTextToSpeechTimeline::record(Phase::Instant, "word", m_currentUtterance, start);
             emit q->sayingWord(word, m_currentUtterance, start, length);
         });
+        QObject::connect(m_engine.get(), &QTextToSpeechEngine::wordTimeline,
+                         q, [this, q](const QList<QTextToSpeech::WordBoundary> &words){
+            // engines report the timeline of the text that they got last
+            emit q->wordTimeline(m_currentUtterance + m_gaplessUtterances, words);
+        });
+        QObject::connect(m_engine.get(), &QTextToSpeechEngine::phonemeEvents,
+                         q, [this, q](const QList<QTextToSpeech::Phoneme> &phonemes){
+            if (m_visemeTable.isEmpty()) {
+                emit q->phonemeEvents(m_currentUtterance + m_gaplessUtterances, phonemes);
+                return;
+            }
+            QList<QTextToSpeech::Phoneme> visemes = phonemes;
+            for (QTextToSpeech::Phoneme &phoneme : visemes)
+                phoneme.viseme = m_visemeTable.value(phoneme.name, -1);
+            emit q->phonemeEvents(m_currentUtterance + m_gaplessUtterances, visemes);
+        });
+        updateWordSignalsEnabled();
+        updatePhonemeEventsEnabled();
+        QObjectPrivate::connect(m_engine.get(), &QTextToSpeechEngine::readyForNextUtterance,
+                                this, &QTextToSpeechPrivate::sayNextUtterance);
+        QObjectPrivate::connect(m_engine.get(), &QTextToSpeechEngine::utteranceStarted,
+                                this, &QTextToSpeechPrivate::nextUtteranceStarted);
     } else {
         m_providerName.clear();
     }
@@ -152,16 +203,118 @@ void QTextToSpeechPrivate::loadPluginMetadata(QMultiHash<QString, QCborMap> &lis
     }
 }
 
+/*!
+    \internal
+
+    Called when connections to QTextToSpeech::sayingWord or wordTimeline
+    change, and when a shared memory sink or a caption file, which use the
+    words reported by the engine, is set or cleared. Must be called in the
+    thread of the engine, see updateInEngineThread().
+*/
+void QTextToSpeechPrivate::updateWordSignalsEnabled()
+{
+    Q_Q(QTextToSpeech);
+    if (!m_engine)
+        return;
+    bool sayingWord = q->isSignalConnected(QMetaMethod::fromSignal(&QTextToSpeech::sayingWord));
+#if QT_CONFIG(sharedmemory)
+    sayingWord = sayingWord || m_sharedMemorySink;
+#endif
+    m_engine->setSayingWordEnabled(sayingWord);
+    // captions are written from the timeline of the words
+    m_engine->setWordTimelineEnabled(bool(m_captionConnection) || q->isSignalConnected(
+            QMetaMethod::fromSignal(&QTextToSpeech::wordTimeline)));
+}
+
+/*!
+    \internal
+
+    Called when connections to QTextToSpeech::phonemeEvents change. Must be
+    called in the thread of the engine, see updateInEngineThread().
+*/
+void QTextToSpeechPrivate::updatePhonemeEventsEnabled()
+{
+    Q_Q(QTextToSpeech);
+    if (m_engine) {
+        m_engine->setPhonemeEventsEnabled(q->isSignalConnected(
+                QMetaMethod::fromSignal(&QTextToSpeech::phonemeEvents)));
+    }
+}
+
+/*!
+    \internal
+
+    Calls \a update, which configures the engine, when called from the thread
+    of the engine, and otherwise queues the call into that thread. Connections
+    to the signals of QTextToSpeech can be made from any thread, and the engine
+    setters are not thread-safe. The queued call evaluates the connections when
+    it runs, so that the latest state wins.
+*/
+void QTextToSpeechPrivate::updateInEngineThread(void (QTextToSpeechPrivate::*update)())
+{
+    Q_Q(QTextToSpeech);
+    if (!m_engine)
+        return;
+    if (QThread::currentThread() == m_engine->thread()) {
+        (this->*update)();
+        return;
+    }
+    QMetaObject::invokeMethod(m_engine.get(), [q, update]{
+        (q->d_func()->*update)();
+    }, Qt::QueuedConnection);
+}
+
+/*!
+    \internal
+
+    Restarts the playback position for a new text.
+*/
+void QTextToSpeechPrivate::restartPlaybackPosition()
+{
+    m_playbackOffset = 0;
+    m_playbackTimer.start();
+}
+
 void QTextToSpeechPrivate::updateState(QTextToSpeech::State newState)
 {
     Q_Q(QTextToSpeech);
     if (m_state == newState)
         return;
 
+    Q_TRACE(QTextToSpeechPrivate_updateState, int(m_state), int(newState));
+    if (m_state == QTextToSpeech::Synthesizing && m_synthesizedBytes) {
+        Q_TRACE(QTextToSpeechEngine_synthesized_last, qint64(m_currentUtterance),
+                m_synthesizedBytes);
+        m_synthesizedBytes = 0;
+    }
+    if (QTextToSpeechTimeline::isRecording()) {
+        QTextToSpeechTimeline::nameThread("QTextToSpeech");
+        QTextToSpeechTimeline::record(Phase::Instant, "state", m_currentUtterance, newState);
+        if (newState == QTextToSpeech::Ready || newState == QTextToSpeech::Error) {
+            if (m_state == QTextToSpeech::Synthesizing)
+                QTextToSpeechTimeline::record(Phase::AsyncEnd, "synthesis", m_currentUtterance);
+            else if (m_state == QTextToSpeech::Speaking || m_state == QTextToSpeech::Paused)
+                QTextToSpeechTimeline::record(Phase::AsyncEnd, "speech", m_currentUtterance);
+        }
+    }
+
+    if (newState == QTextToSpeech::Speaking) {
+        if (m_state == QTextToSpeech::Paused)
+            m_playbackTimer.start();
+        else
+            restartPlaybackPosition();
+    } else if (newState == QTextToSpeech::Paused && m_playbackTimer.isValid()) {
+        m_playbackOffset += m_playbackTimer.elapsed();
+        m_playbackTimer.invalidate();
+    }
+
     if (newState == QTextToSpeech::Ready) {
         // If we have more text to process, start the next request immediately,
-        // and ignore the transition to Ready (don't emit the signals).
-        if (!m_pendingUtterances.isEmpty()) {
+        // and ignore the transition to Ready (don't emit the signals). If the
+        // engine ran out of audio before it played the texts that we passed in
+        // gapless mode, then it still plays them, and reports each with
+        // utteranceStarted(); the queue continues once they are done.
+        if (!m_pendingUtterances.isEmpty() && !m_gaplessUtterances) {
             const QString nextText = m_pendingUtterances.first();
             // QTextToSpeech::pause prepends an empty entry to request a pause
             if (nextText.isEmpty()) {
@@ -188,6 +341,27 @@ void QTextToSpeechPrivate::updateState(QTextToSpeech::State newState)
                     if (m_state == oldState && !m_pendingUtterances.isEmpty()) {
                         m_pendingUtterances.dequeue();
                         ++m_currentUtterance;
+                        m_audioFilters.reset();
+                        QTextToSpeechTimeline::record(Phase::AsyncEnd, "queued",
+                                                      m_currentUtterance);
+                        if (m_state == QTextToSpeech::Synthesizing) {
+                            // the previous text is complete, so its receiver
+                            // makes way for the one of the next text
+                            if (const auto writer = std::exchange(m_fileWriter, nullptr))
+                                writer->finish();
+                            if (!m_pendingReceivers.isEmpty())
+                                m_pendingReceivers.dequeue()();
+                            Q_TRACE(QTextToSpeechEngine_synthesize_entry,
+                                    qint64(m_currentUtterance), int(nextText.size()));
+                            QTextToSpeechTimeline::record(Phase::AsyncBegin, "synthesis",
+                                                          m_currentUtterance, nextText.size());
+                        } else {
+                            Q_TRACE(QTextToSpeechEngine_say_entry,
+                                    qint64(m_currentUtterance), int(nextText.size()));
+                            QTextToSpeechTimeline::record(Phase::AsyncBegin, "speech",
+                                                          m_currentUtterance, nextText.size());
+                            restartPlaybackPosition();
+                        }
                         (m_engine.get()->*nextFunction)(nextText);
                         return;
                     } else if (m_state == QTextToSpeech::Paused) {
@@ -203,9 +377,14 @@ void QTextToSpeechPrivate::updateState(QTextToSpeech::State newState)
             }
         } else {
             // If we are done synthesizing and the functor-overload was used,
-            // clear the temporary connection.
+            // clear the temporary connection. A file that is being written
+            // is complete now.
+            if (m_fileWriter)
+                m_fileWriter->finish();
             disconnectSynthesizeFunctor();
         }
+    } else if (newState == QTextToSpeech::Error && m_fileWriter) {
+        m_fileWriter->cancel();
     }
     m_state = newState;
     emit q->stateChanged(newState);
@@ -213,13 +392,189 @@ void QTextToSpeechPrivate::updateState(QTextToSpeech::State newState)
 
 void QTextToSpeechPrivate::disconnectSynthesizeFunctor()
 {
+    QObject::disconnect(m_backpressureConnection);
+    QObject::disconnect(m_sinkDestroyedConnection);
+    if (QObject::disconnect(m_captionConnection))
+        updateWordSignalsEnabled();
+#if QT_CONFIG(sharedmemory)
+    QObject::disconnect(m_sharedMemoryWordConnection);
+    // the reader learns that the text is done, also if it was stopped
+    if (const QPointer<QTextToSpeechSharedMemorySink> sink = std::exchange(m_sharedMemorySink, nullptr)) {
+        sink->writeEndOfText();
+        updateWordSignalsEnabled();
+    }
+#endif
+    setSynthesisThrottled(false);
     if (m_slotObject) {
-        m_slotObject->destroyIfLastRef();
-        m_slotObject = nullptr;
+        m_slotObject.reset();
         m_engine->disconnect(m_synthesizeConnection);
     }
 }
 
+/*!
+    \internal
+
+    Called when the engine has synthesized all audio of the current text, and
+    can append the audio of the next text to the playing stream without a gap.
+    The next text is passed on unless a pause was requested at the end of the
+    current text. Engines can ask for more texts before the first appended one
+    starts playing.
+*/
+void QTextToSpeechPrivate::sayNextUtterance()
+{
+    Q_Q(QTextToSpeech);
+    const auto canContinue = [this]{
+        return m_state == QTextToSpeech::Speaking
+            && !m_pendingUtterances.isEmpty() && !m_pendingUtterances.first().isEmpty();
+    };
+    if (!canContinue())
+        return;
+
+    emit q->aboutToSynthesize(m_currentUtterance + m_gaplessUtterances);
+    // connected slot could have called pause or stop
+    if (!canContinue())
+        return;
+
+    ++m_gaplessUtterances;
+    Q_TRACE(QTextToSpeechEngine_appendUtterance_entry,
+            qint64(m_currentUtterance + m_gaplessUtterances),
+            int(m_pendingUtterances.first().size()));
+    QTextToSpeechTimeline::record(Phase::AsyncEnd, "queued",
+                                  m_currentUtterance + m_gaplessUtterances);
+    m_engine->appendUtterance(m_pendingUtterances.dequeue());
+}
+
+/*!
+    \internal
+
+    Called when the engine starts playing a text that was passed in sayNextUtterance().
+*/
+void QTextToSpeechPrivate::nextUtteranceStarted()
+{
+    if (!m_gaplessUtterances)
+        return;
+    --m_gaplessUtterances;
+    QTextToSpeechTimeline::record(Phase::AsyncEnd, "speech", m_currentUtterance);
+    ++m_currentUtterance;
+    QTextToSpeechTimeline::record(Phase::AsyncBegin, "speech", m_currentUtterance);
+    restartPlaybackPosition();
+}
+
+/*!
+    \internal
+
+    Asks the engine to stop or continue producing audio data, as the
+    consumer of the synthesized data can't keep up.
+*/
+void QTextToSpeechPrivate::setSynthesisThrottled(bool throttled)
+{
+    if (m_synthesisThrottled == throttled)
+        return;
+    m_synthesisThrottled = throttled;
+    if (m_engine)
+        m_engine->setSynthesisThrottled(throttled);
+}
+
+/*!
+    \internal
+
+    Asks the engine of \a speech to stop or continue producing audio data for
+    the running synthesize() call. The throttle is released once the
+    synthesis is done.
+*/
+void QTextToSpeechPrivate::setSynthesisThrottled(QTextToSpeech *speech, bool throttled)
+{
+    get(speech)->setSynthesisThrottled(throttled);
+}
+
+/*!
+    \internal
+
+    Synthesizes \a text, and calls \a slotObj on the \a context object with
+    the data. \a connectSink connects the other signals that the receiver of
+    the data needs. The slot object and the temporary connections are stored
+    and released in updateState() when the state of the engine transitions back
+    to Ready.
+
+    While the engine still synthesizes another text, the request is queued,
+    and its receiver is only connected once the engine is done with that text.
+    The rest of the audio of that text thus goes to its own receiver.
+*/
+void QTextToSpeechPrivate::synthesize(const QString &text, QtPrivate::QSlotObjectBase *slotObj,
+                                      const QObject *context,
+                                      QTextToSpeech::SynthesizeOverload overload,
+                                      std::function<void()> connectSink)
+{
+    Q_Q(QTextToSpeech);
+    Q_ASSERT(slotObj);
+    Q_TRACE(QTextToSpeech_synthesize_entry, int(text.size()), int(m_pendingUtterances.size()));
+    const std::shared_ptr<QtPrivate::QSlotObjectBase> slotObject(slotObj,
+            [](QtPrivate::QSlotObjectBase *slot) { slot->destroyIfLastRef(); });
+    if (!m_engine)
+        return;
+
+    auto connectReceiver = [this, q, slotObject, context = QPointer<const QObject>(context),
+                            hasContext = context != nullptr, overload,
+                            connectSink = std::move(connectSink)]{
+        // replace the previous functor, if any
+        disconnectSynthesizeFunctor();
+        if (hasContext && !context)
+            return;
+        m_slotObject = slotObject;
+        const QObject *receiver = context.data();
+        const auto receive = [this, receiver, overload](const QAudioFormat &format,
+                                                         const QByteArray &data){
+            Q_ASSERT(m_slotObject);
+            if (Q_TRACE_ENABLED(QTextToSpeechEngine_synthesized_first)
+                || QTextToSpeechTimeline::isRecording()) {
+                if (!m_synthesizedBytes) {
+                    Q_TRACE(QTextToSpeechEngine_synthesized_first, qint64(m_currentUtterance),
+                            int(data.size()));
+                    QTextToSpeechTimeline::record(Phase::Instant, "first chunk",
+                                                  m_currentUtterance, data.size());
+                }
+                m_synthesizedBytes += data.size();
+            }
+            QByteArray bytes = data;
+            if (!m_audioFilters.isEmpty()) {
+                m_audioFilters.process(format, bytes);
+                if (bytes.isEmpty())
+                    return;
+            }
+            if (overload == QTextToSpeech::SynthesizeOverload::AudioBuffer) {
+                const QAudioBuffer buffer(bytes, format);
+                void *args[] = {nullptr, const_cast<QAudioBuffer *>(&buffer)};
+                m_slotObject->call(const_cast<QObject *>(receiver), args);
+            } else {
+                void *args[] = {nullptr,
+                                const_cast<QAudioFormat *>(&format),
+                                const_cast<QByteArray *>(&bytes)};
+                m_slotObject->call(const_cast<QObject *>(receiver), args);
+            }
+        };
+        m_synthesizeConnection = QObject::connect(m_engine.get(), &QTextToSpeechEngine::synthesized,
+                                                  receiver ? receiver : q, receive);
+        if (connectSink)
+            connectSink();
+    };
+
+    if (m_engine->state() == QTextToSpeech::Synthesizing) {
+        QTextToSpeechTimeline::record(Phase::AsyncBegin, "queued",
+                                      m_currentUtterance + m_pendingUtterances.size() + 1,
+                                      text.size());
+        m_pendingUtterances.enqueue(text);
+        m_pendingReceivers.enqueue(std::move(connectReceiver));
+    } else {
+        connectReceiver();
+        m_audioFilters.reset();
+        Q_TRACE(QTextToSpeechEngine_synthesize_entry, qint64(m_currentUtterance),
+                int(text.size()));
+        QTextToSpeechTimeline::record(Phase::AsyncBegin, "synthesis", m_currentUtterance,
+                                      text.size());
+        m_engine->synthesize(text);
+    }
+}
+
 /*!
     \class QTextToSpeech
     \brief The QTextToSpeech class provides a convenient access to text-to-speech engines.
@@ -246,6 +601,16 @@ void QTextToSpeechPrivate::disconnectSynthesizeFunctor()
     Not every engine supports all features. Use the engineCapabilities() function to
     test which features are available, and adjust the usage of the class accordingly.
 
+    To find out where the time goes between queueing a text and hearing it,
+    set the \c QT_TEXTTOSPEECH_TIMELINE environment variable to the name of a
+    file. The spans during which each text is queued, synthesized, and spoken,
+    as well as the spoken words and the audio output of the engine, are then
+    recorded, and written to that file as a \l
+    {https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU}
+    {Chrome trace_event} JSON document when the application exits. The file
+    can be loaded into \l {https://ui.perfetto.dev}{Perfetto}. Only the
+    latest events are kept, so the recording doesn't grow without limits.
+
     \note Which locales and voices the engine supports depends usually on the Operating
     System configuration. E.g. on macOS, end users can install voices through the
     \e Accessibility panel in \e{System Preferences}.
@@ -523,6 +888,9 @@ QString QTextToSpeech::engine() const
                                 each word that gets spoken.
     \value Synthesize           The engine can \l{synthesize()}{synthesize} PCM
                                 audio data from text.
+    \value PhonemeEvents        The engine emits the phonemeEvents() signal with
+                                the phonemes of the audio that it produces.
+                                This value was introduced in Qt 6.7.
 
     \sa engineCapabilities()
 */
@@ -639,6 +1007,11 @@ QTextToSpeech::State QTextToSpeech::state() const
     Applications can use this signal to make last-minute changes to \l voice
     attributes, or to track the process of text enqueued via enqueue().
 
+    Engines that play queued texts without gaps, such as the \c flite engine
+    with the \c gapless parameter, start synthesizing the next text while the
+    audio of the current text is still playing. The signal is then emitted at
+    that time, before the current text has finished playing.
+
     \sa enqueue(), synthesize(), voice
 */
 
@@ -668,7 +1041,127 @@ QTextToSpeech::State QTextToSpeech::state() const
     \note This signal requires that the engine has the
     \l {QTextToSpeech::Capability::}{WordByWordProgress} capability.
 
-    \sa Capability, say()
+    \sa Capability, say(), wordTimeline()
+*/
+
+/*!
+    \class QTextToSpeech::WordBoundary
+    \inmodule QtTextToSpeech
+    \since 6.7
+    \brief The WordBoundary struct describes where a word is in a text, and when it is spoken.
+
+    \sa wordTimeline()
+*/
+
+/*!
+    \variable QTextToSpeech::WordBoundary::start
+
+    The position of the first character of the word in the text.
+*/
+
+/*!
+    \variable QTextToSpeech::WordBoundary::length
+
+    The number of characters of the word.
+*/
+
+/*!
+    \variable QTextToSpeech::WordBoundary::time
+
+    The time, in milliseconds, from the beginning of the audio of the text
+    until the word is spoken.
+*/
+
+/*!
+    \variable QTextToSpeech::WordBoundary::frame
+
+    The number of audio frames from the beginning of the audio of the text
+    until the word is spoken. For a text that is passed to synthesize(), this
+    is the position of the word in the audio data that the text is synthesized
+    into, before any \l{audioFilters()}{audio filters} change the length of
+    the data.
+
+    \sa QAudioFormat::bytesForFrames()
+*/
+
+/*!
+    \class QTextToSpeech::Phoneme
+    \inmodule QtTextToSpeech
+    \since 6.7
+    \brief The Phoneme struct describes a phoneme in the audio of a text.
+
+    \sa phonemeEvents()
+*/
+
+/*!
+    \variable QTextToSpeech::Phoneme::name
+
+    The name of the phoneme, in the phone set of the voice.
+*/
+
+/*!
+    \variable QTextToSpeech::Phoneme::frame
+
+    The number of audio frames from the beginning of the audio of the text
+    until the phoneme starts.
+*/
+
+/*!
+    \variable QTextToSpeech::Phoneme::duration
+
+    The number of audio frames of the phoneme.
+*/
+
+/*!
+    \variable QTextToSpeech::Phoneme::viseme
+
+    The viseme to which the \l{visemeTable()}{viseme table} maps the name of
+    the phoneme, or -1.
+*/
+
+/*!
+    \fn void QTextToSpeech::phonemeEvents(qsizetype id, const QList<QTextToSpeech::Phoneme> &phonemes)
+    \since 6.7
+
+    This signal is emitted while the engine produces the audio of the text
+    with \a id, with the \a phonemes of a chunk of that audio. Applications
+    can use the phonemes, and the visemes to which the visemeTable() maps them,
+    to animate the lips of an avatar in sync with the audio.
+
+    The signal is emitted for a batch of phonemes at a time, typically well
+    before they are heard. Engines only look up the phonemes while something
+    is connected to this signal.
+
+    \note This signal requires that the engine has the
+    \l {QTextToSpeech::Capability::}{PhonemeEvents} capability.
+
+    \sa wordTimeline(), setVisemeTable()
+*/
+
+/*!
+    \fn void QTextToSpeech::wordTimeline(qsizetype id, const QList<QTextToSpeech::WordBoundary> &words)
+    \since 6.7
+
+    This signal is emitted when the engine has synthesized the text with \a id,
+    typically before the text is spoken, with the boundaries of all \a words of
+    the text.
+
+    Applications that highlight the spoken word can look up the word for the
+    current playbackPosition() in \a words, instead of handling the
+    sayingWord() signal for each word. If nothing is connected to sayingWord(),
+    then engines can avoid the overhead of reporting each word while it is
+    spoken.
+
+    For texts that are passed to synthesize(), the signal is emitted before the
+    state changes back to Ready, and the \l{WordBoundary::}{frame} of each word
+    is relative to the beginning of the synthesized audio data. This makes it
+    possible to align words and audio without playing the audio back. Engines
+    only collect the boundaries of the words while something is connected to
+    this signal.
+
+    Engines that don't support this signal never emit it.
+
+    \sa sayingWord(), playbackPosition(), synthesize()
 */
 
 /*!
@@ -695,6 +1188,28 @@ QTextToSpeech::State QTextToSpeech::state() const
     \sa errorReason(), errorString(), {Creating Custom Qt Types}
 */
 
+/*!
+    \qmlsignal void TextToSpeech::availableVoicesChanged()
+    \since 6.7
+
+    This signal is emitted when the engine has loaded more voices, or when the
+    voices that it provides have changed otherwise.
+
+    \sa availableLocales(), availableVoices()
+*/
+
+/*!
+    \fn void QTextToSpeech::availableVoicesChanged()
+    \since 6.7
+
+    This signal is emitted when the engine has loaded more voices, or when the
+    voices that it provides have changed otherwise. Engines that start the
+    services providing their voices on demand might only report some of the
+    voices at first.
+
+    \sa availableLocales(), availableVoices()
+*/
+
 /*!
     \qmlmethod enumeration TextToSpeech::errorReason()
     \return the reason why the engine has reported an error.
@@ -774,10 +1289,16 @@ QString QTextToSpeech::errorString() const
 void QTextToSpeech::say(const QString &text)
 {
     Q_D(QTextToSpeech);
+    Q_TRACE(QTextToSpeech_say_entry, int(text.size()));
     d->m_pendingUtterances = {};
+    d->m_pendingReceivers = {};
     d->m_utteranceCounter = 1;
+    d->m_gaplessUtterances = 0;
     if (d->m_engine) {
         emit aboutToSynthesize(0);
+        Q_TRACE(QTextToSpeechEngine_say_entry, qint64(d->m_currentUtterance), int(text.size()));
+        QTextToSpeechTimeline::record(Phase::AsyncBegin, "speech", d->m_currentUtterance,
+                                      text.size());
         d->m_engine->say(text);
     }
 }
@@ -823,13 +1344,22 @@ void QTextToSpeech::say(const QString &text)
 qsizetype QTextToSpeech::enqueue(const QString &utterance)
 {
     Q_D(QTextToSpeech);
+    Q_TRACE(QTextToSpeech_enqueue_entry, int(utterance.size()), int(d->m_pendingUtterances.size()));
     if (!d->m_engine || utterance.isEmpty())
         return -1;
 
     if (d->m_engine->state() == QTextToSpeech::Speaking) {
+        QTextToSpeechTimeline::record(Phase::AsyncBegin, "queued",
+                                      d->m_currentUtterance + d->m_gaplessUtterances
+                                      + d->m_pendingUtterances.size() + 1,
+                                      utterance.size());
         d->m_pendingUtterances.enqueue(utterance);
     } else {
         emit aboutToSynthesize(0);
+        Q_TRACE(QTextToSpeechEngine_say_entry, qint64(d->m_currentUtterance),
+                int(utterance.size()));
+        QTextToSpeechTimeline::record(Phase::AsyncBegin, "speech", d->m_currentUtterance,
+                                      utterance.size());
         d->m_engine->say(utterance);
     }
 
@@ -883,48 +1413,403 @@ qsizetype QTextToSpeech::enqueue(const QString &utterance)
     \note This API requires that the engine has the
     \l {QTextToSpeech::Capability::}{Synthesize} capability.
 
-    \sa say(), stop()
+    \sa say(), stop(), synthesizeToFile()
 */
 
 /*!
     \internal
 
     Handles the engine's synthesized() signal to call \a slotObj on the \a context
-    object. The slot object and the temporary connection are stored and released
-    in updateState() when the state of the engine transitions back to Ready.
+    object, see QTextToSpeechPrivate::synthesize().
 */
 void QTextToSpeech::synthesizeImpl(const QString &text,
                                    QtPrivate::QSlotObjectBase *slotObj, const QObject *context,
                                    SynthesizeOverload overload)
 {
     Q_D(QTextToSpeech);
-    Q_ASSERT(slotObj);
-    if (d->m_slotObject)
-        d->m_slotObject->destroyIfLastRef();
-    d->m_slotObject = slotObj;
-    const auto receive = [d, context, overload](const QAudioFormat &format, const QByteArray &bytes){
-        Q_ASSERT(d->m_slotObject);
-        if (overload == SynthesizeOverload::AudioBuffer) {
-            const QAudioBuffer buffer(bytes, format);
-            void *args[] = {nullptr, const_cast<QAudioBuffer *>(&buffer)};
-            d->m_slotObject->call(const_cast<QObject *>(context), args);
-        } else {
-            void *args[] = {nullptr,
-                            const_cast<QAudioFormat *>(&format),
-                            const_cast<QByteArray *>(&bytes)};
-            d->m_slotObject->call(const_cast<QObject *>(context), args);
+    d->synthesize(text, slotObj, context, overload);
+}
+
+/*!
+    \since 6.7
+
+    Synthesizes the \a text into raw audio data, and writes the data to the \a sink.
+
+    The \a sink needs to be open for writing, and needs to live in the same
+    thread as this QTextToSpeech object. The data is written as it becomes
+    available, in the format of the engine's output, without any header.
+
+    If the \a sink buffers the data written to it, and the number of bytes that
+    are waiting to be written becomes too large, then the engine is asked to
+    pause the synthesis until the \a sink has caught up again. Not all engines
+    support this; the data is then buffered by the \a sink.
+
+    If the \a sink is destroyed before the synthesis has finished, then the
+    remaining data is discarded.
+
+    \note This API requires that the engine has the
+    \l {QTextToSpeech::Capability::}{Synthesize} capability.
+
+    \sa synthesizeToFile(), QIODevice::bytesToWrite()
+*/
+void QTextToSpeech::synthesize(const QString &text, QIODevice *sink)
+{
+    Q_D(QTextToSpeech);
+    if (!sink || !sink->isWritable()) {
+        qWarning("QTextToSpeech::synthesize: The sink is not open for writing");
+        return;
+    }
+    if (sink->thread() != thread()) {
+        qWarning("QTextToSpeech::synthesize: The sink must live in the same thread");
+        return;
+    }
+
+    // throttle the engine when the sink has too much unwritten data, and
+    // resume once it has drained half of it
+    static constexpr qint64 HighWaterMark = 64 * 1024;
+    using Prototype = void(*)(QAudioFormat, QByteArray);
+    d->synthesize(text, QtPrivate::makeCallableObject<Prototype>(
+                            [d, sink = QPointer<QIODevice>(sink)]
+                            (const QAudioFormat &, const QByteArray &bytes) {
+                                if (!sink)
+                                    return;
+                                sink->write(bytes);
+                                if (sink->bytesToWrite() > HighWaterMark)
+                                    d->setSynthesisThrottled(true);
+                            }),
+                  sink, SynthesizeOverload::AudioFormatByteArray, [this, d, sink]{
+        d->m_backpressureConnection = connect(sink, &QIODevice::bytesWritten, this, [d, sink]{
+            if (sink->bytesToWrite() <= HighWaterMark / 2)
+                d->setSynthesisThrottled(false);
+        });
+        d->m_sinkDestroyedConnection = connect(sink, &QObject::destroyed, this, [d]{
+            d->setSynthesisThrottled(false);
+        });
+    });
+}
+
+#if QT_CONFIG(sharedmemory)
+/*!
+    \since 6.7
+    \overload
+
+    Synthesizes the \a text into raw audio data, and writes the data, and a
+    record for each word that the engine reports, into the ring buffer of
+    the shared memory \a sink. Another process reads the data with a
+    QTextToSpeechSharedMemoryReader. Once the synthesis is done or stopped,
+    the \a sink receives an end-of-text record.
+
+    The \a sink needs to be created, and needs to live in the same thread as
+    this QTextToSpeech object.
+
+    If the ring buffer of the \a sink becomes more than half full, then the
+    engine is asked to pause the synthesis until the reader has caught up.
+    Not all engines support this; the \a sink then drops data that doesn't
+    fit.
+
+    \note This API requires that the engine has the
+    \l {QTextToSpeech::Capability::}{Synthesize} capability.
+
+    \sa QTextToSpeechSharedMemorySink
+*/
+void QTextToSpeech::synthesize(const QString &text, QTextToSpeechSharedMemorySink *sink)
+{
+    Q_D(QTextToSpeech);
+    if (!sink || !sink->isValid()) {
+        qWarning("QTextToSpeech::synthesize: The shared memory sink has not been created");
+        return;
+    }
+    if (sink->thread() != thread()) {
+        qWarning("QTextToSpeech::synthesize: The sink must live in the same thread");
+        return;
+    }
+
+    using Prototype = void(*)(QAudioFormat, QByteArray);
+    d->synthesize(text, QtPrivate::makeCallableObject<Prototype>(
+                            [d, sink = QPointer<QTextToSpeechSharedMemorySink>(sink)]
+                            (const QAudioFormat &format, const QByteArray &bytes) {
+                                if (!sink)
+                                    return;
+                                sink->writeAudio(format, bytes);
+                                if (sink->bytesFree() < sink->capacity() / 2)
+                                    d->setSynthesisThrottled(true);
+                            }),
+                  sink, SynthesizeOverload::AudioFormatByteArray, [this, d, sink]{
+        d->m_sharedMemorySink = sink;
+        d->updateWordSignalsEnabled();
+        d->m_sharedMemoryWordConnection = connect(d->m_engine.get(), &QTextToSpeechEngine::sayingWord,
+                                                  sink, [sink](const QString &, qsizetype start,
+                                                               qsizetype length) {
+            sink->writeWord(start, length);
+        });
+        d->m_backpressureConnection = connect(sink, &QTextToSpeechSharedMemorySink::drained,
+                                              this, [d]{
+            d->setSynthesisThrottled(false);
+        });
+        d->m_sinkDestroyedConnection = connect(sink, &QObject::destroyed, this, [d]{
+            d->setSynthesisThrottled(false);
+        });
+    });
+}
+#endif // QT_CONFIG(sharedmemory)
+
+/*!
+    \enum QTextToSpeech::FileFormat
+    \since 6.7
+    \brief This enum describes the container format of files written by synthesizeToFile().
+
+    \value Wav      A RIFF WAVE file with uncompressed PCM data.
+    \value Flac     A FLAC file. The audio frames are stored verbatim, so the file
+                    is not compressed, but can be read by any FLAC decoder. Only
+                    8 and 16 bit integer sample formats are supported.
+
+    \sa synthesizeToFile()
+*/
+
+/*!
+    \since 6.7
+
+    Synthesizes the \a text into an audio file \a fileName, using the container
+    \a format.
+
+    The synthesized audio data is streamed to the file by a background thread
+    while the engine produces it, so that the memory used stays bounded
+    independent of the length of \a text. If the background thread can't keep
+    up with the engine, then the engine is asked to pause the synthesis until
+    the thread has caught up. Engines that can't pause fail to write the file
+    if the thread falls too far behind. The header of the file is completed
+    once the synthesis is done.
+
+    If the engine is still synthesizing another text, then \a text is
+    synthesized once that is done, and the audio of the other text is not
+    written to \a fileName.
+
+    Returns a QFuture that gets fulfilled with \c true once the file is complete,
+    or with \c false if the file could not be written, if the synthesis failed,
+    or if it was stopped. Incomplete files are removed.
+
+    As with synthesize(), the \l state property is set to \l Synthesizing when
+    the synthesis starts, and to \l Ready once the synthesis is finished.
+
+    \note This API requires that the engine has the
+    \l {QTextToSpeech::Capability::}{Synthesize} capability.
+
+    \sa synthesize(), FileFormat
+*/
+QFuture<bool> QTextToSpeech::synthesizeToFile(const QString &text, const QString &fileName,
+                                              QTextToSpeech::FileFormat format)
+{
+    return synthesizeToFile(text, fileName, QString(), CaptionOptions(), format);
+}
+
+/*!
+    \enum QTextToSpeech::CaptionFormat
+    \since 6.7
+    \brief This enum describes the format of caption files written by synthesizeToFile().
+
+    \value WebVtt   A WebVTT file.
+    \value Srt      A SubRip file.
+
+    \sa CaptionOptions
+*/
+
+/*!
+    \class QTextToSpeech::CaptionOptions
+    \inmodule QtTextToSpeech
+    \since 6.7
+    \brief The CaptionOptions struct describes how synthesizeToFile() writes captions.
+
+    \sa synthesizeToFile()
+*/
+
+/*!
+    \variable QTextToSpeech::CaptionOptions::format
+
+    The format of the caption file. The default is CaptionFormat::WebVtt.
+*/
+
+/*!
+    \variable QTextToSpeech::CaptionOptions::maximumCueLength
+
+    The maximum number of characters of a cue, from the beginning of its first
+    word until the end of its last word. The default is 42.
+*/
+
+/*!
+    \variable QTextToSpeech::CaptionOptions::maximumCueDuration
+
+    The maximum duration of a cue, in milliseconds. The default is 5000.
+*/
+
+/*!
+    \since 6.7
+    \overload
+
+    Synthesizes the \a text into an audio file \a fileName, using the container
+    \a format, and writes captions for the audio to \a captionFileName.
+
+    The words of the text are grouped into cues, each of which is shown from
+    the moment its first word is spoken until the next cue starts. A cue gets
+    as many words as fit into the maximum length and duration that the
+    \a captionOptions specify. The word boundaries come from the engine while
+    it synthesizes the text, so the audio and captions are produced in the same
+    pass, without playing the audio. Engines that don't report the boundaries
+    of words produce a caption file without cues.
+
+    The future is fulfilled with \c true once both files are complete. If
+    \a captionFileName is empty, then no captions are written.
+
+    \sa wordTimeline()
+*/
+QFuture<bool> QTextToSpeech::synthesizeToFile(const QString &text, const QString &fileName,
+                                              const QString &captionFileName,
+                                              const QTextToSpeech::CaptionOptions &captionOptions,
+                                              QTextToSpeech::FileFormat format)
+{
+    Q_D(QTextToSpeech);
+    if (!d->m_engine || !(engineCapabilities() & Capability::Synthesize)) {
+        qWarning("The engine can't synthesize text into %s", qPrintable(fileName));
+        return QtFuture::makeReadyValueFuture(false);
+    }
+
+    auto *writer = new QTextToSpeechFileWriter(fileName, format);
+    connect(writer, &QThread::finished, writer, &QObject::deleteLater);
+    const QFuture<bool> future = writer->future();
+    if (!captionFileName.isEmpty())
+        writer->setCaptions(captionFileName, text, captionOptions);
+    writer->start();
+
+    // The slot object owns the guard, and gets destroyed when the synthesis
+    // is done, stopped, or replaced. Cancelling a finished writer is a no-op.
+    struct WriterGuard
+    {
+        ~WriterGuard()
+        {
+            if (writer)
+                writer->cancel();
         }
+        QPointer<QTextToSpeechFileWriter> writer;
     };
-    d->m_synthesizeConnection = connect(d->m_engine.get(), &QTextToSpeechEngine::synthesized,
-                                        context ? context : this, receive);
+    auto guard = std::make_shared<WriterGuard>();
+    guard->writer = writer;
+    // The engine might report the words as soon as the synthesis starts, so
+    // they are connected together with the receiver of the audio, once the
+    // previous synthesis has been disconnected.
+    using Prototype = void(*)(QAudioFormat, QByteArray);
+    d->synthesize(text, QtPrivate::makeCallableObject<Prototype>(
+                            [d, guard](const QAudioFormat &audioFormat, const QByteArray &bytes) {
+                                if (guard->writer && !guard->writer->append(audioFormat, bytes))
+                                    d->setSynthesisThrottled(true);
+                            }),
+                  nullptr, SynthesizeOverload::AudioFormatByteArray,
+                  [this, d, guard, withCaptions = !captionFileName.isEmpty()]{
+        // the writer is gone if it failed while the request was queued
+        QTextToSpeechFileWriter *writer = guard->writer;
+        if (!writer)
+            return;
+        d->m_fileWriter = writer;
+        if (withCaptions) {
+            d->m_captionConnection = connect(d->m_engine.get(), &QTextToSpeechEngine::wordTimeline,
+                                             writer, [writer](const QList<WordBoundary> &words) {
+                writer->setWords(words);
+            });
+            d->m_engine->setWordTimelineEnabled(true);
+        }
+        d->m_backpressureConnection = connect(writer, &QTextToSpeechFileWriter::drained, this, [d]{
+            d->setSynthesisThrottled(false);
+        });
+    });
+    return future;
+}
 
-    if (!d->m_engine)
+/*!
+    \since 6.7
+
+    Appends \a filter to the chain of audio filters, and takes ownership of it.
+
+    The audio filters process the audio data that the engine produces, in the
+    order in which they were added. Filters apply to the data delivered by all
+    synthesize() overloads and by synthesizeToFile(), and to the audio played
+    by say() and enqueue() if the engine plays audio through Qt Multimedia.
+    This is the case for the \c flite engine; engines that use the speech
+    services of the platform play the audio unfiltered.
+
+    Filters can be added while the engine is speaking or synthesizing. The
+    filter then starts processing with the next block of audio data.
+
+    \code
+    QTextToSpeech tts;
+    tts.addAudioFilter(new QTextToSpeechDcRemovalFilter);
+    tts.addAudioFilter(new QTextToSpeechNormalizationFilter(-18.0));
+    tts.addAudioFilter(new QTextToSpeechLimiterFilter);
+    \endcode
+
+    \sa clearAudioFilters(), audioFilters(), QTextToSpeechAudioFilter
+*/
+void QTextToSpeech::addAudioFilter(QTextToSpeechAudioFilter *filter)
+{
+    Q_D(QTextToSpeech);
+    if (!filter)
         return;
+    d->m_audioFilters.addFilter(filter);
+}
 
-    if (d->m_engine->state() == QTextToSpeech::Synthesizing)
-        d->m_pendingUtterances.enqueue(text);
-    else
-        d->m_engine->synthesize(text);
+/*!
+    \since 6.7
+
+    Removes and deletes all audio filters.
+
+    \sa addAudioFilter()
+*/
+void QTextToSpeech::clearAudioFilters()
+{
+    Q_D(QTextToSpeech);
+    d->m_audioFilters.clear();
+}
+
+/*!
+    \since 6.7
+
+    Returns the audio filters, in the order in which they process the audio.
+
+    \sa addAudioFilter()
+*/
+QList<QTextToSpeechAudioFilter *> QTextToSpeech::audioFilters() const
+{
+    Q_D(const QTextToSpeech);
+    return d->m_audioFilters.filters();
+}
+
+/*!
+    \since 6.7
+
+    Sets the \a table that maps the names of phonemes to visemes, for
+    instance the mouth shapes of an avatar. The phonemes that phonemeEvents()
+    reports get the viseme of their name, or -1 if the table has no entry for
+    the name.
+
+    The names of the phonemes depend on the engine and the voice.
+
+    \sa visemeTable(), QTextToSpeech::Phoneme::viseme
+*/
+void QTextToSpeech::setVisemeTable(const QHash<QString, int> &table)
+{
+    Q_D(QTextToSpeech);
+    d->m_visemeTable = table;
+}
+
+/*!
+    \since 6.7
+
+    Returns the table that maps phonemes to visemes; by default, the table is
+    empty.
+
+    \sa setVisemeTable()
+*/
+QHash<QString, int> QTextToSpeech::visemeTable() const
+{
+    Q_D(const QTextToSpeech);
+    return d->m_visemeTable;
 }
 
 /*!
@@ -952,7 +1837,11 @@ void QTextToSpeech::stop(BoundaryHint boundaryHint)
 {
     Q_D(QTextToSpeech);
     d->m_pendingUtterances = {};
+    d->m_pendingReceivers = {};
     d->m_utteranceCounter = 0;
+    d->m_gaplessUtterances = 0;
+    if (d->m_fileWriter)
+        d->m_fileWriter->cancel();
     if (d->m_engine) {
         if (boundaryHint == QTextToSpeech::BoundaryHint::Immediate)
             d->disconnectSynthesizeFunctor();
@@ -1141,6 +2030,33 @@ void QTextToSpeech::setVolume(double volume)
         emit volumeChanged(volume);
 }
 
+/*!
+    \since 6.7
+
+    Returns the time, in milliseconds, since the playback of the current text
+    started, not counting the time during which the playback was paused; or -1
+    if no text is being spoken.
+
+    The position is measured from the moment the engine reports that it has
+    started speaking, and doesn't account for the latency of the audio device.
+
+    \sa wordTimeline()
+*/
+qint64 QTextToSpeech::playbackPosition() const
+{
+    Q_D(const QTextToSpeech);
+    switch (d->m_state) {
+    case QTextToSpeech::Speaking:
+        return d->m_playbackOffset
+             + (d->m_playbackTimer.isValid() ? d->m_playbackTimer.elapsed() : 0);
+    case QTextToSpeech::Paused:
+        return d->m_playbackOffset;
+    default:
+        break;
+    }
+    return -1;
+}
+
 double QTextToSpeech::volume() const
 {
     Q_D(const QTextToSpeech);
@@ -1366,4 +2282,36 @@ QList<QVoice> QTextToSpeech::allVoices(const QLocale *locale) const
     return voices;
 }
 
+/*!
+    \internal
+
+    Lets the engine know whether it needs to report each spoken word, the
+    timeline of all words, and phonemes.
+*/
+void QTextToSpeech::connectNotify(const QMetaMethod &signal)
+{
+    Q_D(QTextToSpeech);
+    if (signal == QMetaMethod::fromSignal(&QTextToSpeech::sayingWord)
+        || signal == QMetaMethod::fromSignal(&QTextToSpeech::wordTimeline))
+        d->updateInEngineThread(&QTextToSpeechPrivate::updateWordSignalsEnabled);
+    else if (signal == QMetaMethod::fromSignal(&QTextToSpeech::phonemeEvents))
+        d->updateInEngineThread(&QTextToSpeechPrivate::updatePhonemeEventsEnabled);
+    QObject::connectNotify(signal);
+}
+
+/*!
+    \internal
+*/
+void QTextToSpeech::disconnectNotify(const QMetaMethod &signal)
+{
+    Q_D(QTextToSpeech);
+    // an invalid signal means that all connections are removed
+    if (!signal.isValid() || signal == QMetaMethod::fromSignal(&QTextToSpeech::sayingWord)
+        || signal == QMetaMethod::fromSignal(&QTextToSpeech::wordTimeline))
+        d->updateInEngineThread(&QTextToSpeechPrivate::updateWordSignalsEnabled);
+    if (!signal.isValid() || signal == QMetaMethod::fromSignal(&QTextToSpeech::phonemeEvents))
+        d->updateInEngineThread(&QTextToSpeechPrivate::updatePhonemeEventsEnabled);
+    QObject::disconnectNotify(signal);
+}
+
 QT_END_NAMESPACE
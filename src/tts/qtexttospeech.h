@@ -10,6 +10,8 @@
 #include <QtTextToSpeech/qtexttospeech_global.h>
 #include <QtTextToSpeech/qvoice.h>
 #include <QtCore/qobject.h>
+#include <QtCore/qfuture.h>
+#include <QtCore/qhash.h>
 #include <QtCore/qshareddata.h>
 #include <QtCore/qlocale.h>
 
@@ -19,6 +21,9 @@ QT_BEGIN_NAMESPACE
 
 class QAudioFormat;
 class QAudioBuffer;
+class QIODevice;
+class QTextToSpeechAudioFilter;
+class QTextToSpeechSharedMemorySink;
 
 class QTextToSpeechPrivate;
 class Q_TEXTTOSPEECH_EXPORT QTextToSpeech : public QObject
@@ -68,10 +73,46 @@ public:
         PauseResume         = 1 << 1,
         WordByWordProgress  = 1 << 2,
         Synthesize          = 1 << 3,
+        PhonemeEvents       = 1 << 4,
     };
     Q_DECLARE_FLAGS(Capabilities, Capability)
     Q_FLAG(Capabilities)
 
+    enum class FileFormat {
+        Wav,
+        Flac,
+    };
+    Q_ENUM(FileFormat)
+
+    enum class CaptionFormat {
+        WebVtt,
+        Srt,
+    };
+    Q_ENUM(CaptionFormat)
+
+    struct CaptionOptions
+    {
+        QTextToSpeech::CaptionFormat format = QTextToSpeech::CaptionFormat::WebVtt;
+        qsizetype maximumCueLength = 42;
+        qint64 maximumCueDuration = 5000;
+    };
+
+    struct WordBoundary
+    {
+        qsizetype start = 0;
+        qsizetype length = 0;
+        qint64 time = 0;
+        qint64 frame = 0;
+    };
+
+    struct Phoneme
+    {
+        QString name;
+        qint64 frame = 0;
+        qint64 duration = 0;
+        int viseme = -1;
+    };
+
     explicit QTextToSpeech(QObject *parent = nullptr);
     explicit QTextToSpeech(const QString &engine, QObject *parent = nullptr);
     explicit QTextToSpeech(const QString &engine, const QVariantMap &params,
@@ -96,6 +137,8 @@ public:
     double pitch() const;
     double volume() const;
 
+    qint64 playbackPosition() const;
+
     Q_INVOKABLE static QStringList availableEngines();
 
     template <typename Functor>
@@ -123,12 +166,32 @@ public:
     }
 
     // synthesize to a functor or function pointer (without context)
-    template <typename Functor>
+    template <typename Functor,
+              std::enable_if_t<!std::is_convertible_v<Functor, QIODevice *>, bool> = true>
     void synthesize(const QString &text, Functor &&func)
     {
         synthesize(text, nullptr, std::forward<Functor>(func));
     }
 
+    void synthesize(const QString &text, QIODevice *sink);
+#if QT_CONFIG(sharedmemory)
+    void synthesize(const QString &text, QTextToSpeechSharedMemorySink *sink);
+#endif
+
+    QFuture<bool> synthesizeToFile(const QString &text, const QString &fileName,
+                                   QTextToSpeech::FileFormat format = QTextToSpeech::FileFormat::Wav);
+    QFuture<bool> synthesizeToFile(const QString &text, const QString &fileName,
+                                   const QString &captionFileName,
+                                   const QTextToSpeech::CaptionOptions &captionOptions,
+                                   QTextToSpeech::FileFormat format = QTextToSpeech::FileFormat::Wav);
+
+    void addAudioFilter(QTextToSpeechAudioFilter *filter);
+    void clearAudioFilters();
+    QList<QTextToSpeechAudioFilter *> audioFilters() const;
+
+    void setVisemeTable(const QHash<QString, int> &table);
+    QHash<QString, int> visemeTable() const;
+
     template <typename ...Args>
     QList<QVoice> findVoices(Args &&...args) const
     {
@@ -170,12 +233,17 @@ Q_SIGNALS:
     void pitchChanged(double pitch);
     void volumeChanged(double volume);
     void voiceChanged(const QVoice &voice);
+    void availableVoicesChanged();
 
     void sayingWord(const QString &word, qsizetype id, qsizetype start, qsizetype length);
+    void wordTimeline(qsizetype id, const QList<QTextToSpeech::WordBoundary> &words);
+    void phonemeEvents(qsizetype id, const QList<QTextToSpeech::Phoneme> &phonemes);
     void aboutToSynthesize(qsizetype id);
 
 protected:
     QList<QVoice> allVoices(const QLocale *locale) const;
+    void connectNotify(const QMetaMethod &signal) override;
+    void disconnectNotify(const QMetaMethod &signal) override;
 
 private:
     template <typename Functor>
@@ -242,6 +310,8 @@ private:
     Q_DISABLE_COPY(QTextToSpeech)
 };
 Q_DECLARE_OPERATORS_FOR_FLAGS(QTextToSpeech::Capabilities)
+Q_DECLARE_TYPEINFO(QTextToSpeech::WordBoundary, Q_PRIMITIVE_TYPE);
+Q_DECLARE_TYPEINFO(QTextToSpeech::Phoneme, Q_RELOCATABLE_TYPE);
 
 QT_END_NAMESPACE
 
@@ -19,45 +19,99 @@
 
 #include <qtexttospeech.h>
 #include <qtexttospeechplugin.h>
+#include "qtexttospeechaudiofilterchain_p.h"
 #include <QMutex>
 #include <QCborMap>
+#include <QtCore/qelapsedtimer.h>
 #include <QtCore/qhash.h>
 #include <QtCore/qqueue.h>
 #include <QtCore/qnumeric.h>
+#include <QtCore/qpointer.h>
 #include <QtCore/private/qobject_p.h>
 
+#include <functional>
+#include <memory>
+
 QT_BEGIN_NAMESPACE
 
 class QTextToSpeech;
+class QTextToSpeechAudioMixer;
+class QTextToSpeechAudioMixerSource;
+class QTextToSpeechFileWriter;
+class QTextToSpeechSharedMemorySink;
 class QTextToSpeechPrivate : public QObjectPrivate
 {
     Q_DECLARE_PUBLIC(QTextToSpeech)
+    friend class QTextToSpeechAudioMixer;
 public:
     QTextToSpeechPrivate(QTextToSpeech *speech);
     ~QTextToSpeechPrivate();
 
+    static QTextToSpeechPrivate *get(QTextToSpeech *speech) { return speech->d_func(); }
+    static const QTextToSpeechPrivate *get(const QTextToSpeech *speech) { return speech->d_func(); }
+
     void setEngineProvider(const QString &engine, const QVariantMap &params);
     static QMultiHash<QString, QCborMap> plugins(bool reload = false);
+    // for consumers of synthesize() that only learn about back-pressure
+    // outside of the functor, like the speech daemon
+    Q_TEXTTOSPEECH_EXPORT static void setSynthesisThrottled(QTextToSpeech *speech,
+                                                            bool throttled);
 
 private:
     bool loadMeta();
     void loadPlugin();
     void updateState(QTextToSpeech::State newState);
     void disconnectSynthesizeFunctor();
+    void setSynthesisThrottled(bool throttled);
+    void synthesize(const QString &text, QtPrivate::QSlotObjectBase *slotObj,
+                    const QObject *context, QTextToSpeech::SynthesizeOverload overload,
+                    std::function<void()> connectSink = {});
+    void sayNextUtterance();
+    void nextUtteranceStarted();
+    void updateWordSignalsEnabled();
+    void updatePhonemeEventsEnabled();
+    void updateInEngineThread(void (QTextToSpeechPrivate::*update)());
+    void restartPlaybackPosition();
     static void loadPluginMetadata(QMultiHash<QString, QCborMap> &list);
     QTextToSpeech *q_ptr;
     QTextToSpeechPlugin *m_plugin = nullptr;
+    // declared before the engine, which might use it until it is destroyed
+    QTextToSpeechAudioFilterChain m_audioFilters;
+    // created by the first mixer the text-to-speech is added to, and kept,
+    // as the engine might still use it after it is removed from the mixer
+    std::shared_ptr<QTextToSpeechAudioMixerSource> m_mixerSource;
+    QPointer<QTextToSpeechAudioMixer> m_audioMixer;
     std::unique_ptr<QTextToSpeechEngine> m_engine = nullptr;
     QString m_providerName;
     QCborMap m_metaData;
     static QMutex m_mutex;
     QQueue<QString> m_pendingUtterances;
+    // while synthesizing, connects the receiver of each pending text
+    QQueue<std::function<void()>> m_pendingReceivers;
     QTextToSpeech::State m_state = QTextToSpeech::Error;
     QMetaObject::Connection m_synthesizeConnection;
-    QtPrivate::QSlotObjectBase *m_slotObject = nullptr;
+    // shared with the pending receiver that installs it
+    std::shared_ptr<QtPrivate::QSlotObjectBase> m_slotObject;
+    QPointer<QTextToSpeechFileWriter> m_fileWriter;
+    QMetaObject::Connection m_captionConnection;
+    QHash<QString, int> m_visemeTable;
+    QMetaObject::Connection m_backpressureConnection;
+    QMetaObject::Connection m_sinkDestroyedConnection;
+#if QT_CONFIG(sharedmemory)
+    QPointer<QTextToSpeechSharedMemorySink> m_sharedMemorySink;
+    QMetaObject::Connection m_sharedMemoryWordConnection;
+#endif
+    bool m_synthesisThrottled = false;
+    // only counted while tracing, to report the last chunk of a text
+    qint64 m_synthesizedBytes = 0;
 
     qsizetype m_utteranceCounter = 0;
     qsizetype m_currentUtterance = 0;
+    // texts passed to the engine while it is still speaking the current one
+    qsizetype m_gaplessUtterances = 0;
+    // playback position of the current text, excluding pauses
+    QElapsedTimer m_playbackTimer;
+    qint64 m_playbackOffset = 0;
     double m_storedPitch = qQNaN();
     double m_storedVolume = qQNaN();
     double m_storedRate = qQNaN();
@@ -0,0 +1,640 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include "qtexttospeechaudiofilter.h"
+#include "qtexttospeechaudiofilter_p.h"
+#include "qtexttospeechaudiokernels_p.h"
+
+#include <utility>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QTextToSpeechAudioKernels;
+
+/*!
+    \class QTextToSpeechAudioFilter
+    \inmodule QtTextToSpeech
+    \since 6.7
+    \brief The QTextToSpeechAudioFilter class is the base class for audio
+    post-processing filters.
+
+    Audio filters process the PCM data that the text-to-speech engine produces,
+    before it is played back or delivered to the synthesize() callback. Add
+    filters to a QTextToSpeech instance using QTextToSpeech::addAudioFilter().
+
+    The filters of a QTextToSpeech instance form a chain. The chain converts
+    the engine's audio data into blocks of normalized floating point samples
+    with interleaved channels, and passes each block through all filters in
+    the order in which they were added. A block never contains more than 256
+    frames.
+
+    Implement process() to modify the samples of a block in place, and
+    reset() to clear any state that a filter keeps from one block to the next.
+
+    \note Filters might be called from a thread that is different from the
+    thread in which the QTextToSpeech instance lives. The chain serializes
+    calls to the filters, but filter parameters that can be changed while
+    audio is being processed must be safe to access from multiple threads.
+    All filters provided by Qt TextToSpeech meet this requirement.
+
+    \sa QTextToSpeech::addAudioFilter()
+*/
+
+/*!
+    Constructs an audio filter.
+*/
+QTextToSpeechAudioFilter::QTextToSpeechAudioFilter()
+    : d_ptr(new QTextToSpeechAudioFilterPrivate)
+{
+}
+
+/*!
+    \internal
+*/
+QTextToSpeechAudioFilter::QTextToSpeechAudioFilter(QTextToSpeechAudioFilterPrivate &dd)
+    : d_ptr(&dd)
+{
+}
+
+/*!
+    Destroys the filter.
+*/
+QTextToSpeechAudioFilter::~QTextToSpeechAudioFilter() = default;
+
+/*!
+    Called before the first block of a new audio stream is processed. The
+    samples of the stream will be in \a format, with the channels interleaved.
+
+    The default implementation does nothing.
+*/
+void QTextToSpeechAudioFilter::reset(const QAudioFormat &format)
+{
+    Q_UNUSED(format);
+}
+
+/*!
+    \fn qsizetype QTextToSpeechAudioFilter::process(float *samples, qsizetype frameCount)
+
+    Processes the \a frameCount frames of interleaved samples at \a samples
+    in place, and returns the number of frames that remain in the block.
+
+    Filters that remove audio, such as QTextToSpeechSilenceTrimFilter, move
+    the remaining frames to the beginning of the block and return a smaller
+    number. Filters must never return a number larger than \a frameCount.
+*/
+
+/*!
+    \class QTextToSpeechGainFilter
+    \inmodule QtTextToSpeech
+    \since 6.7
+    \brief The QTextToSpeechGainFilter class amplifies or attenuates the audio
+    by a constant factor.
+
+    \sa QTextToSpeechLimiterFilter
+*/
+
+/*!
+    Constructs a filter that multiplies all samples with \a gain.
+*/
+QTextToSpeechGainFilter::QTextToSpeechGainFilter(double gain)
+    : QTextToSpeechAudioFilter(*new QTextToSpeechGainFilterPrivate(gain))
+{
+}
+
+/*!
+    Returns the linear gain factor.
+*/
+double QTextToSpeechGainFilter::gain() const
+{
+    Q_D(const QTextToSpeechGainFilter);
+    return d->gain.load(std::memory_order_relaxed);
+}
+
+/*!
+    Sets the linear gain factor to \a gain.
+
+    Values above 1.0 amplify the audio, and might result in clipping unless
+    a QTextToSpeechLimiterFilter follows this filter.
+*/
+void QTextToSpeechGainFilter::setGain(double gain)
+{
+    Q_D(QTextToSpeechGainFilter);
+    d->gain.store(float(gain), std::memory_order_relaxed);
+}
+
+/*!
+    \reimp
+*/
+void QTextToSpeechGainFilter::reset(const QAudioFormat &format)
+{
+    Q_D(QTextToSpeechGainFilter);
+    d->channelCount = format.channelCount();
+}
+
+/*!
+    \reimp
+*/
+qsizetype QTextToSpeechGainFilter::process(float *samples, qsizetype frameCount)
+{
+    Q_D(QTextToSpeechGainFilter);
+    const float gain = d->gain.load(std::memory_order_relaxed);
+    if (gain != 1.0f)
+        scale(samples, frameCount * d->channelCount, gain);
+    return frameCount;
+}
+
+/*!
+    \class QTextToSpeechDcRemovalFilter
+    \inmodule QtTextToSpeech
+    \since 6.7
+    \brief The QTextToSpeechDcRemovalFilter class removes a constant offset
+    from the audio.
+
+    Some voices produce audio with a DC offset, which reduces the headroom for
+    subsequent amplification and results in clicks when playback starts or
+    stops. The filter is a first-order high-pass filter.
+*/
+
+/*!
+    Constructs a filter with the cutoff frequency \a cutoffFrequency in Hz.
+*/
+QTextToSpeechDcRemovalFilter::QTextToSpeechDcRemovalFilter(double cutoffFrequency)
+    : QTextToSpeechAudioFilter(*new QTextToSpeechDcRemovalFilterPrivate(cutoffFrequency))
+{
+}
+
+/*!
+    Returns the cutoff frequency in Hz.
+*/
+double QTextToSpeechDcRemovalFilter::cutoffFrequency() const
+{
+    Q_D(const QTextToSpeechDcRemovalFilter);
+    return d->cutoffFrequency.load(std::memory_order_relaxed);
+}
+
+/*!
+    Sets the cutoff frequency to \a frequency Hz.
+*/
+void QTextToSpeechDcRemovalFilter::setCutoffFrequency(double frequency)
+{
+    Q_D(QTextToSpeechDcRemovalFilter);
+    d->cutoffFrequency.store(float(frequency), std::memory_order_relaxed);
+}
+
+/*!
+    \reimp
+*/
+void QTextToSpeechDcRemovalFilter::reset(const QAudioFormat &format)
+{
+    Q_D(QTextToSpeechDcRemovalFilter);
+    d->sampleRate = format.sampleRate();
+    d->channelCount = format.channelCount();
+    d->appliedCutoff = 0;
+    d->lastInput.assign(d->channelCount, 0.0f);
+    d->lastOutput.assign(d->channelCount, 0.0f);
+}
+
+/*!
+    \reimp
+*/
+qsizetype QTextToSpeechDcRemovalFilter::process(float *samples, qsizetype frameCount)
+{
+    Q_D(QTextToSpeechDcRemovalFilter);
+    if (d->sampleRate <= 0)
+        return frameCount;
+
+    const float cutoff = d->cutoffFrequency.load(std::memory_order_relaxed);
+    if (cutoff != d->appliedCutoff) {
+        d->appliedCutoff = cutoff;
+        d->pole = std::exp(-2.0f * float(M_PI) * cutoff / d->sampleRate);
+    }
+
+    // the recursion makes this inherently sequential per channel
+    const int stride = d->channelCount;
+    for (int channel = 0; channel < stride; ++channel) {
+        float lastInput = d->lastInput[channel];
+        float lastOutput = d->lastOutput[channel];
+        for (qsizetype i = channel; i < frameCount * stride; i += stride) {
+            const float input = samples[i];
+            lastOutput = input - lastInput + d->pole * lastOutput;
+            lastInput = input;
+            samples[i] = lastOutput;
+        }
+        d->lastInput[channel] = lastInput;
+        d->lastOutput[channel] = lastOutput;
+    }
+    return frameCount;
+}
+
+/*!
+    \class QTextToSpeechNormalizationFilter
+    \inmodule QtTextToSpeech
+    \since 6.7
+    \brief The QTextToSpeechNormalizationFilter class adjusts the loudness of
+    the audio to a target level.
+
+    Voices of different engines, and different voices of the same engine,
+    often produce audio at very different levels. The filter tracks the
+    short-term RMS level of the audio, and smoothly adjusts the gain so that
+    the level approaches the target level. Blocks that are quieter than
+    -50 dBFS are considered silence, and don't affect the gain.
+
+    The filter measures the plain RMS level without frequency weighting, which
+    is a good enough approximation of perceived loudness for speech.
+*/
+
+/*!
+    Constructs a filter that normalizes the level of the audio to
+    \a targetLevel in dBFS, and that amplifies the audio by at most
+    \a maximumGain dB.
+*/
+QTextToSpeechNormalizationFilter::QTextToSpeechNormalizationFilter(double targetLevel,
+                                                                   double maximumGain)
+    : QTextToSpeechAudioFilter(*new QTextToSpeechNormalizationFilterPrivate(targetLevel, maximumGain))
+{
+}
+
+/*!
+    Returns the target level in dBFS.
+*/
+double QTextToSpeechNormalizationFilter::targetLevel() const
+{
+    Q_D(const QTextToSpeechNormalizationFilter);
+    return d->targetLevel.load(std::memory_order_relaxed);
+}
+
+/*!
+    Sets the target level to \a level dBFS.
+*/
+void QTextToSpeechNormalizationFilter::setTargetLevel(double level)
+{
+    Q_D(QTextToSpeechNormalizationFilter);
+    d->targetLevel.store(float(level), std::memory_order_relaxed);
+}
+
+/*!
+    Returns the maximum amplification in dB.
+*/
+double QTextToSpeechNormalizationFilter::maximumGain() const
+{
+    Q_D(const QTextToSpeechNormalizationFilter);
+    return d->maximumGain.load(std::memory_order_relaxed);
+}
+
+/*!
+    Sets the maximum amplification to \a gain dB.
+*/
+void QTextToSpeechNormalizationFilter::setMaximumGain(double gain)
+{
+    Q_D(QTextToSpeechNormalizationFilter);
+    d->maximumGain.store(float(gain), std::memory_order_relaxed);
+}
+
+/*!
+    \reimp
+*/
+void QTextToSpeechNormalizationFilter::reset(const QAudioFormat &format)
+{
+    Q_D(QTextToSpeechNormalizationFilter);
+    d->sampleRate = format.sampleRate();
+    d->channelCount = format.channelCount();
+    d->meanSquare = 0;
+    d->currentGain = 1;
+}
+
+/*!
+    \reimp
+*/
+qsizetype QTextToSpeechNormalizationFilter::process(float *samples, qsizetype frameCount)
+{
+    Q_D(QTextToSpeechNormalizationFilter);
+    if (!frameCount || d->sampleRate <= 0)
+        return frameCount;
+
+    const qsizetype sampleCount = frameCount * d->channelCount;
+    const float blockMeanSquare = sumOfSquares(samples, sampleCount) / sampleCount;
+
+    static const float gateMeanSquare = dbToLinear(-100.0f); // -50 dBFS, squared
+    if (blockMeanSquare > gateMeanSquare) {
+        // integrate over roughly 400ms, but start with the first audible block
+        const float timeConstant = 0.4f * d->sampleRate;
+        const float alpha = d->meanSquare > 0 ? std::min(1.0f, frameCount / timeConstant) : 1.0f;
+        d->meanSquare += alpha * (blockMeanSquare - d->meanSquare);
+    }
+
+    float targetGain = d->currentGain;
+    if (d->meanSquare > 0) {
+        const float target = dbToLinear(d->targetLevel.load(std::memory_order_relaxed));
+        const float maximum = dbToLinear(d->maximumGain.load(std::memory_order_relaxed));
+        targetGain = std::min(target / std::sqrt(d->meanSquare), maximum);
+    }
+
+    if (qFuzzyCompare(targetGain, d->currentGain)) {
+        scale(samples, sampleCount, d->currentGain);
+    } else {
+        // ramp over the block to avoid audible steps
+        const float step = (targetGain - d->currentGain) / frameCount;
+        float gain = d->currentGain;
+        for (qsizetype frame = 0; frame < frameCount; ++frame) {
+            gain += step;
+            for (int channel = 0; channel < d->channelCount; ++channel)
+                samples[frame * d->channelCount + channel] *= gain;
+        }
+        d->currentGain = targetGain;
+    }
+    return frameCount;
+}
+
+/*!
+    \class QTextToSpeechSilenceTrimFilter
+    \inmodule QtTextToSpeech
+    \since 6.7
+    \brief The QTextToSpeechSilenceTrimFilter class removes leading and
+    trailing silence, and shortens long pauses.
+
+    The filter classifies the audio in windows of 10ms as silent if their RMS
+    level is below the threshold. Silence at the beginning of the stream is
+    removed, and within the stream, consecutive silence is shortened to the
+    maximum silence duration.
+
+    The filter holds the retained part of a pause back until the speech
+    continues, and then plays it as digital silence. Silence at the end of the
+    stream is therefore removed as well, but the speech after a pause might
+    reach the filters that follow in bigger blocks.
+
+    Trimming silence shortens the audio, so timestamps reported by the engine
+    no longer match the filtered audio. Use trimmedFrames() to find out how
+    much audio the filter has removed.
+*/
+
+/*!
+    Constructs a filter that removes silence below \a threshold dBFS, and
+    that shortens pauses to \a maximumSilence milliseconds.
+*/
+QTextToSpeechSilenceTrimFilter::QTextToSpeechSilenceTrimFilter(double threshold,
+                                                               int maximumSilence)
+    : QTextToSpeechAudioFilter(*new QTextToSpeechSilenceTrimFilterPrivate(threshold, maximumSilence))
+{
+}
+
+/*!
+    Returns the threshold in dBFS below which audio is considered silent.
+*/
+double QTextToSpeechSilenceTrimFilter::threshold() const
+{
+    Q_D(const QTextToSpeechSilenceTrimFilter);
+    return d->threshold.load(std::memory_order_relaxed);
+}
+
+/*!
+    Sets the threshold to \a threshold dBFS.
+*/
+void QTextToSpeechSilenceTrimFilter::setThreshold(double threshold)
+{
+    Q_D(QTextToSpeechSilenceTrimFilter);
+    d->threshold.store(float(threshold), std::memory_order_relaxed);
+}
+
+/*!
+    Returns the maximum duration of silence within the audio, in milliseconds.
+*/
+int QTextToSpeechSilenceTrimFilter::maximumSilence() const
+{
+    Q_D(const QTextToSpeechSilenceTrimFilter);
+    return d->maximumSilence.load(std::memory_order_relaxed);
+}
+
+/*!
+    Sets the maximum duration of silence within the audio to \a milliseconds.
+*/
+void QTextToSpeechSilenceTrimFilter::setMaximumSilence(int milliseconds)
+{
+    Q_D(QTextToSpeechSilenceTrimFilter);
+    d->maximumSilence.store(milliseconds, std::memory_order_relaxed);
+}
+
+/*!
+    Returns the number of frames that the filter has removed since the
+    beginning of the current audio stream.
+
+    This function can be called from any thread.
+*/
+qint64 QTextToSpeechSilenceTrimFilter::trimmedFrames() const
+{
+    Q_D(const QTextToSpeechSilenceTrimFilter);
+    return d->trimmedFrames.load(std::memory_order_relaxed);
+}
+
+/*!
+    \reimp
+*/
+void QTextToSpeechSilenceTrimFilter::reset(const QAudioFormat &format)
+{
+    Q_D(QTextToSpeechSilenceTrimFilter);
+    d->channelCount = qMax(1, format.channelCount());
+    d->trimmer.reset(format.sampleRate(), d->channelCount);
+    d->trimmedFrames.store(0, std::memory_order_relaxed);
+}
+
+/*!
+    \reimp
+*/
+qsizetype QTextToSpeechSilenceTrimFilter::process(float *samples, qsizetype frameCount)
+{
+    Q_D(QTextToSpeechSilenceTrimFilter);
+    d->insertedSilence = 0;
+    d->trimmer.setThreshold(d->threshold.load(std::memory_order_relaxed));
+    d->trimmer.setMaximumPause(d->maximumSilence.load(std::memory_order_relaxed));
+
+    // silent windows are removed from the block, and the part of a pause that
+    // is kept goes back in once the speech continues
+    const int channelCount = d->channelCount;
+    const qsizetype window = d->trimmer.windowFrames();
+    qsizetype written = 0;
+    qint64 trimmed = 0;
+    for (qsizetype offset = 0; offset < frameCount; offset += window) {
+        const qsizetype length = qMin(window, frameCount - offset);
+        const float *in = samples + offset * channelCount;
+        const qsizetype silence = d->trimmer.next(in, length);
+        if (silence < 0) {
+            trimmed += length;
+            continue;
+        }
+        if (!written) {
+            // the pause began before the speech in this block
+            d->insertedSilence = silence;
+        } else {
+            // the pause is part of the frames that were removed from this block
+            std::fill_n(samples + written * channelCount, silence * channelCount, 0.0f);
+            written += silence;
+        }
+        trimmed -= silence;
+        std::copy_n(in, length * channelCount, samples + written * channelCount);
+        written += length;
+    }
+    d->trimmedFrames.fetch_add(trimmed, std::memory_order_relaxed);
+    return written;
+}
+
+/*!
+    \class QTextToSpeechLimiterFilter
+    \inmodule QtTextToSpeech
+    \since 6.7
+    \brief The QTextToSpeechLimiterFilter class prevents the audio from
+    exceeding a peak level.
+
+    The limiter reduces the gain instantly when a sample exceeds the threshold,
+    and releases the gain reduction smoothly over the release time. Place the
+    limiter last in the chain to protect against clipping caused by preceding
+    filters.
+*/
+
+/*!
+    Constructs a limiter with the peak level \a threshold in dBFS, and a
+    release time of \a releaseTime milliseconds.
+*/
+QTextToSpeechLimiterFilter::QTextToSpeechLimiterFilter(double threshold, int releaseTime)
+    : QTextToSpeechAudioFilter(*new QTextToSpeechLimiterFilterPrivate(threshold, releaseTime))
+{
+}
+
+/*!
+    Returns the peak level in dBFS.
+*/
+double QTextToSpeechLimiterFilter::threshold() const
+{
+    Q_D(const QTextToSpeechLimiterFilter);
+    return d->threshold.load(std::memory_order_relaxed);
+}
+
+/*!
+    Sets the peak level to \a threshold dBFS.
+*/
+void QTextToSpeechLimiterFilter::setThreshold(double threshold)
+{
+    Q_D(QTextToSpeechLimiterFilter);
+    d->threshold.store(float(threshold), std::memory_order_relaxed);
+}
+
+/*!
+    Returns the release time in milliseconds.
+*/
+int QTextToSpeechLimiterFilter::releaseTime() const
+{
+    Q_D(const QTextToSpeechLimiterFilter);
+    return d->releaseTime.load(std::memory_order_relaxed);
+}
+
+/*!
+    Sets the release time to \a milliseconds.
+*/
+void QTextToSpeechLimiterFilter::setReleaseTime(int milliseconds)
+{
+    Q_D(QTextToSpeechLimiterFilter);
+    d->releaseTime.store(milliseconds, std::memory_order_relaxed);
+}
+
+/*!
+    \reimp
+*/
+void QTextToSpeechLimiterFilter::reset(const QAudioFormat &format)
+{
+    Q_D(QTextToSpeechLimiterFilter);
+    d->sampleRate = format.sampleRate();
+    d->channelCount = format.channelCount();
+    d->envelope = 0;
+}
+
+/*!
+    \reimp
+*/
+qsizetype QTextToSpeechLimiterFilter::process(float *samples, qsizetype frameCount)
+{
+    Q_D(QTextToSpeechLimiterFilter);
+    const qsizetype sampleCount = frameCount * d->channelCount;
+    const float threshold = dbToLinear(d->threshold.load(std::memory_order_relaxed));
+
+    // fast path: nothing to limit, and no gain reduction left to release
+    if (d->envelope <= threshold && peak(samples, sampleCount) <= threshold) {
+        d->envelope = 0;
+        return frameCount;
+    }
+
+    const float releaseFrames = std::max(1.0f, d->releaseTime.load(std::memory_order_relaxed)
+                                              * d->sampleRate / 1000.0f);
+    const float release = std::exp(-1.0f / releaseFrames);
+    for (qsizetype frame = 0; frame < frameCount; ++frame) {
+        float *first = samples + frame * d->channelCount;
+        float framePeak = 0;
+        for (int channel = 0; channel < d->channelCount; ++channel)
+            framePeak = std::max(framePeak, std::abs(first[channel]));
+        d->envelope = std::max(framePeak, d->envelope * release);
+        if (d->envelope > threshold) {
+            const float gain = threshold / d->envelope;
+            for (int channel = 0; channel < d->channelCount; ++channel)
+                first[channel] *= gain;
+        }
+    }
+    return frameCount;
+}
+
+void QTextToSpeechSilenceTrimmer::reset(int sampleRate, int channelCount)
+{
+    m_sampleRate = sampleRate;
+    m_channelCount = qMax(1, channelCount);
+    m_windowFrames = qMax(1, sampleRate / 100);
+    m_leading = true;
+    m_pauseFrames = 0;
+    m_heldFrames = 0;
+}
+
+void QTextToSpeechSilenceTrimmer::setThreshold(double threshold)
+{
+    const float linear = dbToLinear(float(threshold));
+    m_threshold = linear * linear;
+}
+
+void QTextToSpeechSilenceTrimmer::setMaximumPause(int milliseconds)
+{
+    m_maximumPause = qMax(0, milliseconds);
+}
+
+bool QTextToSpeechSilenceTrimmer::isSilence(const float *samples, qsizetype frameCount) const
+{
+    const qsizetype sampleCount = frameCount * m_channelCount;
+    return sumOfSquares(samples, sampleCount) < m_threshold * sampleCount;
+}
+
+qsizetype QTextToSpeechSilenceTrimmer::next(const float *samples, qsizetype frameCount)
+{
+    if (frameCount <= 0)
+        return -1;
+
+    if (!isSilence(samples, frameCount)) {
+        m_leading = false;
+        m_pauseFrames = 0;
+        return std::exchange(m_heldFrames, 0);
+    }
+
+    if (!m_leading) {
+        const qint64 maximum = qint64(m_maximumPause) * m_sampleRate / 1000;
+        m_heldFrames += qsizetype(std::clamp(maximum - m_pauseFrames, qint64(0), qint64(frameCount)));
+        m_pauseFrames += frameCount;
+    }
+    return -1;
+}
+
+qsizetype QTextToSpeechSilenceTrimmer::speechEnd(const float *samples, qsizetype frameCount) const
+{
+    if (frameCount <= 0)
+        return 0;
+    for (qsizetype start = (frameCount - 1) / m_windowFrames * m_windowFrames; start >= 0;
+         start -= m_windowFrames) {
+        const qsizetype end = qMin(start + m_windowFrames, frameCount);
+        if (!isSilence(samples + start * m_channelCount, end - start))
+            return end;
+    }
+    return 0;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,123 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHAUDIOFILTER_H
+#define QTEXTTOSPEECHAUDIOFILTER_H
+
+#include <QtTextToSpeech/qtexttospeech_global.h>
+#include <QtCore/qscopedpointer.h>
+#include <QtMultimedia/qaudioformat.h>
+
+QT_BEGIN_NAMESPACE
+
+class QTextToSpeechAudioFilterPrivate;
+class Q_TEXTTOSPEECH_EXPORT QTextToSpeechAudioFilter
+{
+public:
+    virtual ~QTextToSpeechAudioFilter();
+
+    virtual void reset(const QAudioFormat &format);
+    virtual qsizetype process(float *samples, qsizetype frameCount) = 0;
+
+protected:
+    QTextToSpeechAudioFilter();
+    explicit QTextToSpeechAudioFilter(QTextToSpeechAudioFilterPrivate &dd);
+
+    QScopedPointer<QTextToSpeechAudioFilterPrivate> d_ptr;
+
+private:
+    Q_DISABLE_COPY(QTextToSpeechAudioFilter)
+    Q_DECLARE_PRIVATE(QTextToSpeechAudioFilter)
+};
+
+class QTextToSpeechGainFilterPrivate;
+class Q_TEXTTOSPEECH_EXPORT QTextToSpeechGainFilter : public QTextToSpeechAudioFilter
+{
+public:
+    explicit QTextToSpeechGainFilter(double gain = 1.0);
+
+    double gain() const;
+    void setGain(double gain);
+
+    void reset(const QAudioFormat &format) override;
+    qsizetype process(float *samples, qsizetype frameCount) override;
+
+private:
+    Q_DECLARE_PRIVATE(QTextToSpeechGainFilter)
+};
+
+class QTextToSpeechDcRemovalFilterPrivate;
+class Q_TEXTTOSPEECH_EXPORT QTextToSpeechDcRemovalFilter : public QTextToSpeechAudioFilter
+{
+public:
+    explicit QTextToSpeechDcRemovalFilter(double cutoffFrequency = 20.0);
+
+    double cutoffFrequency() const;
+    void setCutoffFrequency(double frequency);
+
+    void reset(const QAudioFormat &format) override;
+    qsizetype process(float *samples, qsizetype frameCount) override;
+
+private:
+    Q_DECLARE_PRIVATE(QTextToSpeechDcRemovalFilter)
+};
+
+class QTextToSpeechNormalizationFilterPrivate;
+class Q_TEXTTOSPEECH_EXPORT QTextToSpeechNormalizationFilter : public QTextToSpeechAudioFilter
+{
+public:
+    explicit QTextToSpeechNormalizationFilter(double targetLevel = -20.0, double maximumGain = 12.0);
+
+    double targetLevel() const;
+    void setTargetLevel(double level);
+    double maximumGain() const;
+    void setMaximumGain(double gain);
+
+    void reset(const QAudioFormat &format) override;
+    qsizetype process(float *samples, qsizetype frameCount) override;
+
+private:
+    Q_DECLARE_PRIVATE(QTextToSpeechNormalizationFilter)
+};
+
+class QTextToSpeechSilenceTrimFilterPrivate;
+class Q_TEXTTOSPEECH_EXPORT QTextToSpeechSilenceTrimFilter : public QTextToSpeechAudioFilter
+{
+public:
+    explicit QTextToSpeechSilenceTrimFilter(double threshold = -50.0, int maximumSilence = 250);
+
+    double threshold() const;
+    void setThreshold(double threshold);
+    int maximumSilence() const;
+    void setMaximumSilence(int milliseconds);
+
+    qint64 trimmedFrames() const;
+
+    void reset(const QAudioFormat &format) override;
+    qsizetype process(float *samples, qsizetype frameCount) override;
+
+private:
+    Q_DECLARE_PRIVATE(QTextToSpeechSilenceTrimFilter)
+};
+
+class QTextToSpeechLimiterFilterPrivate;
+class Q_TEXTTOSPEECH_EXPORT QTextToSpeechLimiterFilter : public QTextToSpeechAudioFilter
+{
+public:
+    explicit QTextToSpeechLimiterFilter(double threshold = -1.0, int releaseTime = 50);
+
+    double threshold() const;
+    void setThreshold(double threshold);
+    int releaseTime() const;
+    void setReleaseTime(int milliseconds);
+
+    void reset(const QAudioFormat &format) override;
+    qsizetype process(float *samples, qsizetype frameCount) override;
+
+private:
+    Q_DECLARE_PRIVATE(QTextToSpeechLimiterFilter)
+};
+
+QT_END_NAMESPACE
+
+#endif
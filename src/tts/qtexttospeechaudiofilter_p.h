@@ -0,0 +1,149 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHAUDIOFILTER_P_H
+#define QTEXTTOSPEECHAUDIOFILTER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists for the convenience
+// of other Qt classes.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qtexttospeechaudiofilter.h"
+
+#include <QtCore/qlist.h>
+
+#include <atomic>
+
+QT_BEGIN_NAMESPACE
+
+// Removes the silence at the beginning of a stream, and shortens pauses, in
+// windows of 10ms. The retained part of a pause is held back until the speech
+// continues, so that trailing silence is dropped without having to know where
+// the stream ends. Shared by QTextToSpeechSilenceTrimFilter and the engines
+// that trim silence themselves, so that both classify audio the same way.
+class Q_TEXTTOSPEECH_EXPORT QTextToSpeechSilenceTrimmer
+{
+public:
+    static constexpr double DefaultThreshold = -50.0;
+
+    void reset(int sampleRate, int channelCount);
+    void setThreshold(double threshold); // dBFS
+    void setMaximumPause(int milliseconds);
+
+    // the number of frames that next() should get at once
+    qsizetype windowFrames() const { return m_windowFrames; }
+    // Classifies the next window of interleaved samples. Returns -1 if the
+    // window is silence that is dropped or held back, otherwise the number of
+    // frames of held-back silence that go before the window.
+    qsizetype next(const float *samples, qsizetype frameCount);
+    qsizetype heldFrames() const { return m_heldFrames; }
+    // Returns the number of frames up to the end of the last window that is
+    // not silence, with the windows counted from the start of the samples.
+    qsizetype speechEnd(const float *samples, qsizetype frameCount) const;
+
+private:
+    bool isSilence(const float *samples, qsizetype frameCount) const;
+
+    int m_sampleRate = 0;
+    int m_channelCount = 1;
+    qsizetype m_windowFrames = 1;
+    float m_threshold = 1e-5f; // linear and squared, -50 dBFS by default
+    int m_maximumPause = 0;
+    bool m_leading = true;
+    qint64 m_pauseFrames = 0;
+    qsizetype m_heldFrames = 0;
+};
+
+class QTextToSpeechAudioFilterPrivate
+{
+public:
+    virtual ~QTextToSpeechAudioFilterPrivate() = default;
+
+    static QTextToSpeechAudioFilterPrivate *get(QTextToSpeechAudioFilter *filter)
+    { return filter->d_func(); }
+
+    // Frames of silence that go before the frames returned by the last call
+    // to process(). Only the built-in filters insert silence; the chain runs
+    // it through the filters that follow.
+    qsizetype insertedSilence = 0;
+};
+
+class QTextToSpeechGainFilterPrivate : public QTextToSpeechAudioFilterPrivate
+{
+public:
+    explicit QTextToSpeechGainFilterPrivate(double gain) : gain(float(gain)) {}
+
+    std::atomic<float> gain;
+    int channelCount = 1;
+};
+
+class QTextToSpeechDcRemovalFilterPrivate : public QTextToSpeechAudioFilterPrivate
+{
+public:
+    explicit QTextToSpeechDcRemovalFilterPrivate(double cutoffFrequency)
+        : cutoffFrequency(float(cutoffFrequency))
+    {}
+
+    std::atomic<float> cutoffFrequency;
+    float appliedCutoff = 0;
+    float pole = 0;
+    int sampleRate = 0;
+    int channelCount = 1;
+    // previous input and output, per channel
+    QList<float> lastInput;
+    QList<float> lastOutput;
+};
+
+class QTextToSpeechNormalizationFilterPrivate : public QTextToSpeechAudioFilterPrivate
+{
+public:
+    QTextToSpeechNormalizationFilterPrivate(double targetLevel, double maximumGain)
+        : targetLevel(float(targetLevel)), maximumGain(float(maximumGain))
+    {}
+
+    std::atomic<float> targetLevel;
+    std::atomic<float> maximumGain;
+    int sampleRate = 0;
+    int channelCount = 1;
+    float meanSquare = 0;
+    float currentGain = 1;
+};
+
+class QTextToSpeechSilenceTrimFilterPrivate : public QTextToSpeechAudioFilterPrivate
+{
+public:
+    QTextToSpeechSilenceTrimFilterPrivate(double threshold, int maximumSilence)
+        : threshold(float(threshold)), maximumSilence(maximumSilence)
+    {}
+
+    std::atomic<float> threshold;
+    std::atomic<int> maximumSilence;
+    std::atomic<qint64> trimmedFrames = 0;
+    int channelCount = 1;
+    QTextToSpeechSilenceTrimmer trimmer;
+};
+
+class QTextToSpeechLimiterFilterPrivate : public QTextToSpeechAudioFilterPrivate
+{
+public:
+    QTextToSpeechLimiterFilterPrivate(double threshold, int releaseTime)
+        : threshold(float(threshold)), releaseTime(releaseTime)
+    {}
+
+    std::atomic<float> threshold;
+    std::atomic<int> releaseTime;
+    int sampleRate = 0;
+    int channelCount = 1;
+    float envelope = 0;
+};
+
+QT_END_NAMESPACE
+
+#endif
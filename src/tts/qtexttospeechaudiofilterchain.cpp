@@ -0,0 +1,187 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include "qtexttospeechaudiofilterchain_p.h"
+#include "qtexttospeechaudiofilter.h"
+#include "qtexttospeechaudiofilter_p.h"
+#include "qtexttospeechaudiokernels_p.h"
+
+#include <cstring>
+#include <utility>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QTextToSpeechAudioKernels;
+
+QTextToSpeechAudioFilterChainClient::~QTextToSpeechAudioFilterChainClient() = default;
+
+QTextToSpeechAudioFilterChain::~QTextToSpeechAudioFilterChain()
+{
+    qDeleteAll(m_filters);
+}
+
+void QTextToSpeechAudioFilterChain::addFilter(QTextToSpeechAudioFilter *filter)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_format.isValid())
+        filter->reset(m_format);
+    m_filters.append(filter);
+    m_filterCount.storeRelaxed(m_filters.size());
+}
+
+void QTextToSpeechAudioFilterChain::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    qDeleteAll(std::exchange(m_filters, {}));
+    m_filterCount.storeRelaxed(0);
+}
+
+QList<QTextToSpeechAudioFilter *> QTextToSpeechAudioFilterChain::filters() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_filters;
+}
+
+void QTextToSpeechAudioFilterChain::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    m_needsReset = true;
+}
+
+void QTextToSpeechAudioFilterChain::process(const QAudioFormat &format, QByteArray &data)
+{
+    if (isEmpty())
+        return;
+
+    switch (format.sampleFormat()) {
+    case QAudioFormat::UInt8:
+    case QAudioFormat::Int16:
+    case QAudioFormat::Int32:
+    case QAudioFormat::Float:
+        break;
+    default:
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (m_needsReset || format != m_format) {
+        m_format = format;
+        m_needsReset = false;
+        m_partialFrame.clear();
+        for (QTextToSpeechAudioFilter *filter : std::as_const(m_filters))
+            filter->reset(format);
+    }
+
+    const int channelCount = format.channelCount();
+    const int bytesPerFrame = format.bytesPerFrame();
+    if (bytesPerFrame <= 0)
+        return;
+    // complete the frame that the previous data ended with
+    if (!m_partialFrame.isEmpty())
+        data.prepend(std::exchange(m_partialFrame, {}));
+    m_blocks.resize(m_filters.size() + 1);
+    for (QList<float> &block : m_blocks)
+        block.resize(BlockFrames * channelCount);
+
+    m_output.clear();
+    m_output.reserve(data.size());
+    const qsizetype totalFrames = data.size() / bytesPerFrame;
+    for (qsizetype frame = 0; frame < totalFrames; frame += BlockFrames) {
+        const qsizetype frames = std::min(BlockFrames, totalFrames - frame);
+        float *block = m_blocks.first().data();
+        toFloat(data.constData() + frame * bytesPerFrame, block, frames * channelCount);
+        runFilters(0, block, frames);
+    }
+
+    // hold back an incomplete trailing frame until the rest of it arrives
+    m_partialFrame = data.sliced(totalFrames * bytesPerFrame);
+    data.swap(m_output);
+}
+
+/*
+    Runs the \a frameCount frames in \a block through the filters from index
+    \a first on, and appends the result to the output. Silence that a filter
+    inserts goes through the filters that follow it, in blocks of its own.
+*/
+void QTextToSpeechAudioFilterChain::runFilters(qsizetype first, float *block, qsizetype frameCount)
+{
+    const int channelCount = m_format.channelCount();
+    for (qsizetype index = first; index < m_filters.size() && frameCount; ++index) {
+        QTextToSpeechAudioFilter *filter = m_filters.at(index);
+        frameCount = std::min(filter->process(block, frameCount), frameCount);
+
+        auto *d = QTextToSpeechAudioFilterPrivate::get(filter);
+        qsizetype silence = std::exchange(d->insertedSilence, 0);
+        float *zeros = m_blocks[index + 1].data();
+        while (silence > 0) {
+            const qsizetype frames = std::min(BlockFrames, silence);
+            std::fill_n(zeros, frames * channelCount, 0.0f);
+            runFilters(index + 1, zeros, frames);
+            silence -= frames;
+        }
+    }
+    if (frameCount)
+        appendFloat(block, frameCount * channelCount);
+}
+
+void QTextToSpeechAudioFilterChain::toFloat(const char *in, float *out, qsizetype sampleCount) const
+{
+    switch (m_format.sampleFormat()) {
+    case QAudioFormat::Int16:
+        if (quintptr(in) % alignof(qint16) == 0) {
+            int16ToFloat(reinterpret_cast<const qint16 *>(in), out, sampleCount);
+        } else {
+            for (qsizetype i = 0; i < sampleCount; ++i) {
+                qint16 sample;
+                std::memcpy(&sample, in + i * sizeof(qint16), sizeof(qint16));
+                out[i] = m_format.normalizedSampleValue(&sample);
+            }
+        }
+        break;
+    case QAudioFormat::Float:
+        std::memcpy(out, in, sampleCount * sizeof(float));
+        break;
+    default:
+        for (qsizetype i = 0; i < sampleCount; ++i)
+            out[i] = m_format.normalizedSampleValue(in + i * m_format.bytesPerSample());
+        break;
+    }
+}
+
+void QTextToSpeechAudioFilterChain::appendFloat(const float *in, qsizetype sampleCount)
+{
+    const qsizetype offset = m_output.size();
+    m_output.resize(offset + sampleCount * m_format.bytesPerSample());
+    char *out = m_output.data() + offset;
+    switch (m_format.sampleFormat()) {
+    case QAudioFormat::Int16:
+        if (quintptr(out) % alignof(qint16) == 0) {
+            floatToInt16(in, reinterpret_cast<qint16 *>(out), sampleCount);
+        } else {
+            for (qsizetype i = 0; i < sampleCount; ++i) {
+                qint16 sample;
+                floatToInt16(in + i, &sample, 1);
+                std::memcpy(out + i * sizeof(qint16), &sample, sizeof(qint16));
+            }
+        }
+        break;
+    case QAudioFormat::Float:
+        std::memcpy(out, in, sampleCount * sizeof(float));
+        break;
+    case QAudioFormat::UInt8:
+        for (qsizetype i = 0; i < sampleCount; ++i)
+            out[i] = char(std::clamp(qRound(in[i] * 128.0f) + 128, 0, 255));
+        break;
+    case QAudioFormat::Int32:
+        for (qsizetype i = 0; i < sampleCount; ++i) {
+            const qint32 sample = qint32(std::clamp(double(in[i]) * 2147483648.0,
+                                                    -2147483648.0, 2147483647.0));
+            std::memcpy(out + i * sizeof(qint32), &sample, sizeof(qint32));
+        }
+        break;
+    default:
+        Q_UNREACHABLE();
+    }
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,93 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHAUDIOFILTERCHAIN_P_H
+#define QTEXTTOSPEECHAUDIOFILTERCHAIN_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists for the convenience
+// of other Qt classes.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtTextToSpeech/qtexttospeech_global.h>
+
+#include <QtCore/qatomic.h>
+#include <QtCore/qbytearray.h>
+#include <QtCore/qlist.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qobject.h>
+#include <QtMultimedia/qaudioformat.h>
+
+QT_BEGIN_NAMESPACE
+
+class QTextToSpeechAudioFilter;
+
+// Owned by QTextToSpeechPrivate; engines that play audio themselves run their
+// PCM data through the chain before writing it to the audio sink.
+class Q_TEXTTOSPEECH_EXPORT QTextToSpeechAudioFilterChain
+{
+public:
+    // the maximum number of frames passed to a filter at once
+    static constexpr qsizetype BlockFrames = 256;
+
+    QTextToSpeechAudioFilterChain() = default;
+    ~QTextToSpeechAudioFilterChain();
+
+    void addFilter(QTextToSpeechAudioFilter *filter);
+    void clear();
+    QList<QTextToSpeechAudioFilter *> filters() const;
+    bool isEmpty() const { return m_filterCount.loadRelaxed() == 0; }
+
+    // the next call to process() starts a new audio stream
+    void reset();
+
+    // thread-safe; replaces data with the filtered data, which is usually
+    // shorter, but can be longer when held-back silence goes back in
+    void process(const QAudioFormat &format, QByteArray &data);
+
+private:
+    Q_DISABLE_COPY(QTextToSpeechAudioFilterChain)
+
+    void runFilters(qsizetype first, float *block, qsizetype frameCount);
+    void toFloat(const char *in, float *out, qsizetype sampleCount) const;
+    void appendFloat(const float *in, qsizetype sampleCount);
+
+    mutable QMutex m_mutex;
+    QList<QTextToSpeechAudioFilter *> m_filters;
+    QAtomicInteger<qsizetype> m_filterCount = 0;
+    QAudioFormat m_format;
+    bool m_needsReset = true;
+    // the block read from the data, and one per filter for the silence it inserts
+    QList<QList<float>> m_blocks;
+    QByteArray m_output;
+    // the bytes of a frame that the previous data ended in the middle of
+    QByteArray m_partialFrame;
+};
+
+// Implemented by the engines that play audio themselves. This is not part of
+// the QTextToSpeechEngine plugin API, as the chain is private; QTextToSpeech
+// finds the interface with qobject_cast.
+class Q_TEXTTOSPEECH_EXPORT QTextToSpeechAudioFilterChainClient
+{
+public:
+    virtual ~QTextToSpeechAudioFilterChainClient();
+
+    // Called once after the engine has been created, with the chain of the
+    // QTextToSpeech instance, which outlives the engine. The engine runs the
+    // audio through the chain before playing it, and resets the chain when a
+    // new utterance starts. The chain can be used from any thread.
+    virtual void setAudioFilterChain(QTextToSpeechAudioFilterChain *chain) = 0;
+};
+
+Q_DECLARE_INTERFACE(QTextToSpeechAudioFilterChainClient,
+                    "org.qt-project.qt.speech.tts.audiofilterchainclient/6.7")
+
+QT_END_NAMESPACE
+
+#endif
@@ -0,0 +1,232 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHAUDIOKERNELS_P_H
+#define QTEXTTOSPEECHAUDIOKERNELS_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists for the convenience
+// of other Qt classes.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtCore/qglobal.h>
+#include <QtCore/qmath.h>
+#include <QtCore/private/qsimd_p.h>
+
+#include <algorithm>
+#include <cmath>
+
+QT_BEGIN_NAMESPACE
+
+// Vectorized helpers for the audio filters. Each kernel processes as many
+// samples as possible with SSE2 or NEON, and the remainder with scalar code.
+namespace QTextToSpeechAudioKernels {
+
+inline void int16ToFloat(const qint16 *in, float *out, qsizetype count)
+{
+    constexpr float scale = 1.0f / 32768.0f;
+    qsizetype i = 0;
+#if defined(__SSE2__)
+    const __m128 vscale = _mm_set1_ps(scale);
+    for (; i + 8 <= count; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        // interleave with itself and shift back to sign-extend to 32 bit
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale));
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t vscale = vdupq_n_f32(scale);
+    for (; i + 8 <= count; i += 8) {
+        const int16x8_t v = vld1q_s16(in + i);
+        vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), vscale));
+        vst1q_f32(out + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), vscale));
+    }
+#endif
+    for (; i < count; ++i)
+        out[i] = in[i] * scale;
+}
+
+// Rounds to the nearest integer, and ties to even, on all paths
+inline void floatToInt16(const float *in, qint16 *out, qsizetype count)
+{
+    constexpr float scale = 32768.0f;
+    qsizetype i = 0;
+#if defined(__SSE2__)
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 vmin = _mm_set1_ps(-1.0f);
+    const __m128 vmax = _mm_set1_ps(1.0f);
+    for (; i + 8 <= count; i += 8) {
+        // clamp before converting, out-of-range conversions yield INT_MIN
+        const __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), vmin), vmax);
+        const __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + 4), vmin), vmax);
+        const __m128i lo = _mm_cvtps_epi32(_mm_mul_ps(a, vscale));
+        const __m128i hi = _mm_cvtps_epi32(_mm_mul_ps(b, vscale));
+        // packs saturates 32768 to 32767
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packs_epi32(lo, hi));
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t vscale = vdupq_n_f32(scale);
+    const auto round = [&](float32x4_t v) {
+        v = vmulq_f32(v, vscale);
+#if defined(Q_PROCESSOR_ARM_64)
+        return vcvtnq_s32_f32(v);
+#else
+        // vcvtq truncates; adding 1.5 * 2^23 rounds in the float domain,
+        // which is exact for the clamped range
+        const float32x4_t magic = vdupq_n_f32(12582912.0f);
+        v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(-32768.0f)), vdupq_n_f32(32768.0f));
+        return vcvtq_s32_f32(vsubq_f32(vaddq_f32(v, magic), magic));
+#endif
+    };
+    for (; i + 8 <= count; i += 8) {
+        // both the conversion and the narrowing saturate
+        const int32x4_t lo = round(vld1q_f32(in + i));
+        const int32x4_t hi = round(vld1q_f32(in + i + 4));
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+    }
+#endif
+    // lrint rounds ties to even like the vector conversions, with the
+    // default rounding mode
+    for (; i < count; ++i)
+        out[i] = qint16(std::min(std::lrint(std::clamp(in[i], -1.0f, 1.0f) * scale), 32767L));
+}
+
+inline void scale(float *samples, qsizetype count, float gain)
+{
+    qsizetype i = 0;
+#if defined(__SSE2__)
+    const __m128 vgain = _mm_set1_ps(gain);
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), vgain));
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= count; i += 4)
+        vst1q_f32(samples + i, vmulq_n_f32(vld1q_f32(samples + i), gain));
+#endif
+    for (; i < count; ++i)
+        samples[i] *= gain;
+}
+
+inline float sumOfSquares(const float *samples, qsizetype count)
+{
+    float sum = 0;
+    qsizetype i = 0;
+#if defined(__SSE2__)
+    __m128 vsum = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        const __m128 v = _mm_loadu_ps(samples + i);
+        vsum = _mm_add_ps(vsum, _mm_mul_ps(v, v));
+    }
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, vsum);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(__ARM_NEON)
+    float32x4_t vsum = vdupq_n_f32(0);
+    for (; i + 4 <= count; i += 4) {
+        const float32x4_t v = vld1q_f32(samples + i);
+        vsum = vmlaq_f32(vsum, v, v);
+    }
+    float lanes[4];
+    vst1q_f32(lanes, vsum);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for (; i < count; ++i)
+        sum += samples[i] * samples[i];
+    return sum;
+}
+
+inline float dotProduct(const float *a, const float *b, qsizetype count)
+{
+    float sum = 0;
+    qsizetype i = 0;
+#if defined(__SSE2__)
+    __m128 vsum = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4)
+        vsum = _mm_add_ps(vsum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, vsum);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(__ARM_NEON)
+    float32x4_t vsum = vdupq_n_f32(0);
+    for (; i + 4 <= count; i += 4)
+        vsum = vmlaq_f32(vsum, vld1q_f32(a + i), vld1q_f32(b + i));
+    float lanes[4];
+    vst1q_f32(lanes, vsum);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    for (; i < count; ++i)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+// adds left and right, scaled by their gains, to interleaved stereo output
+inline void mixStereo(float *out, const float *left, const float *right, qsizetype frameCount,
+                      float leftGain, float rightGain)
+{
+    qsizetype i = 0;
+#if defined(__SSE2__)
+    const __m128 vleft = _mm_set1_ps(leftGain);
+    const __m128 vright = _mm_set1_ps(rightGain);
+    for (; i + 4 <= frameCount; i += 4) {
+        const __m128 l = _mm_mul_ps(_mm_loadu_ps(left + i), vleft);
+        const __m128 r = _mm_mul_ps(_mm_loadu_ps(right + i), vright);
+        float *frame = out + 2 * i;
+        _mm_storeu_ps(frame, _mm_add_ps(_mm_loadu_ps(frame), _mm_unpacklo_ps(l, r)));
+        _mm_storeu_ps(frame + 4, _mm_add_ps(_mm_loadu_ps(frame + 4), _mm_unpackhi_ps(l, r)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 4 <= frameCount; i += 4) {
+        float32x4x2_t frames = vld2q_f32(out + 2 * i);
+        frames.val[0] = vmlaq_n_f32(frames.val[0], vld1q_f32(left + i), leftGain);
+        frames.val[1] = vmlaq_n_f32(frames.val[1], vld1q_f32(right + i), rightGain);
+        vst2q_f32(out + 2 * i, frames);
+    }
+#endif
+    for (; i < frameCount; ++i) {
+        out[2 * i] += left[i] * leftGain;
+        out[2 * i + 1] += right[i] * rightGain;
+    }
+}
+
+inline float peak(const float *samples, qsizetype count)
+{
+    float result = 0;
+    qsizetype i = 0;
+#if defined(__SSE2__)
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 vpeak = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4)
+        vpeak = _mm_max_ps(vpeak, _mm_and_ps(_mm_loadu_ps(samples + i), absMask));
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, vpeak);
+    result = std::max({lanes[0], lanes[1], lanes[2], lanes[3]});
+#elif defined(__ARM_NEON)
+    float32x4_t vpeak = vdupq_n_f32(0);
+    for (; i + 4 <= count; i += 4)
+        vpeak = vmaxq_f32(vpeak, vabsq_f32(vld1q_f32(samples + i)));
+    float lanes[4];
+    vst1q_f32(lanes, vpeak);
+    result = std::max({lanes[0], lanes[1], lanes[2], lanes[3]});
+#endif
+    for (; i < count; ++i)
+        result = std::max(result, std::abs(samples[i]));
+    return result;
+}
+
+inline float dbToLinear(float db)
+{
+    return std::pow(10.0f, db / 20.0f);
+}
+
+} // namespace QTextToSpeechAudioKernels
+
+QT_END_NAMESPACE
+
+#endif
@@ -0,0 +1,603 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include "qtexttospeechaudiomixer.h"
+#include "qtexttospeechaudiomixer_p.h"
+#include "qtexttospeechaudiokernels_p.h"
+#include "qtexttospeech_p.h"
+#include "qtexttospeechengine.h"
+
+#include <QtMultimedia/qaudiosink.h>
+#include <QtMultimedia/qmediadevices.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QTextToSpeechAudioKernels;
+
+namespace {
+// what engines can write ahead, and the latency of the mixed output
+constexpr qint64 SourceBufferUSecs = 250000;
+constexpr qint64 OutputBufferUSecs = 50000;
+
+QAudioFormat mixerFormat(const QAudioDevice &device)
+{
+    QAudioFormat format = device.preferredFormat();
+    if (format.sampleRate() <= 0)
+        format.setSampleRate(48000);
+    format.setChannelConfig(QAudioFormat::ChannelConfigStereo);
+    format.setSampleFormat(QAudioFormat::Float);
+    if (device.isNull() || device.isFormatSupported(format))
+        return format;
+    format.setSampleFormat(QAudioFormat::Int16);
+    if (device.isFormatSupported(format))
+        return format;
+    // mono devices get the average of both channels
+    format.setChannelConfig(QAudioFormat::ChannelConfigMono);
+    return format;
+}
+} // namespace
+
+class QTextToSpeechAudioMixerSourceDevice : public QIODevice
+{
+public:
+    explicit QTextToSpeechAudioMixerSourceDevice(QTextToSpeechAudioMixerSource *source)
+        : m_source(source)
+    {}
+
+    bool isSequential() const override { return true; }
+    void close() override
+    {
+        QIODevice::close();
+        m_source->close();
+    }
+
+protected:
+    qint64 readData(char *, qint64) override { return -1; }
+    qint64 writeData(const char *data, qint64 size) override { return m_source->write(data, size); }
+
+private:
+    QTextToSpeechAudioMixerSource *const m_source;
+};
+
+QTextToSpeechAudioMixerSource::QTextToSpeechAudioMixerSource()
+    : m_device(std::make_unique<QTextToSpeechAudioMixerSourceDevice>(this))
+{
+}
+
+QTextToSpeechAudioMixerSource::~QTextToSpeechAudioMixerSource() = default;
+
+/*
+    Starts a new stream in \a format, dropping what is left of the previous
+    one, and returns the device to write it to, or \nullptr if the format
+    isn't supported.
+*/
+QIODevice *QTextToSpeechAudioMixerSource::start(const QAudioFormat &format)
+{
+    if (!format.isValid() || (format.sampleFormat() != QAudioFormat::Int16
+                              && format.sampleFormat() != QAudioFormat::Float)) {
+        return nullptr;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    const qsizetype capacity = qNextPowerOfTwo(quint64(format.bytesForDuration(SourceBufferUSecs)) - 1);
+    if (capacity != m_capacity) {
+        m_ring = std::make_unique<char[]>(capacity);
+        m_capacity = capacity;
+    }
+    m_format = format;
+    m_writePosition.store(0, std::memory_order_relaxed);
+    m_readPosition.store(0, std::memory_order_relaxed);
+    m_processedFrames.store(0, std::memory_order_relaxed);
+    m_phase = 0;
+    m_state.store(QAudio::IdleState, std::memory_order_release);
+
+    m_device->close();
+    m_device->open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+    return m_device.get();
+}
+
+void QTextToSpeechAudioMixerSource::stop()
+{
+    QMutexLocker locker(&m_mutex);
+    m_state.store(QAudio::StoppedState, std::memory_order_release);
+    m_device->close();
+    m_readPosition.store(m_writePosition.load(std::memory_order_relaxed), std::memory_order_release);
+}
+
+void QTextToSpeechAudioMixerSource::suspend()
+{
+    if (!changeState(QAudio::ActiveState, QAudio::SuspendedState))
+        changeState(QAudio::IdleState, QAudio::SuspendedState);
+}
+
+void QTextToSpeechAudioMixerSource::resume()
+{
+    const bool buffered = bytesFree() < m_capacity;
+    changeState(QAudio::SuspendedState, buffered ? QAudio::ActiveState : QAudio::IdleState);
+}
+
+qsizetype QTextToSpeechAudioMixerSource::bytesFree() const
+{
+    const quint64 used = m_writePosition.load(std::memory_order_relaxed)
+                       - m_readPosition.load(std::memory_order_acquire);
+    return m_capacity - qsizetype(used);
+}
+
+qint64 QTextToSpeechAudioMixerSource::processedUSecs() const
+{
+    const int sampleRate = m_format.sampleRate();
+    return sampleRate > 0
+         ? m_processedFrames.load(std::memory_order_relaxed) * 1000000 / sampleRate : 0;
+}
+
+void QTextToSpeechAudioMixerSource::setAttached(bool attached)
+{
+    m_attached.store(attached, std::memory_order_release);
+    if (attached)
+        return;
+
+    // what the mixer didn't play yet never will be
+    QMutexLocker locker(&m_mutex);
+    const quint64 write = m_writePosition.load(std::memory_order_acquire);
+    const quint64 read = m_readPosition.exchange(write, std::memory_order_acq_rel);
+    if (const int bytesPerFrame = m_format.bytesPerFrame(); bytesPerFrame > 0)
+        m_processedFrames.fetch_add(qint64(write - read) / bytesPerFrame, std::memory_order_relaxed);
+    changeState(QAudio::ActiveState, QAudio::IdleState);
+}
+
+qint64 QTextToSpeechAudioMixerSource::write(const char *data, qint64 size)
+{
+    const int bytesPerFrame = m_format.bytesPerFrame();
+    if (bytesPerFrame <= 0)
+        return -1;
+    if (!m_attached.load(std::memory_order_acquire)) {
+        // played at once, until the writer closes the device
+        m_processedFrames.fetch_add(size / bytesPerFrame, std::memory_order_relaxed);
+        changeState(QAudio::IdleState, QAudio::ActiveState);
+        return size;
+    }
+
+    const quint64 write = m_writePosition.load(std::memory_order_relaxed);
+    const quint64 read = m_readPosition.load(std::memory_order_acquire);
+    qint64 count = qMin(size, qint64(m_capacity) - qint64(write - read));
+    count -= count % bytesPerFrame;
+    if (count <= 0)
+        return 0;
+
+    const qsizetype offset = qsizetype(write & quint64(m_capacity - 1));
+    const qsizetype first = qMin(qsizetype(count), m_capacity - offset);
+    std::memcpy(m_ring.get() + offset, data, first);
+    std::memcpy(m_ring.get(), data + first, count - first);
+    m_writePosition.store(write + count, std::memory_order_release);
+
+    changeState(QAudio::IdleState, QAudio::ActiveState);
+    return count;
+}
+
+// The end of the stream; without a mixer, everything written has been played.
+void QTextToSpeechAudioMixerSource::close()
+{
+    if (!m_attached.load(std::memory_order_acquire))
+        changeState(QAudio::ActiveState, QAudio::IdleState);
+}
+
+bool QTextToSpeechAudioMixerSource::changeState(QAudio::State from, QAudio::State to)
+{
+    if (!m_state.compare_exchange_strong(from, to, std::memory_order_acq_rel))
+        return false;
+    emit stateChanged(to);
+    return true;
+}
+
+float QTextToSpeechAudioMixerSource::sample(quint64 position) const
+{
+    // samples never wrap around, as the capacity is a power of two
+    const char *data = m_ring.get() + (position & quint64(m_capacity - 1));
+    if (m_format.sampleFormat() == QAudioFormat::Int16) {
+        qint16 value;
+        std::memcpy(&value, data, sizeof(value));
+        return value / 32768.0f;
+    }
+    float value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+/*
+    Resamples the stream by linear interpolation into the left and right
+    channels, and mixes them into \a output with the gain and pan of the
+    source. If not enough audio has been written, then the source becomes
+    idle, like a QAudioSink that runs dry.
+*/
+void QTextToSpeechAudioMixerSource::mixInto(float *output, qsizetype frameCount, int sampleRate)
+{
+    QMutexLocker locker(&m_mutex);
+    if (state() != QAudio::ActiveState)
+        return;
+
+    const int channelCount = m_format.channelCount();
+    const int bytesPerFrame = m_format.bytesPerFrame();
+    const int bytesPerSample = m_format.bytesPerSample();
+    const quint64 read = m_readPosition.load(std::memory_order_relaxed);
+    const qint64 available = qint64(m_writePosition.load(std::memory_order_acquire) - read)
+                           / bytesPerFrame;
+    const double step = double(m_format.sampleRate()) / sampleRate;
+    if (m_left.size() < frameCount) {
+        m_left.resize(frameCount);
+        m_right.resize(frameCount);
+    }
+
+    qsizetype frames = 0;
+    for (; frames < frameCount; ++frames) {
+        const qint64 index = qint64(m_phase);
+        const float fraction = float(m_phase - double(index));
+        if (index >= available || (fraction > 0 && index + 1 >= available))
+            break;
+        const quint64 position = read + quint64(index) * bytesPerFrame;
+        float left = sample(position);
+        float right = channelCount > 1 ? sample(position + bytesPerSample) : left;
+        if (fraction > 0) {
+            const quint64 next = position + bytesPerFrame;
+            const float nextLeft = sample(next);
+            const float nextRight = channelCount > 1 ? sample(next + bytesPerSample) : nextLeft;
+            left += (nextLeft - left) * fraction;
+            right += (nextRight - right) * fraction;
+        }
+        m_left[frames] = left;
+        m_right[frames] = right;
+        m_phase += step;
+    }
+
+    const qint64 consumed = qMin(qint64(m_phase), available);
+    m_phase -= double(consumed);
+    m_readPosition.store(read + quint64(consumed) * bytesPerFrame, std::memory_order_release);
+    m_processedFrames.fetch_add(consumed, std::memory_order_relaxed);
+
+    const float gain = m_volume.load(std::memory_order_relaxed) * m_gain.load(std::memory_order_relaxed);
+    const float pan = m_pan.load(std::memory_order_relaxed);
+    mixStereo(output, m_left.constData(), m_right.constData(), frames,
+              gain * qMin(1.0f, 1.0f - pan), gain * qMin(1.0f, 1.0f + pan));
+
+    if (frames < frameCount)
+        changeState(QAudio::ActiveState, QAudio::IdleState);
+}
+
+QTextToSpeechAudioMixerOutput::QTextToSpeechAudioMixerOutput(const QAudioFormat &format)
+    : m_format(format)
+{
+}
+
+void QTextToSpeechAudioMixerOutput::addSource(const std::shared_ptr<QTextToSpeechAudioMixerSource> &source)
+{
+    QMutexLocker locker(&m_mutex);
+    m_sources.append(source);
+}
+
+void QTextToSpeechAudioMixerOutput::removeSource(QTextToSpeechAudioMixerSource *source)
+{
+    QMutexLocker locker(&m_mutex);
+    m_sources.removeIf([source](const auto &entry) { return entry.get() == source; });
+}
+
+qint64 QTextToSpeechAudioMixerOutput::bytesAvailable() const
+{
+    // there is always something to play, if only silence
+    return m_format.bytesForDuration(OutputBufferUSecs) + QIODevice::bytesAvailable();
+}
+
+qint64 QTextToSpeechAudioMixerOutput::readData(char *data, qint64 maxSize)
+{
+    const int channelCount = m_format.channelCount();
+    const qsizetype frameCount = qsizetype(maxSize / m_format.bytesPerFrame());
+    if (frameCount <= 0)
+        return 0;
+
+    m_mix.assign(frameCount * 2, 0.0f);
+    {
+        QMutexLocker locker(&m_mutex);
+        for (const auto &source : std::as_const(m_sources))
+            source->mixInto(m_mix.data(), frameCount, m_format.sampleRate());
+    }
+
+    const float *mixed = m_mix.constData();
+    if (channelCount == 1) {
+        m_frames.resize(frameCount);
+        for (qsizetype i = 0; i < frameCount; ++i)
+            m_frames[i] = 0.5f * (mixed[2 * i] + mixed[2 * i + 1]);
+        mixed = m_frames.constData();
+    }
+
+    const qsizetype sampleCount = frameCount * channelCount;
+    if (m_format.sampleFormat() == QAudioFormat::Int16) {
+        floatToInt16(mixed, reinterpret_cast<qint16 *>(data), sampleCount);
+    } else {
+        std::transform(mixed, mixed + sampleCount, reinterpret_cast<float *>(data),
+                       [](float sample) { return std::clamp(sample, -1.0f, 1.0f); });
+    }
+    return frameCount * m_format.bytesPerFrame();
+}
+
+qint64 QTextToSpeechAudioMixerOutput::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+QTextToSpeechAudioMixerClient::~QTextToSpeechAudioMixerClient() = default;
+
+QTextToSpeechAudioMixerPrivate::QTextToSpeechAudioMixerPrivate(const QAudioDevice &device)
+    : m_device(device), m_format(mixerFormat(device)),
+      m_output(std::make_unique<QTextToSpeechAudioMixerOutput>(m_format))
+{
+}
+
+// Engines that don't play audio themselves don't implement the interface.
+void QTextToSpeechAudioMixerPrivate::setEngineSource(QTextToSpeechEngine *engine,
+                                                     QTextToSpeechAudioMixerSource *source)
+{
+    if (auto *client = qobject_cast<QTextToSpeechAudioMixerClient *>(engine))
+        client->setAudioMixerSource(source);
+}
+
+// Returns whether the mixed audio is played.
+bool QTextToSpeechAudioMixerPrivate::startOutput()
+{
+    Q_Q(QTextToSpeechAudioMixer);
+    if (m_sink && m_sink->state() != QAudio::StoppedState)
+        return true;
+    if (m_device.isNull())
+        return false;
+
+    if (!m_sink) {
+        m_sink = new QAudioSink(m_device, m_format, q);
+        m_sink->setBufferSize(m_format.bytesForDuration(OutputBufferUSecs));
+    }
+    m_output->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    m_sink->start(m_output.get());
+    return m_sink->error() == QAudio::NoError;
+}
+
+void QTextToSpeechAudioMixerPrivate::stopOutput()
+{
+    if (m_sink)
+        m_sink->stop();
+    m_output->close();
+}
+
+/*!
+    \class QTextToSpeechAudioMixer
+    \inmodule QtTextToSpeech
+    \since 6.7
+    \brief The QTextToSpeechAudioMixer class plays the speech of several
+    QTextToSpeech instances through one audio output.
+
+    Without a mixer, each QTextToSpeech instance whose engine plays the audio
+    itself opens its own audio stream on the device. To let several voices
+    speak at the same time, for instance the characters of a game, add them
+    to a mixer. The mixer sums their audio into a single stream, in the
+    format() that the device prefers, and places each voice in the stereo
+    field with its own gain() and pan().
+
+    \code
+    QTextToSpeechAudioMixer mixer;
+    QTextToSpeech hero(u"flite"_s);
+    QTextToSpeech villain(u"flite"_s);
+    mixer.addSource(&hero, 1.0, -0.5);
+    mixer.addSource(&villain, 0.8, 0.5);
+    hero.say(u"Stop right there!"_s);
+    villain.say(u"Never!"_s);
+    \endcode
+
+    Each source has a ring buffer for a quarter of a second of audio, into
+    which the engine writes from its own thread. The mixer reads from these
+    buffers when the audio output needs more data, so that an engine never
+    waits for the output, and the output never waits for an engine. Audio
+    with a different sample rate than the output is resampled.
+
+    Only engines that play the audio in-process support the mixer; currently
+    this is the "flite" engine. Other engines keep playing through their own
+    output. Adding or removing a QTextToSpeech instance while it is speaking
+    stops the current text.
+
+    \sa QTextToSpeech::volume
+*/
+
+/*!
+    Constructs a mixer for the default audio output device, with the given
+    \a parent.
+*/
+QTextToSpeechAudioMixer::QTextToSpeechAudioMixer(QObject *parent)
+    : QTextToSpeechAudioMixer(QMediaDevices::defaultAudioOutput(), parent)
+{
+}
+
+/*!
+    Constructs a mixer for the audio output \a device, with the given
+    \a parent.
+
+    If \a device is null, then the audio of the sources is dropped.
+*/
+QTextToSpeechAudioMixer::QTextToSpeechAudioMixer(const QAudioDevice &device, QObject *parent)
+    : QObject(*new QTextToSpeechAudioMixerPrivate(device), parent)
+{
+}
+
+/*!
+    Destroys the mixer. The sources play through their own audio output
+    again.
+*/
+QTextToSpeechAudioMixer::~QTextToSpeechAudioMixer()
+{
+    Q_D(QTextToSpeechAudioMixer);
+    for (QTextToSpeech *speech : QList<QTextToSpeech *>(d->m_sources))
+        removeSource(speech);
+    delete std::exchange(d->m_sink, nullptr);
+}
+
+/*!
+    Returns the audio output device of the mixer.
+*/
+QAudioDevice QTextToSpeechAudioMixer::device() const
+{
+    Q_D(const QTextToSpeechAudioMixer);
+    return d->m_device;
+}
+
+/*!
+    Returns the format of the mixed audio. This is the preferred format of the
+    device(), in stereo, with floating point samples if the device supports
+    them.
+*/
+QAudioFormat QTextToSpeechAudioMixer::format() const
+{
+    Q_D(const QTextToSpeechAudioMixer);
+    return d->m_format;
+}
+
+/*!
+    Adds \a speech as a source of the mixer, with the given \a gain and \a pan.
+    If \a speech already is a source of another mixer, then it is moved to this
+    one.
+
+    The source stays in the mixer when the engine of \a speech changes, and is
+    removed when \a speech is destroyed.
+
+    \sa removeSource(), setGain(), setPan()
+*/
+void QTextToSpeechAudioMixer::addSource(QTextToSpeech *speech, double gain, double pan)
+{
+    Q_D(QTextToSpeechAudioMixer);
+    if (!speech)
+        return;
+    if (d->m_sources.contains(speech)) {
+        setGain(speech, gain);
+        setPan(speech, pan);
+        return;
+    }
+
+    QTextToSpeechPrivate *speechPrivate = QTextToSpeechPrivate::get(speech);
+    if (speechPrivate->m_audioMixer)
+        speechPrivate->m_audioMixer->removeSource(speech);
+    if (!speechPrivate->m_mixerSource)
+        speechPrivate->m_mixerSource = std::make_shared<QTextToSpeechAudioMixerSource>();
+    QTextToSpeechAudioMixerSource *source = speechPrivate->m_mixerSource.get();
+    source->setGain(gain);
+    source->setPan(pan);
+
+    d->m_output->addSource(speechPrivate->m_mixerSource);
+    d->m_sources.append(speech);
+    source->setAttached(d->startOutput());
+    speechPrivate->m_audioMixer = this;
+    if (speechPrivate->m_engine)
+        QTextToSpeechAudioMixerPrivate::setEngineSource(speechPrivate->m_engine.get(), source);
+
+    // the engine goes away together with the text-to-speech
+    connect(speech, &QObject::destroyed, this, [d, speech, source]{
+        source->setAttached(false);
+        d->m_output->removeSource(source);
+        d->m_sources.removeOne(speech);
+        if (d->m_sources.isEmpty())
+            d->stopOutput();
+    });
+}
+
+/*!
+    Removes \a speech from the mixer. It plays through its own audio output
+    again.
+
+    \sa addSource()
+*/
+void QTextToSpeechAudioMixer::removeSource(QTextToSpeech *speech)
+{
+    Q_D(QTextToSpeechAudioMixer);
+    const qsizetype index = d->m_sources.indexOf(speech);
+    if (index < 0)
+        return;
+
+    disconnect(speech, nullptr, this, nullptr);
+    QTextToSpeechPrivate *speechPrivate = QTextToSpeechPrivate::get(speech);
+    if (speechPrivate->m_engine)
+        QTextToSpeechAudioMixerPrivate::setEngineSource(speechPrivate->m_engine.get(), nullptr);
+    speechPrivate->m_mixerSource->setAttached(false);
+    d->m_output->removeSource(speechPrivate->m_mixerSource.get());
+    speechPrivate->m_audioMixer = nullptr;
+    d->m_sources.removeAt(index);
+    if (d->m_sources.isEmpty())
+        d->stopOutput();
+}
+
+/*!
+    Returns the QTextToSpeech instances that play through this mixer.
+*/
+QList<QTextToSpeech *> QTextToSpeechAudioMixer::sources() const
+{
+    Q_D(const QTextToSpeechAudioMixer);
+    return d->m_sources;
+}
+
+/*!
+    Returns the gain of \a speech, or 0 if \a speech is not a source of the
+    mixer.
+
+    \sa setGain()
+*/
+double QTextToSpeechAudioMixer::gain(const QTextToSpeech *speech) const
+{
+    Q_D(const QTextToSpeechAudioMixer);
+    if (!d->m_sources.contains(speech))
+        return 0;
+    return QTextToSpeechPrivate::get(speech)->m_mixerSource->gain();
+}
+
+/*!
+    Sets the \a gain with which the audio of \a speech is mixed. The gain is
+    applied in addition to the QTextToSpeech::volume. A gain of 1 leaves the
+    audio unchanged; negative values are treated as 0.
+
+    The sum of all sources is clipped, so reduce the gain of the sources if
+    many of them speak at the same time.
+
+    \sa gain()
+*/
+void QTextToSpeechAudioMixer::setGain(QTextToSpeech *speech, double gain)
+{
+    Q_D(QTextToSpeechAudioMixer);
+    if (d->m_sources.contains(speech))
+        QTextToSpeechPrivate::get(speech)->m_mixerSource->setGain(gain);
+}
+
+/*!
+    Returns the pan of \a speech, or 0 if \a speech is not a source of the
+    mixer.
+
+    \sa setPan()
+*/
+double QTextToSpeechAudioMixer::pan(const QTextToSpeech *speech) const
+{
+    Q_D(const QTextToSpeechAudioMixer);
+    if (!d->m_sources.contains(speech))
+        return 0;
+    return QTextToSpeechPrivate::get(speech)->m_mixerSource->pan();
+}
+
+/*!
+    Sets the position of \a speech in the stereo field to \a pan, from -1 for
+    only the left channel to 1 for only the right channel. At 0, both channels
+    play the audio unchanged; moving the source to one side attenuates the
+    other channel. Values outside that range are bound to it.
+
+    \sa pan()
+*/
+void QTextToSpeechAudioMixer::setPan(QTextToSpeech *speech, double pan)
+{
+    Q_D(QTextToSpeechAudioMixer);
+    if (d->m_sources.contains(speech))
+        QTextToSpeechPrivate::get(speech)->m_mixerSource->setPan(pan);
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,47 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHAUDIOMIXER_H
+#define QTEXTTOSPEECHAUDIOMIXER_H
+
+#include <QtTextToSpeech/qtexttospeech_global.h>
+
+#include <QtCore/qlist.h>
+#include <QtCore/qobject.h>
+#include <QtMultimedia/qaudiodevice.h>
+#include <QtMultimedia/qaudioformat.h>
+
+QT_BEGIN_NAMESPACE
+
+class QTextToSpeech;
+class QTextToSpeechAudioMixerPrivate;
+
+class Q_TEXTTOSPEECH_EXPORT QTextToSpeechAudioMixer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit QTextToSpeechAudioMixer(QObject *parent = nullptr);
+    explicit QTextToSpeechAudioMixer(const QAudioDevice &device, QObject *parent = nullptr);
+    ~QTextToSpeechAudioMixer() override;
+
+    QAudioDevice device() const;
+    QAudioFormat format() const;
+
+    void addSource(QTextToSpeech *speech, double gain = 1.0, double pan = 0.0);
+    void removeSource(QTextToSpeech *speech);
+    QList<QTextToSpeech *> sources() const;
+
+    double gain(const QTextToSpeech *speech) const;
+    void setGain(QTextToSpeech *speech, double gain);
+    double pan(const QTextToSpeech *speech) const;
+    void setPan(QTextToSpeech *speech, double pan);
+
+private:
+    Q_DISABLE_COPY(QTextToSpeechAudioMixer)
+    Q_DECLARE_PRIVATE(QTextToSpeechAudioMixer)
+};
+
+QT_END_NAMESPACE
+
+#endif
@@ -0,0 +1,173 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHAUDIOMIXER_P_H
+#define QTEXTTOSPEECHAUDIOMIXER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists for the convenience
+// of other Qt classes.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include "qtexttospeechaudiomixer.h"
+
+#include <QtCore/qiodevice.h>
+#include <QtCore/qlist.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qobject.h>
+#include <QtCore/private/qobject_p.h>
+#include <QtMultimedia/qaudio.h>
+#include <QtMultimedia/qaudioformat.h>
+
+#include <atomic>
+#include <memory>
+
+QT_BEGIN_NAMESPACE
+
+class QAudioSink;
+class QTextToSpeechAudioMixerSourceDevice;
+class QTextToSpeechEngine;
+
+// One input of a QTextToSpeechAudioMixer, owned by QTextToSpeechPrivate. It
+// replaces the QAudioSink of an engine that plays audio itself, and has the
+// subset of the QAudioSink API that such engines use in push mode. The engine
+// writes into a ring buffer from its own thread, and the mixer reads from it
+// in the audio callback, so neither ever waits for the other. stateChanged()
+// is emitted from both threads. Without a mixer, the written audio counts as
+// played at once: the source becomes active when it is written, and idle
+// again when the device is closed.
+class Q_TEXTTOSPEECH_EXPORT QTextToSpeechAudioMixerSource : public QObject
+{
+    Q_OBJECT
+
+public:
+    QTextToSpeechAudioMixerSource();
+    ~QTextToSpeechAudioMixerSource() override;
+
+    // for the engine; the format needs to be Int16 or Float
+    QIODevice *start(const QAudioFormat &format);
+    void stop();
+    void suspend();
+    void resume();
+    QAudio::State state() const { return m_state.load(std::memory_order_acquire); }
+    QAudioFormat format() const { return m_format; }
+    qsizetype bufferSize() const { return m_capacity; }
+    qsizetype bytesFree() const;
+    qint64 processedUSecs() const;
+    void setVolume(double volume) { m_volume.store(float(volume), std::memory_order_relaxed); }
+
+    // thread-safe, set through QTextToSpeechAudioMixer
+    double gain() const { return m_gain.load(std::memory_order_relaxed); }
+    void setGain(double gain) { m_gain.store(float(qMax(gain, 0.0)), std::memory_order_relaxed); }
+    double pan() const { return m_pan.load(std::memory_order_relaxed); }
+    void setPan(double pan) { m_pan.store(float(qBound(-1.0, pan, 1.0)), std::memory_order_relaxed); }
+    // without a mixer, written audio is dropped as if it had been played
+    void setAttached(bool attached);
+
+    // for the audio callback; adds the next frames of the stream, resampled
+    // to sampleRate, to the interleaved stereo output
+    void mixInto(float *output, qsizetype frameCount, int sampleRate);
+
+Q_SIGNALS:
+    void stateChanged(QAudio::State state);
+
+private:
+    Q_DISABLE_COPY(QTextToSpeechAudioMixerSource)
+    friend class QTextToSpeechAudioMixerSourceDevice;
+
+    qint64 write(const char *data, qint64 size);
+    void close();
+    bool changeState(QAudio::State from, QAudio::State to);
+    float sample(quint64 position) const;
+
+    // held by the audio callback, and when the stream is replaced
+    QMutex m_mutex;
+    std::unique_ptr<QTextToSpeechAudioMixerSourceDevice> m_device;
+    QAudioFormat m_format;
+    std::unique_ptr<char[]> m_ring;
+    qsizetype m_capacity = 0; // a power of two
+    // bytes since start(), so they never wrap
+    alignas(64) std::atomic<quint64> m_writePosition = 0;
+    alignas(64) std::atomic<quint64> m_readPosition = 0;
+    std::atomic<qint64> m_processedFrames = 0;
+    std::atomic<QAudio::State> m_state = QAudio::StoppedState;
+    std::atomic<bool> m_attached = false;
+    std::atomic<float> m_volume = 1;
+    std::atomic<float> m_gain = 1;
+    std::atomic<float> m_pan = 0;
+
+    // only used by the audio callback
+    double m_phase = 0; // between the frame at the read position and the next one
+    QList<float> m_left;
+    QList<float> m_right;
+};
+
+// The device from which the mixer's QAudioSink pulls the sum of all sources,
+// as interleaved frames in the mixer's format.
+class QTextToSpeechAudioMixerOutput : public QIODevice
+{
+public:
+    explicit QTextToSpeechAudioMixerOutput(const QAudioFormat &format);
+
+    void addSource(const std::shared_ptr<QTextToSpeechAudioMixerSource> &source);
+    void removeSource(QTextToSpeechAudioMixerSource *source);
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    const QAudioFormat m_format;
+    QMutex m_mutex;
+    QList<std::shared_ptr<QTextToSpeechAudioMixerSource>> m_sources;
+    QList<float> m_mix; // stereo
+    QList<float> m_frames; // in the channels of the format
+};
+
+// Implemented by the engines that can play through a mixer. This is not part
+// of the QTextToSpeechEngine plugin API, as the source is private; the mixer
+// finds the interface with qobject_cast.
+class Q_TEXTTOSPEECH_EXPORT QTextToSpeechAudioMixerClient
+{
+public:
+    virtual ~QTextToSpeechAudioMixerClient();
+
+    // Called when the text-to-speech is added to a mixer, with the source to
+    // write to instead of a QAudioSink, and with nullptr when it is removed.
+    // The source outlives the engine. Changing it may stop the current text.
+    virtual void setAudioMixerSource(QTextToSpeechAudioMixerSource *source) = 0;
+};
+
+Q_DECLARE_INTERFACE(QTextToSpeechAudioMixerClient,
+                    "org.qt-project.qt.speech.tts.audiomixerclient/6.7")
+
+class QTextToSpeechAudioMixerPrivate : public QObjectPrivate
+{
+    Q_DECLARE_PUBLIC(QTextToSpeechAudioMixer)
+public:
+    explicit QTextToSpeechAudioMixerPrivate(const QAudioDevice &device);
+
+    static void setEngineSource(QTextToSpeechEngine *engine, QTextToSpeechAudioMixerSource *source);
+
+    bool startOutput();
+    void stopOutput();
+
+    const QAudioDevice m_device;
+    const QAudioFormat m_format;
+    std::unique_ptr<QTextToSpeechAudioMixerOutput> m_output;
+    QAudioSink *m_sink = nullptr;
+    QList<QTextToSpeech *> m_sources;
+};
+
+QT_END_NAMESPACE
+
+#endif
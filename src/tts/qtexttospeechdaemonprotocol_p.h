@@ -0,0 +1,106 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHDAEMONPROTOCOL_P_H
+#define QTEXTTOSPEECHDAEMONPROTOCOL_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists for the convenience
+// of other Qt classes.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtTextToSpeech/qtexttospeech_global.h>
+
+#include <QtCore/qbytearray.h>
+#include <QtCore/qdatastream.h>
+#include <QtCore/qiodevice.h>
+#include <QtCore/qstring.h>
+#include <QtMultimedia/qaudioformat.h>
+
+QT_BEGIN_NAMESPACE
+
+// Messages exchanged between the qttexttospeechd daemon and the localdaemon
+// engine plugin over a local socket. Each message is a QByteArray, written
+// with QDataStream, that starts with the MessageType.
+namespace QTextToSpeechDaemonProtocol
+{
+inline constexpr quint32 Version = 1;
+inline constexpr QDataStream::Version StreamVersion = QDataStream::Qt_6_0;
+
+inline QString defaultServerName()
+{
+    return QStringLiteral("qttexttospeechd");
+}
+
+enum class MessageType : quint8 {
+    // client to daemon
+    Hello,          // quint32 version, QString engine, QVariantMap parameters
+    Synthesize,     // quint32 id, QString text, QLocale locale, QVoice voice,
+                    // double rate, double pitch, double volume
+    Cancel,         // quint32 id
+
+    // daemon to client
+    Welcome,        // int errorReason, QString errorString, int capabilities,
+                    // QVoice voice, QList<QVoice> voices
+    Format,         // quint32 id, int sampleRate, int channelCount, int sampleFormat
+    Audio,          // quint32 id, QByteArray pcm
+    Word,           // quint32 id, qint64 audioOffset, qint64 start, qint64 length
+    Finished,       // quint32 id
+    Error,          // quint32 id, int errorReason, QString errorString
+};
+
+template <typename ...Args>
+QByteArray message(MessageType type, const Args &...args)
+{
+    QByteArray payload;
+    {
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out.setVersion(StreamVersion);
+        out << quint8(type);
+        (out << ... << args);
+    }
+    QByteArray framed;
+    QDataStream out(&framed, QIODevice::WriteOnly);
+    out.setVersion(StreamVersion);
+    out << payload;
+    return framed;
+}
+
+// Reads the next complete message from the device of \a in, and returns
+// false if it hasn't been received completely yet.
+inline bool readMessage(QDataStream &in, QByteArray &payload)
+{
+    in.startTransaction();
+    in >> payload;
+    return in.commitTransaction();
+}
+
+inline QByteArray formatMessage(quint32 id, const QAudioFormat &format)
+{
+    return message(MessageType::Format, id, format.sampleRate(), format.channelCount(),
+                   int(format.sampleFormat()));
+}
+
+inline QAudioFormat readFormat(QDataStream &in)
+{
+    int sampleRate = 0;
+    int channelCount = 0;
+    int sampleFormat = 0;
+    in >> sampleRate >> channelCount >> sampleFormat;
+    QAudioFormat format;
+    format.setSampleRate(sampleRate);
+    format.setChannelCount(channelCount);
+    format.setSampleFormat(QAudioFormat::SampleFormat(sampleFormat));
+    return format;
+}
+} // namespace QTextToSpeechDaemonProtocol
+
+QT_END_NAMESPACE
+
+#endif
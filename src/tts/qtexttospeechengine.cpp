@@ -43,6 +43,20 @@ QT_BEGIN_NAMESPACE
     Implementation of \l {QTextToSpeech::say()}{QTextToSpeech::say}(\a text).
 */
 
+/*!
+    \fn void QTextToSpeechEngine::appendUtterance(const QString &text)
+
+    Called in response to readyForNextUtterance() with the next queued \a text.
+    The engine should append the audio of \a text to the audio that is still
+    playing, without changing state, and emit utteranceStarted() once the
+    playback reaches the beginning of \a text. If the audio can't be appended,
+    for instance because the playback ran out of audio before, the engine can
+    change its state to Ready and play \a text from the start; it still emits
+    utteranceStarted() when the playback of \a text begins.
+
+    The default implementation calls say().
+*/
+
 /*!
     \fn void QTextToSpeechEngine::stop(QTextToSpeech::BoundaryHint hint)
 
@@ -61,6 +75,53 @@ QT_BEGIN_NAMESPACE
     Implementation of \l QTextToSpeech::resume().
 */
 
+/*!
+    \fn void QTextToSpeechEngine::setSynthesisThrottled(bool throttled)
+
+    Called with \a throttled set to \c true when the consumer of the data emitted
+    through synthesized() can't keep up, and with \c false once it has caught up.
+
+    Engines that produce data faster than real time should stop synthesizing
+    while throttled, rather than emitting more data that has to be buffered.
+    Engines running the synthesizer in a separate thread can block that thread.
+    The default implementation does nothing.
+*/
+
+/*!
+    \fn void QTextToSpeechEngine::setSayingWordEnabled(bool enabled)
+
+    Called with \a enabled set to \c false when nothing is connected to
+    QTextToSpeech::sayingWord(), and with \c true once something is. This
+    function might be called from any thread.
+
+    Engines that report each word while it is spoken, for instance from a timer,
+    can skip that work while the signal is not used; the words are then only
+    reported through wordTimeline(). The default implementation does nothing.
+*/
+
+/*!
+    \fn void QTextToSpeechEngine::setWordTimelineEnabled(bool enabled)
+
+    Called with \a enabled set to \c false when nothing is connected to
+    QTextToSpeech::wordTimeline(), and with \c true once something is. This
+    function might be called from any thread.
+
+    Engines that need extra work to find the words in synthesized audio can
+    skip it while the signal is not used. The default implementation does
+    nothing.
+*/
+
+/*!
+    \fn void QTextToSpeechEngine::setPhonemeEventsEnabled(bool enabled)
+
+    Called with \a enabled set to \c true when something gets connected to
+    QTextToSpeech::phonemeEvents(), and with \c false once nothing is. This
+    function might be called from any thread. Engines with the
+    \l{QTextToSpeech::Capability::}{PhonemeEvents} capability only emit
+    phonemeEvents() while enabled, which is not the case initially.
+    The default implementation does nothing.
+*/
+
 /*!
     \fn void QTextToSpeechEngine::rate() const
 
@@ -147,6 +208,80 @@ QT_BEGIN_NAMESPACE
     This signal is connected to QTextToSpeech::stateChanged() signal.
 */
 
+/*!
+    \fn void QTextToSpeechEngine::localeChanged(const QLocale &locale)
+
+    Emitted when the engine changes its \a locale on its own, for instance
+    once it has loaded the voices for a locale that was set before. Engines
+    don't need to emit this signal from setLocale().
+
+    This signal is connected to QTextToSpeech::localeChanged() signal.
+*/
+
+/*!
+    \fn void QTextToSpeechEngine::voiceChanged(const QVoice &voice)
+
+    Emitted when the engine changes its \a voice on its own, for instance
+    once it has loaded the voices for a locale that was set before. Engines
+    don't need to emit this signal from setVoice().
+
+    This signal is connected to QTextToSpeech::voiceChanged() signal.
+*/
+
+/*!
+    \fn void QTextToSpeechEngine::voicesChanged()
+
+    Emitted when the available locales or voices have changed, for instance
+    when an engine that loads its voices in the background has loaded more.
+
+    This signal is connected to QTextToSpeech::availableVoicesChanged() signal.
+*/
+
+/*!
+    \fn void QTextToSpeechEngine::readyForNextUtterance()
+
+    Engines that can play consecutive texts without a gap emit this signal
+    once they have synthesized all audio of the current text, while that
+    audio is still playing. If more text is queued, QTextToSpeech responds
+    by calling appendUtterance() with the next text. Otherwise the engine
+    finishes the current text, and changes its state to Ready.
+
+    Engines that queue texts themselves can emit this signal again after
+    appendUtterance() returned, to submit several texts ahead of time.
+*/
+
+/*!
+    \fn void QTextToSpeechEngine::wordTimeline(const QList<QTextToSpeech::WordBoundary> &words)
+
+    Emitted with the boundaries of all \a words in the text that was last
+    passed to say(), appendUtterance(), or synthesize(), once the engine knows
+    when each word will be spoken. The time and frame of each word are relative
+    to the beginning of the audio of that text. For synthesize(), the signal
+    needs to be emitted before the state changes back to Ready.
+*/
+
+/*!
+    \fn void QTextToSpeechEngine::phonemeEvents(const QList<QTextToSpeech::Phoneme> &phonemes)
+
+    Emitted with the \a phonemes of a chunk of the audio of the text that was
+    last passed to say(), appendUtterance(), or synthesize(), once the engine
+    has produced that audio. The frame of each phoneme is relative to the
+    beginning of the audio of that text. Engines should create the name of
+    each phone once, and share it between the events. The viseme of each
+    phoneme is set by QTextToSpeech.
+
+    To avoid an event for each phoneme, engines report all phonemes of a
+    chunk at once.
+*/
+
+/*!
+    \fn void QTextToSpeechEngine::utteranceStarted()
+
+    Emitted when the playback reaches the beginning of a text that was passed
+    to appendUtterance(), whether its audio was appended to the playing stream
+    or not.
+*/
+
 /*!
     Constructs the text-to-speech engine base class with \a parent.
 */
@@ -41,10 +41,15 @@ public:
     virtual QList<QVoice> availableVoices() const = 0;
 
     virtual void say(const QString &text) = 0;
+    virtual void appendUtterance(const QString &text) { say(text); }
     virtual void synthesize(const QString &text) = 0;
     virtual void stop(QTextToSpeech::BoundaryHint boundaryHint) = 0;
     virtual void pause(QTextToSpeech::BoundaryHint boundaryHint) = 0;
     virtual void resume() = 0;
+    virtual void setSynthesisThrottled(bool throttled) { Q_UNUSED(throttled); }
+    virtual void setSayingWordEnabled(bool enabled) { Q_UNUSED(enabled); }
+    virtual void setWordTimelineEnabled(bool enabled) { Q_UNUSED(enabled); }
+    virtual void setPhonemeEventsEnabled(bool enabled) { Q_UNUSED(enabled); }
 
     virtual double rate() const = 0;
     virtual bool setRate(double rate) = 0;
@@ -68,8 +73,15 @@ protected:
 Q_SIGNALS:
     void stateChanged(QTextToSpeech::State state);
     void errorOccurred(QTextToSpeech::ErrorReason error, const QString &errorString);
+    void localeChanged(const QLocale &locale);
+    void voiceChanged(const QVoice &voice);
+    void voicesChanged();
 
     void sayingWord(const QString &word, qsizetype start, qsizetype length);
+    void wordTimeline(const QList<QTextToSpeech::WordBoundary> &words);
+    void phonemeEvents(const QList<QTextToSpeech::Phoneme> &phonemes);
+    void readyForNextUtterance();
+    void utteranceStarted();
     void synthesized(const QAudioFormat &format, const QByteArray &data);
 };
 
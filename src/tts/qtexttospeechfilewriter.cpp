@@ -0,0 +1,577 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include "qtexttospeechfilewriter_p.h"
+
+#include <QtCore/qdebug.h>
+#include <QtCore/qendian.h>
+
+#include <array>
+#include <cstring>
+#include <limits>
+
+QT_BEGIN_NAMESPACE
+
+using namespace Qt::StringLiterals;
+
+namespace {
+
+// FLAC uses CRC-8 with polynomial x^8 + x^2 + x^1 + x^0 for the frame header,
+// and CRC-16 with polynomial x^16 + x^15 + x^2 + x^0 for the entire frame.
+constexpr auto flacCrc8Table = []{
+    std::array<quint8, 256> table = {};
+    for (int i = 0; i < 256; ++i) {
+        quint8 crc = quint8(i);
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc & 0x80) ? quint8((crc << 1) ^ 0x07) : quint8(crc << 1);
+        table[i] = crc;
+    }
+    return table;
+}();
+
+constexpr auto flacCrc16Table = []{
+    std::array<quint16, 256> table = {};
+    for (int i = 0; i < 256; ++i) {
+        quint16 crc = quint16(i << 8);
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc & 0x8000) ? quint16((crc << 1) ^ 0x8005) : quint16(crc << 1);
+        table[i] = crc;
+    }
+    return table;
+}();
+
+quint8 flacCrc8(const char *data, qsizetype size)
+{
+    quint8 crc = 0;
+    for (qsizetype i = 0; i < size; ++i)
+        crc = flacCrc8Table[crc ^ quint8(data[i])];
+    return crc;
+}
+
+quint16 flacCrc16(const char *data, qsizetype size)
+{
+    quint16 crc = 0;
+    for (qsizetype i = 0; i < size; ++i)
+        crc = quint16(crc << 8) ^ flacCrc16Table[(crc >> 8) ^ quint8(data[i])];
+    return crc;
+}
+
+// Frame numbers are coded like extended UTF-8, with up to 36 bits.
+void appendFlacFrameNumber(QByteArray &frame, quint64 number)
+{
+    if (number < 0x80) {
+        frame.append(char(number));
+        return;
+    }
+    int continuationBytes = 1;
+    while (continuationBytes < 6 && number >= (quint64(1) << (5 * continuationBytes + 6)))
+        ++continuationBytes;
+    const quint8 leadMask = quint8(0xff00 >> (continuationBytes + 1));
+    frame.append(char(leadMask | quint8(number >> (6 * continuationBytes))));
+    for (int i = continuationBytes - 1; i >= 0; --i)
+        frame.append(char(0x80 | ((number >> (6 * i)) & 0x3f)));
+}
+
+template <typename T>
+void appendBigEndian(QByteArray &data, T value)
+{
+    const T bigEndian = qToBigEndian(value);
+    data.append(reinterpret_cast<const char *>(&bigEndian), sizeof(T));
+}
+
+template <typename T>
+void appendLittleEndian(QByteArray &data, T value)
+{
+    const T littleEndian = qToLittleEndian(value);
+    data.append(reinterpret_cast<const char *>(&littleEndian), sizeof(T));
+}
+
+constexpr qint64 WavHeaderSize = 44;
+// "fLaC", the metadata block header, and the beginning of STREAMINFO
+constexpr qint64 FlacStreamInfoOffset = 8;
+
+} // namespace
+
+QTextToSpeechFileWriter::QTextToSpeechFileWriter(const QString &fileName,
+                                                 QTextToSpeech::FileFormat fileFormat)
+    : m_fileFormat(fileFormat), m_file(fileName)
+{
+    m_promise.start();
+}
+
+QTextToSpeechFileWriter::~QTextToSpeechFileWriter()
+{
+    cancel();
+    wait();
+}
+
+/*!
+    \internal
+
+    Lets the writer also write the captions of \a text to \a fileName once
+    the audio file is complete, grouping the words into cues as the
+    \a options specify.
+*/
+void QTextToSpeechFileWriter::setCaptions(const QString &fileName, const QString &text,
+                                          const QTextToSpeech::CaptionOptions &options)
+{
+    Q_ASSERT(!isRunning());
+    m_captionFileName = fileName;
+    m_text = text;
+    m_captionOptions = options;
+}
+
+/*!
+    \internal
+
+    Sets the boundaries of the \a words of the text, relative to the audio
+    data, for the captions.
+*/
+void QTextToSpeechFileWriter::setWords(const QList<QTextToSpeech::WordBoundary> &words)
+{
+    QMutexLocker locker(&m_mutex);
+    m_words = words;
+}
+
+/*!
+    \internal
+
+    Queues \a data in \a format for writing. Returns \c false if the writer
+    thread has fallen behind, in which case the producer should be throttled
+    until drained() gets emitted. This function never waits for the writer
+    thread. If the producer can't be throttled and the queue grows beyond
+    MaxQueuedBytes, then writing fails, so that the memory used for long
+    texts stays bounded.
+*/
+bool QTextToSpeechFileWriter::append(const QAudioFormat &format, const QByteArray &data)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_status != Status::Running)
+        return true;
+
+    if (!m_format.isValid()) {
+        m_format = format;
+    } else if (m_format != format) {
+        qWarning() << "Audio format changed during synthesis from" << m_format
+                   << "to" << format << "- can't write" << m_file.fileName();
+        m_status = Status::Cancelled;
+        m_dataAvailable.wakeOne();
+        return true;
+    }
+
+    if (m_queuedBytes + data.size() > MaxQueuedBytes) {
+        qWarning() << "The engine can't be throttled, and" << m_file.fileName()
+                   << "can't be written fast enough";
+        m_status = Status::Cancelled;
+        m_chunks.clear();
+        m_queuedBytes = 0;
+        m_dataAvailable.wakeOne();
+        return true;
+    }
+
+    m_chunks.enqueue(data);
+    m_queuedBytes += data.size();
+    m_dataAvailable.wakeOne();
+    if (m_queuedBytes > HighWaterMark)
+        m_aboveHighWaterMark = true;
+    return !m_aboveHighWaterMark;
+}
+
+/*!
+    \internal
+
+    Ends the stream; the writer thread completes the file once all queued
+    data has been written.
+*/
+void QTextToSpeechFileWriter::finish()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_status != Status::Running)
+        return;
+    m_status = Status::Finishing;
+    m_dataAvailable.wakeOne();
+}
+
+/*!
+    \internal
+
+    Aborts writing. Queued data is discarded, and the incomplete file is removed.
+*/
+void QTextToSpeechFileWriter::cancel()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_status != Status::Running)
+        return;
+    m_status = Status::Cancelled;
+    m_dataAvailable.wakeOne();
+}
+
+void QTextToSpeechFileWriter::run()
+{
+    bool ok = m_file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    if (!ok) {
+        qWarning("Can't open %s for writing: %s", qPrintable(m_file.fileName()),
+                 qPrintable(m_file.errorString()));
+    }
+
+    while (ok) {
+        QByteArray chunk;
+        bool drainedBelowHighWaterMark = false;
+        {
+            QMutexLocker locker(&m_mutex);
+            while (m_chunks.isEmpty() && m_status == Status::Running)
+                m_dataAvailable.wait(&m_mutex);
+            if (m_status == Status::Cancelled) {
+                ok = false;
+                break;
+            }
+            // finishing, and all data is written
+            if (m_chunks.isEmpty())
+                break;
+            chunk = m_chunks.dequeue();
+            m_queuedBytes -= chunk.size();
+            if (!m_fileAudioFormat.isValid())
+                m_fileAudioFormat = m_format;
+            if (m_aboveHighWaterMark && m_queuedBytes < HighWaterMark / 2) {
+                m_aboveHighWaterMark = false;
+                drainedBelowHighWaterMark = true;
+            }
+        }
+        if (drainedBelowHighWaterMark)
+            emit drained();
+
+        if (m_file.pos() == 0)
+            ok = writeHeader();
+        if (ok)
+            ok = writeData(chunk);
+    }
+
+    if (ok)
+        ok = m_fileAudioFormat.isValid() && writeTrailer();
+    if (ok && !m_captionFileName.isEmpty())
+        ok = writeCaptions();
+
+    if (!ok) {
+        // later data is dropped by append()
+        QMutexLocker locker(&m_mutex);
+        m_status = Status::Cancelled;
+        m_chunks.clear();
+        m_queuedBytes = 0;
+    }
+
+    if (m_file.isOpen()) {
+        m_file.close();
+        if (!ok)
+            m_file.remove();
+    }
+
+    m_promise.addResult(ok);
+    m_promise.finish();
+}
+
+bool QTextToSpeechFileWriter::writeHeader()
+{
+    const int channelCount = m_fileAudioFormat.channelCount();
+    const int bytesPerSample = m_fileAudioFormat.bytesPerSample();
+    const int sampleRate = m_fileAudioFormat.sampleRate();
+
+    QByteArray header;
+    switch (m_fileFormat) {
+    case QTextToSpeech::FileFormat::Wav: {
+        const bool isFloat = m_fileAudioFormat.sampleFormat() == QAudioFormat::Float;
+        header.reserve(WavHeaderSize);
+        header.append("RIFF");
+        appendLittleEndian<quint32>(header, 0); // patched in writeTrailer
+        header.append("WAVE");
+        header.append("fmt ");
+        appendLittleEndian<quint32>(header, 16);
+        appendLittleEndian<quint16>(header, isFloat ? 3 : 1); // IEEE float or PCM
+        appendLittleEndian<quint16>(header, quint16(channelCount));
+        appendLittleEndian<quint32>(header, quint32(sampleRate));
+        appendLittleEndian<quint32>(header, quint32(m_fileAudioFormat.bytesForFrames(sampleRate)));
+        appendLittleEndian<quint16>(header, quint16(m_fileAudioFormat.bytesPerFrame()));
+        appendLittleEndian<quint16>(header, quint16(bytesPerSample * 8));
+        header.append("data");
+        appendLittleEndian<quint32>(header, 0); // patched in writeTrailer
+        break;
+    }
+    case QTextToSpeech::FileFormat::Flac: {
+        const auto sampleFormat = m_fileAudioFormat.sampleFormat();
+        if (sampleFormat != QAudioFormat::UInt8 && sampleFormat != QAudioFormat::Int16) {
+            qWarning() << "Can't write audio format" << m_fileAudioFormat << "to a FLAC file";
+            return false;
+        }
+        if (channelCount < 1 || channelCount > 8) {
+            qWarning("FLAC supports at most 8 channels, data has %d", channelCount);
+            return false;
+        }
+        header.append("fLaC");
+        // last metadata block, type STREAMINFO, 34 bytes
+        header.append(char(0x80));
+        header.append(char(0));
+        header.append(char(0));
+        header.append(char(34));
+        // min/max block size, min/max frame size, sample rate, channels,
+        // bits per sample, total samples; the rest is patched in writeTrailer
+        header.append(QByteArray(34, '\0'));
+        break;
+    }
+    }
+
+    if (m_file.write(header) != header.size()) {
+        qWarning("Failed to write to %s: %s", qPrintable(m_file.fileName()),
+                 qPrintable(m_file.errorString()));
+        return false;
+    }
+    return true;
+}
+
+bool QTextToSpeechFileWriter::writeData(const QByteArray &data)
+{
+    switch (m_fileFormat) {
+    case QTextToSpeech::FileFormat::Wav: {
+        qint64 written = 0;
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+        if (m_fileAudioFormat.bytesPerSample() > 1) {
+            QByteArray swapped(data.size(), Qt::Uninitialized);
+            switch (m_fileAudioFormat.bytesPerSample()) {
+            case 2:
+                qbswap<2>(data.constData(), data.size() / 2, swapped.data());
+                break;
+            case 4:
+                qbswap<4>(data.constData(), data.size() / 4, swapped.data());
+                break;
+            }
+            written = m_file.write(swapped);
+        } else
+#endif
+        {
+            written = m_file.write(data);
+        }
+        if (written != data.size()) {
+            qWarning("Failed to write to %s: %s", qPrintable(m_file.fileName()),
+                     qPrintable(m_file.errorString()));
+            return false;
+        }
+        m_dataBytes += written;
+        return true;
+    }
+    case QTextToSpeech::FileFormat::Flac: {
+        m_flacBlock.append(data);
+        const qsizetype blockBytes = m_fileAudioFormat.bytesForFrames(FlacBlockSize);
+        qsizetype offset = 0;
+        while (m_flacBlock.size() - offset >= blockBytes) {
+            if (!writeFlacFrame(m_flacBlock.constData() + offset, FlacBlockSize))
+                return false;
+            offset += blockBytes;
+        }
+        m_flacBlock.remove(0, offset);
+        m_dataBytes += data.size();
+        return true;
+    }
+    }
+    Q_UNREACHABLE_RETURN(false);
+}
+
+/*!
+    \internal
+
+    Writes a FLAC frame with \a frameCount frames from the interleaved \a samples.
+    The subframes are stored verbatim, so that we don't depend on libFLAC; the
+    result is a valid, if uncompressed, FLAC file.
+*/
+bool QTextToSpeechFileWriter::writeFlacFrame(const char *samples, qsizetype frameCount)
+{
+    Q_ASSERT(frameCount > 0 && frameCount <= 65536);
+    const int channelCount = m_fileAudioFormat.channelCount();
+    const int bytesPerSample = m_fileAudioFormat.bytesPerSample();
+
+    QByteArray frame;
+    frame.reserve(16 + 2 + channelCount * (1 + frameCount * bytesPerSample));
+    // sync code, fixed block size
+    frame.append(char(0xff));
+    frame.append(char(0xf8));
+    // block size is stored as 16 bit value at the end of the header,
+    // sample rate is taken from STREAMINFO
+    frame.append(char(0x70));
+    // independent channels, sample size from STREAMINFO
+    frame.append(char((channelCount - 1) << 4));
+    appendFlacFrameNumber(frame, m_flacFrameNumber++);
+    appendBigEndian<quint16>(frame, quint16(frameCount - 1));
+    frame.append(char(flacCrc8(frame.constData(), frame.size())));
+
+    for (int channel = 0; channel < channelCount; ++channel) {
+        // VERBATIM subframe without wasted bits
+        frame.append(char(0x02));
+        for (qsizetype i = 0; i < frameCount; ++i) {
+            const char *sample = samples + (i * channelCount + channel) * bytesPerSample;
+            if (bytesPerSample == 1) {
+                frame.append(char(quint8(*sample) - 128));
+            } else {
+                qint16 value;
+                memcpy(&value, sample, sizeof(value));
+                appendBigEndian<qint16>(frame, value);
+            }
+        }
+    }
+    appendBigEndian<quint16>(frame, flacCrc16(frame.constData(), frame.size()));
+
+    if (m_file.write(frame) != frame.size()) {
+        qWarning("Failed to write to %s: %s", qPrintable(m_file.fileName()),
+                 qPrintable(m_file.errorString()));
+        return false;
+    }
+    const quint32 frameSize = quint32(frame.size());
+    if (!m_flacMinFrameSize || frameSize < m_flacMinFrameSize)
+        m_flacMinFrameSize = frameSize;
+    m_flacMaxFrameSize = qMax(m_flacMaxFrameSize, frameSize);
+    return true;
+}
+
+/*!
+    \internal
+
+    Completes the file by patching the sizes into the header, which we
+    only know once all data has been written.
+*/
+bool QTextToSpeechFileWriter::writeTrailer()
+{
+    QByteArray patch;
+    qint64 patchOffset = 0;
+    switch (m_fileFormat) {
+    case QTextToSpeech::FileFormat::Wav: {
+        // the size fields are 32 bit; larger files are truncated as far as
+        // the header is concerned
+        const quint32 dataSize = quint32(qMin<qint64>(m_dataBytes,
+                                                      std::numeric_limits<quint32>::max()
+                                                      - WavHeaderSize));
+        if (!m_file.seek(4))
+            return false;
+        appendLittleEndian<quint32>(patch, quint32(WavHeaderSize - 8) + dataSize);
+        if (m_file.write(patch) != patch.size())
+            return false;
+        patch.clear();
+        patchOffset = WavHeaderSize - 4;
+        appendLittleEndian<quint32>(patch, dataSize);
+        break;
+    }
+    case QTextToSpeech::FileFormat::Flac: {
+        const qsizetype remainingFrames = m_fileAudioFormat.framesForBytes(m_flacBlock.size());
+        if (remainingFrames && !writeFlacFrame(m_flacBlock.constData(), remainingFrames))
+            return false;
+        m_flacBlock.clear();
+
+        const quint64 totalFrames = quint64(m_fileAudioFormat.framesForBytes(m_dataBytes));
+        patchOffset = FlacStreamInfoOffset;
+        appendBigEndian<quint16>(patch, quint16(FlacBlockSize));
+        appendBigEndian<quint16>(patch, quint16(FlacBlockSize));
+        const auto append24 = [&patch](quint32 value) {
+            patch.append(char((value >> 16) & 0xff));
+            patch.append(char((value >> 8) & 0xff));
+            patch.append(char(value & 0xff));
+        };
+        append24(m_flacMinFrameSize);
+        append24(m_flacMaxFrameSize);
+        const quint64 packed = (quint64(m_fileAudioFormat.sampleRate() & 0xfffff) << 44)
+                             | (quint64(m_fileAudioFormat.channelCount() - 1) << 41)
+                             | (quint64(m_fileAudioFormat.bytesPerSample() * 8 - 1) << 36)
+                             | (totalFrames & Q_UINT64_C(0xfffffffff));
+        appendBigEndian<quint64>(patch, packed);
+        // leave the MD5 signature as all zeros, meaning "unknown"
+        break;
+    }
+    }
+
+    if (!m_file.seek(patchOffset) || m_file.write(patch) != patch.size()) {
+        qWarning("Failed to write to %s: %s", qPrintable(m_file.fileName()),
+                 qPrintable(m_file.errorString()));
+        return false;
+    }
+    return true;
+}
+
+/*!
+    \internal
+
+    Writes the caption file. Consecutive words are grouped into a cue as long
+    as the cue stays within the maximum length and duration; a single word
+    that exceeds them gets a cue of its own. Each cue lasts until the next one
+    starts, and the last one until the end of the audio.
+*/
+bool QTextToSpeechFileWriter::writeCaptions()
+{
+    QList<QTextToSpeech::WordBoundary> words;
+    {
+        QMutexLocker locker(&m_mutex);
+        words.reserve(m_words.size());
+        // Engines that normalize the text report words that aren't in it:
+        // flite reports the words of a number or an abbreviation with the
+        // position of the token, or with -1. Their audio is part of the cue
+        // of the word before them.
+        for (QTextToSpeech::WordBoundary word : std::as_const(m_words)) {
+            if (word.start < 0 || word.start >= m_text.size()
+                || (!words.isEmpty() && word.start <= words.last().start)) {
+                continue;
+            }
+            word.length = qBound(qsizetype(0), word.length, m_text.size() - word.start);
+            words.append(word);
+        }
+    }
+
+    const qint64 sampleRate = m_fileAudioFormat.sampleRate();
+    const auto toMs = [sampleRate](qint64 frame) { return frame * 1000 / sampleRate; };
+    const qint64 audioEnd = toMs(m_fileAudioFormat.framesForBytes(m_dataBytes));
+    const bool webVtt = m_captionOptions.format == QTextToSpeech::CaptionFormat::WebVtt;
+    const auto timestamp = [webVtt](qint64 ms) {
+        return QByteArray::asprintf("%02lld:%02lld:%02lld%c%03lld", ms / 3600000,
+                                    ms / 60000 % 60, ms / 1000 % 60, webVtt ? '.' : ',',
+                                    ms % 1000);
+    };
+
+    QByteArray captions;
+    if (webVtt)
+        captions.append("WEBVTT\n\n");
+    int cueNumber = 0;
+    for (qsizetype first = 0; first < words.size();) {
+        const QTextToSpeech::WordBoundary &firstWord = words.at(first);
+        const qint64 cueStart = toMs(firstWord.frame);
+        qsizetype next = first + 1;
+        for (; next < words.size(); ++next) {
+            const QTextToSpeech::WordBoundary &word = words.at(next);
+            const qint64 wordEnd = next + 1 < words.size() ? toMs(words.at(next + 1).frame)
+                                                           : audioEnd;
+            if (word.start + word.length - firstWord.start > m_captionOptions.maximumCueLength
+                || wordEnd - cueStart > m_captionOptions.maximumCueDuration) {
+                break;
+            }
+        }
+        // punctuation after the last word belongs to the cue
+        const qsizetype textEnd = next < words.size() ? words.at(next).start : m_text.size();
+        QString text = m_text.sliced(firstWord.start, textEnd - firstWord.start).simplified();
+        if (webVtt) {
+            text.replace(u'&', "&amp;"_L1);
+            text.replace(u'<', "&lt;"_L1);
+            text.replace(u'>', "&gt;"_L1);
+        }
+        const qint64 cueEnd = next < words.size() ? toMs(words.at(next).frame) : audioEnd;
+
+        if (!webVtt)
+            captions.append(QByteArray::number(++cueNumber) + '\n');
+        captions.append(timestamp(cueStart) + " --> " + timestamp(qMax(cueStart, cueEnd)) + '\n');
+        captions.append(text.toUtf8() + "\n\n");
+        first = next;
+    }
+
+    QFile file(m_captionFileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+        || file.write(captions) != captions.size()) {
+        qWarning("Failed to write to %s: %s", qPrintable(file.fileName()),
+                 qPrintable(file.errorString()));
+        if (file.isOpen())
+            file.remove();
+        return false;
+    }
+    return true;
+}
+
+QT_END_NAMESPACE
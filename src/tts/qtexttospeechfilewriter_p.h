@@ -0,0 +1,106 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHFILEWRITER_P_H
+#define QTEXTTOSPEECHFILEWRITER_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists for the convenience
+// of other Qt classes.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <qtexttospeech.h>
+
+#include <QtCore/qbytearray.h>
+#include <QtCore/qfile.h>
+#include <QtCore/qfuture.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qpromise.h>
+#include <QtCore/qqueue.h>
+#include <QtCore/qthread.h>
+#include <QtCore/qwaitcondition.h>
+#include <QtMultimedia/qaudioformat.h>
+
+QT_BEGIN_NAMESPACE
+
+class QTextToSpeechFileWriter : public QThread
+{
+    Q_OBJECT
+public:
+    QTextToSpeechFileWriter(const QString &fileName, QTextToSpeech::FileFormat fileFormat);
+    ~QTextToSpeechFileWriter() override;
+
+    QFuture<bool> future() { return m_promise.future(); }
+
+    // to be called before start()
+    void setCaptions(const QString &fileName, const QString &text,
+                     const QTextToSpeech::CaptionOptions &options);
+
+    // called from the thread that delivers the synthesized data
+    bool append(const QAudioFormat &format, const QByteArray &data);
+    void setWords(const QList<QTextToSpeech::WordBoundary> &words);
+    void finish();
+    void cancel();
+
+Q_SIGNALS:
+    void drained();
+
+protected:
+    void run() override;
+
+private:
+    enum class Status {
+        Running,
+        Finishing,
+        Cancelled
+    };
+
+    bool writeHeader();
+    bool writeData(const QByteArray &data);
+    bool writeTrailer();
+    bool writeCaptions();
+
+    bool writeFlacFrame(const char *samples, qsizetype frameCount);
+
+    // the number of queued bytes at which the engine should be throttled
+    static constexpr qsizetype HighWaterMark = 256 * 1024;
+    // the maximum number of bytes that can be queued, for engines that can't
+    // be throttled; writing fails beyond it
+    static constexpr qsizetype MaxQueuedBytes = 16 * HighWaterMark;
+    // the number of audio frames in each FLAC frame
+    static constexpr qsizetype FlacBlockSize = 4096;
+
+    QMutex m_mutex;
+    QWaitCondition m_dataAvailable;
+    QQueue<QByteArray> m_chunks;
+    qsizetype m_queuedBytes = 0;
+    bool m_aboveHighWaterMark = false;
+    Status m_status = Status::Running;
+    QAudioFormat m_format; // protected by m_mutex
+    QList<QTextToSpeech::WordBoundary> m_words; // protected by m_mutex
+
+    // only accessed by the writer thread
+    const QTextToSpeech::FileFormat m_fileFormat;
+    QFile m_file;
+    QAudioFormat m_fileAudioFormat;
+    qint64 m_dataBytes = 0;
+    QByteArray m_flacBlock;
+    quint64 m_flacFrameNumber = 0;
+    quint32 m_flacMinFrameSize = 0;
+    quint32 m_flacMaxFrameSize = 0;
+    QString m_captionFileName;
+    QString m_text;
+    QTextToSpeech::CaptionOptions m_captionOptions;
+
+    QPromise<bool> m_promise;
+};
+
+QT_END_NAMESPACE
+
+#endif
@@ -0,0 +1,51 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include "qtexttospeechsharedlibrary_p.h"
+
+#include <QtCore/qbytearray.h>
+#include <QtCore/qhash.h>
+
+QT_BEGIN_NAMESPACE
+
+namespace {
+struct SharedLibraries
+{
+    ~SharedLibraries() { qDeleteAll(libraries); }
+
+    QMutex mutex;
+    QHash<QByteArray, QTextToSpeechSharedLibrary *> libraries;
+};
+Q_GLOBAL_STATIC(SharedLibraries, sharedLibraries)
+} // namespace
+
+QTextToSpeechSharedLibrary *QTextToSpeechSharedLibrary::instance(const char *name)
+{
+    QMutexLocker locker(&sharedLibraries->mutex);
+    QTextToSpeechSharedLibrary *&library = sharedLibraries->libraries[QByteArray(name)];
+    if (!library)
+        library = new QTextToSpeechSharedLibrary;
+    return library;
+}
+
+int QTextToSpeechSharedLibrary::ref(Initialize initialize)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_users == 0)
+        m_initializeResult = initialize();
+    if (m_initializeResult > 0)
+        ++m_users;
+    return m_initializeResult;
+}
+
+void QTextToSpeechSharedLibrary::deref(Terminate terminate)
+{
+    QMutexLocker locker(&m_mutex);
+    Q_ASSERT(m_users > 0);
+    if (--m_users == 0) {
+        terminate();
+        m_initializeResult = 0;
+    }
+}
+
+QT_END_NAMESPACE
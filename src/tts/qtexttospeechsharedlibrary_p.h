@@ -0,0 +1,52 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHSHAREDLIBRARY_P_H
+#define QTEXTTOSPEECHSHAREDLIBRARY_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists for the convenience
+// of other Qt classes.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtTextToSpeech/qtexttospeech_global.h>
+
+#include <QtCore/qmutex.h>
+
+QT_BEGIN_NAMESPACE
+
+// Owner of a third-party library with global state, like libespeak-ng, that
+// several plugins use. The plugins take turns by locking the mutex. The first
+// user initializes the library, and the last one terminates it, so that a
+// plugin doesn't terminate the library while another one is using it.
+class Q_TEXTTOSPEECH_EXPORT QTextToSpeechSharedLibrary
+{
+public:
+    using Initialize = int (*)();
+    using Terminate = void (*)();
+
+    // the owner of the library with the given name, shared by all plugins
+    static QTextToSpeechSharedLibrary *instance(const char *name);
+
+    QMutex *mutex() { return &m_mutex; }
+
+    // Returns the result of initialize() from the first user. If that is not
+    // positive, then the library is not initialized, and the caller is no user.
+    int ref(Initialize initialize);
+    void deref(Terminate terminate);
+
+private:
+    QMutex m_mutex;
+    int m_users = 0;
+    int m_initializeResult = 0;
+};
+
+QT_END_NAMESPACE
+
+#endif
@@ -0,0 +1,675 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include "qtexttospeechsharedmemory.h"
+#include "qtexttospeechsharedmemory_p.h"
+
+#include <QtCore/qcoreapplication.h>
+#include <QtCore/qcoreevent.h>
+#include <QtCore/qdebug.h>
+
+#include <cstring>
+#include <new>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QTextToSpeechSharedMemory;
+
+static char *ringOf(QSharedMemory &memory)
+{
+    return static_cast<char *>(memory.data()) + DataOffset;
+}
+
+static const char *ringOf(const QSharedMemory &memory)
+{
+    return static_cast<const char *>(memory.constData()) + DataOffset;
+}
+
+QTextToSpeechSharedMemorySinkPrivate::QTextToSpeechSharedMemorySinkPrivate(const QString &key)
+    : key(key), memory(QSharedMemory::platformSafeKey(key))
+{
+}
+
+QTextToSpeechSharedMemoryReaderPrivate::QTextToSpeechSharedMemoryReaderPrivate(const QString &key)
+    : memory(QSharedMemory::platformSafeKey(key))
+{
+}
+
+/*!
+    \class QTextToSpeechSharedMemorySink
+    \inmodule QtTextToSpeech
+    \since 6.7
+    \brief The QTextToSpeechSharedMemorySink class writes synthesized audio
+    into a ring buffer in shared memory.
+
+    Use QTextToSpeechSharedMemorySink with QTextToSpeech::synthesize() to pass
+    the synthesized audio to another process without copying it through the
+    kernel. The other process reads the audio with a
+    QTextToSpeechSharedMemoryReader that uses the same key.
+
+    \code
+    QTextToSpeechSharedMemorySink sink(u"my-mixer"_s);
+    if (sink.create())
+        tts.synthesize(text, &sink);
+    \endcode
+
+    The sink writes a sequence of records: the audio format whenever it
+    changes, the PCM data, a record for each word that the engine reports,
+    and a record at the end of the text. Each record has a sequence number.
+    Writing and reading the records only accesses the shared memory, and
+    doesn't require a system call.
+
+    If the ring buffer is more than half full, then QTextToSpeech asks the
+    engine to pause the synthesis until the reader has caught up. If the
+    engine doesn't support this and the ring buffer overflows, then the sink
+    drops records, and the reader sees a gap in the sequence numbers. The
+    records that mark the end of a text are never dropped.
+
+    There can be only one reader for a sink.
+
+    \sa QTextToSpeechSharedMemoryReader, QTextToSpeech::synthesize()
+*/
+
+/*!
+    \fn void QTextToSpeechSharedMemorySink::drained()
+
+    This signal is emitted when the reader has consumed enough data so that
+    the ring buffer is less than half full again, after it was more than half
+    full.
+*/
+
+/*!
+    Constructs a sink for the shared memory segment with \a key, and with
+    the given \a parent. Call create() to create the segment.
+*/
+QTextToSpeechSharedMemorySink::QTextToSpeechSharedMemorySink(const QString &key, QObject *parent)
+    : QObject(*new QTextToSpeechSharedMemorySinkPrivate(key), parent)
+{
+}
+
+/*!
+    Destroys the sink. A reader that is still attached reads the remaining
+    records, and then reports that the sink is closed.
+*/
+QTextToSpeechSharedMemorySink::~QTextToSpeechSharedMemorySink()
+{
+    Q_D(QTextToSpeechSharedMemorySink);
+    if (isValid())
+        d->header()->closed.store(1, std::memory_order_release);
+}
+
+/*!
+    Creates the shared memory segment with a ring buffer of \a capacity
+    bytes. Returns \c true on success; otherwise returns \c false, and
+    errorString() describes the error.
+
+    The \a capacity is rounded up to a multiple of 16 bytes.
+*/
+bool QTextToSpeechSharedMemorySink::create(qsizetype capacity)
+{
+    Q_D(QTextToSpeechSharedMemorySink);
+    if (isValid()) {
+        d->errorString = QCoreApplication::translate("QTextToSpeech",
+                                                     "The shared memory sink is already created.");
+        return false;
+    }
+    if (capacity < qsizetype(64 * RecordAlignment)) {
+        d->errorString = QCoreApplication::translate("QTextToSpeech",
+                                                     "The capacity %1 is too small.").arg(capacity);
+        return false;
+    }
+
+    d->capacity = (quint64(capacity) + RecordAlignment - 1) & ~(RecordAlignment - 1);
+    if (!d->memory.create(DataOffset + d->capacity)) {
+        d->errorString = d->memory.errorString();
+        d->capacity = 0;
+        return false;
+    }
+
+    Header *header = new (d->memory.data()) Header;
+    header->version = Version;
+    header->capacity = d->capacity;
+    header->writePosition.store(0, std::memory_order_relaxed);
+    header->readPosition.store(0, std::memory_order_relaxed);
+    header->closed.store(0, std::memory_order_relaxed);
+    // readers check the magic last
+    header->magic.store(Magic, std::memory_order_release);
+
+    d->sequence = 0;
+    d->droppedRecords = 0;
+    d->pendingEndOfText = 0;
+    d->format = {};
+    d->frameOffset = 0;
+    d->errorString.clear();
+    return true;
+}
+
+/*!
+    Returns whether the shared memory segment has been created.
+*/
+bool QTextToSpeechSharedMemorySink::isValid() const
+{
+    Q_D(const QTextToSpeechSharedMemorySink);
+    return d->memory.isAttached();
+}
+
+/*!
+    Returns the key of the shared memory segment.
+*/
+QString QTextToSpeechSharedMemorySink::key() const
+{
+    Q_D(const QTextToSpeechSharedMemorySink);
+    return d->key;
+}
+
+/*!
+    Returns a description of the last error.
+*/
+QString QTextToSpeechSharedMemorySink::errorString() const
+{
+    Q_D(const QTextToSpeechSharedMemorySink);
+    return d->errorString;
+}
+
+/*!
+    Returns the size of the ring buffer in bytes.
+*/
+qsizetype QTextToSpeechSharedMemorySink::capacity() const
+{
+    Q_D(const QTextToSpeechSharedMemorySink);
+    return qsizetype(d->capacity);
+}
+
+/*!
+    Returns the number of bytes in the ring buffer that the reader has
+    consumed, or that have never been written.
+*/
+qsizetype QTextToSpeechSharedMemorySink::bytesFree() const
+{
+    Q_D(const QTextToSpeechSharedMemorySink);
+    if (!isValid())
+        return 0;
+    return qsizetype(d->bytesFree());
+}
+
+quint64 QTextToSpeechSharedMemorySinkPrivate::bytesFree() const
+{
+    const quint64 used = header()->writePosition.load(std::memory_order_relaxed)
+                       - header()->readPosition.load(std::memory_order_acquire);
+    return capacity - used;
+}
+
+/*!
+    Returns the number of records that were dropped because the ring buffer
+    was full.
+*/
+quint64 QTextToSpeechSharedMemorySink::droppedRecords() const
+{
+    Q_D(const QTextToSpeechSharedMemorySink);
+    return d->droppedRecords;
+}
+
+/*!
+    Writes the PCM \a data in the audio \a format. A format record is written
+    first if the format changed.
+
+    Returns \c false if the data, or part of it, was dropped because the ring
+    buffer is full.
+*/
+bool QTextToSpeechSharedMemorySink::writeAudio(const QAudioFormat &format, QByteArrayView data)
+{
+    Q_D(QTextToSpeechSharedMemorySink);
+    if (!isValid() || !format.isValid())
+        return false;
+
+    const qsizetype frameSize = qMax(1, format.bytesPerFrame());
+    if (format != d->format) {
+        const FormatRecord record{format.sampleRate(), format.channelCount(),
+                                  qint32(format.sampleFormat()), 0};
+        // without the format, the audio can't be interpreted; the format
+        // record is written again with the next data
+        if (!d->writeRecord(RecordType::Format, &record, sizeof(record))) {
+            d->frameOffset += data.size() / frameSize;
+            return false;
+        }
+        d->format = format;
+    }
+
+    // split the data so that a record never needs more than a quarter of
+    // the ring buffer, and contains only complete frames
+    bool written = true;
+    const qsizetype maximumChunk = qMax(frameSize,
+        ((qsizetype(d->capacity / 4) - qsizetype(recordSize(sizeof(AudioRecord)))) / frameSize)
+            * frameSize);
+    while (!data.isEmpty()) {
+        const QByteArrayView chunk = data.first(qMin(data.size(), maximumChunk));
+        const AudioRecord record{d->frameOffset};
+        written &= d->writeRecord(RecordType::Audio, &record, sizeof(record), chunk);
+        // dropped audio still advances the timeline
+        d->frameOffset += chunk.size() / frameSize;
+        data = data.sliced(chunk.size());
+    }
+    return written;
+}
+
+/*!
+    Writes a record for the word at \a start with \a length characters in the
+    text. The word begins at the end of the audio written so far.
+
+    Returns \c false if the record was dropped because the ring buffer is full.
+*/
+bool QTextToSpeechSharedMemorySink::writeWord(qsizetype start, qsizetype length)
+{
+    Q_D(QTextToSpeechSharedMemorySink);
+    if (!isValid())
+        return false;
+    const WordRecord record{d->frameOffset, start, length};
+    return d->writeRecord(RecordType::Word, &record, sizeof(record));
+}
+
+/*!
+    Writes a record that marks the end of the synthesized text. The frame
+    offset of the next audio and word records starts at 0 again.
+
+    This record is never dropped. Room for it is kept free in the ring
+    buffer. If that room has been used already, then the record is written
+    once the reader has made room, and the records written in the meantime
+    are dropped. Returns \c false if the sink has not been created.
+*/
+bool QTextToSpeechSharedMemorySink::writeEndOfText()
+{
+    Q_D(QTextToSpeechSharedMemorySink);
+    if (!isValid())
+        return false;
+    d->frameOffset = 0;
+    return d->writeRecord(RecordType::EndOfText, nullptr, 0);
+}
+
+// Other records leave room for an end-of-text record, so that a reader that
+// is behind still learns where a text ends. Records that don't fit are
+// dropped, and the reader sees the gap in the sequence numbers.
+bool QTextToSpeechSharedMemorySinkPrivate::writeRecord(RecordType type, const void *payload,
+                                                       qsizetype size, QByteArrayView data)
+{
+    const bool endOfText = type == RecordType::EndOfText;
+    if (flushEndOfText()
+        && tryWriteRecord(type, payload, size, data, endOfText ? 0 : recordSize(0))) {
+        if (bytesFree() < capacity / 2)
+            startDrainTimer();
+        return true;
+    }
+
+    if (endOfText) {
+        ++pendingEndOfText;
+    } else {
+        ++sequence;
+        ++droppedRecords;
+    }
+    startDrainTimer();
+    return endOfText;
+}
+
+bool QTextToSpeechSharedMemorySinkPrivate::tryWriteRecord(RecordType type, const void *payload,
+                                                          qsizetype size, QByteArrayView data,
+                                                          quint64 reserve)
+{
+    Header *header = this->header();
+    char *ring = ringOf(memory);
+    const quint64 payloadSize = quint64(size + data.size());
+    const quint64 bytes = recordSize(payloadSize);
+
+    quint64 writePosition = header->writePosition.load(std::memory_order_relaxed);
+    const quint64 offset = writePosition % capacity;
+    const quint64 contiguous = capacity - offset;
+    const quint64 padding = bytes > contiguous ? contiguous : 0;
+    if (bytesFree() < padding + bytes + reserve)
+        return false;
+
+    if (padding) {
+        auto *record = reinterpret_cast<RecordHeader *>(ring + offset);
+        *record = RecordHeader{quint32(padding - sizeof(RecordHeader)), RecordType::Padding, 0, 0};
+        writePosition += padding;
+    }
+
+    char *target = ring + writePosition % capacity;
+    *reinterpret_cast<RecordHeader *>(target) =
+        RecordHeader{quint32(payloadSize), type, 0, sequence++};
+    target += sizeof(RecordHeader);
+    if (size)
+        memcpy(target, payload, size_t(size));
+    if (!data.isEmpty())
+        memcpy(target + size, data.data(), size_t(data.size()));
+    // publish the record to the reader
+    header->writePosition.store(writePosition + bytes, std::memory_order_release);
+    return true;
+}
+
+// Writes the end-of-text records that didn't fit, and returns whether all
+// of them are written now.
+bool QTextToSpeechSharedMemorySinkPrivate::flushEndOfText()
+{
+    while (pendingEndOfText && tryWriteRecord(RecordType::EndOfText, nullptr, 0, {}, 0))
+        --pendingEndOfText;
+    return !pendingEndOfText;
+}
+
+void QTextToSpeechSharedMemorySinkPrivate::startDrainTimer()
+{
+    Q_Q(QTextToSpeechSharedMemorySink);
+    if (!drainTimer.isActive())
+        drainTimer.start(5, q);
+}
+
+void QTextToSpeechSharedMemorySink::timerEvent(QTimerEvent *event)
+{
+    Q_D(QTextToSpeechSharedMemorySink);
+    if (event->timerId() != d->drainTimer.timerId()) {
+        QObject::timerEvent(event);
+        return;
+    }
+
+    // the reader doesn't notify us, so poll for the consumed data
+    if (d->flushEndOfText() && bytesFree() >= capacity() / 2) {
+        d->drainTimer.stop();
+        emit drained();
+    }
+}
+
+/*!
+    \class QTextToSpeechSharedMemoryReader
+    \inmodule QtTextToSpeech
+    \since 6.7
+    \brief The QTextToSpeechSharedMemoryReader class reads synthesized audio
+    from the shared memory of a QTextToSpeechSharedMemorySink.
+
+    Attach the reader to the shared memory segment that a
+    QTextToSpeechSharedMemorySink in another process has created with the same
+    key, and call readRecord() to read the records that the sink has written.
+    The reader doesn't notify about new records; consumers call readRecord()
+    when they need more data, for instance from the callback of their audio
+    device.
+
+    \code
+    QTextToSpeechSharedMemoryReader reader(u"my-mixer"_s);
+    if (!reader.attach())
+        return;
+    QTextToSpeechSharedMemoryReader::Record record;
+    while (reader.readRecord(record)) {
+        if (record.type == QTextToSpeechSharedMemoryReader::RecordType::Audio)
+            mix(record.format, record.audio);
+    }
+    \endcode
+
+    \sa QTextToSpeechSharedMemorySink
+*/
+
+/*!
+    \enum QTextToSpeechSharedMemoryReader::RecordType
+
+    This enum describes the type of a record.
+
+    \value Format       The audio format changed to \c format.
+    \value Audio        The \c audio contains PCM data in the \c format.
+    \value Word         The engine started to synthesize the word at \c start
+                        in the text, with \c length characters.
+    \value EndOfText    The synthesis of the text has finished, or was stopped.
+*/
+
+/*!
+    \class QTextToSpeechSharedMemoryReader::Record
+    \inmodule QtTextToSpeech
+    \brief The Record class describes a record read from the shared memory.
+
+    The \c sequence is the sequence number of the record. The \c format is
+    the audio format of the most recent format record. The \c frameOffset is
+    the number of audio frames that precede the audio or word record in the
+    synthesized text.
+
+    The \c audio data points into the shared memory, and stays valid until
+    the next call to readRecord() or detach().
+*/
+
+/*!
+    Constructs a reader for the shared memory segment with \a key.
+*/
+QTextToSpeechSharedMemoryReader::QTextToSpeechSharedMemoryReader(const QString &key)
+    : d_ptr(new QTextToSpeechSharedMemoryReaderPrivate(key))
+{
+}
+
+/*!
+    Destroys the reader, and detaches from the shared memory.
+*/
+QTextToSpeechSharedMemoryReader::~QTextToSpeechSharedMemoryReader()
+{
+    detach();
+}
+
+/*!
+    Attaches to the shared memory segment that the sink has created. Returns
+    \c true on success; otherwise returns \c false, and errorString()
+    describes the error.
+
+    The reader starts with the oldest record that hasn't been read yet.
+*/
+bool QTextToSpeechSharedMemoryReader::attach()
+{
+    Q_D(QTextToSpeechSharedMemoryReader);
+    if (isAttached())
+        return true;
+    if (!d->memory.attach(QSharedMemory::ReadWrite)) {
+        d->errorString = d->memory.errorString();
+        return false;
+    }
+
+    const Header *header = d->header();
+    if (d->memory.size() < qsizetype(DataOffset)
+        || header->magic.load(std::memory_order_acquire) != Magic
+        || header->version != Version
+        || d->memory.size() < qsizetype(DataOffset + header->capacity)) {
+        d->errorString = QCoreApplication::translate("QTextToSpeech",
+                             "The shared memory was not created by a compatible sink.");
+        d->memory.detach();
+        return false;
+    }
+
+    d->capacity = header->capacity;
+    d->readPosition = header->readPosition.load(std::memory_order_relaxed);
+    d->nextSequence = 0;
+    d->lostRecords = 0;
+    d->format = {};
+    d->errorString.clear();
+    return true;
+}
+
+/*!
+    Detaches from the shared memory, and releases the last record that was
+    read.
+*/
+void QTextToSpeechSharedMemoryReader::detach()
+{
+    Q_D(QTextToSpeechSharedMemoryReader);
+    if (!isAttached())
+        return;
+    d->releaseRecord();
+    d->memory.detach();
+}
+
+/*!
+    Returns whether the reader is attached to the shared memory.
+*/
+bool QTextToSpeechSharedMemoryReader::isAttached() const
+{
+    Q_D(const QTextToSpeechSharedMemoryReader);
+    return d->memory.isAttached();
+}
+
+/*!
+    Returns a description of the last error.
+*/
+QString QTextToSpeechSharedMemoryReader::errorString() const
+{
+    Q_D(const QTextToSpeechSharedMemoryReader);
+    return d->errorString;
+}
+
+// Returns the space of the records read so far to the sink
+void QTextToSpeechSharedMemoryReaderPrivate::releaseRecord()
+{
+    // the reader owns the read position, and only writes it
+    auto *header = static_cast<Header *>(memory.data());
+    header->readPosition.store(readPosition, std::memory_order_release);
+}
+
+// Checks that the record at the read position fits into the data that the
+// sink has published, and into the end of the ring buffer. The sink is
+// trusted no further than that, as any process with the key can write.
+bool QTextToSpeechSharedMemoryReaderPrivate::isValidRecord(const RecordHeader &recordHeader,
+                                                           quint64 available) const
+{
+    quint64 minimumSize = 0;
+    switch (recordHeader.type) {
+    case QTextToSpeechSharedMemory::RecordType::Format:
+        minimumSize = sizeof(FormatRecord);
+        break;
+    case QTextToSpeechSharedMemory::RecordType::Audio:
+        minimumSize = sizeof(AudioRecord);
+        break;
+    case QTextToSpeechSharedMemory::RecordType::Word:
+        minimumSize = sizeof(WordRecord);
+        break;
+    default:
+        break;
+    }
+    const quint64 contiguous = capacity - readPosition % capacity;
+    return recordHeader.size >= minimumSize
+        && recordHeader.size <= capacity
+        && recordSize(recordHeader.size) <= qMin(available, contiguous);
+}
+
+// Discards all data that the sink has written, so that reading continues
+// with the next record that the sink writes.
+void QTextToSpeechSharedMemoryReaderPrivate::resetRing(quint64 writePosition)
+{
+    qWarning() << "The shared memory" << memory.nativeKey() << "is corrupt, discarding"
+               << writePosition - readPosition << "bytes";
+    readPosition = writePosition;
+    releaseRecord();
+    format = {};
+    errorString = QCoreApplication::translate("QTextToSpeech", "The shared memory is corrupt.");
+}
+
+/*!
+    Reads the next record into \a record, and releases the record that was
+    read before. Returns \c false if there is no record available.
+
+    If the data in the shared memory is inconsistent, then the reader
+    discards everything that has been written so far, and returns \c false.
+    errorString() describes the error, and reading continues with the next
+    record that the sink writes.
+*/
+bool QTextToSpeechSharedMemoryReader::readRecord(Record &record)
+{
+    Q_D(QTextToSpeechSharedMemoryReader);
+    if (!isAttached())
+        return false;
+
+    d->releaseRecord();
+    const char *ring = ringOf(d->memory);
+    const quint64 writePosition = d->header()->writePosition.load(std::memory_order_acquire);
+
+    if (writePosition < d->readPosition || writePosition - d->readPosition > d->capacity) {
+        d->resetRing(writePosition);
+        return false;
+    }
+
+    while (d->readPosition < writePosition) {
+        const char *source = ring + d->readPosition % d->capacity;
+        const RecordHeader recordHeader = *reinterpret_cast<const RecordHeader *>(source);
+        if (!d->isValidRecord(recordHeader, writePosition - d->readPosition)) {
+            d->resetRing(writePosition);
+            return false;
+        }
+        const char *payload = source + sizeof(RecordHeader);
+        d->readPosition += recordSize(recordHeader.size);
+
+        switch (recordHeader.type) {
+        case QTextToSpeechSharedMemory::RecordType::Padding:
+            continue;
+        case QTextToSpeechSharedMemory::RecordType::Format: {
+            FormatRecord format;
+            memcpy(&format, payload, sizeof(format));
+            d->format.setSampleRate(format.sampleRate);
+            d->format.setChannelCount(format.channelCount);
+            d->format.setSampleFormat(QAudioFormat::SampleFormat(format.sampleFormat));
+            record = Record{RecordType::Format, recordHeader.sequence, d->format, 0, {}, 0, 0};
+            break;
+        }
+        case QTextToSpeechSharedMemory::RecordType::Audio: {
+            AudioRecord audio;
+            memcpy(&audio, payload, sizeof(audio));
+            record = Record{RecordType::Audio, recordHeader.sequence, d->format, audio.frameOffset,
+                            QByteArrayView(payload + sizeof(AudioRecord),
+                                           recordHeader.size - sizeof(AudioRecord)), 0, 0};
+            break;
+        }
+        case QTextToSpeechSharedMemory::RecordType::Word: {
+            WordRecord word;
+            memcpy(&word, payload, sizeof(word));
+            record = Record{RecordType::Word, recordHeader.sequence, d->format, word.frameOffset,
+                            {}, qsizetype(word.start), qsizetype(word.length)};
+            break;
+        }
+        case QTextToSpeechSharedMemory::RecordType::EndOfText:
+            record = Record{RecordType::EndOfText, recordHeader.sequence, d->format, 0, {}, 0, 0};
+            break;
+        default:
+            // written by a newer sink
+            continue;
+        }
+
+        if (record.sequence > d->nextSequence)
+            d->lostRecords += record.sequence - d->nextSequence;
+        d->nextSequence = record.sequence + 1;
+        return true;
+    }
+    return false;
+}
+
+/*!
+    Returns the number of bytes that the sink has written, and that haven't
+    been read yet.
+*/
+qsizetype QTextToSpeechSharedMemoryReader::bytesAvailable() const
+{
+    Q_D(const QTextToSpeechSharedMemoryReader);
+    if (!isAttached())
+        return 0;
+    return qsizetype(d->header()->writePosition.load(std::memory_order_acquire)
+                     - d->readPosition);
+}
+
+/*!
+    Returns the number of records that the sink dropped because the ring
+    buffer was full, as far as the reader has detected so far from the gaps
+    in the sequence numbers.
+*/
+quint64 QTextToSpeechSharedMemoryReader::lostRecords() const
+{
+    Q_D(const QTextToSpeechSharedMemoryReader);
+    return d->lostRecords;
+}
+
+/*!
+    Returns whether the sink has been destroyed and all records have been
+    read.
+*/
+bool QTextToSpeechSharedMemoryReader::isClosed() const
+{
+    Q_D(const QTextToSpeechSharedMemoryReader);
+    if (!isAttached())
+        return true;
+    return d->header()->closed.load(std::memory_order_acquire) && !bytesAvailable();
+}
+
+QT_END_NAMESPACE
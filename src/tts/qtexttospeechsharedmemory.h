@@ -0,0 +1,97 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHSHAREDMEMORY_H
+#define QTEXTTOSPEECHSHAREDMEMORY_H
+
+#include <QtTextToSpeech/qtexttospeech_global.h>
+
+#if QT_CONFIG(sharedmemory)
+
+#include <QtCore/qbytearrayview.h>
+#include <QtCore/qobject.h>
+#include <QtCore/qscopedpointer.h>
+#include <QtCore/qstring.h>
+#include <QtMultimedia/qaudioformat.h>
+
+QT_BEGIN_NAMESPACE
+
+class QTextToSpeechSharedMemorySinkPrivate;
+class Q_TEXTTOSPEECH_EXPORT QTextToSpeechSharedMemorySink : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit QTextToSpeechSharedMemorySink(const QString &key, QObject *parent = nullptr);
+    ~QTextToSpeechSharedMemorySink() override;
+
+    bool create(qsizetype capacity = 1024 * 1024);
+    bool isValid() const;
+    QString key() const;
+    QString errorString() const;
+
+    qsizetype capacity() const;
+    qsizetype bytesFree() const;
+    quint64 droppedRecords() const;
+
+    bool writeAudio(const QAudioFormat &format, QByteArrayView data);
+    bool writeWord(qsizetype start, qsizetype length);
+    bool writeEndOfText();
+
+Q_SIGNALS:
+    void drained();
+
+protected:
+    void timerEvent(QTimerEvent *event) override;
+
+private:
+    Q_DECLARE_PRIVATE(QTextToSpeechSharedMemorySink)
+};
+
+class QTextToSpeechSharedMemoryReaderPrivate;
+class Q_TEXTTOSPEECH_EXPORT QTextToSpeechSharedMemoryReader
+{
+public:
+    enum class RecordType {
+        Format,
+        Audio,
+        Word,
+        EndOfText
+    };
+
+    struct Record
+    {
+        RecordType type = RecordType::EndOfText;
+        quint64 sequence = 0;
+        QAudioFormat format;
+        qint64 frameOffset = 0;
+        QByteArrayView audio;
+        qsizetype start = 0;
+        qsizetype length = 0;
+    };
+
+    explicit QTextToSpeechSharedMemoryReader(const QString &key);
+    ~QTextToSpeechSharedMemoryReader();
+
+    bool attach();
+    void detach();
+    bool isAttached() const;
+    QString errorString() const;
+
+    bool readRecord(Record &record);
+    qsizetype bytesAvailable() const;
+    quint64 lostRecords() const;
+    bool isClosed() const;
+
+private:
+    Q_DISABLE_COPY(QTextToSpeechSharedMemoryReader)
+    Q_DECLARE_PRIVATE(QTextToSpeechSharedMemoryReader)
+
+    QScopedPointer<QTextToSpeechSharedMemoryReaderPrivate> d_ptr;
+};
+
+QT_END_NAMESPACE
+
+#endif // QT_CONFIG(sharedmemory)
+
+#endif
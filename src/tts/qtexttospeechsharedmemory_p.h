@@ -0,0 +1,162 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHSHAREDMEMORY_P_H
+#define QTEXTTOSPEECHSHAREDMEMORY_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists for the convenience
+// of other Qt classes.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtTextToSpeech/qtexttospeech_global.h>
+
+#if QT_CONFIG(sharedmemory)
+#include "qtexttospeechsharedmemory.h"
+
+#include <QtCore/qbasictimer.h>
+#include <QtCore/qsharedmemory.h>
+#include <QtCore/private/qobject_p.h>
+#endif
+
+#include <atomic>
+
+QT_BEGIN_NAMESPACE
+
+// Layout of the shared memory segment written by QTextToSpeechSharedMemorySink
+// and read by QTextToSpeechSharedMemoryReader. The segment starts with the
+// Header, followed by the ring buffer of records. The writer only advances
+// writePosition, the reader only advances readPosition; both positions count
+// bytes since the creation of the segment, so they never wrap.
+namespace QTextToSpeechSharedMemory
+{
+inline constexpr quint32 Magic = 0x53545451; // "QTTS"
+inline constexpr quint32 Version = 1;
+// Records start at multiples of the alignment, so that a padding record
+// always fits into the space left at the end of the ring buffer.
+inline constexpr quint64 RecordAlignment = 16;
+
+static_assert(std::atomic<quint64>::is_always_lock_free);
+static_assert(std::atomic<quint32>::is_always_lock_free);
+
+struct Header
+{
+    std::atomic<quint32> magic;
+    quint32 version;
+    quint64 capacity;
+    // on separate cache lines, as they are written by different processes
+    alignas(64) std::atomic<quint64> writePosition;
+    std::atomic<quint32> closed;
+    alignas(64) std::atomic<quint64> readPosition;
+};
+
+inline constexpr quint64 DataOffset = (sizeof(Header) + 63) & ~quint64(63);
+
+enum class RecordType : quint16 {
+    Padding,        // fills the end of the ring buffer
+    Format,         // FormatRecord
+    Audio,          // PCM data
+    Word,           // WordRecord
+    EndOfText,
+};
+
+struct RecordHeader
+{
+    quint32 size; // of the payload
+    RecordType type;
+    quint16 reserved;
+    quint64 sequence;
+};
+static_assert(sizeof(RecordHeader) == RecordAlignment);
+
+struct FormatRecord
+{
+    qint32 sampleRate;
+    qint32 channelCount;
+    qint32 sampleFormat;
+    qint32 reserved;
+};
+
+struct WordRecord
+{
+    qint64 frameOffset;
+    qint64 start;
+    qint64 length;
+};
+
+struct AudioRecord
+{
+    qint64 frameOffset;
+    // followed by the PCM data
+};
+
+constexpr quint64 recordSize(quint64 payloadSize)
+{
+    return (sizeof(RecordHeader) + payloadSize + RecordAlignment - 1) & ~(RecordAlignment - 1);
+}
+} // namespace QTextToSpeechSharedMemory
+
+#if QT_CONFIG(sharedmemory)
+class QTextToSpeechSharedMemorySinkPrivate : public QObjectPrivate
+{
+    Q_DECLARE_PUBLIC(QTextToSpeechSharedMemorySink)
+public:
+    explicit QTextToSpeechSharedMemorySinkPrivate(const QString &key);
+
+    QTextToSpeechSharedMemory::Header *header()
+    { return static_cast<QTextToSpeechSharedMemory::Header *>(memory.data()); }
+    const QTextToSpeechSharedMemory::Header *header() const
+    { return static_cast<const QTextToSpeechSharedMemory::Header *>(memory.constData()); }
+    quint64 bytesFree() const;
+
+    bool writeRecord(QTextToSpeechSharedMemory::RecordType type, const void *payload,
+                     qsizetype size, QByteArrayView data = {});
+    bool tryWriteRecord(QTextToSpeechSharedMemory::RecordType type, const void *payload,
+                        qsizetype size, QByteArrayView data, quint64 reserve);
+    bool flushEndOfText();
+    void startDrainTimer();
+
+    const QString key;
+    QSharedMemory memory;
+    QString errorString;
+    quint64 capacity = 0;
+    quint64 sequence = 0;
+    quint64 droppedRecords = 0;
+    // end-of-text records that wait for the reader to make room
+    quint64 pendingEndOfText = 0;
+    QAudioFormat format;
+    qint64 frameOffset = 0;
+    QBasicTimer drainTimer;
+};
+
+class QTextToSpeechSharedMemoryReaderPrivate
+{
+public:
+    explicit QTextToSpeechSharedMemoryReaderPrivate(const QString &key);
+
+    const QTextToSpeechSharedMemory::Header *header() const
+    { return static_cast<const QTextToSpeechSharedMemory::Header *>(memory.constData()); }
+    void releaseRecord();
+    bool isValidRecord(const QTextToSpeechSharedMemory::RecordHeader &recordHeader,
+                       quint64 available) const;
+    void resetRing(quint64 writePosition);
+
+    QSharedMemory memory;
+    QString errorString;
+    quint64 capacity = 0;
+    quint64 readPosition = 0;
+    quint64 nextSequence = 0;
+    quint64 lostRecords = 0;
+    QAudioFormat format;
+};
+#endif // QT_CONFIG(sharedmemory)
+
+QT_END_NAMESPACE
+
+#endif
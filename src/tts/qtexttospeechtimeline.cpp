@@ -0,0 +1,221 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include "qtexttospeechtimeline_p.h"
+
+#include <QtCore/qcoreapplication.h>
+#include <QtCore/qdebug.h>
+#include <QtCore/qelapsedtimer.h>
+#include <QtCore/qfile.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qjsonarray.h>
+#include <QtCore/qjsondocument.h>
+#include <QtCore/qjsonobject.h>
+#include <QtCore/qmath.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qthread.h>
+
+#include <memory>
+
+QT_BEGIN_NAMESPACE
+
+using namespace Qt::StringLiterals;
+
+namespace {
+// The fields are written and read with relaxed atomics, as a reader can
+// read them while the slot is overwritten; it detects that with the sequence.
+struct Event
+{
+    // index + 1 of the event once it is written, 0 while it is written
+    std::atomic<quint64> sequence = 0;
+    std::atomic<const char *> name = nullptr;
+    std::atomic<qint64> timestamp = 0;
+    std::atomic<qint64> id = 0;
+    std::atomic<qint64> value = 0;
+    std::atomic<quintptr> thread = 0;
+    std::atomic<QTextToSpeechTimeline::Phase> phase = QTextToSpeechTimeline::Phase::Instant;
+};
+
+struct Ring
+{
+    QMutex mutex;
+    std::unique_ptr<Event[]> storage;
+    std::atomic<Event *> events = nullptr;
+    quint64 mask = 0;
+    std::atomic<quint64> next = 0;
+    // events before this index were recorded before the last start()
+    std::atomic<quint64> first = 0;
+    QElapsedTimer clock;
+    QString fileName;
+    // not in the ring, so that they are never overwritten
+    QHash<quintptr, const char *> threadNames;
+};
+Q_GLOBAL_STATIC(Ring, ring)
+
+void saveOnExit()
+{
+    QTextToSpeechTimeline::stop();
+    QTextToSpeechTimeline::save(ring->fileName);
+}
+} // namespace
+
+std::atomic<bool> QTextToSpeechTimeline::s_recording = false;
+
+void QTextToSpeechTimeline::start(qsizetype capacity)
+{
+    Ring *r = ring();
+    QMutexLocker locker(&r->mutex);
+    if (!r->storage) {
+        const quint64 size = qNextPowerOfTwo(quint64(qMax(capacity, qsizetype(2)) - 1));
+        r->storage = std::make_unique<Event[]>(size);
+        r->mask = size - 1;
+        r->clock.start();
+        r->events.store(r->storage.get(), std::memory_order_release);
+    }
+    r->first.store(r->next.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    s_recording.store(true, std::memory_order_relaxed);
+}
+
+void QTextToSpeechTimeline::stop()
+{
+    s_recording.store(false, std::memory_order_relaxed);
+}
+
+void QTextToSpeechTimeline::startFromEnvironment()
+{
+    static const bool fromEnvironment = []{
+        const QString fileName = qEnvironmentVariable("QT_TEXTTOSPEECH_TIMELINE");
+        if (fileName.isEmpty())
+            return false;
+        ring->fileName = fileName;
+        start();
+        qAddPostRoutine(saveOnExit);
+        return true;
+    }();
+    Q_UNUSED(fromEnvironment);
+}
+
+void QTextToSpeechTimeline::nameThread(const char *name)
+{
+    thread_local const char *threadName = nullptr;
+    if (threadName == name)
+        return;
+    threadName = name;
+    Ring *r = ring();
+    QMutexLocker locker(&r->mutex);
+    r->threadNames.insert(quintptr(QThread::currentThreadId()), name);
+}
+
+void QTextToSpeechTimeline::recordEvent(Phase phase, const char *name, qint64 id, qint64 value)
+{
+    Ring *r = ring();
+    Event *events = r->events.load(std::memory_order_acquire);
+    if (!events)
+        return;
+
+    const quint64 index = r->next.fetch_add(1, std::memory_order_relaxed);
+    Event &event = events[index & r->mask];
+    event.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    event.name.store(name, std::memory_order_relaxed);
+    event.timestamp.store(r->clock.nsecsElapsed(), std::memory_order_relaxed);
+    event.id.store(id, std::memory_order_relaxed);
+    event.value.store(value, std::memory_order_relaxed);
+    event.thread.store(quintptr(QThread::currentThreadId()), std::memory_order_relaxed);
+    event.phase.store(phase, std::memory_order_relaxed);
+    event.sequence.store(index + 1, std::memory_order_release);
+}
+
+QByteArray QTextToSpeechTimeline::toJson()
+{
+    Ring *r = ring();
+    const Event *events = r->events.load(std::memory_order_acquire);
+    const quint64 end = r->next.load(std::memory_order_acquire);
+    const quint64 capacity = r->mask + 1;
+    const quint64 begin = events ? qMax(r->first.load(std::memory_order_relaxed),
+                                        end > capacity ? end - capacity : 0)
+                                 : end;
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    // Perfetto shows small thread ids in the order in which threads appear
+    QHash<quintptr, int> threads;
+    QJsonArray traceEvents;
+    for (quint64 index = begin; index < end; ++index) {
+        const Event &slot = events[index & r->mask];
+        const quint64 sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != index + 1)
+            continue;
+        const char *name = slot.name.load(std::memory_order_relaxed);
+        const qint64 timestamp = slot.timestamp.load(std::memory_order_relaxed);
+        const qint64 id = slot.id.load(std::memory_order_relaxed);
+        const qint64 value = slot.value.load(std::memory_order_relaxed);
+        const quintptr thread = slot.thread.load(std::memory_order_relaxed);
+        const Phase phase = slot.phase.load(std::memory_order_relaxed);
+        // skip events that got overwritten while we were reading them
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+            continue;
+
+        const auto tid = threads.constFind(thread);
+        const bool newThread = tid == threads.constEnd();
+        const int threadIndex = newThread ? int(threads.size()) + 1 : *tid;
+        if (newThread)
+            threads.insert(thread, threadIndex);
+
+        QJsonObject object{
+            {"pid"_L1, pid},
+            {"tid"_L1, threadIndex},
+            {"ph"_L1, QString(QLatin1Char(char(phase)))},
+        };
+        object.insert("name"_L1, QString::fromUtf8(name));
+        object.insert("cat"_L1, "texttospeech"_L1);
+        object.insert("ts"_L1, timestamp / 1000.0);
+        if (phase == Phase::AsyncBegin || phase == Phase::AsyncEnd)
+            object.insert("id"_L1, id);
+        else if (phase == Phase::Instant)
+            object.insert("s"_L1, "t"_L1);
+        if (phase != Phase::End && phase != Phase::AsyncEnd) {
+            QJsonObject args{{"value"_L1, value}};
+            if (id >= 0)
+                args.insert("text"_L1, id);
+            object.insert("args"_L1, args);
+        }
+        traceEvents.append(object);
+    }
+
+    // metadata for the threads that appear in the timeline
+    {
+        QMutexLocker locker(&r->mutex);
+        for (auto it = threads.cbegin(); it != threads.cend(); ++it) {
+            const char *name = r->threadNames.value(it.key());
+            if (!name)
+                continue;
+            traceEvents.append(QJsonObject{
+                {"pid"_L1, pid},
+                {"tid"_L1, it.value()},
+                {"ph"_L1, "M"_L1},
+                {"name"_L1, "thread_name"_L1},
+                {"args"_L1, QJsonObject{{"name"_L1, QString::fromUtf8(name)}}},
+            });
+        }
+    }
+
+    const QJsonObject trace{
+        {"traceEvents"_L1, traceEvents},
+        {"displayTimeUnit"_L1, "ms"_L1},
+    };
+    return QJsonDocument(trace).toJson(QJsonDocument::Compact);
+}
+
+bool QTextToSpeechTimeline::save(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Could not write the text-to-speech timeline to" << fileName
+                   << ":" << file.errorString();
+        return false;
+    }
+    return file.write(toJson()) >= 0;
+}
+
+QT_END_NAMESPACE
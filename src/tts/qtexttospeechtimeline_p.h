@@ -0,0 +1,73 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHTIMELINE_P_H
+#define QTEXTTOSPEECHTIMELINE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists for the convenience
+// of other Qt classes.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtTextToSpeech/qtexttospeech_global.h>
+
+#include <QtCore/qbytearray.h>
+#include <QtCore/qstring.h>
+
+#include <atomic>
+
+QT_BEGIN_NAMESPACE
+
+// Process-wide recorder of the spans and events of texts, from any thread,
+// written as Chrome trace_event JSON. The events are stored in a ring that is
+// allocated once by start(), so recording never allocates; when the ring is
+// full, the oldest events are overwritten. Names need to be string literals.
+class Q_TEXTTOSPEECH_EXPORT QTextToSpeechTimeline
+{
+public:
+    enum class Phase : char {
+        Begin = 'B',        // span on the calling thread
+        End = 'E',
+        AsyncBegin = 'b',   // span of the text identified by the id
+        AsyncEnd = 'e',
+        Instant = 'i',
+    };
+
+    static constexpr qsizetype DefaultCapacity = 64 * 1024;
+
+    static bool isRecording() { return s_recording.load(std::memory_order_relaxed); }
+    static void record(Phase phase, const char *name, qint64 id = -1, qint64 value = 0)
+    {
+        if (isRecording())
+            recordEvent(phase, name, id, value);
+    }
+    // names the calling thread in all timelines; only the first call in
+    // each thread, or with a different name, takes a lock
+    static void nameThread(const char *name);
+
+    // clears the ring; the capacity is rounded up to a power of two, and only
+    // applies to the first call
+    static void start(qsizetype capacity = DefaultCapacity);
+    static void stop();
+    // starts recording if QT_TEXTTOSPEECH_TIMELINE names the file to which
+    // the timeline is written when the application exits
+    static void startFromEnvironment();
+
+    static QByteArray toJson();
+    static bool save(const QString &fileName);
+
+private:
+    static void recordEvent(Phase phase, const char *name, qint64 id, qint64 value);
+
+    static std::atomic<bool> s_recording;
+};
+
+QT_END_NAMESPACE
+
+#endif
@@ -0,0 +1,220 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include "qtexttospeechtimestretch_p.h"
+#include "qtexttospeechaudiokernels_p.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+QT_BEGIN_NAMESPACE
+
+using namespace QTextToSpeechAudioKernels;
+
+namespace {
+// Segments of 30ms overlap by half, and are moved by up to 6ms to where they
+// continue the previous segment best, which is more than half the period of
+// a typical speaking voice.
+constexpr int HopMs = 15;
+constexpr int SeekMs = 6;
+
+// Drops the consumed samples at the front of a buffer once they make up half
+// of it, so that moving the rest costs no more than consuming them did.
+void compact(QList<float> &buffer, qsizetype &consumed)
+{
+    if (consumed && consumed * 2 >= buffer.size()) {
+        buffer.remove(0, consumed);
+        consumed = 0;
+    }
+}
+} // namespace
+
+void QTextToSpeechTimeStretch::reset(int sampleRate, int channelCount)
+{
+    m_channelCount = qMax(1, channelCount);
+    m_hop = qMax(1, sampleRate * HopMs / 1000);
+    m_seek = qMax(1, sampleRate * SeekMs / 1000);
+    m_window.resize(m_hop);
+    for (qsizetype i = 0; i < m_hop; ++i)
+        m_window[i] = 0.5f - 0.5f * std::cos(float(M_PI) * float(i) / float(m_hop));
+
+    m_input.clear();
+    m_inputOffset = 0;
+    m_inputStart = 0;
+    m_inputEnd = 0;
+    m_position = 0;
+    m_previousStart = -1;
+    m_overlap.assign(m_hop * m_channelCount, 0.0f);
+    m_output.clear();
+    m_outputRead = 0;
+    m_outputFrames = 0;
+    m_checkpoints = {Checkpoint{0, 0, m_tempo}};
+}
+
+void QTextToSpeechTimeStretch::setTempo(double tempo)
+{
+    tempo = std::clamp(tempo, MinimumTempo, MaximumTempo);
+    if (tempo == m_tempo)
+        return;
+    m_tempo = tempo;
+
+    // the audio up to the next segment has been stretched with the old tempo
+    const Checkpoint checkpoint{qint64(m_position), m_outputFrames, tempo};
+    if (!m_checkpoints.isEmpty() && m_checkpoints.constLast().input == checkpoint.input)
+        m_checkpoints.last() = checkpoint;
+    else
+        m_checkpoints.append(checkpoint);
+}
+
+void QTextToSpeechTimeStretch::write(const short *samples, qsizetype count)
+{
+    const qsizetype frames = count / m_channelCount;
+    if (frames <= 0)
+        return;
+    compact(m_input, m_inputOffset);
+    const qsizetype offset = m_input.size();
+    m_input.resize(offset + frames * m_channelCount);
+    int16ToFloat(samples, m_input.data() + offset, frames * m_channelCount);
+    m_inputEnd += frames;
+}
+
+void QTextToSpeechTimeStretch::flush()
+{
+    const qint64 end = m_inputEnd;
+    if (qint64(m_position) < end) {
+        // silence lets the last segments be taken from the written audio
+        const qsizetype padding = m_seek + 2 * m_hop;
+        m_input.resize(m_input.size() + padding * m_channelCount, 0.0f);
+        m_inputEnd += padding;
+        while (qint64(m_position) < end && stretchSegment())
+            ;
+    }
+    if (m_previousStart >= 0) {
+        m_output.append(m_overlap);
+        m_outputFrames += m_hop;
+    }
+
+    m_input.clear();
+    m_inputOffset = 0;
+    m_inputStart = end;
+    m_inputEnd = end;
+    m_position = double(end);
+    m_previousStart = -1;
+    m_checkpoints.append(Checkpoint{end, m_outputFrames, m_tempo});
+}
+
+qsizetype QTextToSpeechTimeStretch::read(short *out, qsizetype maximum)
+{
+    const qsizetype wanted = maximum - maximum % m_channelCount;
+    while (m_output.size() - m_outputRead < wanted && stretchSegment())
+        ;
+    const qsizetype count = qMin(wanted, m_output.size() - m_outputRead);
+    floatToInt16(m_output.constData() + m_outputRead, out, count);
+    m_outputRead += count;
+    compact(m_output, m_outputRead);
+    return count;
+}
+
+bool QTextToSpeechTimeStretch::isEmpty() const
+{
+    return m_output.size() == m_outputRead && qint64(m_position) >= m_inputEnd;
+}
+
+qint64 QTextToSpeechTimeStretch::outputPosition(qint64 inputPosition) const
+{
+    const qint64 frame = inputPosition / m_channelCount;
+    for (auto it = m_checkpoints.crbegin(); it != m_checkpoints.crend(); ++it) {
+        if (it->input <= frame)
+            return (it->output + qRound64((frame - it->input) / it->tempo)) * m_channelCount;
+    }
+    return inputPosition;
+}
+
+void QTextToSpeechTimeStretch::discardBefore(qint64 inputPosition)
+{
+    // keep the checkpoint that the position itself maps through
+    const qint64 frame = inputPosition / m_channelCount;
+    qsizetype count = 0;
+    while (count + 1 < m_checkpoints.size() && m_checkpoints.at(count + 1).input <= frame)
+        ++count;
+    m_checkpoints.remove(0, count);
+}
+
+/*
+    Cross-fades the next segment of the input into the output, and advances
+    the nominal position by the hop size times the tempo. Returns false if
+    not enough input has been written for the segment and its search range.
+*/
+bool QTextToSpeechTimeStretch::stretchSegment()
+{
+    const qint64 nominal = qint64(m_position);
+    if (nominal + m_seek + 2 * m_hop > m_inputEnd)
+        return false;
+
+    // at a tempo of 1, the segment continues the previous one exactly
+    const qint64 start = m_previousStart < 0 || nominal == m_previousStart + m_hop
+                       ? nominal : bestMatch(nominal);
+    const qsizetype length = m_hop * m_channelCount;
+    const float *segment = input(start);
+    const qsizetype offset = m_output.size();
+    m_output.resize(offset + length);
+    float *out = m_output.data() + offset;
+    if (m_previousStart < 0) {
+        std::copy_n(segment, length, out);
+    } else {
+        for (qsizetype i = 0; i < length; ++i)
+            out[i] = m_overlap[i] + segment[i] * m_window[i / m_channelCount];
+    }
+    for (qsizetype i = 0; i < length; ++i)
+        m_overlap[i] = segment[length + i] * (1.0f - m_window[i / m_channelCount]);
+
+    m_previousStart = start;
+    m_position += m_hop * m_tempo;
+    m_outputFrames += m_hop;
+
+    // keep what the next segment compares with, and its search range
+    const qint64 keepFrom = qMin(m_previousStart + m_hop, qint64(m_position) - m_seek);
+    if (keepFrom > m_inputStart) {
+        m_inputOffset += (keepFrom - m_inputStart) * m_channelCount;
+        m_inputStart = keepFrom;
+    }
+    return true;
+}
+
+/*
+    Returns the start of the segment within the search range around
+    \a nominal that is most similar to the natural continuation of the
+    previous segment, by normalized cross-correlation.
+*/
+qint64 QTextToSpeechTimeStretch::bestMatch(qint64 nominal) const
+{
+    const qsizetype length = m_hop * m_channelCount;
+    const float *target = input(m_previousStart + m_hop);
+    const auto score = [&](qint64 start, float energy) {
+        return dotProduct(target, input(start), length)
+             / std::sqrt(qMax(energy, std::numeric_limits<float>::min()));
+    };
+
+    // prefer the nominal position, which keeps the tempo exact
+    qint64 best = nominal;
+    float bestScore = score(nominal, sumOfSquares(input(nominal), length));
+    const qint64 first = qMax(nominal - m_seek, m_inputStart);
+    float energy = sumOfSquares(input(first), length);
+    for (qint64 start = first; start <= nominal + m_seek; ++start) {
+        if (start > first) {
+            const float *leaving = input(start - 1);
+            const float *entering = input(start - 1 + m_hop);
+            for (int channel = 0; channel < m_channelCount; ++channel)
+                energy += entering[channel] * entering[channel] - leaving[channel] * leaving[channel];
+        }
+        const float candidate = score(start, energy);
+        if (candidate > bestScore) {
+            bestScore = candidate;
+            best = start;
+        }
+    }
+    return best;
+}
+
+QT_END_NAMESPACE
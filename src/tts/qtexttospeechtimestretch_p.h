@@ -0,0 +1,95 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#ifndef QTEXTTOSPEECHTIMESTRETCH_P_H
+#define QTEXTTOSPEECHTIMESTRETCH_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the Qt API.  It exists for the convenience
+// of other Qt classes.  This header file may change from version to
+// version without notice, or even be removed.
+//
+// We mean it.
+//
+
+#include <QtTextToSpeech/qtexttospeech_global.h>
+
+#include <QtCore/qlist.h>
+
+QT_BEGIN_NAMESPACE
+
+// Changes the tempo of interleaved Int16 audio without changing its pitch,
+// using waveform-similarity overlap-add (WSOLA). The written audio is only
+// stretched when it is read, so engines that play audio themselves can keep
+// the synthesized audio here and apply tempo changes to it while it plays.
+// Positions are counted in samples, like the written data.
+class Q_TEXTTOSPEECH_EXPORT QTextToSpeechTimeStretch
+{
+public:
+    static constexpr double MinimumTempo = 0.25;
+    static constexpr double MaximumTempo = 4.0;
+
+    QTextToSpeechTimeStretch() = default;
+
+    // drops all audio and starts a new stream
+    void reset(int sampleRate, int channelCount);
+
+    // values above 1 make the audio faster; applies to the audio read next
+    void setTempo(double tempo);
+    double tempo() const { return m_tempo; }
+
+    void write(const short *samples, qsizetype count);
+    // stretches all written audio, so that it can be read completely; the
+    // next write starts a new segment of the stream
+    void flush();
+    // returns the number of samples written to out
+    qsizetype read(short *out, qsizetype maximum);
+    // whether everything that was written has been read
+    bool isEmpty() const;
+
+    // the position in the stretched stream of the given written position
+    qint64 outputPosition(qint64 inputPosition) const;
+    // forgets how the positions before the given written position map, as
+    // outputPosition() won't be asked for them anymore
+    void discardBefore(qint64 inputPosition);
+
+private:
+    Q_DISABLE_COPY(QTextToSpeechTimeStretch)
+
+    bool stretchSegment();
+    qint64 bestMatch(qint64 nominal) const;
+    const float *input(qint64 frame) const
+    { return m_input.constData() + m_inputOffset + (frame - m_inputStart) * m_channelCount; }
+
+    struct Checkpoint {
+        qint64 input;
+        qint64 output;
+        double tempo;
+    };
+
+    int m_channelCount = 1;
+    qsizetype m_hop = 1; // frames, half the window length
+    qsizetype m_seek = 1; // frames searched around the nominal position
+    double m_tempo = 1;
+    QList<float> m_window; // rising half of a Hann window
+
+    QList<float> m_input; // frames from m_inputStart to m_inputEnd, after m_inputOffset
+    qsizetype m_inputOffset = 0; // samples that are no longer needed
+    qint64 m_inputStart = 0;
+    qint64 m_inputEnd = 0;
+    double m_position = 0; // nominal start of the next segment, in frames
+    qint64 m_previousStart = -1; // start of the previous segment, if any
+    QList<float> m_overlap; // faded-out second half of the previous segment
+    QList<float> m_output; // stretched, not read yet after m_outputRead
+    qsizetype m_outputRead = 0;
+    qint64 m_outputFrames = 0;
+    // where the tempo changed, for mapping positions
+    QList<Checkpoint> m_checkpoints;
+};
+
+QT_END_NAMESPACE
+
+#endif
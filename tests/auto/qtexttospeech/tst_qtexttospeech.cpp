@@ -11,6 +11,21 @@
 #include <QAudioBuffer>
 #include <QOperatingSystemVersion>
 #include <QRegularExpression>
+#include <QTemporaryDir>
+#include <QBuffer>
+#include <QDeadlineTimer>
+#include <QFile>
+#include <QFuture>
+#include <QtEndian>
+#if QT_CONFIG(sharedmemory)
+#include <QSharedMemory>
+#include <QTextToSpeechSharedMemorySink>
+#include <QtTextToSpeech/private/qtexttospeechsharedmemory_p.h>
+#endif
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtTextToSpeech/private/qtexttospeechtimeline_p.h>
 #include <qttexttospeech-config.h>
 
 #if QT_CONFIG(speechd)
@@ -20,6 +35,8 @@
     #endif
 #endif
 
+#include <limits>
+
 using namespace Qt::StringLiterals;
 
 enum : int { SpeechDuration = 20000 };
@@ -57,17 +74,43 @@ private slots:
     void pauseAtUtterance_data();
     void pauseAtUtterance();
 
+    void sayGapless_data();
+    void sayGapless();
+
     void sayingWord_data();
     void sayingWord();
 
     void sayingWordWithPause_data();
     void sayingWordWithPause();
+    void wordTimeline();
+    void synthesizeWordTimeline();
+    void phonemeEvents();
 
     void synthesize_data();
     void synthesize();
 
     void synthesizeCallback_data();
     void synthesizeCallback();
+    void synthesizeWhileSynthesizing();
+
+    void synthesizeToFile_data();
+    void synthesizeToFile();
+    void synthesizeCaptions_data();
+    void synthesizeCaptions();
+    void synthesizeCaptionsNormalized();
+
+    void synthesizeToDevice();
+    void synthesizeWhileThrottled();
+#if QT_CONFIG(sharedmemory)
+    void synthesizeToSharedMemory();
+    void sharedMemoryEndOfText();
+    void sharedMemoryCorrupt();
+#endif
+    void synthesizeSynthetic();
+    void syntheticJitter();
+    void timeline();
+
+    void audioFilters();
 
 public:
     using Selector = QList<QVoice>(*)(const QTextToSpeech *);
@@ -168,6 +211,10 @@ void tst_QTextToSpeech::init()
     QFETCH_GLOBAL(QString, engine);
     if (engine == "speechd") {
         QTextToSpeech tts(engine);
+        // the engine connects in the background, and selects the voice for
+        // the default locale once it is connected, or reports the failure
+        QSignalSpy errorSpy(&tts, &QTextToSpeech::errorOccurred);
+        QTRY_VERIFY(tts.voice() != QVoice() || errorSpy.count());
         if (tts.state() == QTextToSpeech::Error) {
             QSKIP("speechd engine reported an error, "
                   "make sure the speech-dispatcher service is running!");
@@ -763,6 +810,49 @@ void tst_QTextToSpeech::pauseAtUtterance()
         qInfo("Skipping test of spoken words");
 }
 
+void tst_QTextToSpeech::sayGapless_data()
+{
+    QTest::addColumn<bool>("restart");
+    QTest::addRow("appended") << false;
+    QTest::addRow("restarted") << true;
+}
+
+void tst_QTextToSpeech::sayGapless()
+{
+    QFETCH_GLOBAL(QString, engine);
+    if (engine != "mock")
+        QSKIP("Only the mock engine supports gapless playback without audio output");
+    QFETCH(bool, restart);
+
+    const QStringList textList{"one two", "three four", "five"};
+
+    QTextToSpeech tts(engine, {{"gapless", true}, {"gaplessRestart", restart}});
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+
+    QList<QTextToSpeech::State> states;
+    connect(&tts, &QTextToSpeech::stateChanged, this, [&states](QTextToSpeech::State state){
+        states << state;
+    });
+    QSignalSpy aboutToSynthesizeSpy(&tts, &QTextToSpeech::aboutToSynthesize);
+    QStringList wordsSpoken;
+    connect(&tts, &QTextToSpeech::sayingWord, this,
+            [&](const QString &word, qsizetype id, qsizetype at, qsizetype length){
+        QCOMPARE_LT(id, textList.size());
+        QCOMPARE(textList.at(id).mid(at, length), word);
+        wordsSpoken += word;
+    });
+
+    for (qsizetype i = 0; i < textList.count(); ++i)
+        QCOMPARE(tts.enqueue(textList.at(i)), i);
+
+    QList<QTextToSpeech::State> expectedStates;
+    for (qsizetype i = 0; i < (restart ? textList.size() : 1); ++i)
+        expectedStates << QTextToSpeech::Speaking << QTextToSpeech::Ready;
+    QTRY_COMPARE(states, expectedStates);
+    QCOMPARE(aboutToSynthesizeSpy.count(), textList.size());
+    QCOMPARE(wordsSpoken, textList.join(u' ').split(u' '));
+}
+
 void tst_QTextToSpeech::sayingWord_data()
 {
     QTest::addColumn<QString>("text");
@@ -891,6 +981,147 @@ void tst_QTextToSpeech::sayingWordWithPause()
     debugHelper.dismiss();
 }
 
+void tst_QTextToSpeech::wordTimeline()
+{
+    QFETCH_GLOBAL(QString, engine);
+    if (engine != "mock")
+        QSKIP("Only testing with mock engine");
+
+    QTextToSpeech tts(engine);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QCOMPARE(tts.playbackPosition(), qint64(-1));
+
+    QList<qsizetype> timelineIds;
+    QList<QList<QTextToSpeech::WordBoundary>> timelines;
+    connect(&tts, &QTextToSpeech::wordTimeline, this,
+            [&](qsizetype id, const QList<QTextToSpeech::WordBoundary> &words){
+        timelineIds << id;
+        timelines << words;
+    });
+    QList<qsizetype> wordIds;
+    qint64 positionOfSecondWord = -1;
+    connect(&tts, &QTextToSpeech::sayingWord, this,
+            [&](const QString &, qsizetype id, qsizetype, qsizetype){
+        if (wordIds.size() == 1)
+            positionOfSecondWord = tts.playbackPosition();
+        wordIds << id;
+    });
+
+    const qsizetype firstId = tts.enqueue(u"one two"_s);
+    const qsizetype secondId = tts.enqueue(u"three"_s);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+
+    QCOMPARE(wordIds.size(), 3);
+    QCOMPARE(timelineIds, (QList<qsizetype>{wordIds.first(), wordIds.last()}));
+    QCOMPARE(timelineIds.last() - timelineIds.first(), secondId - firstId);
+    QCOMPARE(timelines.size(), 2);
+    QCOMPARE(timelines.first().size(), 2);
+    QCOMPARE(timelines.first().at(0).start, qsizetype(0));
+    QCOMPARE(timelines.first().at(0).length, qsizetype(3));
+    QCOMPARE(timelines.first().at(0).time, qint64(0));
+    QCOMPARE(timelines.first().at(1).start, qsizetype(4));
+    QCOMPARE(timelines.first().at(1).length, qsizetype(3));
+    // the mock engine speaks each word for 100ms at the default rate
+    QCOMPARE(timelines.first().at(1).time, qint64(100));
+    QCOMPARE(timelines.last().size(), 1);
+    QCOMPARE(timelines.last().at(0).start, qsizetype(0));
+    QCOMPARE(timelines.last().at(0).length, qsizetype(5));
+
+    QCOMPARE_GE(positionOfSecondWord, timelines.first().at(1).time);
+    QCOMPARE(tts.playbackPosition(), qint64(-1));
+}
+
+void tst_QTextToSpeech::synthesizeWordTimeline()
+{
+    QFETCH_GLOBAL(QString, engine);
+    if (engine != "mock")
+        QSKIP("Only testing with mock engine");
+
+    // the synthetic mode produces the audio faster than real time
+    QTextToSpeech tts(engine, {{u"synthetic"_s, true}});
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+
+    QList<QTextToSpeech::WordBoundary> words;
+    QTextToSpeech::State stateAtTimeline = QTextToSpeech::Error;
+    connect(&tts, &QTextToSpeech::wordTimeline, this,
+            [&](qsizetype, const QList<QTextToSpeech::WordBoundary> &timeline){
+        words = timeline;
+        stateAtTimeline = tts.state();
+    });
+
+    QAudioFormat format;
+    QByteArray data;
+    tts.synthesize(u"one two three"_s, [&](const QAudioFormat &f, const QByteArray &bytes){
+        format = f;
+        data += bytes;
+    });
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+
+    QCOMPARE(stateAtTimeline, QTextToSpeech::Synthesizing);
+    QCOMPARE(words.size(), 3);
+    QVERIFY(format.isValid());
+    // each word has the same number of frames in the mock engine
+    const qint64 framesPerWord = format.framesForBytes(data.size()) / words.size();
+    QCOMPARE_GT(framesPerWord, 0);
+    for (qsizetype i = 0; i < words.size(); ++i) {
+        QCOMPARE(words.at(i).frame, i * framesPerWord);
+        QCOMPARE(words.at(i).time, format.durationForFrames(words.at(i).frame) / 1000);
+    }
+    QCOMPARE(words.at(2).start, qsizetype(8));
+    QCOMPARE(words.at(2).length, qsizetype(5));
+}
+
+void tst_QTextToSpeech::phonemeEvents()
+{
+    QFETCH_GLOBAL(QString, engine);
+    if (engine != "mock")
+        QSKIP("Only testing with mock engine");
+
+    QTextToSpeech tts(engine, {{u"synthetic"_s, true}});
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QVERIFY(tts.engineCapabilities() & QTextToSpeech::Capability::PhonemeEvents);
+
+    const QHash<QString, int> visemes{{u"o"_s, 1}, {u"e"_s, 2}};
+    tts.setVisemeTable(visemes);
+    QCOMPARE(tts.visemeTable(), visemes);
+
+    QList<qsizetype> ids;
+    qsizetype batches = 0;
+    QList<QTextToSpeech::Phoneme> phonemes;
+    connect(&tts, &QTextToSpeech::phonemeEvents, this,
+            [&](qsizetype id, const QList<QTextToSpeech::Phoneme> &batch){
+        ids << id;
+        ++batches;
+        phonemes << batch;
+    });
+
+    QAudioFormat format;
+    QByteArray data;
+    tts.synthesize(u"one two"_s, [&](const QAudioFormat &f, const QByteArray &bytes){
+        format = f;
+        data += bytes;
+    });
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+
+    // the mock engine reports a phoneme for each letter, in a batch per word
+    QCOMPARE(batches, 2);
+    QCOMPARE(ids.first(), ids.last());
+    QStringList names;
+    QList<int> phonemeVisemes;
+    for (const QTextToSpeech::Phoneme &phoneme : std::as_const(phonemes)) {
+        names << phoneme.name;
+        phonemeVisemes << phoneme.viseme;
+    }
+    QCOMPARE(names, (QStringList{u"o"_s, u"n"_s, u"e"_s, u"t"_s, u"w"_s, u"o"_s}));
+    QCOMPARE(phonemeVisemes, (QList<int>{1, -1, 2, -1, -1, 1}));
+
+    const qint64 framesPerWord = format.framesForBytes(data.size()) / 2;
+    QCOMPARE(phonemes.at(0).frame, qint64(0));
+    QCOMPARE(phonemes.at(1).frame, phonemes.at(0).duration);
+    QCOMPARE(phonemes.at(3).frame, framesPerWord);
+    QCOMPARE(phonemes.at(3).duration, framesPerWord / 3);
+}
+
 void tst_QTextToSpeech::synthesize_data()
 {
     QTest::addColumn<QString>("text");
@@ -1072,5 +1303,685 @@ void tst_QTextToSpeech::synthesizeCallback()
     processor.reset();
 }
 
+void tst_QTextToSpeech::synthesizeWhileSynthesizing()
+{
+    QFETCH_GLOBAL(QString, engine);
+    if (engine != "mock")
+        QSKIP("Queuing is engine independent, only testing once");
+
+    QTextToSpeech tts(engine);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    const QString text = u"one two three four five"_s;
+    QByteArray expected;
+    tts.synthesize(text, [&expected](const QAudioFormat &, const QByteArray &bytes) {
+        expected += bytes;
+    });
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QVERIFY(!expected.isEmpty());
+
+    // the rest of the first text doesn't go to the receiver of the second
+    QByteArray first;
+    QByteArray second;
+    tts.synthesize(text, [&first](const QAudioFormat &, const QByteArray &bytes) {
+        first += bytes;
+    });
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Synthesizing);
+    tts.synthesize(text, [&second](const QAudioFormat &, const QByteArray &bytes) {
+        second += bytes;
+    });
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QCOMPARE(first, expected);
+    QCOMPARE(second, expected);
+}
+
+void tst_QTextToSpeech::synthesizeToFile_data()
+{
+    QTest::addColumn<QTextToSpeech::FileFormat>("fileFormat");
+
+    QTest::addRow("wav") << QTextToSpeech::FileFormat::Wav;
+    QTest::addRow("flac") << QTextToSpeech::FileFormat::Flac;
+}
+
+void tst_QTextToSpeech::synthesizeToFile()
+{
+    QFETCH_GLOBAL(QString, engine);
+    if (engine != "mock")
+        QSKIP("Only testing with mock engine");
+
+    QFETCH(QTextToSpeech::FileFormat, fileFormat);
+
+    QTextToSpeech tts(engine);
+    QVERIFY(tts.engineCapabilities() & QTextToSpeech::Capability::Synthesize);
+
+    const QString text = u"this will produce more than one chunk."_s;
+    QAudioFormat expectedFormat;
+    QByteArray expectedBytes;
+    tts.synthesize(text, [&expectedFormat, &expectedBytes]
+                         (const QAudioFormat &format, const QByteArray &bytes) {
+        expectedFormat = format;
+        expectedBytes += bytes;
+    });
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QVERIFY(expectedFormat.isValid());
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.filePath(u"output"_s);
+
+    QFuture<bool> result = tts.synthesizeToFile(text, fileName, fileFormat);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QTRY_VERIFY(result.isFinished());
+    QVERIFY(result.result());
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QByteArray content = file.readAll();
+    const qint64 frameCount = expectedFormat.framesForBytes(expectedBytes.size());
+
+    switch (fileFormat) {
+    case QTextToSpeech::FileFormat::Wav: {
+        QCOMPARE(content.size(), 44 + expectedBytes.size());
+        QCOMPARE(content.first(4), QByteArray("RIFF"));
+        QCOMPARE(content.sliced(8, 4), QByteArray("WAVE"));
+        QCOMPARE(qFromLittleEndian<quint32>(content.constData() + 4), quint32(content.size() - 8));
+        QCOMPARE(qFromLittleEndian<quint16>(content.constData() + 22),
+                 quint16(expectedFormat.channelCount()));
+        QCOMPARE(qFromLittleEndian<quint32>(content.constData() + 24),
+                 quint32(expectedFormat.sampleRate()));
+        QCOMPARE(qFromLittleEndian<quint32>(content.constData() + 40),
+                 quint32(expectedBytes.size()));
+        QCOMPARE(content.sliced(44), expectedBytes);
+        break;
+    }
+    case QTextToSpeech::FileFormat::Flac: {
+        QCOMPARE(content.first(4), QByteArray("fLaC"));
+        const quint64 streamInfo = qFromBigEndian<quint64>(content.constData() + 18);
+        QCOMPARE(streamInfo >> 44, quint64(expectedFormat.sampleRate()));
+        QCOMPARE(((streamInfo >> 41) & 0x7) + 1, quint64(expectedFormat.channelCount()));
+        QCOMPARE(((streamInfo >> 36) & 0x1f) + 1, quint64(expectedFormat.bytesPerSample() * 8));
+        QCOMPARE(streamInfo & Q_UINT64_C(0xfffffffff), quint64(frameCount));
+        // each verbatim frame adds header and checksum to the data
+        QCOMPARE_GT(content.size(), 42 + expectedBytes.size());
+        break;
+    }
+    }
+
+    // stopping discards the file
+    file.close();
+    QVERIFY(QFile::remove(fileName));
+    result = tts.synthesizeToFile(text, fileName, fileFormat);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Synthesizing);
+    tts.stop(QTextToSpeech::BoundaryHint::Immediate);
+    QTRY_VERIFY(result.isFinished());
+    QVERIFY(!result.result());
+    QVERIFY(!QFile::exists(fileName));
+}
+
+void tst_QTextToSpeech::synthesizeCaptions_data()
+{
+    QTest::addColumn<QTextToSpeech::CaptionFormat>("captionFormat");
+    QTest::addColumn<QByteArray>("expected");
+
+    // the mock engine speaks each word for 100ms at the default rate
+    QTest::addRow("webvtt") << QTextToSpeech::CaptionFormat::WebVtt
+                            << QByteArray("WEBVTT\n\n"
+                                          "00:00:00.000 --> 00:00:00.200\n"
+                                          "one two,\n\n"
+                                          "00:00:00.200 --> 00:00:00.300\n"
+                                          "three &lt;\n\n"
+                                          "00:00:00.300 --> 00:00:00.400\n"
+                                          "four.\n\n");
+    QTest::addRow("srt") << QTextToSpeech::CaptionFormat::Srt
+                         << QByteArray("1\n"
+                                       "00:00:00,000 --> 00:00:00,200\n"
+                                       "one two,\n\n"
+                                       "2\n"
+                                       "00:00:00,200 --> 00:00:00,300\n"
+                                       "three <\n\n"
+                                       "3\n"
+                                       "00:00:00,300 --> 00:00:00,400\n"
+                                       "four.\n\n");
+}
+
+void tst_QTextToSpeech::synthesizeCaptions()
+{
+    QFETCH_GLOBAL(QString, engine);
+    if (engine != "mock")
+        QSKIP("Only testing with mock engine");
+
+    QFETCH(QTextToSpeech::CaptionFormat, captionFormat);
+    QFETCH(QByteArray, expected);
+
+    QTextToSpeech tts(engine, {{u"synthetic"_s, true}});
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.filePath(u"output.wav"_s);
+    const QString captionFileName = dir.filePath(u"output.captions"_s);
+
+    QTextToSpeech::CaptionOptions options;
+    options.format = captionFormat;
+    options.maximumCueLength = 8;
+    QFuture<bool> result = tts.synthesizeToFile(u"one two, three < four."_s, fileName,
+                                                captionFileName, options);
+    QTRY_VERIFY(result.isFinished());
+    QVERIFY(result.result());
+    QVERIFY(QFile::exists(fileName));
+
+    QFile captions(captionFileName);
+    QVERIFY(captions.open(QIODevice::ReadOnly));
+    QCOMPARE(captions.readAll(), expected);
+    captions.close();
+
+    // a duration limit splits the cues as well
+    options.maximumCueLength = 100;
+    options.maximumCueDuration = 250;
+    result = tts.synthesizeToFile(u"one two three four"_s, fileName, captionFileName, options);
+    QTRY_VERIFY(result.isFinished());
+    QVERIFY(result.result());
+    QVERIFY(captions.open(QIODevice::ReadOnly));
+    const QByteArray content = captions.readAll();
+    QCOMPARE(content.count("-->"), 2);
+    QVERIFY(content.contains("one two\n"));
+    QVERIFY(content.contains("three four\n"));
+}
+
+void tst_QTextToSpeech::synthesizeCaptionsNormalized()
+{
+    QFETCH_GLOBAL(QString, engine);
+    if (engine != "flite")
+        QSKIP("Only flite reports the words of normalized text");
+
+    QTextToSpeech tts(engine);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.filePath(u"output.wav"_s);
+    const QString captionFileName = dir.filePath(u"output.srt"_s);
+
+    // flite speaks more words than the text has, with positions of tokens or -1
+    const QString text = u"Dr. Smith paid $1,250 for 3 tickets on Jan. 21st, 2023."_s;
+    QTextToSpeech::CaptionOptions options;
+    options.format = QTextToSpeech::CaptionFormat::Srt;
+    options.maximumCueLength = 10;
+    QFuture<bool> result = tts.synthesizeToFile(text, fileName, captionFileName, options);
+    QTRY_VERIFY_WITH_TIMEOUT(result.isFinished(), SpeechDuration);
+    QVERIFY(result.result());
+
+    QFile captions(captionFileName);
+    QVERIFY(captions.open(QIODevice::ReadOnly));
+    // each cue is a number, the timestamps, the text, and an empty line
+    const QList<QByteArray> lines = captions.readAll().split('\n');
+    QStringList texts;
+    QByteArray lastTimestamps;
+    for (qsizetype i = 0; i + 2 < lines.size(); i += 4) {
+        QCOMPARE(lines.at(i).toInt(), int(texts.size()) + 1);
+        QVERIFY(lines.at(i + 1).contains(" --> "));
+        QCOMPARE_GE(lines.at(i + 1), lastTimestamps);
+        lastTimestamps = lines.at(i + 1);
+        QVERIFY(!lines.at(i + 2).isEmpty());
+        texts << QString::fromUtf8(lines.at(i + 2));
+    }
+    QVERIFY(!texts.isEmpty());
+    // every part of the text appears once, in order
+    QVERIFY2(text.endsWith(texts.join(u' ')), qPrintable(texts.join(u'|')));
+}
+
+void tst_QTextToSpeech::synthesizeToDevice()
+{
+    QFETCH_GLOBAL(QString, engine);
+    if (engine != "mock")
+        QSKIP("Only testing with mock engine");
+
+    QTextToSpeech tts(engine);
+    QVERIFY(tts.engineCapabilities() & QTextToSpeech::Capability::Synthesize);
+
+    const QString text = u"this will produce more than one chunk."_s;
+    QByteArray expectedBytes;
+    tts.synthesize(text, [&expectedBytes](const QAudioFormat &, const QByteArray &bytes) {
+        expectedBytes += bytes;
+    });
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+
+    QBuffer buffer;
+    QVERIFY(buffer.open(QIODevice::WriteOnly));
+    tts.synthesize(text, &buffer);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QCOMPARE(buffer.data(), expectedBytes);
+
+    // a device that only makes progress when we tell it to
+    class SlowDevice : public QIODevice
+    {
+    public:
+        qint64 bytesToWrite() const override { return pending; }
+        void drain()
+        {
+            const qint64 written = std::exchange(pending, 0);
+            emit bytesWritten(written);
+        }
+
+        QByteArray data;
+        qint64 pending = 0;
+    protected:
+        qint64 readData(char *, qint64) override { return -1; }
+        qint64 writeData(const char *bytes, qint64 length) override
+        {
+            data.append(bytes, length);
+            pending += length;
+            return length;
+        }
+    } device;
+    QVERIFY(device.open(QIODevice::WriteOnly));
+    device.pending = 1024 * 1024;
+
+    tts.synthesize(text, &device);
+    QTRY_VERIFY(!device.data.isEmpty());
+    const qsizetype throttledSize = device.data.size();
+    QTest::qWait(500);
+    QCOMPARE(device.data.size(), throttledSize);
+    QCOMPARE(tts.state(), QTextToSpeech::Synthesizing);
+
+    device.drain();
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QCOMPARE(device.data, expectedBytes);
+}
+
+void tst_QTextToSpeech::synthesizeWhileThrottled()
+{
+    QFETCH_GLOBAL(QString, engine);
+    if (engine != "espeakng")
+        QSKIP("Only the espeakng engine shares its library between instances");
+
+    QTextToSpeech throttledTts(engine);
+    QTextToSpeech tts(engine);
+    QTRY_COMPARE(throttledTts.state(), QTextToSpeech::Ready);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+
+    const QString text = u"This text produces more audio than a consumer can take at once."_s;
+    QByteArray expectedBytes;
+    tts.synthesize(text, [&expectedBytes](const QAudioFormat &, const QByteArray &bytes) {
+        expectedBytes += bytes;
+    });
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QVERIFY(!expectedBytes.isEmpty());
+
+    // a device that doesn't make progress until we tell it to
+    class BlockedDevice : public QIODevice
+    {
+    public:
+        qint64 bytesToWrite() const override { return pending; }
+        void unblock()
+        {
+            blocked = false;
+            emit bytesWritten(std::exchange(pending, 0));
+        }
+
+        QByteArray data;
+        qint64 pending = 0;
+        bool blocked = true;
+    protected:
+        qint64 readData(char *, qint64) override { return -1; }
+        qint64 writeData(const char *bytes, qint64 length) override
+        {
+            data.append(bytes, length);
+            if (blocked)
+                pending += length;
+            return length;
+        }
+    } device;
+    QVERIFY(device.open(QIODevice::WriteOnly));
+    device.pending = 1024 * 1024;
+
+    throttledTts.synthesize(text, &device);
+    QTRY_VERIFY(!device.data.isEmpty());
+    QCOMPARE(throttledTts.state(), QTextToSpeech::Synthesizing);
+
+    // the throttled instance doesn't keep the other one from synthesizing
+    QByteArray bytes;
+    tts.synthesize(text, [&bytes](const QAudioFormat &, const QByteArray &data) {
+        bytes += data;
+    });
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QCOMPARE(bytes, expectedBytes);
+    QCOMPARE(throttledTts.state(), QTextToSpeech::Synthesizing);
+
+    device.unblock();
+    QTRY_COMPARE(throttledTts.state(), QTextToSpeech::Ready);
+    QCOMPARE(device.data, expectedBytes);
+}
+
+#if QT_CONFIG(sharedmemory)
+void tst_QTextToSpeech::synthesizeToSharedMemory()
+{
+    QFETCH_GLOBAL(QString, engine);
+    if (engine != "mock")
+        QSKIP("Only testing with mock engine");
+
+    QTextToSpeech tts(engine);
+    QVERIFY(tts.engineCapabilities() & QTextToSpeech::Capability::Synthesize);
+
+    const QString text = u"this will produce more than one chunk."_s;
+    QAudioFormat expectedFormat;
+    QByteArray expectedBytes;
+    tts.synthesize(text, [&](const QAudioFormat &format, const QByteArray &bytes) {
+        expectedFormat = format;
+        expectedBytes += bytes;
+    });
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    const int frameSize = expectedFormat.bytesPerFrame();
+
+    const QString key = u"tst_qtexttospeech-%1"_s.arg(QCoreApplication::applicationPid());
+    auto sink = std::make_unique<QTextToSpeechSharedMemorySink>(key);
+    // large enough for a chunk of the mock engine, but smaller than the text
+    QVERIFY2(sink->create(16 * 1024), qPrintable(sink->errorString()));
+    QTextToSpeechSharedMemoryReader reader(key);
+    QVERIFY2(reader.attach(), qPrintable(reader.errorString()));
+
+    tts.synthesize(text, sink.get());
+    // the engine is throttled as long as nothing reads the data
+    QTRY_VERIFY(sink->bytesFree() < sink->capacity() / 2);
+    QTest::qWait(500);
+    QCOMPARE(tts.state(), QTextToSpeech::Synthesizing);
+    QCOMPARE(sink->droppedRecords(), quint64(0));
+
+    QByteArray bytes;
+    QList<qsizetype> wordStarts;
+    bool endOfText = false;
+    QTextToSpeechSharedMemoryReader::Record record;
+    QDeadlineTimer deadline(SpeechDuration);
+    while (!endOfText && !deadline.hasExpired()) {
+        if (!reader.readRecord(record)) {
+            QTest::qWait(10);
+            continue;
+        }
+        switch (record.type) {
+        case QTextToSpeechSharedMemoryReader::RecordType::Format:
+            QCOMPARE(record.format, expectedFormat);
+            break;
+        case QTextToSpeechSharedMemoryReader::RecordType::Audio:
+            QCOMPARE(record.frameOffset, qint64(bytes.size() / frameSize));
+            bytes += record.audio.toByteArray();
+            break;
+        case QTextToSpeechSharedMemoryReader::RecordType::Word:
+            QCOMPARE(record.frameOffset, qint64(bytes.size() / frameSize));
+            wordStarts << record.start;
+            break;
+        case QTextToSpeechSharedMemoryReader::RecordType::EndOfText:
+            endOfText = true;
+            break;
+        }
+    }
+    QVERIFY(endOfText);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QCOMPARE(bytes, expectedBytes);
+    QCOMPARE(wordStarts, (QList<qsizetype>{0, 5, 10, 18, 23, 28, 32}));
+    QCOMPARE(reader.lostRecords(), quint64(0));
+
+    QVERIFY(!reader.isClosed());
+    sink.reset();
+    QVERIFY(reader.isClosed());
+}
+
+void tst_QTextToSpeech::sharedMemoryEndOfText()
+{
+    QFETCH_GLOBAL(QString, engine);
+    if (engine != "mock")
+        QSKIP("Only testing once");
+
+    const QString key = u"tst_qtexttospeech-eot-%1"_s.arg(QCoreApplication::applicationPid());
+    QTextToSpeechSharedMemorySink sink(key);
+    QVERIFY2(sink.create(1024), qPrintable(sink.errorString()));
+    QTextToSpeechSharedMemoryReader reader(key);
+    QVERIFY2(reader.attach(), qPrintable(reader.errorString()));
+
+    QAudioFormat format;
+    format.setSampleRate(16000);
+    format.setChannelConfig(QAudioFormat::ChannelConfigMono);
+    format.setSampleFormat(QAudioFormat::Int16);
+    const QByteArray chunk(128, '\0');
+    // fill the ring buffer until audio is dropped
+    while (sink.writeAudio(format, chunk))
+        ;
+    QVERIFY(sink.droppedRecords() > 0);
+    // ends of texts still fit into the room that audio left, and once that
+    // is used up, they are written when the reader has made room, ahead of
+    // further audio
+    for (int i = 0; i < 4; ++i)
+        QVERIFY(sink.writeEndOfText());
+    QCOMPARE(sink.bytesFree(), qsizetype(0));
+    QVERIFY(!sink.writeAudio(format, chunk));
+
+    QList<QTextToSpeechSharedMemoryReader::RecordType> types;
+    QTextToSpeechSharedMemoryReader::Record record;
+    QDeadlineTimer deadline(SpeechDuration);
+    while (types.count(QTextToSpeechSharedMemoryReader::RecordType::EndOfText) < 4
+           && !deadline.hasExpired()) {
+        if (reader.readRecord(record))
+            types << record.type;
+        else
+            QTest::qWait(10);
+    }
+    QCOMPARE(types.count(QTextToSpeechSharedMemoryReader::RecordType::EndOfText), 4);
+    QCOMPARE(types.last(4), (QList<QTextToSpeechSharedMemoryReader::RecordType>(
+                                4, QTextToSpeechSharedMemoryReader::RecordType::EndOfText)));
+}
+
+void tst_QTextToSpeech::sharedMemoryCorrupt()
+{
+    QFETCH_GLOBAL(QString, engine);
+    if (engine != "mock")
+        QSKIP("Only testing once");
+
+    const QString key = u"tst_qtexttospeech-corrupt-%1"_s.arg(QCoreApplication::applicationPid());
+    QTextToSpeechSharedMemorySink sink(key);
+    QVERIFY2(sink.create(1024), qPrintable(sink.errorString()));
+    QTextToSpeechSharedMemoryReader reader(key);
+    QVERIFY2(reader.attach(), qPrintable(reader.errorString()));
+
+    QAudioFormat format;
+    format.setSampleRate(16000);
+    format.setChannelConfig(QAudioFormat::ChannelConfigMono);
+    format.setSampleFormat(QAudioFormat::Int16);
+    const QByteArray chunk(128, '\0');
+    QVERIFY(sink.writeAudio(format, chunk));
+
+    // another process with the key claims that the first record is larger
+    // than the ring buffer
+    QSharedMemory memory(QSharedMemory::platformSafeKey(key));
+    QVERIFY2(memory.attach(), qPrintable(memory.errorString()));
+    auto *recordHeader = reinterpret_cast<QTextToSpeechSharedMemory::RecordHeader *>(
+            static_cast<char *>(memory.data()) + QTextToSpeechSharedMemory::DataOffset);
+    recordHeader->size = std::numeric_limits<quint32>::max();
+
+    QTextToSpeechSharedMemoryReader::Record record;
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression(u"is corrupt"_s));
+    QVERIFY(!reader.readRecord(record));
+    QVERIFY(!reader.errorString().isEmpty());
+    QCOMPARE(reader.bytesAvailable(), qsizetype(0));
+    QCOMPARE(sink.bytesFree(), sink.capacity());
+
+    // the reader continues with the next record
+    QVERIFY(sink.writeAudio(format, chunk));
+    QVERIFY(reader.readRecord(record));
+    QCOMPARE(record.type, QTextToSpeechSharedMemoryReader::RecordType::Audio);
+    QCOMPARE(record.audio.size(), chunk.size());
+}
+#endif
+
+void tst_QTextToSpeech::synthesizeSynthetic()
+{
+    QFETCH_GLOBAL(QString, engine);
+    if (engine != "mock")
+        QSKIP("Only the mock engine has a synthetic mode");
+
+    constexpr int chunkSize = 1024;
+    QTextToSpeech tts(engine, {{"synthetic", true}, {"chunkSize", chunkSize}});
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+
+    const QString text = u"this will produce more than one chunk."_s;
+    QAudioFormat format;
+    qsizetype bytes = 0;
+    qsizetype largestChunk = 0;
+    QList<qsizetype> wordStarts;
+    connect(&tts, &QTextToSpeech::sayingWord, this,
+            [&wordStarts](const QString &, qsizetype, qsizetype start, qsizetype) {
+        wordStarts << start;
+    });
+    tts.synthesize(text, [&](const QAudioFormat &chunkFormat, const QByteArray &chunk) {
+        format = chunkFormat;
+        bytes += chunk.size();
+        largestChunk = qMax(largestChunk, chunk.size());
+    });
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+
+    QVERIFY(format.isValid());
+    // the mock engine produces 100ms of audio per word at the default rate
+    QCOMPARE(bytes, 7 * format.bytesForDuration(100000));
+    QCOMPARE(largestChunk, format.bytesForFrames(chunkSize));
+    QCOMPARE(wordStarts, (QList<qsizetype>{0, 5, 10, 18, 23, 28, 32}));
+
+    // without a real-time factor, a long queue is spoken without delays
+    constexpr int count = 1000;
+    QSignalSpy aboutToSynthesizeSpy(&tts, &QTextToSpeech::aboutToSynthesize);
+    wordStarts.clear();
+    for (int i = 0; i < count; ++i)
+        tts.enqueue(u"Hello"_s);
+    // speaking in real time would take 100s
+    QTRY_COMPARE_WITH_TIMEOUT(tts.state(), QTextToSpeech::Ready, SpeechDuration);
+    QCOMPARE(aboutToSynthesizeSpy.count(), count);
+    QCOMPARE(wordStarts.size(), count);
+}
+
+void tst_QTextToSpeech::syntheticJitter()
+{
+    QFETCH_GLOBAL(QString, engine);
+    if (engine != "mock")
+        QSKIP("Only the mock engine has a synthetic mode");
+
+    // 20s of audio in 1000 chunks of 20ms, due within 200ms
+    QTextToSpeech tts(engine, {{"synthetic", true}, {"chunkSize", 441},
+                               {"realTimeFactor", 0.01}, {"jitter", 20}});
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+
+    const QString text = QStringList(200, u"word"_s).join(u' ');
+    qsizetype chunks = 0;
+    tts.synthesize(text, [&chunks](const QAudioFormat &, const QByteArray &) { ++chunks; });
+    // each chunk is late by up to 20ms, but the delays don't add up, which
+    // would take 10s on average
+    QTRY_COMPARE_WITH_TIMEOUT(tts.state(), QTextToSpeech::Ready, 5000);
+    QCOMPARE(chunks, qsizetype(1000));
+}
+
+void tst_QTextToSpeech::timeline()
+{
+    QFETCH_GLOBAL(QString, engine);
+    if (engine != "mock")
+        QSKIP("Only testing with mock engine");
+
+    QTextToSpeech tts(engine);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+
+    QTextToSpeechTimeline::start();
+    tts.enqueue(u"one two"_s);
+    tts.enqueue(u"three"_s);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QTextToSpeechTimeline::stop();
+
+    const QJsonDocument document = QJsonDocument::fromJson(QTextToSpeechTimeline::toJson());
+    const QJsonArray events = document.object().value("traceEvents"_L1).toArray();
+    QVERIFY(!events.isEmpty());
+
+    // spans of texts, with ids relative to the first text
+    QStringList spans;
+    QList<qint64> wordStarts;
+    QStringList threadNames;
+    qint64 firstId = -1;
+    double lastTimestamp = 0;
+    for (const QJsonValue &value : events) {
+        const QJsonObject event = value.toObject();
+        const QString phase = event.value("ph"_L1).toString();
+        const QString name = event.value("name"_L1).toString();
+        if (phase == "M"_L1) {
+            threadNames << event.value("args"_L1).toObject().value("name"_L1).toString();
+            continue;
+        }
+        const double timestamp = event.value("ts"_L1).toDouble();
+        QCOMPARE_GE(timestamp, lastTimestamp);
+        lastTimestamp = timestamp;
+        if (phase == "b"_L1 || phase == "e"_L1) {
+            const qint64 id = event.value("id"_L1).toInteger();
+            if (firstId < 0)
+                firstId = id;
+            spans << u"%1 %2 %3"_s.arg(phase, name).arg(id - firstId);
+        } else if (name == "word"_L1) {
+            wordStarts << event.value("args"_L1).toObject().value("value"_L1).toInteger();
+        }
+    }
+    QCOMPARE(spans, (QStringList{"b speech 0", "b queued 1", "e speech 0", "e queued 1",
+                                 "b speech 1", "e speech 1"}));
+    QCOMPARE(wordStarts, (QList<qint64>{0, 4, 0}));
+    // named once, although every state change names the thread
+    QCOMPARE(threadNames, QStringList{u"QTextToSpeech"_s});
+}
+
+void tst_QTextToSpeech::audioFilters()
+{
+    QFETCH_GLOBAL(QString, engine);
+    if (engine != "mock")
+        QSKIP("Only testing with mock engine");
+
+    // replaces the (silent) audio of the mock engine with a constant signal
+    struct ConstantFilter : QTextToSpeechAudioFilter
+    {
+        void reset(const QAudioFormat &format) override
+        {
+            ++resetCount;
+            channelCount = format.channelCount();
+        }
+        qsizetype process(float *samples, qsizetype frameCount) override
+        {
+            maxFrameCount = std::max(maxFrameCount, frameCount);
+            std::fill(samples, samples + frameCount * channelCount, 0.25f);
+            return frameCount;
+        }
+        int resetCount = 0;
+        int channelCount = 0;
+        qsizetype maxFrameCount = 0;
+    };
+
+    QTextToSpeech tts(engine);
+    auto *constant = new ConstantFilter;
+    auto *gain = new QTextToSpeechGainFilter(2.0);
+    tts.addAudioFilter(constant);
+    tts.addAudioFilter(gain);
+    QCOMPARE(tts.audioFilters(), (QList<QTextToSpeechAudioFilter *>{constant, gain}));
+
+    QByteArray bytes;
+    tts.synthesize(u"Filtered speech"_s, [&bytes](const QAudioFormat &format, const QByteArray &data) {
+        QCOMPARE(format.sampleFormat(), QAudioFormat::Int16);
+        bytes += data;
+    });
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QVERIFY(!bytes.isEmpty());
+    QCOMPARE(constant->resetCount, 1);
+    QCOMPARE_LE(constant->maxFrameCount, 256);
+    const auto *samples = reinterpret_cast<const qint16 *>(bytes.constData());
+    for (qsizetype i = 0; i < bytes.size() / qsizetype(sizeof(qint16)); ++i)
+        QCOMPARE(samples[i], qint16(16384));
+
+    // silence is removed completely, so the callback is not called at all
+    tts.clearAudioFilters();
+    QVERIFY(tts.audioFilters().isEmpty());
+    tts.addAudioFilter(new QTextToSpeechSilenceTrimFilter);
+    bytes.clear();
+    tts.synthesize(u"Silent speech"_s, [&bytes](const QAudioFormat &, const QByteArray &data) {
+        bytes += data;
+    });
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QVERIFY(bytes.isEmpty());
+}
+
 QTEST_MAIN(tst_QTextToSpeech)
 #include "tst_qtexttospeech.moc"
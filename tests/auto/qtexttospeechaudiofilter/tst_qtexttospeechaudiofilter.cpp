@@ -0,0 +1,197 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+
+#include <QTest>
+#include <QTextToSpeechAudioFilter>
+#include <QAudioFormat>
+#include <QtTextToSpeech/private/qtexttospeechaudiofilter_p.h>
+#include <QtTextToSpeech/private/qtexttospeechaudiofilterchain_p.h>
+#include <QtTextToSpeech/private/qtexttospeechaudiokernels_p.h>
+
+#include <algorithm>
+#include <cmath>
+
+class tst_QTextToSpeechAudioFilter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+
+    void sampleConversion();
+    void limiter();
+    void dcRemoval();
+    void normalization();
+    void silenceTrim();
+    void speechEnd();
+    void partialFrames();
+
+private:
+    void sine(float amplitude)
+    {
+        for (qsizetype i = 0; i < block.size(); ++i)
+            block[i] = amplitude * std::sin(float(i) * 0.25f);
+    }
+    float peak() const
+    {
+        float result = 0;
+        for (float sample : block)
+            result = std::max(result, std::abs(sample));
+        return result;
+    }
+
+    static constexpr qsizetype blockSize = 256;
+    QAudioFormat format;
+    QList<float> block;
+};
+
+void tst_QTextToSpeechAudioFilter::init()
+{
+    format.setSampleRate(8000);
+    format.setChannelConfig(QAudioFormat::ChannelConfigMono);
+    format.setSampleFormat(QAudioFormat::Float);
+    block.assign(blockSize, 0.0f);
+}
+
+void tst_QTextToSpeechAudioFilter::sampleConversion()
+{
+    // enough samples for the vectorized paths, which round like the scalar one,
+    // also for ties
+    QList<float> in;
+    for (int i = -20; i < 20; ++i)
+        in << (i + (i % 2 ? 0.4f : 0.6f)) / 32768.0f;
+    for (float tie : {0.5f, -0.5f, 1.5f, -1.5f, 2.5f, -2.5f, 32766.5f, -32767.5f})
+        in << tie / 32768.0f;
+    QList<qint16> out(in.size());
+    QTextToSpeechAudioKernels::floatToInt16(in.constData(), out.data(), in.size());
+    for (qsizetype i = 0; i < in.size(); ++i) {
+        qint16 scalar = 0;
+        QTextToSpeechAudioKernels::floatToInt16(in.constData() + i, &scalar, 1);
+        QCOMPARE(out.at(i), scalar);
+        QCOMPARE(scalar, qint16(std::lrint(in.at(i) * 32768.0f)));
+    }
+
+    // out-of-range samples saturate
+    in = QList<float>(8, 2.0f) + QList<float>(8, -2.0f);
+    out.resize(in.size());
+    QTextToSpeechAudioKernels::floatToInt16(in.constData(), out.data(), in.size());
+    QCOMPARE(out, QList<qint16>(8, 32767) + QList<qint16>(8, -32768));
+}
+
+void tst_QTextToSpeechAudioFilter::limiter()
+{
+    // peaks never pass above the threshold
+    QTextToSpeechLimiterFilter limiter(-6.0);
+    limiter.reset(format);
+    for (int i = 0; i < 10; ++i) {
+        sine(1.0f);
+        QCOMPARE(limiter.process(block.data(), blockSize), blockSize);
+        QCOMPARE_LE(peak(), 0.502f);
+    }
+}
+
+void tst_QTextToSpeechAudioFilter::dcRemoval()
+{
+    // a constant offset decays
+    QTextToSpeechDcRemovalFilter dcRemoval;
+    dcRemoval.reset(format);
+    for (int i = 0; i < 40; ++i) {
+        block.fill(0.5f);
+        dcRemoval.process(block.data(), blockSize);
+    }
+    QCOMPARE_LT(peak(), 0.01f);
+
+    // also in every channel of formats with many channels
+    format.setChannelCount(10);
+    dcRemoval.reset(format);
+    for (int i = 0; i < 400; ++i) {
+        block.fill(0.5f);
+        dcRemoval.process(block.data(), blockSize / 10);
+    }
+    block.resize(blockSize / 10 * 10);
+    QCOMPARE_LT(peak(), 0.01f);
+}
+
+void tst_QTextToSpeechAudioFilter::normalization()
+{
+    // quiet audio gets amplified towards the target, but not above the maximum gain
+    QTextToSpeechNormalizationFilter normalization(-20.0, 30.0);
+    normalization.reset(format);
+    for (int i = 0; i < 40; ++i) {
+        sine(0.01f);
+        normalization.process(block.data(), blockSize);
+    }
+    // a sine with a peak of 0.1414 has an RMS level of -20 dBFS
+    QVERIFY(qAbs(peak() - 0.1414f) < 0.02f);
+}
+
+void tst_QTextToSpeechAudioFilter::silenceTrim()
+{
+    // leading and trailing silence is removed, pauses are shortened to 100ms
+    QTextToSpeechAudioFilterChain chain;
+    auto *trim = new QTextToSpeechSilenceTrimFilter(-50.0, 100);
+    chain.addFilter(trim);
+    QByteArray data;
+    const auto filter = [&](float amplitude, int blockCount) {
+        sine(amplitude);
+        data.clear();
+        for (int i = 0; i < blockCount; ++i)
+            data.append(reinterpret_cast<const char *>(block.constData()), blockSize * sizeof(float));
+        chain.process(format, data);
+        return data.size() / qsizetype(sizeof(float));
+    };
+    QCOMPARE(filter(0.0f, 2), qsizetype(0));
+    QCOMPARE(filter(0.5f, 1), blockSize);
+    // the pause is held back until the speech continues
+    QCOMPARE(filter(0.0f, 10), qsizetype(0));
+    QCOMPARE(filter(0.5f, 1), qsizetype(800 + blockSize));
+    const auto *pause = reinterpret_cast<const float *>(data.constData());
+    QVERIFY(std::all_of(pause, pause + 800, [](float sample) { return sample == 0.0f; }));
+    QCOMPARE(filter(0.0f, 10), qsizetype(0));
+    QCOMPARE(trim->trimmedFrames(), qint64(2 * blockSize + 20 * blockSize - 800));
+}
+
+void tst_QTextToSpeechAudioFilter::speechEnd()
+{
+    // silence is found in windows of 10ms, which are 80 frames at 8 kHz
+    QTextToSpeechSilenceTrimmer trimmer;
+    trimmer.reset(format.sampleRate(), format.channelCount());
+    trimmer.setThreshold(-50.0);
+    sine(0.5f);
+    QCOMPARE(trimmer.speechEnd(block.constData(), block.size()), blockSize);
+    std::fill(block.begin() + 100, block.end(), 0.0f);
+    QCOMPARE(trimmer.speechEnd(block.constData(), block.size()), qsizetype(160));
+    std::fill(block.begin(), block.end(), 0.0f);
+    QCOMPARE(trimmer.speechEnd(block.constData(), block.size()), qsizetype(0));
+}
+
+void tst_QTextToSpeechAudioFilter::partialFrames()
+{
+    // data that ends in the middle of a frame is filtered as if it came at once
+    format.setChannelConfig(QAudioFormat::ChannelConfigStereo);
+    format.setSampleFormat(QAudioFormat::Int16);
+    QByteArray data(4 * 1000, '\0');
+    auto *samples = reinterpret_cast<qint16 *>(data.data());
+    for (qsizetype i = 0; i < data.size() / 2; ++i)
+        samples[i] = qint16(8000 * std::sin(float(i) * 0.1f) + 4000);
+
+    QTextToSpeechAudioFilterChain whole;
+    whole.addFilter(new QTextToSpeechDcRemovalFilter);
+    QByteArray expected = data;
+    whole.process(format, expected);
+
+    QTextToSpeechAudioFilterChain pieces;
+    pieces.addFilter(new QTextToSpeechDcRemovalFilter);
+    QByteArray actual;
+    for (qsizetype offset = 0, size = 1; offset < data.size(); offset += size, size += 2) {
+        QByteArray piece = data.sliced(offset, std::min(size, data.size() - offset));
+        pieces.process(format, piece);
+        QCOMPARE(piece.size() % format.bytesPerFrame(), 0);
+        actual += piece;
+    }
+    QCOMPARE(actual, expected);
+}
+
+QTEST_MAIN(tst_QTextToSpeechAudioFilter)
+#include "tst_qtexttospeechaudiofilter.moc"
@@ -0,0 +1,158 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+
+#include <QTest>
+#include <QTextToSpeech>
+#include <QTextToSpeechAudioMixer>
+#include <QSignalSpy>
+#include <QAudioDevice>
+#include <QAudioFormat>
+#include <QtTextToSpeech/private/qtexttospeechaudiomixer_p.h>
+
+using namespace Qt::StringLiterals;
+
+class tst_QTextToSpeechAudioMixer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void source();
+    void sources();
+    void say_data();
+    void say();
+};
+
+void tst_QTextToSpeechAudioMixer::source()
+{
+    constexpr int sampleRate = 8000;
+    QAudioFormat format;
+    format.setSampleRate(sampleRate);
+    format.setChannelConfig(QAudioFormat::ChannelConfigMono);
+    format.setSampleFormat(QAudioFormat::Int16);
+
+    QTextToSpeechAudioMixerSource source;
+    QSignalSpy stateSpy(&source, &QTextToSpeechAudioMixerSource::stateChanged);
+    QIODevice *device = source.start(format);
+    QVERIFY(device);
+    QCOMPARE(source.state(), QAudio::IdleState);
+    source.setAttached(true);
+    source.setGain(0.5);
+    source.setPan(2.0);
+    QCOMPARE(source.pan(), 1.0);
+
+    const QList<qint16> samples(100, 16384);
+    const auto writeSamples = [&]{
+        QCOMPARE(device->write(reinterpret_cast<const char *>(samples.constData()),
+                               samples.size() * sizeof(qint16)),
+                 qint64(samples.size() * sizeof(qint16)));
+    };
+    writeSamples();
+    QCOMPARE(source.state(), QAudio::ActiveState);
+    QCOMPARE(source.bytesFree(), source.bufferSize() - qsizetype(samples.size() * sizeof(qint16)));
+
+    // panned to the right, and added to what is already there
+    QList<float> output(2 * 110, 0.25f);
+    source.mixInto(output.data(), 110, sampleRate);
+    for (qsizetype frame = 0; frame < 110; ++frame) {
+        QCOMPARE(output.at(2 * frame), 0.25f);
+        QCOMPARE(output.at(2 * frame + 1), frame < 100 ? 0.5f : 0.25f);
+    }
+    QCOMPARE(source.state(), QAudio::IdleState);
+    QCOMPARE(stateSpy.size(), 2);
+    QCOMPARE(source.processedUSecs(), 12500);
+    QCOMPARE(source.bytesFree(), source.bufferSize());
+
+    // resampled to twice the rate; the last frame waits for the next one
+    writeSamples();
+    output.assign(2 * 220, 0.0f);
+    source.mixInto(output.data(), 110, 2 * sampleRate);
+    QCOMPARE(source.state(), QAudio::ActiveState);
+    source.mixInto(output.data() + 2 * 110, 110, 2 * sampleRate);
+    QCOMPARE(source.state(), QAudio::IdleState);
+    for (qsizetype frame = 0; frame < 220; ++frame)
+        QCOMPARE(output.at(2 * frame + 1), frame < 199 ? 0.25f : 0.0f);
+    QCOMPARE(source.processedUSecs(), 2 * 12500 - 125);
+
+    // without a mixer, audio is dropped as if it had been played, until the
+    // end of the stream
+    source.setAttached(false);
+    writeSamples();
+    QCOMPARE(source.bytesFree(), source.bufferSize());
+    QCOMPARE(source.state(), QAudio::ActiveState);
+    QCOMPARE(source.processedUSecs(), 3 * 12500 - 125);
+    device->close();
+    QCOMPARE(source.state(), QAudio::IdleState);
+    QCOMPARE(stateSpy.size(), 6);
+}
+
+void tst_QTextToSpeechAudioMixer::sources()
+{
+    QTextToSpeechAudioMixer mixer(QAudioDevice{});
+    QCOMPARE(mixer.format().channelCount(), 2);
+    QTextToSpeech tts(u"mock"_s);
+    QTextToSpeech *other = new QTextToSpeech(u"mock"_s);
+    mixer.addSource(&tts, 0.5, -0.5);
+    mixer.addSource(other);
+    QCOMPARE(mixer.sources(), (QList<QTextToSpeech *>{&tts, other}));
+    QCOMPARE(mixer.gain(&tts), 0.5);
+    QCOMPARE(mixer.pan(&tts), -0.5);
+    mixer.setGain(&tts, -1.0);
+    mixer.setPan(&tts, -2.0);
+    QCOMPARE(mixer.gain(&tts), 0.0);
+    QCOMPARE(mixer.pan(&tts), -1.0);
+
+    // sources move between mixers
+    QTextToSpeechAudioMixer otherMixer(QAudioDevice{});
+    otherMixer.addSource(&tts);
+    QCOMPARE(mixer.sources(), QList<QTextToSpeech *>{other});
+    QCOMPARE(otherMixer.sources(), QList<QTextToSpeech *>{&tts});
+    otherMixer.removeSource(&tts);
+    QVERIFY(otherMixer.sources().isEmpty());
+
+    delete other;
+    QVERIFY(mixer.sources().isEmpty());
+}
+
+void tst_QTextToSpeechAudioMixer::say_data()
+{
+    QTest::addColumn<QString>("engine");
+    // flite plays through the mixer, and mock through its own output
+    QTest::addRow("flite") << u"flite"_s;
+    QTest::addRow("mock") << u"mock"_s;
+}
+
+void tst_QTextToSpeechAudioMixer::say()
+{
+    QFETCH(QString, engine);
+    if (!QTextToSpeech::availableEngines().contains(engine))
+        QSKIP("Engine not available");
+
+    // without a device, the mixed audio is dropped as if it had been played
+    QTextToSpeechAudioMixer mixer(QAudioDevice{});
+    QTextToSpeech tts(engine);
+    mixer.addSource(&tts);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QSignalSpy stateSpy(&tts, &QTextToSpeech::stateChanged);
+
+    const auto states = [&stateSpy]{
+        QList<QTextToSpeech::State> result;
+        for (const auto &arguments : std::as_const(stateSpy))
+            result << arguments.first().value<QTextToSpeech::State>();
+        return result;
+    };
+
+    tts.say(u"one two three"_s);
+    QTRY_COMPARE(stateSpy.size(), 2);
+    QCOMPARE(states(), (QList{QTextToSpeech::Speaking, QTextToSpeech::Ready}));
+    QCOMPARE(tts.errorReason(), QTextToSpeech::ErrorReason::NoError);
+
+    // and again, once the text has ended
+    stateSpy.clear();
+    tts.say(u"four five"_s);
+    QTRY_COMPARE(stateSpy.size(), 2);
+    QCOMPARE(states(), (QList{QTextToSpeech::Speaking, QTextToSpeech::Ready}));
+}
+
+QTEST_MAIN(tst_QTextToSpeechAudioMixer)
+#include "tst_qtexttospeechaudiomixer.moc"
@@ -0,0 +1,166 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+
+#include <QTest>
+#include <QTextToSpeech>
+#include <QSignalSpy>
+#include <QMediaDevices>
+#include <QAudioDevice>
+#include <QAudioFormat>
+
+#include "qtexttospeechdaemon.h"
+
+#include <memory>
+
+using namespace Qt::StringLiterals;
+
+class tst_QTextToSpeechDaemon : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void listenTwice();
+    void notRunning();
+    void synthesize();
+    void emptyText();
+    void cancel();
+    void say();
+
+private:
+    QVariantMap parameters(const QVariant &audioDevice = QVariant::fromValue(QAudioDevice())) const
+    {
+        QVariantMap result{{u"serverName"_s, serverName}, {u"engine"_s, u"mock"_s}};
+        if (audioDevice.isValid())
+            result.insert(u"audioDevice"_s, audioDevice);
+        return result;
+    }
+
+    QString serverName;
+    std::unique_ptr<QTextToSpeechDaemon> daemon;
+};
+
+void tst_QTextToSpeechDaemon::initTestCase()
+{
+    serverName = u"tst_qtexttospeechdaemon-%1"_s.arg(QCoreApplication::applicationPid());
+    daemon = std::make_unique<QTextToSpeechDaemon>(2);
+    QVERIFY2(daemon->listen(serverName), qPrintable(daemon->errorString()));
+}
+
+void tst_QTextToSpeechDaemon::cleanupTestCase()
+{
+    daemon.reset();
+}
+
+void tst_QTextToSpeechDaemon::listenTwice()
+{
+    // the socket of a running daemon is not taken over
+    QTextToSpeechDaemon second(1);
+    QVERIFY(!second.listen(serverName));
+    QVERIFY(!second.errorString().isEmpty());
+
+    QTextToSpeech tts(u"localdaemon"_s, parameters());
+    QTRY_VERIFY(tts.voice() != QVoice());
+    QCOMPARE(tts.state(), QTextToSpeech::Ready);
+}
+
+void tst_QTextToSpeechDaemon::notRunning()
+{
+    QVariantMap params = parameters();
+    params.insert(u"serverName"_s, serverName + u"-not-running"_s);
+    QTextToSpeech tts(u"localdaemon"_s, params);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Error);
+    QCOMPARE(tts.errorReason(), QTextToSpeech::ErrorReason::Initialization);
+}
+
+void tst_QTextToSpeechDaemon::synthesize()
+{
+    QTextToSpeech tts(u"localdaemon"_s, parameters());
+    QSignalSpy stateSpy(&tts, &QTextToSpeech::stateChanged);
+
+    // requested while connecting, and sent once the daemon has described the engine
+    QAudioFormat format;
+    QByteArray pcm;
+    tts.synthesize(u"one two three"_s, this, [&](const QAudioFormat &f, const QByteArray &bytes) {
+        format = f;
+        pcm += bytes;
+    });
+    QCOMPARE(tts.state(), QTextToSpeech::Synthesizing);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QCOMPARE(stateSpy.size(), 2);
+    QVERIFY(format.isValid());
+    QVERIFY(!pcm.isEmpty());
+    QCOMPARE(pcm.size() % format.bytesPerFrame(), 0);
+    QVERIFY(!tts.availableVoices().isEmpty());
+}
+
+void tst_QTextToSpeechDaemon::emptyText()
+{
+    QTextToSpeech tts(u"localdaemon"_s, parameters());
+    QTRY_VERIFY(tts.voice() != QVoice());
+    QSignalSpy errorSpy(&tts, &QTextToSpeech::errorOccurred);
+
+    QByteArray pcm;
+    const auto receive = [&pcm](const QAudioFormat &, const QByteArray &bytes) { pcm += bytes; };
+    tts.synthesize(u" \n "_s, this, receive);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Error);
+    QCOMPARE(errorSpy.size(), 1);
+    QCOMPARE(tts.errorReason(), QTextToSpeech::ErrorReason::Input);
+    QVERIFY(pcm.isEmpty());
+
+    // the daemon is not stuck with the request
+    tts.synthesize(u"one two"_s, this, receive);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QVERIFY(!pcm.isEmpty());
+}
+
+void tst_QTextToSpeechDaemon::cancel()
+{
+    QTextToSpeech tts(u"localdaemon"_s, parameters());
+    QTRY_VERIFY(tts.voice() != QVoice());
+
+    QByteArray pcm;
+    const auto receive = [&pcm](const QAudioFormat &, const QByteArray &bytes) { pcm += bytes; };
+    tts.synthesize(u"one two three four five six seven eight nine ten"_s, this, receive);
+    QTRY_VERIFY(!pcm.isEmpty());
+    tts.stop(QTextToSpeech::BoundaryHint::Immediate);
+    QCOMPARE(tts.state(), QTextToSpeech::Ready);
+
+    // the output of the canceled request is dropped
+    pcm.clear();
+    QTest::qWait(300);
+    QVERIFY(pcm.isEmpty());
+
+    tts.synthesize(u"one"_s, this, receive);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QVERIFY(!pcm.isEmpty());
+}
+
+void tst_QTextToSpeechDaemon::say()
+{
+    if (QMediaDevices::defaultAudioOutput().isNull())
+        QSKIP("No audio output device available");
+
+    QTextToSpeech tts(u"localdaemon"_s, parameters(QVariant()));
+    QTRY_VERIFY(tts.voice() != QVoice());
+    QSignalSpy stateSpy(&tts, &QTextToSpeech::stateChanged);
+
+    tts.say(u"one two three"_s);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Speaking);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    QCOMPARE(stateSpy.size(), 2);
+    QCOMPARE(tts.errorReason(), QTextToSpeech::ErrorReason::NoError);
+
+    // stopped before the audio is played
+    tts.say(u"one two three four five six seven eight nine ten"_s);
+    tts.stop(QTextToSpeech::BoundaryHint::Immediate);
+    QCOMPARE(tts.state(), QTextToSpeech::Ready);
+    QTest::qWait(300);
+    QCOMPARE(tts.state(), QTextToSpeech::Ready);
+}
+
+QTEST_MAIN(tst_QTextToSpeechDaemon)
+#include "tst_qtexttospeechdaemon.moc"
@@ -0,0 +1,106 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+
+#include <QTest>
+#include <QtTextToSpeech/private/qtexttospeechtimestretch_p.h>
+
+#include <cmath>
+
+class tst_QTextToSpeechTimeStretch : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void timeStretch_data();
+    void timeStretch();
+    void discardBefore();
+};
+
+void tst_QTextToSpeechTimeStretch::timeStretch_data()
+{
+    QTest::addColumn<double>("tempo");
+    QTest::addRow("slower") << 0.5;
+    QTest::addRow("unchanged") << 1.0;
+    QTest::addRow("faster") << 2.0;
+}
+
+void tst_QTextToSpeechTimeStretch::timeStretch()
+{
+    QFETCH(double, tempo);
+
+    // one second of a 220 Hz tone
+    constexpr int sampleRate = 22050;
+    QList<short> input(sampleRate);
+    for (qsizetype i = 0; i < input.size(); ++i)
+        input[i] = short(qRound(8000 * std::sin(2 * M_PI * 220 * i / sampleRate)));
+
+    QTextToSpeechTimeStretch stretch;
+    stretch.reset(sampleRate, 1);
+    stretch.setTempo(tempo);
+    QCOMPARE(stretch.outputPosition(sampleRate / 2), qRound64(sampleRate / 2 / tempo));
+
+    constexpr qsizetype blockSize = 1000;
+    QList<short> output;
+    const auto readAll = [&]{
+        qsizetype count = 0;
+        do {
+            const qsizetype size = output.size();
+            output.resize(size + blockSize);
+            count = stretch.read(output.data() + size, blockSize);
+            output.resize(size + count);
+        } while (count);
+    };
+    for (qsizetype i = 0; i < input.size(); i += blockSize) {
+        stretch.write(input.constData() + i, qMin(blockSize, input.size() - i));
+        readAll();
+    }
+    QVERIFY(!stretch.isEmpty());
+    stretch.flush();
+    readAll();
+    QVERIFY(stretch.isEmpty());
+
+    // the duration changes with the tempo, up to the fade-out at the end
+    const qsizetype expected = qRound64(sampleRate / tempo);
+    QCOMPARE_GE(output.size(), expected);
+    QCOMPARE_LT(output.size(), expected + sampleRate / 20);
+    if (tempo == 1.0)
+        QCOMPARE(output.first(input.size()), input);
+
+    // the pitch doesn't
+    const auto crossings = [](const QList<short> &samples, qsizetype count) {
+        int result = 0;
+        for (qsizetype i = 1; i < count; ++i)
+            result += samples.at(i - 1) < 0 && samples.at(i) >= 0;
+        return result;
+    };
+    const qsizetype length = qMin(input.size(), expected) - sampleRate / 20;
+    QVERIFY(qAbs(crossings(output, length) - crossings(input, length)) <= 2);
+}
+
+void tst_QTextToSpeechTimeStretch::discardBefore()
+{
+    constexpr int sampleRate = 8000;
+    QTextToSpeechTimeStretch stretch;
+    stretch.reset(sampleRate, 1);
+
+    // the first second at half the tempo, the next at double the tempo
+    const QList<short> silence(sampleRate);
+    stretch.setTempo(0.5);
+    stretch.write(silence.constData(), silence.size());
+    stretch.flush();
+    stretch.setTempo(2.0);
+    stretch.write(silence.constData(), silence.size());
+    stretch.flush();
+    const qint64 position = stretch.outputPosition(sampleRate * 3 / 2);
+    QCOMPARE_GT(position, 2 * sampleRate);
+
+    // positions from the discarded one on still map the same
+    stretch.discardBefore(sampleRate * 5 / 4);
+    QCOMPARE(stretch.outputPosition(sampleRate * 3 / 2), position);
+    stretch.discardBefore(sampleRate * 3 / 2);
+    QCOMPARE(stretch.outputPosition(sampleRate * 3 / 2), position);
+}
+
+QTEST_APPLESS_MAIN(tst_QTextToSpeechTimeStretch)
+#include "tst_qtexttospeechtimestretch.moc"
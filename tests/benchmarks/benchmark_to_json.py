@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+# Copyright (C) 2023 The Qt Company Ltd.
+# SPDX-License-Identifier: LicenseRef-Qt-Commercial OR GPL-3.0-only WITH Qt-GPL-exception-1.0
+
+"""Converts the XML output of Qt Test benchmarks into JSON.
+
+Run the benchmarks with XML output, for instance
+
+    tst_bench_qtexttospeech -o bench_qtexttospeech.xml,xml
+    tst_bench_qvoice -o bench_qvoice.xml,xml
+
+and convert the results with
+
+    benchmark_to_json.py --label $(git rev-parse --short HEAD) \\
+        bench_qtexttospeech.xml bench_qvoice.xml > results.json
+
+The results are sorted, and each value is the measurement for a single
+iteration, so that the files of two commits can be compared line by line.
+"""
+
+import argparse
+import json
+import sys
+import xml.etree.ElementTree as ElementTree
+
+
+def read_results(file_name):
+    results = []
+    root = ElementTree.parse(file_name).getroot()
+    test_case = root.get('name')
+    for function in root.iter('TestFunction'):
+        for result in function.iter('BenchmarkResult'):
+            iterations = int(result.get('iterations', '1')) or 1
+            results.append({
+                'testcase': test_case,
+                'function': function.get('name'),
+                'tag': result.get('tag', ''),
+                'metric': result.get('metric'),
+                'value': float(result.get('value')) / iterations,
+                'iterations': iterations,
+            })
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--label', default='',
+                        help='a label for the results, like the commit')
+    parser.add_argument('files', nargs='+', metavar='file',
+                        help='the XML output of a benchmark')
+    args = parser.parse_args()
+
+    results = []
+    for file_name in args.files:
+        results += read_results(file_name)
+    results.sort(key=lambda r: (r['testcase'], r['function'], r['tag'], r['metric']))
+
+    json.dump({'label': args.label, 'results': results}, sys.stdout, indent=2, sort_keys=True)
+    sys.stdout.write('\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,225 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include <QTest>
+#include <QTextToSpeech>
+#include <QAudioFormat>
+#include <QElapsedTimer>
+
+#include <algorithm>
+
+using namespace Qt::StringLiterals;
+
+enum : int { SpeechDuration = 20000 };
+
+class tst_QTextToSpeechBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void enqueue_data();
+    void enqueue();
+    void dispatch_data();
+    void dispatch();
+
+    void findVoices_data();
+    void findVoices();
+
+    void synthesize_data();
+    void synthesize();
+    void timeToFirstChunk_data();
+    void timeToFirstChunk();
+
+private:
+    // engines whose performance doesn't depend on a system service
+    static void addEngineRows()
+    {
+        QTest::addColumn<QString>("engine");
+        const QStringList engines = QTextToSpeech::availableEngines();
+        for (const auto &engine : {u"mock"_s, u"flite"_s}) {
+            if (engines.contains(engine))
+                QTest::addRow("%s", qPrintable(engine)) << engine;
+        }
+    }
+
+    // the mock engine produces audio as fast as possible in synthetic mode,
+    // so that the measurements aren't dominated by its speaking time
+    static QVariantMap parameters(const QString &engine)
+    {
+        if (engine == "mock"_L1)
+            return {{u"synthetic"_s, true}};
+        return {};
+    }
+
+    static bool waitForState(QTextToSpeech &tts, QTextToSpeech::State state)
+    {
+        return QTest::qWaitFor([&tts, state]{ return tts.state() == state; }, SpeechDuration);
+    }
+};
+
+void tst_QTextToSpeechBenchmark::enqueue_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::addRow("10") << 10;
+    QTest::addRow("100") << 100;
+    QTest::addRow("1000") << 1000;
+}
+
+/*
+    Measures the cost of queueing texts while the engine speaks the first one.
+*/
+void tst_QTextToSpeechBenchmark::enqueue()
+{
+    QFETCH(int, count);
+    QTextToSpeech tts(u"mock"_s, parameters(u"mock"_s));
+    QVERIFY(waitForState(tts, QTextToSpeech::Ready));
+
+    const QString text = u"Hello"_s;
+    QBENCHMARK {
+        for (int i = 0; i < count; ++i)
+            tts.enqueue(text);
+        tts.stop(QTextToSpeech::BoundaryHint::Immediate);
+    }
+}
+
+void tst_QTextToSpeechBenchmark::dispatch_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::addRow("1") << 1;
+    QTest::addRow("10") << 10;
+    QTest::addRow("100") << 100;
+    QTest::addRow("1000") << 1000;
+}
+
+/*
+    Measures how long it takes to speak a queue of one-word texts, including
+    the state changes through which QTextToSpeech passes each text on.
+*/
+void tst_QTextToSpeechBenchmark::dispatch()
+{
+    QFETCH(int, count);
+    QTextToSpeech tts(u"mock"_s, parameters(u"mock"_s));
+    QVERIFY(waitForState(tts, QTextToSpeech::Ready));
+    tts.setRate(1.0);
+
+    QBENCHMARK {
+        for (int i = 0; i < count; ++i)
+            tts.enqueue(u"Hello"_s);
+        QVERIFY(waitForState(tts, QTextToSpeech::Ready));
+    }
+}
+
+void tst_QTextToSpeechBenchmark::findVoices_data()
+{
+    QTest::addColumn<QString>("engine");
+    QTest::addColumn<QString>("criterion");
+    const QStringList engines = QTextToSpeech::availableEngines();
+    for (const auto &engine : {u"mock"_s, u"flite"_s}) {
+        if (!engines.contains(engine))
+            continue;
+        for (const auto &criterion : {u"all"_s, u"locale"_s, u"language"_s, u"gender"_s}) {
+            QTest::addRow("%s:%s", qPrintable(engine), qPrintable(criterion))
+                << engine << criterion;
+        }
+    }
+}
+
+/*
+    Searching by locale only looks at the voices of that locale; all other
+    criteria go through the voices of all locales.
+*/
+void tst_QTextToSpeechBenchmark::findVoices()
+{
+    QFETCH(QString, engine);
+    QFETCH(QString, criterion);
+    QTextToSpeech tts(engine);
+    QVERIFY(waitForState(tts, QTextToSpeech::Ready));
+
+    const QLocale locale = tts.locale();
+    const QVoice::Gender gender = tts.voice().gender();
+    qsizetype found = 0;
+    if (criterion == "all"_L1) {
+        QBENCHMARK { found = tts.findVoices().size(); }
+    } else if (criterion == "locale"_L1) {
+        QBENCHMARK { found = tts.findVoices(locale).size(); }
+    } else if (criterion == "language"_L1) {
+        QBENCHMARK { found = tts.findVoices(locale.language()).size(); }
+    } else if (criterion == "gender"_L1) {
+        QBENCHMARK { found = tts.findVoices(gender).size(); }
+    }
+    QVERIFY(found > 0);
+}
+
+void tst_QTextToSpeechBenchmark::synthesize_data()
+{
+    addEngineRows();
+}
+
+/*
+    Measures how long it takes to synthesize a paragraph into PCM data.
+*/
+void tst_QTextToSpeechBenchmark::synthesize()
+{
+    QFETCH(QString, engine);
+    QTextToSpeech tts(engine, parameters(engine));
+    QVERIFY(waitForState(tts, QTextToSpeech::Ready));
+    if (!(tts.engineCapabilities() & QTextToSpeech::Capability::Synthesize))
+        QSKIP("This engine doesn't support synthesize()");
+    tts.setRate(1.0);
+
+    const QString text = u"The quick brown fox jumps over the lazy dog. "
+                          "Pack my box with five dozen liquor jugs. "
+                          "How vexingly quick daft zebras jump!"_s;
+    qsizetype bytes = 0;
+    QBENCHMARK {
+        bytes = 0;
+        tts.synthesize(text, [&bytes](const QAudioFormat &, const QByteArray &data) {
+            bytes += data.size();
+        });
+        QVERIFY(waitForState(tts, QTextToSpeech::Ready));
+    }
+    QVERIFY(bytes > 0);
+}
+
+void tst_QTextToSpeechBenchmark::timeToFirstChunk_data()
+{
+    addEngineRows();
+}
+
+/*
+    Measures the latency from the call to synthesize() until the first audio
+    data arrives. The median of several runs is reported, as the latency
+    of a single run depends on when the engine's thread gets scheduled.
+*/
+void tst_QTextToSpeechBenchmark::timeToFirstChunk()
+{
+    QFETCH(QString, engine);
+    QTextToSpeech tts(engine, parameters(engine));
+    QVERIFY(waitForState(tts, QTextToSpeech::Ready));
+    if (!(tts.engineCapabilities() & QTextToSpeech::Capability::Synthesize))
+        QSKIP("This engine doesn't support synthesize()");
+
+    const QString text = u"The quick brown fox jumps over the lazy dog."_s;
+    constexpr int Runs = 9;
+    QList<qint64> latencies;
+    QElapsedTimer timer;
+    qint64 latency = -1;
+    for (int run = 0; run < Runs; ++run) {
+        latency = -1;
+        timer.start();
+        tts.synthesize(text, [&timer, &latency](const QAudioFormat &, const QByteArray &) {
+            if (latency < 0)
+                latency = timer.nsecsElapsed();
+        });
+        QVERIFY(QTest::qWaitFor([&latency]{ return latency >= 0; }, SpeechDuration));
+        tts.stop(QTextToSpeech::BoundaryHint::Immediate);
+        QVERIFY(waitForState(tts, QTextToSpeech::Ready));
+        latencies << latency;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    QTest::setBenchmarkResult(latencies.at(Runs / 2) / 1000000.0, QTest::WalltimeMilliseconds);
+}
+
+QTEST_MAIN(tst_QTextToSpeechBenchmark)
+#include "tst_bench_qtexttospeech.moc"
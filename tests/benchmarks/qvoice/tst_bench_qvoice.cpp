@@ -0,0 +1,83 @@
+// Copyright (C) 2023 The Qt Company Ltd.
+// SPDX-License-Identifier: LicenseRef-Qt-Commercial OR LGPL-3.0-only OR GPL-2.0-only
+
+#include <QTest>
+#include <QTextToSpeech>
+#include <QDataStream>
+
+using namespace Qt::StringLiterals;
+
+class tst_QVoiceBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void copy();
+    void compare();
+    void serialize();
+    void deserialize();
+
+private:
+    QList<QVoice> m_voices;
+};
+
+void tst_QVoiceBenchmark::initTestCase()
+{
+    QTextToSpeech tts(u"mock"_s);
+    QTRY_COMPARE(tts.state(), QTextToSpeech::Ready);
+    m_voices = tts.findVoices();
+    QVERIFY(!m_voices.isEmpty());
+}
+
+void tst_QVoiceBenchmark::copy()
+{
+    QList<QVoice> copies(m_voices.size());
+    QBENCHMARK {
+        for (qsizetype i = 0; i < m_voices.size(); ++i)
+            copies[i] = m_voices.at(i);
+    }
+    QCOMPARE(copies, m_voices);
+}
+
+void tst_QVoiceBenchmark::compare()
+{
+    qsizetype matches = 0;
+    QBENCHMARK {
+        matches = 0;
+        for (const QVoice &voice : std::as_const(m_voices))
+            matches += m_voices.count(voice);
+    }
+    QCOMPARE(matches, m_voices.size());
+}
+
+void tst_QVoiceBenchmark::serialize()
+{
+    QByteArray storage;
+    QBENCHMARK {
+        storage.clear();
+        QDataStream stream(&storage, QIODevice::WriteOnly);
+        stream << m_voices;
+    }
+    QVERIFY(!storage.isEmpty());
+}
+
+void tst_QVoiceBenchmark::deserialize()
+{
+    QByteArray storage;
+    {
+        QDataStream stream(&storage, QIODevice::WriteOnly);
+        stream << m_voices;
+    }
+
+    QList<QVoice> voices;
+    QBENCHMARK {
+        QDataStream stream(storage);
+        stream >> voices;
+    }
+    QCOMPARE(voices, m_voices);
+}
+
+QTEST_MAIN(tst_QVoiceBenchmark)
+#include "tst_bench_qvoice.moc"